@@ -33,11 +33,13 @@
 #endif
 
 #include <pthread.h>
+#include <poll.h>
 
 #include "db_driver.h"
 #include "sb_list.h"
 #include "sb_histogram.h"
 #include "sb_ck_pr.h"
+#include "sb_rand.h"
 
 /* Query length limit for bulk insert queries */
 #define BULK_PACKET_SIZE (512*1024)
@@ -55,6 +57,140 @@ static uint8_t stats_enabled;
 static bool db_global_initialized;
 static pthread_once_t db_global_once = PTHREAD_ONCE_INIT;
 
+/*
+  Compiled query of an emulated prepared statement: nparams + 1 literal
+  segments stored back to back in text, with a parameter slot between each two
+  consecutive segments
+*/
+struct db_query_tpl
+{
+  char         *text;         /* Literal segments */
+  size_t       *seg_len;      /* Lengths of literal segments */
+  size_t       text_len;      /* Total length of literal segments */
+  unsigned int nparams;       /* Number of parameter slots */
+  char         *buf;          /* Query buffer reused by all executions */
+  size_t       buflen;        /* Allocated length of buf */
+};
+
+/*
+  Connection pool of a driver. Idle connections are kept in a stack, so the
+  most recently used ones are checked out first.
+*/
+typedef struct db_pool
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t  cond;         /* signaled when a connection is returned */
+  db_conn_t       **idle;       /* Idle connections */
+  uint64_t        *idle_since;  /* Time when connections became idle, ns */
+  unsigned int    nidle;        /* Number of idle connections */
+  unsigned int    nconns;       /* Number of connections owned by the pool */
+} db_pool_t;
+
+/* Latency statistics of a connection phase, see --db-connect-stats */
+typedef struct
+{
+  sb_histogram_t histogram;
+  uint64_t       count;
+  uint64_t       sum_ns;
+  uint64_t       max_ns;
+} conn_phase_stat_t;
+
+static conn_phase_stat_t conn_phases[DB_CONN_PHASE_MAX];
+
+static const char *conn_phase_names[DB_CONN_PHASE_MAX] =
+{
+  "connect",
+  "TLS handshake",
+  "authentication",
+  "total",
+  "first query"
+};
+
+/* Upper bound of connection phase latencies to track, ms */
+#define CONN_PHASE_MAX_VALUE 1E5
+
+/* Failed connection attempts and reconnects, see --db-connect-stats */
+static uint64_t conn_failures;
+static uint64_t conn_reconnects;
+
+/* Bounds of the delay between attempts to re-establish a connection, us */
+#define RECONNECT_BACKOFF_MIN 1000
+#define RECONNECT_BACKOFF_MAX 1000000
+
+/*
+  Counters of a statement updated only by the owning thread. Each thread's
+  counters occupy a separate cache line.
+*/
+typedef struct
+{
+  uint64_t count;
+  uint64_t errors;
+  uint64_t sum_ns;
+  uint64_t max_ns;
+  char     pad[SB_CACHELINE_PAD(sizeof(uint64_t) * 4)];
+} stmt_thread_stat_t;
+
+/* Totals of a statement over all threads */
+typedef struct
+{
+  uint64_t count;
+  uint64_t errors;
+  uint64_t sum_ns;
+} stmt_totals_t;
+
+/*
+  Statistics of a statement, identified by its fingerprint. Entries are never
+  removed, so pointers to them can be kept in prepared statements.
+*/
+struct db_stmt_stats
+{
+  char               *text;         /* Fingerprint */
+  size_t             len;           /* Length of the fingerprint */
+  uint32_t           hash;          /* Hash of the fingerprint */
+  stmt_thread_stat_t *threads;      /* Per-thread counters */
+  sb_histogram_t     histogram;     /* Latency histogram */
+  stmt_totals_t      last;          /* Totals at the last intermediate report */
+  stmt_totals_t      cp;            /* Totals at the last cumulative report */
+};
+
+/*
+  Registry of statement statistics: an open addressing hash table with
+  lock-free lookups. Insertions are serialized by stmt_stats_mutex.
+*/
+#define STMT_STATS_SLOTS 512
+#define STMT_STATS_MAX   256
+
+static db_stmt_stats_t *stmt_stats[STMT_STATS_SLOTS];
+static unsigned int    nstmt_stats;
+static pthread_mutex_t stmt_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+  Maximum length of a statement fingerprint. Longer ones are truncated, so
+  statements differing only past that length share their statistics.
+*/
+#define STMT_FINGERPRINT_MAX 1024
+
+/*
+  Per-statement histograms are sharded by thread, so use a lower precision to
+  keep their memory footprint small
+*/
+#define STMT_STATS_SIG_DIGITS 2
+
+/* Upper bound of statement latencies to track, ms */
+#define STMT_STATS_MAX_VALUE 1E5
+
+/* Statement text length in reports */
+#define STMT_REPORT_TEXT_LEN 60
+
+/* How often threads waiting for pooled connections check for errors, ms */
+#define POOL_WAIT_CHECK_MS 100
+
+/*
+  Maximum length of a printed non-string parameter value. The longest one is
+  -DBL_MAX printed with "%f".
+*/
+#define MAX_VALUE_LEN 320
+
 /* Timers used in debug mode */
 static sb_timer_t *exec_timers;
 static sb_timer_t *fetch_timers;
@@ -67,7 +203,12 @@ static void db_free_row(db_row_t *);
 #endif
 static int db_bulk_do_insert(db_conn_t *, int);
 static void db_reset_stats(void);
+static db_query_tpl_t *db_tpl_compile(const char *);
+static void db_tpl_free(db_query_tpl_t *);
+static void db_pool_free(struct db_pool *);
 static int db_free_results_int(db_conn_t *con);
+static db_stmt_stats_t *db_stmt_stats_get(db_conn_t *, const char *, size_t);
+static void db_stmt_stats_free(void);
 
 /* DB layer arguments */
 
@@ -84,6 +225,18 @@ static sb_arg_t db_args[] =
   SB_OPT("db-ps-mode", "prepared statements usage mode {auto, disable}", "auto",
          STRING),
   SB_OPT("db-debug", "print database-specific debug information", "off", BOOL),
+  SB_OPT("db-pool-size", "number of connections in the pool shared by all "
+         "threads. 0 disables pooling, i.e. each checkout creates a new "
+         "connection", "0", INT),
+  SB_OPT("db-pool-check-idle", "check pooled connections idle for at least "
+         "this many milliseconds with a trivial query before checkout "
+         "(0 to disable)", "0", INT),
+  SB_OPT("db-connect-stats", "report latencies of connection phases and "
+         "first queries on new connections", "off", BOOL),
+  SB_OPT("db-stmt-stats", "collect per-statement latency statistics "
+         "{off, prepared, all}. 'prepared' tracks prepared statements, 'all' "
+         "also tracks non-prepared queries by their fingerprints, i.e. with "
+         "literals replaced by '?'", "off", STRING),
 
   SB_OPT_END
 };
@@ -180,6 +333,17 @@ static void db_init(void)
   if (db_parse_arguments())
     return;
 
+  if (db_globals.connect_stats)
+  {
+    for (unsigned i = 0; i < DB_CONN_PHASE_MAX; i++)
+    {
+      if (sb_histogram_init(&conn_phases[i].histogram,
+                            SB_HISTOGRAM_DEFAULT_SIG_DIGITS, NS2MS(1),
+                            CONN_PHASE_MAX_VALUE))
+        return;
+    }
+  }
+
   /* Initialize timers if in debug mode */
   if (db_globals.debug)
   {
@@ -317,6 +481,8 @@ db_conn_t *db_connection_create(db_driver_t *drv)
     return NULL;
   }
 
+  con->first_query = db_globals.connect_stats;
+
   return con;
 }
 
@@ -342,6 +508,7 @@ int db_connection_close(db_conn_t *con)
   rc = drv->ops.disconnect(con);
 
   con->state = DB_CONN_INVALID;
+  con->pending = 0;
 
   return rc;
 }
@@ -371,6 +538,9 @@ int db_connection_reconnect(db_conn_t *con)
 
   rc = drv->ops.reconnect(con);
 
+  /* Results of asynchronous statements are lost with the old connection */
+  con->pending = 0;
+
   if (rc == DB_ERROR_FATAL)
   {
     con->state = DB_CONN_INVALID;
@@ -379,8 +549,12 @@ int db_connection_reconnect(db_conn_t *con)
   else
   {
     con->state = DB_CONN_READY;
+    con->first_query = db_globals.connect_stats;
     sb_counter_inc(con->thread_id, SB_CNT_RECONNECT);
 
+    if (db_globals.connect_stats)
+      ck_pr_inc_64(&conn_reconnects);
+
     /* Clear DB_ERROR_IGNORABLE */
     rc = DB_ERROR_NONE;
   }
@@ -395,166 +569,1261 @@ void db_connection_free(db_conn_t *con)
   if (con->state != DB_CONN_INVALID)
     db_connection_close(con);
 
+  free(con->rs.row.values);
   free(con);
 }
 
 
-/* Prepare statement */
+void db_conn_phase_done(db_conn_phase_t phase, uint64_t ns)
+{
+  conn_phase_stat_t * const stat = conn_phases + phase;
+  uint64_t                  max;
+
+  if (!db_globals.connect_stats)
+    return;
 
+  sb_histogram_update_int(&stat->histogram, ns);
+  ck_pr_inc_64(&stat->count);
+  ck_pr_add_64(&stat->sum_ns, ns);
 
-db_stmt_t *db_prepare(db_conn_t *con, const char *query, size_t len)
+  max = ck_pr_load_64(&stat->max_ns);
+  while (ns > max && !ck_pr_cas_64_value(&stat->max_ns, max, ns, &max))
+    ;
+}
+
+
+void db_conn_attempt_failed(void)
 {
-  db_stmt_t *stmt;
+  if (db_globals.connect_stats)
+    ck_pr_inc_64(&conn_failures);
+}
 
-  if (con->state == DB_CONN_INVALID)
+
+void db_reconnect_backoff(unsigned int attempt)
+{
+  uint32_t delay = RECONNECT_BACKOFF_MAX;
+
+  if (attempt < 10)
+    delay = SB_MIN(RECONNECT_BACKOFF_MIN << attempt, RECONNECT_BACKOFF_MAX);
+
+  /* Randomize the second half of the delay to spread retries of threads */
+  usleep(delay / 2 + sb_rand_uniform(0, delay / 2));
+}
+
+
+/* Print connection phase statistics collected with --db-connect-stats */
+
+static void db_report_conn_phases(void)
+{
+  log_text(LOG_NOTICE, "    connection latency (ms):");
+
+  for (unsigned i = 0; i < DB_CONN_PHASE_MAX; i++)
   {
-    log_text(LOG_ALERT, "attempt to use an already closed connection");
-    return NULL;
+    conn_phase_stat_t * const stat = conn_phases + i;
+    const uint64_t            count = ck_pr_load_64(&stat->count);
+    double                    pcts[MAX_PERCENTILES];
+    char                      pct_buf[SB_REPORT_LATENCY_BUF_SIZE];
+
+    if (count == 0)
+      continue;
+
+    sb_histogram_get_pcts_cumulative(&stat->histogram, sb_globals.percentiles,
+                                     sb_globals.n_percentiles, pcts);
+    for (unsigned j = 0; j < sb_globals.n_percentiles; j++)
+      pcts[j] = MS2SEC(pcts[j]);
+    sb_report_format_pcts(pcts, pct_buf, sizeof(pct_buf));
+
+    log_text(LOG_NOTICE, "        %-16s count: %" PRIu64 ", avg: %.2f, "
+             "max: %.2f%s", conn_phase_names[i], count,
+             NS2MS(ck_pr_load_64(&stat->sum_ns)) / count,
+             NS2MS(ck_pr_load_64(&stat->max_ns)), pct_buf);
   }
 
-  stmt = (db_stmt_t *)calloc(1, sizeof(db_stmt_t));
-  if (stmt == NULL)
-    return NULL;
+  log_text(LOG_NOTICE, "        failed attempts: %" PRIu64,
+           ck_pr_load_64(&conn_failures));
+  log_text(LOG_NOTICE, "        reconnects: %" PRIu64,
+           ck_pr_load_64(&conn_reconnects));
 
-  stmt->connection = con;
+  if (!sb_globals.histogram)
+    return;
 
-  if (con->driver->ops.prepare(stmt, query, len))
+  for (unsigned i = 0; i < DB_CONN_PHASE_MAX; i++)
   {
-    con->error = DB_ERROR_FATAL;
-    free(stmt);
-    return NULL;
+    if (ck_pr_load_64(&conn_phases[i].count) == 0)
+      continue;
+
+    log_text(LOG_NOTICE, "");
+    log_text(LOG_NOTICE, "Connection %s latency histogram "
+             "(values are in milliseconds)", conn_phase_names[i]);
+    sb_histogram_print(&conn_phases[i].histogram);
   }
+}
 
-  return stmt;
+
+/*
+  Print driver-specific statistics of all initialized drivers, e.g.
+  per-endpoint statistics of the MySQL driver
+*/
+
+static void db_report_drivers(sb_stat_t *stat, bool cumulative)
+{
+  sb_list_item_t *pos;
+
+  SB_LIST_FOR_EACH(pos, &drivers)
+  {
+    db_driver_t *drv = SB_LIST_ENTRY(pos, db_driver_t, listitem);
+
+    if (!drv->initialized)
+      continue;
+
+    if (cumulative && drv->ops.report_cumulative != NULL)
+      drv->ops.report_cumulative(stat);
+    else if (!cumulative && drv->ops.report_intermediate != NULL)
+      drv->ops.report_intermediate(stat);
+  }
 }
 
 
-/* Bind parameters for prepared statement */
+void db_report_driver_stats(double time_total, double time_interval,
+                            bool cumulative)
+{
+  sb_stat_t stat;
 
+  memset(&stat, 0, sizeof(stat));
+  stat.time_total = time_total;
+  stat.time_interval = time_interval;
 
-int db_bind_param(db_stmt_t *stmt, db_bind_t *params, size_t len)
+  db_report_drivers(&stat, cumulative);
+}
+
+
+void db_report_conn_stats(bool cumulative)
 {
-  db_conn_t *con = stmt->connection;
+  /* Connection statistics are only reported by cumulative reports */
+  if (db_globals.connect_stats && cumulative)
+    db_report_conn_phases();
+}
 
-  if (con->state == DB_CONN_INVALID)
+
+/* Per-statement totals for a reporting period */
+typedef struct
+{
+  db_stmt_stats_t *stats;
+  uint64_t        count;
+  uint64_t        errors;
+  uint64_t        sum_ns;
+  uint64_t        max_ns;
+} stmt_report_t;
+
+
+static int stmt_report_cmp(const void *a, const void *b)
+{
+  const stmt_report_t * const ra = a;
+  const stmt_report_t * const rb = b;
+
+  return (ra->sum_ns < rb->sum_ns) - (ra->sum_ns > rb->sum_ns);
+}
+
+
+/*
+  Aggregate per-thread counters of all statements executed since the last
+  intermediate or cumulative report into 'res', sorted by total execution time
+  in descending order. Maximum latencies are only tracked and reset by
+  cumulative reports. Returns the number of statements stored in 'res'.
+*/
+
+static unsigned int db_stmt_stats_collect(stmt_report_t *res,
+                                          bool cumulative)
+{
+  unsigned int n = 0;
+
+  for (unsigned int i = 0; i < STMT_STATS_SLOTS; i++)
   {
-    log_text(LOG_ALERT, "attempt to use an already closed connection");
-    return 1;
+    db_stmt_stats_t * const stats = ck_pr_load_ptr(&stmt_stats[i]);
+    uint64_t                count = 0, errors = 0, sum_ns = 0, max_ns = 0;
+
+    if (stats == NULL)
+      continue;
+
+    /* Include the last slot shared by non-worker threads */
+    for (unsigned int j = 0; j <= sb_globals.threads; j++)
+    {
+      stmt_thread_stat_t * const t = stats->threads + j;
+
+      count += ck_pr_load_64(&t->count);
+      errors += ck_pr_load_64(&t->errors);
+      sum_ns += ck_pr_load_64(&t->sum_ns);
+
+      if (cumulative)
+        max_ns = SB_MAX(max_ns, ck_pr_fas_64(&t->max_ns, 0));
+    }
+
+    stmt_totals_t * const prev = cumulative ? &stats->cp : &stats->last;
+
+    res[n].stats = stats;
+    res[n].count = count - prev->count;
+    res[n].errors = errors - prev->errors;
+    res[n].sum_ns = sum_ns - prev->sum_ns;
+    res[n].max_ns = max_ns;
+
+    prev->count = count;
+    prev->errors = errors;
+    prev->sum_ns = sum_ns;
+
+    if (res[n].count > 0)
+      n++;
   }
 
-  return con->driver->ops.bind_param(stmt, params, len);
+  qsort(res, n, sizeof(stmt_report_t), stmt_report_cmp);
+
+  return n;
 }
 
 
-/* Bind results for prepared statement */
+/*
+  Calculate all percentiles in sb_globals.percentiles[] from a given statement
+  histogram for an intermediate or a cumulative report into 'pcts', in seconds
+  like latency percentiles in sb_stat_t
+*/
 
+static void stmt_get_pcts(sb_histogram_t *h, bool cumulative, double *pcts)
+{
+  if (cumulative)
+    sb_histogram_get_pcts_checkpoint(h, sb_globals.percentiles,
+                                     sb_globals.n_percentiles, pcts);
+  else
+    sb_histogram_get_pcts_intermediate(h, sb_globals.percentiles,
+                                       sb_globals.n_percentiles, pcts);
 
-int db_bind_result(db_stmt_t *stmt, db_bind_t *results, size_t len)
+  for (unsigned int i = 0; i < sb_globals.n_percentiles; i++)
+    pcts[i] = MS2SEC(pcts[i]);
+}
+
+
+/* Print per-statement statistics for the last reporting interval */
+
+static void db_stmt_stats_report_intermediate(sb_stat_t *stat)
+{
+  stmt_report_t      res[STMT_STATS_MAX];
+  const unsigned int n = db_stmt_stats_collect(res, false);
+  const double       seconds = stat->time_interval;
+
+  for (unsigned int i = 0; i < n; i++)
+  {
+    char      lat_buf[SB_REPORT_LATENCY_BUF_SIZE] = "";
+    sb_stat_t lat;
+
+    if (sb_globals.n_percentiles > 0)
+    {
+      stmt_get_pcts(&res[i].stats->histogram, false, lat.latency_pcts);
+      lat.latency_pct = lat.latency_pcts[0];
+      lat_buf[0] = ' ';
+      sb_report_format_latency(&lat, lat_buf + 1, sizeof(lat_buf) - 1);
+    }
+
+    log_timestamp(LOG_NOTICE, stat->time_total,
+                  "stmt: %-40.40s qps: %4.2f avg (ms): %4.2f%s err/s: %4.2f",
+                  res[i].stats->text, res[i].count / seconds,
+                  NS2MS(res[i].sum_ns) / res[i].count, lat_buf,
+                  res[i].errors / seconds);
+  }
+}
+
+
+/* Print per-statement statistics since the last cumulative report */
+
+static void db_stmt_stats_report_cumulative(sb_stat_t *stat)
+{
+  stmt_report_t      res[STMT_STATS_MAX];
+  const unsigned int n = db_stmt_stats_collect(res, true);
+  const double       seconds = stat->time_interval;
+  uint64_t           total_ns = 0;
+
+  if (n == 0)
+    return;
+
+  for (unsigned int i = 0; i < n; i++)
+    total_ns += res[i].sum_ns;
+
+  log_text(LOG_NOTICE, "    per-statement statistics (ms):");
+
+  for (unsigned int i = 0; i < n; i++)
+  {
+    db_stmt_stats_t * const stats = res[i].stats;
+    double                  pcts[MAX_PERCENTILES];
+    char                    pct_buf[SB_REPORT_LATENCY_BUF_SIZE];
+
+    stmt_get_pcts(&stats->histogram, true, pcts);
+    sb_report_format_pcts(pcts, pct_buf, sizeof(pct_buf));
+
+    if (stats->len > STMT_REPORT_TEXT_LEN)
+      log_text(LOG_NOTICE, "        %.*s...", STMT_REPORT_TEXT_LEN - 3,
+               stats->text);
+    else
+      log_text(LOG_NOTICE, "        %s", stats->text);
+
+    log_text(LOG_NOTICE, "            count: %" PRIu64 " (%.2f per sec.), "
+             "errors: %" PRIu64 ", avg: %.2f, max: %.2f%s, time: %.1f%%",
+             res[i].count, res[i].count / seconds, res[i].errors,
+             NS2MS(res[i].sum_ns) / res[i].count, NS2MS(res[i].max_ns),
+             pct_buf, total_ns > 0 ? 100.0 * res[i].sum_ns / total_ns : 0);
+  }
+}
+
+
+void db_report_stmt_stats(double time_total, double time_interval,
+                          bool cumulative)
+{
+  sb_stat_t stat;
+
+  if (db_globals.stmt_stats == DB_STMT_STATS_OFF)
+    return;
+
+  memset(&stat, 0, sizeof(stat));
+  stat.time_total = time_total;
+  stat.time_interval = time_interval;
+
+  if (cumulative)
+    db_stmt_stats_report_cumulative(&stat);
+  else
+    db_stmt_stats_report_intermediate(&stat);
+}
+
+
+/* Print connection pool statistics for the last reporting interval */
+
+static void db_pool_report_intermediate(sb_stat_t *stat)
+{
+  const double seconds = stat->time_interval;
+
+  log_timestamp(LOG_NOTICE, stat->time_total,
+                "pool checkouts/s: %4.2f, waits/s: %4.2f, "
+                "avg wait (ms): %4.2f",
+                stat->pool_checkouts / seconds,
+                stat->pool_waits / seconds,
+                stat->pool_checkouts > 0 ?
+                SEC2MS(stat->pool_wait_time) / stat->pool_checkouts : 0);
+}
+
+
+/* Print connection pool statistics since the last cumulative report */
+
+static void db_pool_report_cumulative(sb_stat_t *stat)
+{
+  const double seconds = stat->time_interval;
+
+  log_text(LOG_NOTICE, "    connection pool:");
+  log_text(LOG_NOTICE, "        checkouts:                       %-6" PRIu64
+           " (%.2f per sec.)", stat->pool_checkouts,
+           stat->pool_checkouts / seconds);
+  log_text(LOG_NOTICE, "        waits:                           %-6" PRIu64
+           " (%.2f per sec.)", stat->pool_waits, stat->pool_waits / seconds);
+  log_text(LOG_NOTICE, "        avg wait time (ms):              %.2f",
+           stat->pool_checkouts > 0 ?
+           SEC2MS(stat->pool_wait_time) / stat->pool_checkouts : 0);
+}
+
+
+void db_report_pool_stats(double time_total, double time_interval,
+                          uint64_t checkouts, uint64_t waits,
+                          double wait_time, bool cumulative)
+{
+  sb_stat_t stat;
+
+  if (db_globals.pool_size == 0)
+    return;
+
+  memset(&stat, 0, sizeof(stat));
+  stat.time_total = time_total;
+  stat.time_interval = time_interval;
+  stat.pool_checkouts = checkouts;
+  stat.pool_waits = waits;
+  stat.pool_wait_time = wait_time;
+
+  if (cumulative)
+    db_pool_report_cumulative(&stat);
+  else
+    db_pool_report_intermediate(&stat);
+}
+
+
+/* Return the pool of a given driver, creating it on the first call */
+
+static db_pool_t *db_pool_get(db_driver_t *drv)
+{
+  db_pool_t *pool;
+
+  pthread_mutex_lock(&drv->mutex);
+
+  if ((pool = drv->pool) == NULL)
+  {
+    pool = calloc(1, sizeof(db_pool_t));
+    if (pool == NULL)
+      goto end;
+
+    pool->idle = calloc(db_globals.pool_size, sizeof(db_conn_t *));
+    pool->idle_since = calloc(db_globals.pool_size, sizeof(uint64_t));
+    if (pool->idle == NULL || pool->idle_since == NULL)
+    {
+      free(pool->idle);
+      free(pool->idle_since);
+      free(pool);
+      pool = NULL;
+      goto end;
+    }
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    drv->pool = pool;
+  }
+
+end:
+  pthread_mutex_unlock(&drv->mutex);
+
+  return pool;
+}
+
+
+/* Close idle connections and release the pool */
+
+static void db_pool_free(db_pool_t *pool)
+{
+  for (unsigned int i = 0; i < pool->nidle; i++)
+    db_connection_free(pool->idle[i]);
+
+  if (pool->nconns > pool->nidle)
+    log_text(LOG_DEBUG, "%u pooled connections have not been checked in",
+             pool->nconns - pool->nidle);
+
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_cond_destroy(&pool->cond);
+
+  free(pool->idle);
+  free(pool->idle_since);
+  free(pool);
+}
+
+
+/* Give up a connection slot, e.g. when a connection is closed */
+
+static void db_pool_release(db_pool_t *pool)
+{
+  pthread_mutex_lock(&pool->mutex);
+  pool->nconns--;
+  pthread_cond_signal(&pool->cond);
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+
+/* Check if a connection is still usable with a trivial query */
+
+static bool db_pool_check(db_conn_t *con)
+{
+  db_result_t *rs = &con->rs;
+  db_error_t  rc;
+
+  rc = con->driver->ops.query(con, "SELECT 1", 8, rs);
+
+  if (rc == DB_ERROR_NONE && rs->counter == SB_CNT_READ)
+  {
+    con->state = DB_CONN_RESULT_SET;
+    db_free_results_int(con);
+  }
+
+  return rc == DB_ERROR_NONE;
+}
+
+
+db_conn_t *db_pool_checkout(db_driver_t *drv)
+{
+  db_pool_t      *pool;
+  db_conn_t      *con = NULL;
+  uint64_t       idle_since = 0;
+  bool           waited = false;
+  struct timespec ts;
+
+  sb_counter_inc(sb_tls_thread_id, SB_CNT_POOL_CHECKOUT);
+
+  if (db_globals.pool_size == 0)
+    return db_connection_create(drv);
+
+  if ((pool = db_pool_get(drv)) == NULL)
+    return NULL;
+
+  const uint64_t start = sb_clock_ns();
+
+  pthread_mutex_lock(&pool->mutex);
+
+  while (pool->nidle == 0 && pool->nconns >= db_globals.pool_size)
+  {
+    if (sb_globals.error)
+    {
+      pthread_mutex_unlock(&pool->mutex);
+      return NULL;
+    }
+
+    waited = true;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += MS2NS(POOL_WAIT_CHECK_MS);
+    ts.tv_sec += ts.tv_nsec / NS_PER_SEC;
+    ts.tv_nsec %= NS_PER_SEC;
+    pthread_cond_timedwait(&pool->cond, &pool->mutex, &ts);
+  }
+
+  if (pool->nidle > 0)
+  {
+    pool->nidle--;
+    con = pool->idle[pool->nidle];
+    idle_since = pool->idle_since[pool->nidle];
+  }
+  else
+    pool->nconns++;
+
+  pthread_mutex_unlock(&pool->mutex);
+
+  if (waited)
+  {
+    sb_counter_inc(sb_tls_thread_id, SB_CNT_POOL_WAIT);
+    sb_counter_add(sb_tls_thread_id, SB_CNT_POOL_WAIT_NS,
+                   sb_clock_ns() - start);
+  }
+
+  if (con != NULL)
+  {
+    /* Statistic counters of the connection now belong to this thread */
+    con->thread_id = sb_tls_thread_id;
+
+    if (db_globals.pool_check_idle > 0 &&
+        sb_clock_ns() - idle_since >= MS2NS(db_globals.pool_check_idle) &&
+        !db_pool_check(con))
+    {
+      log_text(LOG_DEBUG, "closing a broken pooled connection");
+      db_connection_free(con);
+      con = NULL;
+    }
+  }
+
+  /* Open a new connection in place of a missing or broken one */
+  if (con == NULL && (con = db_connection_create(drv)) == NULL)
+    db_pool_release(pool);
+
+  return con;
+}
+
+
+void db_pool_checkin(db_conn_t *con)
+{
+  db_pool_t *pool = con->driver->pool;
+
+  if (pool == NULL)
+  {
+    db_connection_free(con);
+    return;
+  }
+
+  if (con->state == DB_CONN_RESULT_SET)
+    db_free_results_int(con);
+
+  /* Do not reuse connections which may be in an unknown state */
+  if (con->state == DB_CONN_INVALID || con->error == DB_ERROR_FATAL ||
+      con->pending > 0)
+  {
+    db_connection_free(con);
+    db_pool_release(pool);
+    return;
+  }
+
+  pthread_mutex_lock(&pool->mutex);
+
+  /* Not a pooled connection */
+  if (SB_UNLIKELY(pool->nidle >= db_globals.pool_size))
+  {
+    pthread_mutex_unlock(&pool->mutex);
+    db_connection_free(con);
+    return;
+  }
+
+  pool->idle[pool->nidle] = con;
+  pool->idle_since[pool->nidle] = sb_clock_ns();
+  pool->nidle++;
+  pthread_cond_signal(&pool->cond);
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+
+#define IS_IDENT_CHAR(c) (isalnum((unsigned char) (c)) || (c) == '_' ||  \
+                          (c) == '$')
+
+/*
+  Check if the identifier at the end of a partially built fingerprint is a
+  table name, i.e. follows FROM, INTO, UPDATE, JOIN or TABLE
+*/
+
+static bool fp_is_table_name(const char *buf, size_t n)
+{
+  static const char * const keywords[] =
+    { "FROM", "INTO", "UPDATE", "JOIN", "TABLE" };
+  size_t end;
+
+  /* Skip the identifier, possibly qualified or quoted */
+  while (n > 0 && (IS_IDENT_CHAR(buf[n - 1]) || buf[n - 1] == '.' ||
+                   buf[n - 1] == '`' || buf[n - 1] == '"'))
+    n--;
+
+  if (n == 0 || buf[n - 1] != ' ')
+    return false;
+
+  end = --n;
+  while (n > 0 && isalpha((unsigned char) buf[n - 1]))
+    n--;
+
+  for (size_t k = 0; k < sizeof(keywords) / sizeof(keywords[0]); k++)
+  {
+    if (end - n == strlen(keywords[k]) &&
+        !strncasecmp(buf + n, keywords[k], end - n))
+      return true;
+  }
+
+  return false;
+}
+
+
+/*
+  Normalize a query into its fingerprint: replace string and numeric literals
+  with '?' and collapse whitespace. Numeric suffixes of table names are also
+  replaced, so that queries to sbtest1 ... sbtestN share their statistics.
+  Double-quoted strings are literals if 'dq_strings' is true (MySQL), and
+  quoted identifiers otherwise. Returns the length of the fingerprint.
+*/
+
+static size_t db_fingerprint(const char *query, size_t len, bool dq_strings,
+                             char *buf, size_t buflen)
+{
+  size_t i = 0;
+  size_t n = 0;
+
+  while (i < len && n < buflen - 1)
+  {
+    const char c = query[i];
+
+    if (isspace((unsigned char) c))
+    {
+      while (i < len && isspace((unsigned char) query[i]))
+        i++;
+      if (n > 0 && i < len)
+        buf[n++] = ' ';
+    }
+    else if (c == '\'' || (c == '"' && dq_strings))
+    {
+      /* Skip to the closing quote, honoring escapes and doubled quotes */
+      for (i++; i < len; i++)
+      {
+        if (query[i] == '\\')
+          i++;
+        else if (query[i] == c)
+        {
+          if (i + 1 < len && query[i + 1] == c)
+            i++;
+          else
+            break;
+        }
+      }
+      i++;
+      buf[n++] = '?';
+    }
+    else if (isdigit((unsigned char) c) && (n == 0 || !IS_IDENT_CHAR(buf[n - 1])))
+    {
+      while (i < len && (isdigit((unsigned char) query[i]) || query[i] == '.'))
+        i++;
+      buf[n++] = '?';
+    }
+    else if (isdigit((unsigned char) c) && fp_is_table_name(buf, n))
+    {
+      size_t j = i;
+
+      while (j < len && isdigit((unsigned char) query[j]))
+        j++;
+
+      if (j < len && IS_IDENT_CHAR(query[j]))
+        buf[n++] = query[i++];
+      else
+      {
+        /* Numeric suffix of a table name */
+        i = j;
+        buf[n++] = '?';
+      }
+    }
+    else
+      buf[n++] = query[i++];
+  }
+
+  buf[n] = '\0';
+
+  return n;
+}
+
+#undef IS_IDENT_CHAR
+
+
+/* Find statistics of a statement, allocating them on the first call */
+
+static db_stmt_stats_t *db_stmt_stats_get(db_conn_t *con, const char *query,
+                                          size_t len)
+{
+  char            fp[STMT_FINGERPRINT_MAX];
+  db_stmt_stats_t *stats;
+  uint32_t        hash = 2166136261U;
+  size_t          fplen;
+  unsigned int    i;
+
+  fplen = db_fingerprint(query, len, !strcmp(con->driver->sname, "mysql"), fp,
+                         sizeof(fp));
+
+  /* FNV-1a */
+  for (size_t j = 0; j < fplen; j++)
+    hash = (hash ^ (unsigned char) fp[j]) * 16777619U;
+
+  for (bool locked = false; ; locked = true)
+  {
+    for (i = hash % STMT_STATS_SLOTS;
+         (stats = ck_pr_load_ptr(&stmt_stats[i])) != NULL;
+         i = (i + 1) % STMT_STATS_SLOTS)
+    {
+      if (stats->hash == hash && stats->len == fplen &&
+          !memcmp(stats->text, fp, fplen))
+      {
+        if (locked)
+          pthread_mutex_unlock(&stmt_stats_mutex);
+
+        return stats;
+      }
+    }
+
+    if (locked)
+      break;
+
+    pthread_mutex_lock(&stmt_stats_mutex);
+  }
+
+  /* Not found, insert a new entry into slot i */
+  if (nstmt_stats == STMT_STATS_MAX)
+  {
+    pthread_mutex_unlock(&stmt_stats_mutex);
+    return NULL;
+  }
+
+  stats = calloc(1, sizeof(db_stmt_stats_t));
+  if (stats == NULL)
+    goto error;
+
+  stats->text = strdup(fp);
+  stats->len = fplen;
+  stats->hash = hash;
+  stats->threads = sb_alloc_per_thread_array(sizeof(stmt_thread_stat_t));
+
+  if (stats->text == NULL || stats->threads == NULL ||
+      sb_histogram_init(&stats->histogram, STMT_STATS_SIG_DIGITS, NS2MS(1),
+                        STMT_STATS_MAX_VALUE))
+  {
+    free(stats->text);
+    free(stats->threads);
+    free(stats);
+    goto error;
+  }
+
+  if (++nstmt_stats == STMT_STATS_MAX)
+    log_text(LOG_WARNING, "Statistics are tracked for at most %d statements, "
+             "ignoring new ones", STMT_STATS_MAX);
+
+  ck_pr_fence_store();
+  ck_pr_store_ptr(&stmt_stats[i], stats);
+
+  pthread_mutex_unlock(&stmt_stats_mutex);
+
+  return stats;
+
+ error:
+  pthread_mutex_unlock(&stmt_stats_mutex);
+
+  return NULL;
+}
+
+
+static void db_stmt_stats_free(void)
+{
+  for (unsigned int i = 0; i < STMT_STATS_SLOTS; i++)
+  {
+    db_stmt_stats_t * const stats = stmt_stats[i];
+
+    if (stats == NULL)
+      continue;
+
+    sb_histogram_done(&stats->histogram);
+    free(stats->threads);
+    free(stats->text);
+    free(stats);
+
+    stmt_stats[i] = NULL;
+  }
+
+  nstmt_stats = 0;
+}
+
+
+/*
+  Account a timed statement in per-statement and first query statistics.
+  Worker threads are the only writers to their own counters, so atomic
+  increments are only needed for the last slot shared by all other threads.
+*/
+
+static void db_query_done(db_conn_t *con, db_stmt_stats_t *stats,
+                          uint64_t ns)
+{
+  if (SB_UNLIKELY(con->first_query))
+  {
+    db_conn_phase_done(DB_CONN_PHASE_FIRST_QUERY, ns);
+    con->first_query = 0;
+  }
+
+  if (stats == NULL)
+    return;
+
+  const unsigned int tid = (unsigned int) con->thread_id;
+
+  if (SB_LIKELY(sb_tls_worker && tid < sb_globals.threads))
+  {
+    stmt_thread_stat_t * const t = stats->threads + tid;
+
+    ck_pr_store_64(&t->count, ck_pr_load_64(&t->count) + 1);
+    ck_pr_store_64(&t->sum_ns, ck_pr_load_64(&t->sum_ns) + ns);
+
+    if (con->error != DB_ERROR_NONE)
+      ck_pr_store_64(&t->errors, ck_pr_load_64(&t->errors) + 1);
+
+    if (ns > ck_pr_load_64(&t->max_ns))
+      ck_pr_store_64(&t->max_ns, ns);
+  }
+  else
+  {
+    /*
+      The last slot is shared by the main thread running Lua init()/done()
+      hooks and by background threads
+    */
+    stmt_thread_stat_t * const t = stats->threads + sb_globals.threads;
+    uint64_t                   max_ns = ck_pr_load_64(&t->max_ns);
+
+    ck_pr_inc_64(&t->count);
+    ck_pr_add_64(&t->sum_ns, ns);
+
+    if (con->error != DB_ERROR_NONE)
+      ck_pr_inc_64(&t->errors);
+
+    while (ns > max_ns && !ck_pr_cas_64_value(&t->max_ns, max_ns, ns, &max_ns))
+      ;
+  }
+
+  sb_histogram_update_int(&stats->histogram, ns);
+}
+
+
+/* Prepare statement */
+
+
+db_stmt_t *db_prepare(db_conn_t *con, const char *query, size_t len)
+{
+  db_stmt_t *stmt;
+
+  if (con->state == DB_CONN_INVALID)
+  {
+    log_text(LOG_ALERT, "attempt to use an already closed connection");
+    return NULL;
+  }
+
+  stmt = (db_stmt_t *)calloc(1, sizeof(db_stmt_t));
+  if (stmt == NULL)
+    return NULL;
+
+  stmt->connection = con;
+
+  if (con->driver->ops.prepare(stmt, query, len))
+  {
+    con->error = DB_ERROR_FATAL;
+    free(stmt);
+    return NULL;
+  }
+
+  /* Parse the query of emulated statements only once */
+  if (stmt->emulated && (stmt->tpl = db_tpl_compile(query)) == NULL)
+  {
+    con->driver->ops.close(stmt);
+    con->error = DB_ERROR_FATAL;
+    free(stmt->query);
+    free(stmt);
+    return NULL;
+  }
+
+  if (db_globals.stmt_stats != DB_STMT_STATS_OFF)
+    stmt->stats = db_stmt_stats_get(con, query, len);
+
+  return stmt;
+}
+
+
+/* Bind parameters for prepared statement */
+
+
+int db_bind_param(db_stmt_t *stmt, db_bind_t *params, size_t len)
+{
+  db_conn_t *con = stmt->connection;
+
+  if (con->state == DB_CONN_INVALID)
+  {
+    log_text(LOG_ALERT, "attempt to use an already closed connection");
+    return 1;
+  }
+
+  return con->driver->ops.bind_param(stmt, params, len);
+}
+
+
+/* Bind results for prepared statement */
+
+
+int db_bind_result(db_stmt_t *stmt, db_bind_t *results, size_t len)
+{
+  db_conn_t *con = stmt->connection;
+
+  if (con->state == DB_CONN_INVALID)
+  {
+    log_text(LOG_ALERT, "attempt to use an already closed connection");
+    return 1;
+  }
+
+  return con->driver->ops.bind_result(stmt, results, len);
+}
+
+
+/* Execute prepared statement */
+
+
+db_result_t *db_execute(db_stmt_t *stmt)
+{
+  db_conn_t       *con = stmt->connection;
+  db_result_t     *rs = &con->rs;
+  int             rc;
+
+  if (con->state == DB_CONN_INVALID)
+  {
+    log_text(LOG_ALERT, "attempt to use an already closed connection");
+    return NULL;
+  }
+  else if (con->state == DB_CONN_RESULT_SET &&
+           (rc = db_free_results_int(con)) != 0)
+  {
+    return NULL;
+  }
+
+  if (SB_UNLIKELY(con->pending > 0))
+  {
+    log_text(LOG_ALERT, "attempt to execute a statement on a connection with "
+             "pending asynchronous results");
+    con->error = DB_ERROR_FATAL;
+    return NULL;
+  }
+
+  rs->statement = stmt;
+
+  if (SB_UNLIKELY(con->first_query || stmt->stats != NULL))
+  {
+    const uint64_t start = sb_clock_ns();
+
+    con->error = con->driver->ops.execute(stmt, rs);
+    db_query_done(con, stmt->stats, sb_clock_ns() - start);
+  }
+  else
+    con->error = con->driver->ops.execute(stmt, rs);
+
+  if (SB_LIKELY(rs->counter != DB_CNT_DEFERRED))
+    sb_counter_inc(con->thread_id, rs->counter);
+
+  if (SB_LIKELY(con->error == DB_ERROR_NONE))
+  {
+    if (rs->counter == SB_CNT_READ)
+    {
+      con->state = DB_CONN_RESULT_SET;
+      return rs;
+    }
+    con->state = DB_CONN_READY;
+
+    return NULL;
+  }
+
+  return NULL;
+}
+
+
+/* Fetch row from result set of a query */
+
+
+db_row_t *db_fetch_row(db_result_t *rs)
+{
+  db_conn_t *con = SB_CONTAINER_OF(rs, db_conn_t, rs);
+  int       rc;
+
+  if (con->state == DB_CONN_INVALID)
+  {
+    log_text(LOG_ALERT, "attempt to use an already closed connection");
+    return NULL;
+  }
+  else if (con->state != DB_CONN_RESULT_SET)
+  {
+    log_text(LOG_ALERT, "attempt to fetch row from an invalid result set");
+    return NULL;
+  }
+
+  if (con->driver->ops.fetch_row == NULL)
+  {
+    log_text(LOG_ALERT, "fetching rows is not supported by the driver");
+  }
+
+  if (rs->nfields == 0)
+  {
+    log_text(LOG_ALERT, "attempt to fetch row from an empty result set");
+    return NULL;
+  }
+
+  /* Row values are kept across result sets and only grow when needed */
+  if (SB_UNLIKELY(rs->nfields > con->nvalues))
+  {
+    db_value_t *values = realloc(rs->row.values,
+                                 rs->nfields * sizeof(db_value_t));
+    if (values == NULL)
+      return NULL;
+
+    rs->row.values = values;
+    con->nvalues = rs->nfields;
+  }
+
+  if ((rc = con->driver->ops.fetch_row(rs, &rs->row)) != DB_ERROR_NONE)
+  {
+    /* DB_ERROR_IGNORABLE means there are no more rows */
+    if (rc == DB_ERROR_FATAL)
+      con->error = DB_ERROR_FATAL;
+
+    return NULL;
+  }
+
+  return &rs->row;
+}
+
+
+/* Execute non-prepared statement with a given driver operation */
+
+
+static db_result_t *db_query_int(db_conn_t *con, const char *query, size_t len,
+                                 drv_op_query *op)
+{
+  db_result_t *rs = &con->rs;
+  int         rc;
+
+  if (con->state == DB_CONN_INVALID)
+  {
+    log_text(LOG_ALERT, "attempt to use an already closed connection");
+    con->error = DB_ERROR_FATAL;
+    return NULL;
+  }
+  else if (con->state == DB_CONN_RESULT_SET &&
+           (rc = db_free_results_int(con)) != 0)
+  {
+    con->error = DB_ERROR_FATAL;
+    return NULL;
+  }
+
+  if (SB_UNLIKELY(con->pending > 0))
+  {
+    log_text(LOG_ALERT, "attempt to execute a query on a connection with "
+             "pending asynchronous results");
+    con->error = DB_ERROR_FATAL;
+    return NULL;
+  }
+
+  if (SB_UNLIKELY(con->first_query ||
+                  db_globals.stmt_stats == DB_STMT_STATS_ALL))
+  {
+    db_stmt_stats_t * const stats =
+      db_globals.stmt_stats == DB_STMT_STATS_ALL ?
+      db_stmt_stats_get(con, query, len) : NULL;
+    const uint64_t start = sb_clock_ns();
+
+    con->error = op(con, query, len, rs);
+    db_query_done(con, stats, sb_clock_ns() - start);
+  }
+  else
+    con->error = op(con, query, len, rs);
+
+  if (SB_LIKELY(rs->counter != DB_CNT_DEFERRED))
+    sb_counter_inc(con->thread_id, rs->counter);
+
+  if (SB_LIKELY(con->error == DB_ERROR_NONE))
+  {
+    if (rs->counter == SB_CNT_READ)
+    {
+      con->state = DB_CONN_RESULT_SET;
+      return rs;
+    }
+    con->state = DB_CONN_READY;
+
+    return NULL;
+  }
+
+  return NULL;
+}
+
+
+/* Execute non-prepared statement */
+
+
+db_result_t *db_query(db_conn_t *con, const char *query, size_t len)
+{
+  return db_query_int(con, query, len, con->driver->ops.query);
+}
+
+
+/* Execute non-prepared statement and stream its result set */
+
+
+db_result_t *db_query_stream(db_conn_t *con, const char *query, size_t len)
+{
+  drv_op_query * const op = con->driver->ops.query_stream != NULL ?
+    con->driver->ops.query_stream : con->driver->ops.query;
+
+  return db_query_int(con, query, len, op);
+}
+
+
+/* Free result set */
+
+
+static int db_free_results_int(db_conn_t *con)
+{
+  int       rc;
+
+  rc = con->driver->ops.free_results(&con->rs);
+
+  con->rs.nrows = 0;
+  con->rs.nfields = 0;
+
+  con->rs.statement = NULL;
+
+  con->state = DB_CONN_READY;
+
+  return rc;
+}
+
+int db_free_results(db_result_t *rs)
 {
-  db_conn_t *con = stmt->connection;
+  db_conn_t * const con = SB_CONTAINER_OF(rs, db_conn_t, rs);
 
   if (con->state == DB_CONN_INVALID)
   {
     log_text(LOG_ALERT, "attempt to use an already closed connection");
     return 1;
   }
+  else if (con->state != DB_CONN_RESULT_SET)
+  {
+    log_text(LOG_ALERT, "attempt to free an invalid result set");
+    return 1;
+  }
 
-  return con->driver->ops.bind_result(stmt, results, len);
+  return db_free_results_int(con);
 }
 
+/*
+  Check connection state before sending an asynchronous statement. Returns 0 if
+  a statement can be sent, 1 otherwise.
+*/
 
-/* Execute prepared statement */
-
-
-db_result_t *db_execute(db_stmt_t *stmt)
+static int db_send_check(db_conn_t *con, void *op)
 {
-  db_conn_t       *con = stmt->connection;
-  db_result_t     *rs = &con->rs;
-  int             rc;
-
   if (con->state == DB_CONN_INVALID)
   {
     log_text(LOG_ALERT, "attempt to use an already closed connection");
-    return NULL;
+    con->error = DB_ERROR_FATAL;
+    return 1;
   }
-  else if (con->state == DB_CONN_RESULT_SET &&
-           (rc = db_free_results_int(con)) != 0)
+  else if (con->state == DB_CONN_RESULT_SET && db_free_results_int(con) != 0)
   {
-    return NULL;
+    con->error = DB_ERROR_FATAL;
+    return 1;
   }
 
-  rs->statement = stmt;
-
-  con->error = con->driver->ops.execute(stmt, rs);
-
-  sb_counter_inc(con->thread_id, rs->counter);
-
-  if (SB_LIKELY(con->error == DB_ERROR_NONE))
+  if (op == NULL)
   {
-    if (rs->counter == SB_CNT_READ)
-    {
-      con->state = DB_CONN_RESULT_SET;
-      return rs;
-    }
-    con->state = DB_CONN_READY;
-
-    return NULL;
+    log_text(LOG_FATAL, "asynchronous execution is not supported by the '%s' "
+             "driver", con->driver->sname);
+    con->error = DB_ERROR_FATAL;
+    return 1;
   }
 
-  return NULL;
+  con->error = DB_ERROR_NONE;
+
+  return 0;
 }
 
 
-/* Fetch row from result set of a query */
+/* Send non-prepared statement without waiting for results */
 
 
-db_row_t *db_fetch_row(db_result_t *rs)
+int db_send_query(db_conn_t *con, const char *query, size_t len)
 {
-  db_conn_t *con = SB_CONTAINER_OF(rs, db_conn_t, rs);
+  if (db_send_check(con, con->driver->ops.send_query))
+    return 1;
 
-  if (con->state == DB_CONN_INVALID)
-  {
-    log_text(LOG_ALERT, "attempt to use an already closed connection");
-    return NULL;
-  }
-  else if (con->state != DB_CONN_RESULT_SET)
+  if (con->driver->ops.send_query(con, query, len))
   {
-    log_text(LOG_ALERT, "attempt to fetch row from an invalid result set");
-    return NULL;
+    con->error = DB_ERROR_FATAL;
+    return 1;
   }
 
-  if (con->driver->ops.fetch_row == NULL)
-  {
-    log_text(LOG_ALERT, "fetching rows is not supported by the driver");
-  }
+  con->pending++;
 
-  if (rs->nrows == 0 || rs->nfields == 0)
-  {
-    log_text(LOG_ALERT, "attempt to fetch row from an empty result set");
-    return NULL;
-  }
+  return 0;
+}
 
-  if (rs->row.values == NULL)
-  {
-    rs->row.values = malloc(rs->nfields * sizeof(db_value_t));
-  }
 
-  if (con->driver->ops.fetch_row(rs, &rs->row))
+/* Send prepared statement without waiting for results */
+
+
+int db_send_execute(db_stmt_t *stmt)
+{
+  db_conn_t *con = stmt->connection;
+
+  if (db_send_check(con, con->driver->ops.send_execute))
+    return 1;
+
+  if (con->driver->ops.send_execute(stmt))
   {
-    return NULL;
+    con->error = DB_ERROR_FATAL;
+    return 1;
   }
 
-  return &rs->row;
+  con->pending++;
+
+  return 0;
 }
 
 
-/* Execute non-prepared statement */
+/*
+  Read results of the oldest asynchronous statement sent over a given
+  connection, waiting for them if necessary
+*/
 
 
-db_result_t *db_query(db_conn_t *con, const char *query, size_t len)
+db_result_t *db_reap(db_conn_t *con)
 {
   db_result_t *rs = &con->rs;
-  int         rc;
 
   if (con->state == DB_CONN_INVALID)
   {
@@ -562,14 +1831,23 @@ db_result_t *db_query(db_conn_t *con, const char *query, size_t len)
     con->error = DB_ERROR_FATAL;
     return NULL;
   }
-  else if (con->state == DB_CONN_RESULT_SET &&
-           (rc = db_free_results_int(con)) != 0)
+  else if (con->state == DB_CONN_RESULT_SET && db_free_results_int(con) != 0)
+  {
+    con->error = DB_ERROR_FATAL;
+    return NULL;
+  }
+
+  if (con->pending == 0)
   {
+    log_text(LOG_ALERT, "attempt to reap results with no pending asynchronous "
+             "statements");
     con->error = DB_ERROR_FATAL;
     return NULL;
   }
 
-  con->error = con->driver->ops.query(con, query, len, rs);
+  con->pending--;
+
+  con->error = con->driver->ops.reap(con, rs);
 
   sb_counter_inc(con->thread_id, rs->counter);
 
@@ -589,47 +1867,92 @@ db_result_t *db_query(db_conn_t *con, const char *query, size_t len)
 }
 
 
-/* Free result set */
+/* Get the number of asynchronous statements with results not reaped yet */
 
 
-static int db_free_results_int(db_conn_t *con)
+unsigned int db_pending(db_conn_t *con)
 {
-  int       rc;
+  return con->pending;
+}
 
-  rc = con->driver->ops.free_results(&con->rs);
 
-  if (con->rs.row.values != NULL)
+/*
+  Wait up to 'timeout' milliseconds (or indefinitely, if 'timeout' is negative)
+  until results can be reaped without blocking on at least one of 'ncons'
+  connections. Sets ready[i] to 1 for such connections, and to 0 for all other
+  ones. Returns the number of ready connections, which may be 0 on timeout, or
+  -1 on errors.
+*/
+
+
+int db_poll(db_conn_t **cons, size_t ncons, int timeout, char *ready)
+{
+  static TLS struct pollfd *fds;
+  static TLS size_t        fds_len;
+  int                      nready = 0;
+  int                      nwait = 0;
+  int                      fd;
+  short                    events;
+
+  if (ncons > fds_len)
   {
-    free(con->rs.row.values);
-    con->rs.row.values = NULL;
+    struct pollfd *tmp = realloc(fds, ncons * sizeof(struct pollfd));
+
+    if (tmp == NULL)
+      return -1;
+
+    fds = tmp;
+    fds_len = ncons;
   }
 
-  con->rs.nrows = 0;
-  con->rs.nfields = 0;
+  for (size_t i = 0; i < ncons; i++)
+  {
+    db_conn_t * const con = cons[i];
 
-  con->rs.statement = NULL;
+    ready[i] = 0;
+    fds[i].fd = -1;
+    fds[i].events = 0;
 
-  con->state = DB_CONN_READY;
+    if (con->state == DB_CONN_INVALID || con->pending == 0)
+      continue;
 
-  return rc;
-}
+    /* Errors are reported by db_reap() */
+    if (con->driver->ops.poll(con, &fd, &events) != 0)
+    {
+      ready[i] = 1;
+      nready++;
+    }
+    else
+    {
+      fds[i].fd = fd;
+      fds[i].events = events;
+      nwait++;
+    }
+  }
 
-int db_free_results(db_result_t *rs)
-{
-  db_conn_t * const con = SB_CONTAINER_OF(rs, db_conn_t, rs);
+  if (nready > 0 || nwait == 0)
+    return nready;
 
-  if (con->state == DB_CONN_INVALID)
+  if (poll(fds, ncons, timeout) < 0)
   {
-    log_text(LOG_ALERT, "attempt to use an already closed connection");
-    return 1;
+    log_errno(LOG_FATAL, "poll() failed");
+    return -1;
   }
-  else if (con->state != DB_CONN_RESULT_SET)
+
+  /* Socket activity does not necessarily mean a complete result */
+  for (size_t i = 0; i < ncons; i++)
   {
-    log_text(LOG_ALERT, "attempt to free an invalid result set");
-    return 1;
+    if (fds[i].fd < 0 || fds[i].revents == 0)
+      continue;
+
+    if (cons[i]->driver->ops.poll(cons[i], &fd, &events) != 0)
+    {
+      ready[i] = 1;
+      nready++;
+    }
   }
 
-  return db_free_results_int(con);
+  return nready;
 }
 
 /* Close prepared statement */
@@ -674,6 +1997,7 @@ int db_close(db_stmt_t *stmt)
     free(stmt->bound_param);
     stmt->bound_param = NULL;
   }
+  db_tpl_free(stmt->tpl);
   free(stmt);
 
   return rc;
@@ -699,9 +2023,24 @@ void db_done(void)
     exec_timers = fetch_timers = NULL;
   }
 
+  if (db_globals.connect_stats)
+  {
+    for (unsigned i = 0; i < DB_CONN_PHASE_MAX; i++)
+      sb_histogram_done(&conn_phases[i].histogram);
+  }
+
+  db_stmt_stats_free();
+
   SB_LIST_FOR_EACH(pos, &drivers)
   {
     drv = SB_LIST_ENTRY(pos, db_driver_t, listitem);
+
+    if (drv->pool != NULL)
+    {
+      db_pool_free(drv->pool);
+      drv->pool = NULL;
+    }
+
     if (drv->initialized)
     {
       drv->ops.done();
@@ -735,7 +2074,36 @@ int db_parse_arguments(void)
   db_globals.driver = sb_get_value_string("db-driver");
 
   db_globals.debug = sb_get_value_flag("db-debug");
-  
+
+  int pool_size = sb_get_value_int("db-pool-size");
+  int pool_check_idle = sb_get_value_int("db-pool-check-idle");
+
+  if (pool_size < 0 || pool_check_idle < 0)
+  {
+    log_text(LOG_FATAL, "Invalid value for db-pool-size or "
+             "db-pool-check-idle");
+    return 1;
+  }
+
+  db_globals.pool_size = (unsigned int) pool_size;
+  db_globals.pool_check_idle = (unsigned int) pool_check_idle;
+
+  db_globals.connect_stats = sb_get_value_flag("db-connect-stats");
+
+  s = sb_get_value_string("db-stmt-stats");
+
+  if (!strcmp(s, "off"))
+    db_globals.stmt_stats = DB_STMT_STATS_OFF;
+  else if (!strcmp(s, "prepared"))
+    db_globals.stmt_stats = DB_STMT_STATS_PREPARED;
+  else if (!strcmp(s, "all"))
+    db_globals.stmt_stats = DB_STMT_STATS_ALL;
+  else
+  {
+    log_text(LOG_FATAL, "Invalid value for db-stmt-stats: %s", s);
+    return 1;
+  }
+
   return 0;
 }
 
@@ -801,6 +2169,219 @@ int db_print_value(db_bind_t *var, char *buf, int buflen)
 }
 
 
+/* Split a query into literal segments and parameter slots */
+
+static db_query_tpl_t *db_tpl_compile(const char *query)
+{
+  db_query_tpl_t *tpl;
+  const char     *p;
+  size_t         i, j, start;
+  unsigned int   n;
+
+  tpl = calloc(1, sizeof(db_query_tpl_t));
+  if (tpl == NULL)
+    return NULL;
+
+  for (p = query; (p = strchr(p, '?')) != NULL; p++)
+    tpl->nparams++;
+
+  tpl->text = malloc(strlen(query) - tpl->nparams + 1);
+  tpl->seg_len = malloc((tpl->nparams + 1) * sizeof(size_t));
+  if (tpl->text == NULL || tpl->seg_len == NULL)
+  {
+    db_tpl_free(tpl);
+    return NULL;
+  }
+
+  for (i = 0, j = 0, start = 0, n = 0; query[i] != '\0'; i++)
+  {
+    if (query[i] == '?')
+    {
+      tpl->seg_len[n++] = j - start;
+      start = j;
+    }
+    else
+      tpl->text[j++] = query[i];
+  }
+  tpl->seg_len[n] = j - start;
+  tpl->text_len = j;
+
+  return tpl;
+}
+
+
+static void db_tpl_free(db_query_tpl_t *tpl)
+{
+  if (tpl == NULL)
+    return;
+
+  free(tpl->text);
+  free(tpl->seg_len);
+  free(tpl->buf);
+  free(tpl);
+}
+
+
+/* Length of a string parameter value */
+
+static inline size_t db_string_len(const db_bind_t *var)
+{
+  return (var->data_len != NULL) ? *var->data_len :
+    strlen((const char *) var->buffer);
+}
+
+
+/* Print an integer in decimal notation, return the end of printed value */
+
+static inline char *db_print_int(char *p, long long val)
+{
+  char               tmp[20];
+  unsigned long long u;
+  unsigned int       n = 0;
+
+  if (val < 0)
+  {
+    *p++ = '-';
+    u = -(unsigned long long) val;
+  }
+  else
+    u = (unsigned long long) val;
+
+  do {
+    tmp[n++] = (char) ('0' + u % 10);
+    u /= 10;
+  } while (u > 0);
+
+  while (n > 0)
+    *p++ = tmp[--n];
+
+  return p;
+}
+
+
+/*
+  Print a quoted string literal with single quotes doubled, return the end of
+  printed value
+*/
+
+static inline char *db_print_string(char *p, const char *str, size_t len)
+{
+  const char *q;
+  size_t     n;
+
+  *p++ = '\'';
+  while ((q = memchr(str, '\'', len)) != NULL)
+  {
+    n = (size_t) (q - str) + 1;
+    memcpy(p, str, n);
+    p += n;
+    *p++ = '\'';
+    str += n;
+    len -= n;
+  }
+  memcpy(p, str, len);
+  p += len;
+  *p++ = '\'';
+
+  return p;
+}
+
+
+char *db_build_query(db_stmt_t *stmt, size_t *len)
+{
+  db_query_tpl_t * const tpl = stmt->tpl;
+  const char     *text;
+  db_bind_t      *var;
+  size_t         size;
+  unsigned int   i;
+  int            n;
+  char           *p;
+
+  if (tpl == NULL)
+    return NULL;
+
+  if (SB_UNLIKELY(stmt->bound_param_len < tpl->nparams))
+  {
+    log_text(LOG_FATAL, "Wrong number of parameters for query \"%s\"",
+             stmt->query);
+    return NULL;
+  }
+
+  /* Find the maximum length of the query and grow the buffer if needed */
+  size = tpl->text_len + 1;
+  for (i = 0; i < tpl->nparams; i++)
+  {
+    var = stmt->bound_param + i;
+
+    if (var->is_null != NULL && *var->is_null)
+      size += sizeof("NULL") - 1;
+    else if (var->type == DB_TYPE_CHAR || var->type == DB_TYPE_VARCHAR)
+      size += 2 * db_string_len(var) + 2;
+    else
+      size += MAX_VALUE_LEN;
+  }
+
+  if (SB_UNLIKELY(size > tpl->buflen))
+  {
+    char *buf = realloc(tpl->buf, size);
+    if (buf == NULL)
+      return NULL;
+    tpl->buf = buf;
+    tpl->buflen = size;
+  }
+
+  p = tpl->buf;
+  text = tpl->text;
+  for (i = 0; ; i++)
+  {
+    memcpy(p, text, tpl->seg_len[i]);
+    p += tpl->seg_len[i];
+    text += tpl->seg_len[i];
+
+    if (i == tpl->nparams)
+      break;
+
+    var = stmt->bound_param + i;
+
+    if (var->is_null != NULL && *var->is_null)
+    {
+      memcpy(p, "NULL", 4);
+      p += 4;
+      continue;
+    }
+
+    switch (var->type) {
+      case DB_TYPE_TINYINT:
+        p = db_print_int(p, *(char *) var->buffer);
+        break;
+      case DB_TYPE_SMALLINT:
+        p = db_print_int(p, *(short *) var->buffer);
+        break;
+      case DB_TYPE_INT:
+        p = db_print_int(p, *(int *) var->buffer);
+        break;
+      case DB_TYPE_BIGINT:
+        p = db_print_int(p, *(long long *) var->buffer);
+        break;
+      case DB_TYPE_CHAR:
+      case DB_TYPE_VARCHAR:
+        p = db_print_string(p, (const char *) var->buffer,
+                            db_string_len(var));
+        break;
+      default:
+        n = db_print_value(var, p, MAX_VALUE_LEN + 1);
+        p += (n > 0) ? n : 0;
+        break;
+    }
+  }
+  *p = '\0';
+
+  *len = (size_t) (p - tpl->buf);
+
+  return tpl->buf;
+}
+
+
 #if 0
 /* Free row fetched by db_fetch_row() */
 
@@ -973,11 +2554,12 @@ void db_report_intermediate(sb_stat_t *stat)
   }
 
   const double seconds = stat->time_interval;
+  char lat_buf[SB_REPORT_LATENCY_BUF_SIZE];
 
   log_timestamp(LOG_NOTICE, stat->time_total,
                 "thds: %u tps: %4.2f "
                 "qps: %4.2f (r/w/o: %4.2f/%4.2f/%4.2f) "
-                "lat (ms,%u%%): %4.2f err/s: %4.2f "
+                "%s err/s: %4.2f "
                 "reconn/s: %4.2f",
                 stat->threads_running,
                 stat->events / seconds,
@@ -985,16 +2567,28 @@ void db_report_intermediate(sb_stat_t *stat)
                 stat->reads / seconds,
                 stat->writes / seconds,
                 stat->other / seconds,
-                sb_globals.percentile,
-                SEC2MS(stat->latency_pct),
+                sb_report_format_latency(stat, lat_buf, sizeof(lat_buf)),
                 stat->errors / seconds,
                 stat->reconnects / seconds);
 
+  if (db_globals.pool_size > 0)
+    db_pool_report_intermediate(stat);
+
+  db_report_drivers(stat, false);
+
+  if (db_globals.stmt_stats != DB_STMT_STATS_OFF)
+    db_stmt_stats_report_intermediate(stat);
+
   if (sb_globals.tx_rate > 0)
   {
     log_timestamp(LOG_NOTICE, stat->time_total,
                   "queue length: %" PRIu64", concurrency: %" PRIu64,
                   stat->queue_length, stat->concurrency);
+    log_timestamp(LOG_NOTICE, stat->time_total,
+                  "target rate: %4.2f, backlog (ms): %4.2f, "
+                  "service lat (ms,%u%%): %4.2f",
+                  stat->rate_target, SEC2MS(stat->backlog_time),
+                  sb_globals.percentile, SEC2MS(stat->latency_service_pct));
   }
 }
 
@@ -1034,6 +2628,17 @@ void db_report_cumulative(sb_stat_t *stat)
   log_text(LOG_NOTICE, "    reconnects:                          %-6" PRIu64
            " (%.2f per sec.)", stat->reconnects, stat->reconnects / seconds);
 
+  if (db_globals.pool_size > 0)
+    db_pool_report_cumulative(stat);
+
+  if (db_globals.connect_stats)
+    db_report_conn_phases();
+
+  db_report_drivers(stat, true);
+
+  if (db_globals.stmt_stats != DB_STMT_STATS_OFF)
+    db_stmt_stats_report_cumulative(stat);
+
   if (db_globals.debug)
   {
     sb_timer_init(&exec_timer);
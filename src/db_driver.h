@@ -38,13 +38,41 @@ typedef enum
 
 /* Global DB API options */
 
+/* Per-statement statistics modes, see --db-stmt-stats */
+
+typedef enum
+{
+  DB_STMT_STATS_OFF,
+  DB_STMT_STATS_PREPARED,   /* Track prepared statements */
+  DB_STMT_STATS_ALL         /* Also track queries by their fingerprints */
+} db_stmt_stats_mode_t;
+
 typedef struct
 {
   db_ps_mode_t  ps_mode;   /* Requested prepared statements usage mode */
   char          *driver;   /* Requested database driver */
   unsigned char debug;     /* debug flag */
+  unsigned int  pool_size; /* Connection pool size, 0 if disabled */
+  unsigned int  pool_check_idle; /* Idle time in ms before health checks */
+  unsigned char connect_stats; /* Track connection phase latencies */
+  db_stmt_stats_mode_t stmt_stats; /* Per-statement statistics mode */
 } db_globals_t;
 
+/*
+  Phases of establishing a connection tracked with --db-connect-stats. Drivers
+  report durations of the phases they can tell apart with db_conn_phase_done().
+*/
+
+typedef enum
+{
+  DB_CONN_PHASE_CONNECT,      /* Transport (TCP or socket) connection */
+  DB_CONN_PHASE_TLS,          /* TLS handshake */
+  DB_CONN_PHASE_AUTH,         /* Authentication and session setup */
+  DB_CONN_PHASE_TOTAL,        /* Entire connection establishment */
+  DB_CONN_PHASE_FIRST_QUERY,  /* First query on a new connection */
+  DB_CONN_PHASE_MAX
+} db_conn_phase_t;
+
 /* Driver capabilities definition */
 
 typedef struct
@@ -137,6 +165,16 @@ typedef db_error_t drv_op_query(struct db_conn *, const char *, size_t,
                                 struct db_result *);
 typedef int drv_op_free_results(struct db_result *);
 typedef int drv_op_close(struct db_stmt *);
+typedef int drv_op_send_query(struct db_conn *, const char *, size_t);
+typedef int drv_op_send_execute(struct db_stmt *);
+/*
+  Return 1 if the oldest pending result can be reaped without blocking, -1 on
+  errors (which are then reported by reap), or 0 if I/O is required. In the
+  latter case, store the socket and poll(2) events to wait for.
+*/
+typedef int drv_op_poll(struct db_conn *, int *, short *);
+typedef db_error_t drv_op_reap(struct db_conn *, struct db_result *);
+typedef void drv_op_report(sb_stat_t *);
 typedef int drv_op_thread_done(int);
 typedef int drv_op_done(void);
 
@@ -157,6 +195,21 @@ typedef struct
   drv_op_free_results    *free_results;   /* free result set */
   drv_op_close           *close;          /* close prepared statement */
   drv_op_query           *query;          /* execute non-prepared statement */
+  drv_op_query           *query_stream;   /* execute non-prepared statement
+                                             and fetch result set rows one
+                                             by one rather than storing them */
+  drv_op_send_query      *send_query;     /* send non-prepared statement
+                                             without waiting for results */
+  drv_op_send_execute    *send_execute;   /* send prepared statement without
+                                             waiting for results */
+  drv_op_poll            *poll;           /* check if the oldest pending result
+                                             can be reaped without blocking */
+  drv_op_reap            *reap;           /* wait for and read the oldest
+                                             pending result */
+  drv_op_report          *report_intermediate; /* print driver-specific
+                                                  intermediate statistics */
+  drv_op_report          *report_cumulative; /* print driver-specific
+                                                cumulative statistics */
   drv_op_thread_done     *thread_done;    /* thread-local driver deinitialization */
   drv_op_done            *done;           /* uninitialize driver */
 } drv_ops_t;
@@ -173,6 +226,7 @@ typedef struct
   sb_list_item_t  listitem; /* can be linked in a list */
   bool            initialized;
   pthread_mutex_t mutex;
+  struct db_pool  *pool;    /* connection pool, created on first checkout */
 } db_driver_t;
 
 /* Row value definition */
@@ -192,6 +246,13 @@ typedef struct db_row
 
 /* Result set definition */
 
+/*
+  Counter type of statements which were sent to the server, but have no results
+  yet (e.g. when pipelining). Drivers update statistic counters for such
+  statements once results are received.
+*/
+#define DB_CNT_DEFERRED SB_CNT_MAX
+
 typedef struct db_result
 {
   sb_counter_type_t counter;     /* Statistical counter type */
@@ -229,6 +290,11 @@ typedef struct db_conn
   unsigned int    bulk_values;       /* Save value of bulk_ptr */
   unsigned int    bulk_commit_cnt;   /* Current value of uncommitted rows */
   unsigned int    bulk_commit_max;   /* Maximum value of uncommitted rows */
+  unsigned int    pending;           /* Number of sent but not yet reaped
+                                        asynchronous statements */
+  unsigned int    nvalues;           /* Allocated length of rs.row.values */
+  char            first_query;       /* Time the next query as the first one
+                                        on a new connection */
 
   char            pad[SB_CACHELINE_PAD(sizeof(db_error_t) +
                                        sizeof(int) +
@@ -241,10 +307,21 @@ typedef struct db_conn
                                        sizeof(int) +
                                        sizeof(int) * 2 +
                                        sizeof(void *) +
-                                       sizeof(int) * 4
+                                       sizeof(int) * 4 +
+                                       sizeof(int) +
+                                       sizeof(int) +
+                                       sizeof(char)
                                        )];
 } db_conn_t;
 
+/* Query template of an emulated prepared statement */
+
+typedef struct db_query_tpl db_query_tpl_t;
+
+/* Latency statistics of a statement, see --db-stmt-stats */
+
+typedef struct db_stmt_stats db_stmt_stats_t;
+
 /* Prepared statement definition */
 
 typedef struct db_stmt
@@ -258,6 +335,8 @@ typedef struct db_stmt
   char            emulated;        /* Should this statement be emulated? */
   sb_counter_type_t  counter;       /* Query type */
   void            *ptr;            /* Pointer to driver-specific data structure */
+  db_query_tpl_t  *tpl;            /* Compiled query for emulated PS */
+  db_stmt_stats_t *stats;          /* Per-statement statistics, or NULL */
 } db_stmt_t;
 
 extern db_globals_t db_globals;
@@ -282,6 +361,32 @@ int db_connection_reconnect(db_conn_t *con);
 
 void db_connection_free(db_conn_t *con);
 
+/* Record the duration of a connection phase in nanoseconds */
+void db_conn_phase_done(db_conn_phase_t phase, uint64_t ns);
+
+/* Record a failed attempt to connect to the server */
+void db_conn_attempt_failed(void);
+
+/*
+  Sleep before retrying to connect after a given number of failed attempts
+  (starting from 0) in a driver reconnect loop. The delay grows exponentially
+  from 1 ms up to 1 second.
+*/
+void db_reconnect_backoff(unsigned int attempt);
+
+/*
+  Check out a connection from the pool of a given driver, waiting until one is
+  available if all --db-pool-size connections are in use. Each checkout creates
+  a new connection if pooling is disabled.
+*/
+db_conn_t *db_pool_checkout(db_driver_t *drv);
+
+/*
+  Return a connection to the pool. Connections in an invalid or failed state
+  are closed rather than reused.
+*/
+void db_pool_checkin(db_conn_t *con);
+
 db_stmt_t *db_prepare(db_conn_t *, const char *, size_t);
 
 int db_bind_param(db_stmt_t *, db_bind_t *, size_t);
@@ -294,8 +399,34 @@ db_row_t *db_fetch_row(db_result_t *);
 
 db_result_t *db_query(db_conn_t *, const char *, size_t len);
 
+/*
+  Execute a non-prepared statement without storing its result set in memory.
+  Rows must be fetched with db_fetch_row(), which sets the connection error on
+  failures to fetch a row. Falls back to db_query() if the driver does not
+  support streaming.
+*/
+db_result_t *db_query_stream(db_conn_t *, const char *, size_t len);
+
 int db_free_results(db_result_t *);
 
+/*
+  Asynchronous statement execution. db_send_query() and db_send_execute() send
+  a statement without waiting for its results. Results are then read in the
+  order statements were sent with db_reap(), which has the same semantics as
+  db_query(). db_poll() checks which of the specified connections have results
+  that can be reaped without blocking.
+*/
+
+int db_send_query(db_conn_t *, const char *, size_t);
+
+int db_send_execute(db_stmt_t *);
+
+db_result_t *db_reap(db_conn_t *);
+
+unsigned int db_pending(db_conn_t *);
+
+int db_poll(db_conn_t **, size_t, int, char *);
+
 int db_store_results(db_result_t *);
 
 int db_close(db_stmt_t *);
@@ -304,6 +435,13 @@ void db_done(void);
 
 int db_print_value(db_bind_t *, char *, int);
 
+/*
+  Build the query string of an emulated prepared statement from its compiled
+  template and bound parameters. The returned buffer belongs to the statement
+  and is reused by subsequent calls.
+*/
+char *db_build_query(db_stmt_t *, size_t *);
+
 /* Initialize multi-row insert operation */
 int db_bulk_insert_init(db_conn_t *, const char *, size_t);
 
@@ -317,6 +455,38 @@ int db_bulk_insert_done(db_conn_t *);
 void db_report_intermediate(sb_stat_t *);
 void db_report_cumulative(sb_stat_t *);
 
+/*
+  Print per-statement statistics collected with --db-stmt-stats since the last
+  intermediate or cumulative report. Used by Lua report hooks replacing the
+  default reports.
+*/
+void db_report_stmt_stats(double time_total, double time_interval,
+                          bool cumulative);
+
+/*
+  Print driver-specific statistics, e.g. per-endpoint statistics of the MySQL
+  driver, for an intermediate or cumulative report. Used by Lua report hooks
+  replacing the default reports.
+*/
+void db_report_driver_stats(double time_total, double time_interval,
+                            bool cumulative);
+
+/*
+  Print connection statistics collected with --db-connect-stats. Only
+  cumulative reports include them. Used by Lua report hooks replacing the
+  default reports.
+*/
+void db_report_conn_stats(bool cumulative);
+
+/*
+  Print connection pool statistics (--db-pool-size) from given counters of an
+  intermediate or cumulative report. Used by Lua report hooks replacing the
+  default reports.
+*/
+void db_report_pool_stats(double time_total, double time_interval,
+                          uint64_t checkouts, uint64_t waits,
+                          double wait_time, bool cumulative);
+
 /* DB drivers registrars */
 
 #ifdef USE_MYSQL
@@ -30,6 +30,9 @@
 # include <strings.h>
 #endif
 #include <stdio.h>
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
 
 #include <mysql.h>
 #include <mysqld_error.h>
@@ -37,6 +40,8 @@
 
 #include "sb_options.h"
 #include "db_driver.h"
+#include "sb_rand.h"
+#include "sb_ck_pr.h"
 
 #define DEBUG(format, ...)                      \
   do {                                          \
@@ -61,6 +66,21 @@ static sb_arg_t mysql_drv_args[] =
   SB_OPT("mysql-host", "MySQL server host", "localhost", LIST),
   SB_OPT("mysql-port", "MySQL server port", "3306", LIST),
   SB_OPT("mysql-socket", "MySQL socket", NULL, LIST),
+  SB_OPT("mysql-balance", "strategy to distribute load among multiple "
+         "endpoints specified with --mysql-host/--mysql-port or "
+         "--mysql-socket: round-robin, random, least-outstanding (fewest "
+         "queries in flight), weighted (see --mysql-weights) or affinity "
+         "(by the table name of the first statement in a transaction, or by "
+         "thread with --mysql-balance-scope=connection)", "round-robin",
+         STRING),
+  SB_OPT("mysql-balance-scope", "pick an endpoint for each 'connection', or "
+         "for each 'transaction' started with BEGIN or START TRANSACTION. In "
+         "the latter case each connection keeps a session to every endpoint "
+         "it uses, and server-side prepared statements are not used",
+         "connection", STRING),
+  SB_OPT("mysql-weights", "list of endpoint weights for "
+         "--mysql-balance=weighted, in the order endpoints are listed with "
+         "--mysql-host/--mysql-port or --mysql-socket", NULL, LIST),
   SB_OPT("mysql-user", "MySQL user", "sbtest", STRING),
   SB_OPT("mysql-password", "MySQL password", "", STRING),
   SB_OPT("mysql-db", "MySQL database name", "sbtest", STRING),
@@ -86,15 +106,37 @@ static sb_arg_t mysql_drv_args[] =
          "1213,1020,1205", LIST),
   SB_OPT("mysql-dry-run", "Dry run, pretend that all MySQL client API "
          "calls are successful without executing them", "off", BOOL),
+  SB_OPT("mysql-ps-stream", "Fetch rows of prepared statement results from "
+         "the server one by one rather than buffering entire result sets on "
+         "the client", "off", BOOL),
 
   SB_OPT_END
 };
 
+/* Strategies to distribute load among endpoints, see --mysql-balance */
+typedef enum
+{
+  BALANCE_ROUND_ROBIN,
+  BALANCE_RANDOM,
+  BALANCE_LEAST_OUTSTANDING,
+  BALANCE_WEIGHTED,
+  BALANCE_AFFINITY
+} balance_t;
+
+/* When endpoints are picked, see --mysql-balance-scope */
+typedef enum
+{
+  BALANCE_SCOPE_CONNECTION,
+  BALANCE_SCOPE_TRANSACTION
+} balance_scope_t;
+
 typedef struct
 {
   sb_list_t          *hosts;
   sb_list_t          *ports;
   sb_list_t          *sockets;
+  balance_t          balance;
+  balance_scope_t    balance_scope;
   const char         *user;
   const char         *password;
   const char         *db;
@@ -110,19 +152,114 @@ typedef struct
   unsigned char      debug;
   sb_list_t          *ignored_errors;
   unsigned int       dry_run;
+  bool               ps_stream;
 } mysql_drv_args_t;
 
+/*
+  Asynchronous queries are only supported with the non-blocking API of the
+  MariaDB client library
+*/
+#ifdef MYSQL_WAIT_READ
+# define HAVE_MYSQL_NONBLOCK_API 1
+
+/* Stages of an asynchronous query */
+typedef enum
+{
+  ASYNC_NONE,                   /* no query in flight */
+  ASYNC_QUERY,                  /* waiting for mysql_real_query_cont() */
+  ASYNC_STORE,                  /* waiting for mysql_store_result_cont() */
+  ASYNC_DONE,                   /* results can be reaped */
+  ASYNC_DEFERRED                /* query handled without sending it, e.g. BEGIN
+                                   deferred by --mysql-balance=affinity */
+} async_stage_t;
+#endif
+
+/*
+  Server endpoint, i.e. a host/port pair or a socket. Statistics are only
+  collected when there are multiple endpoints.
+*/
+typedef struct
+{
+  const char     *host;
+  unsigned int   port;
+  char           *socket;
+  char           name[128];     /* host:port or socket for reports */
+  int            weight;        /* weight for --mysql-balance=weighted */
+  int            cur_weight;    /* smooth weighted round-robin state */
+  uint64_t       connects;      /* sessions opened */
+  uint64_t       sessions;      /* sessions currently open */
+  uint64_t       outstanding;   /* queries in flight */
+  uint64_t       queries;       /* queries executed */
+  uint64_t       errors;        /* queries failed */
+  uint64_t       sum_ns;        /* total query latency */
+  uint64_t       max_ns;        /* maximum query latency */
+  uint64_t       last_queries;  /* values at the last intermediate report */
+  uint64_t       last_errors;
+  uint64_t       last_sum_ns;
+  sb_histogram_t histogram;     /* query latency histogram */
+} mysql_endpoint_t;
+
+/*
+  Client session. The MYSQL handle must be the first member, so that handles of
+  sessions allocated by open_session() can be cast to sessions.
+*/
+typedef struct
+{
+  MYSQL        mysql;
+#ifdef HAVE_MYSQL_NONBLOCK_API
+  bool         nonblock;        /* MYSQL_OPT_NONBLOCK is set on the handle */
+#endif
+} mysql_session_t;
+
 typedef struct
 {
   MYSQL        *mysql;
-  const char   *host;
+  mysql_endpoint_t *ep;         /* Endpoint of the current session */
+  MYSQL        **sessions;      /* Sessions to each endpoint, only used with
+                                   --mysql-balance-scope=transaction */
+  bool         pending_begin;   /* BEGIN is deferred until the first
+                                   statement of a transaction is known */
   const char   *user;
   const char   *password;
   const char   *db;
-  unsigned int port;
-  char         *socket;
+#ifdef HAVE_MYSQL_NONBLOCK_API
+  async_stage_t async_stage;    /* Stage of the in-flight query */
+  int           async_status;   /* Events the client library waits for */
+  int           async_err;      /* Result of mysql_real_query() */
+  MYSQL_RES     *async_res;     /* Result of mysql_store_result() */
+  char          *async_query;   /* Query text, must be valid until sent */
+  size_t        async_buflen;   /* Allocated length of async_query */
+  mysql_endpoint_t *async_ep;   /* Endpoint of the in-flight query */
+  uint64_t      async_start_ns; /* Start time of the in-flight query */
+#endif
 } db_mysql_conn_t;
 
+/*
+  Initial size of result buffers of prepared statements. Buffers are grown when
+  a longer value is fetched.
+*/
+#define RES_BUF_INIT_MAX 1024
+
+/*
+  Server-side prepared statement. All buffers are allocated on the first use
+  and reused by subsequent executions, so the steady state execution path does
+  not allocate memory.
+*/
+typedef struct
+{
+  MYSQL_STMT    *stmt;
+  unsigned long param_count;    /* Number of parameters */
+  MYSQL_BIND    *param_bind;    /* Parameter bindings */
+  MYSQL_BIND    *user_res_bind; /* Bindings of buffers passed to bind_result() */
+  unsigned int  nfields;        /* Number of fields in the result set */
+  MYSQL_BIND    *res_bind;      /* Result bindings reused by all executions */
+  char          **res_buf;      /* Result buffers */
+  unsigned long *res_len;       /* Lengths of fetched values */
+  my_bool       *res_null;      /* NULL flags of fetched values */
+  my_bool       *res_error;     /* Truncation flags of fetched values */
+  db_bind_t     *user_bind;     /* Result bindings passed to bind_result() */
+} db_mysql_stmt_t;
+
 #ifdef HAVE_MYSQL_OPT_SSL_MODE
 typedef struct {
   const char *name;
@@ -173,12 +310,30 @@ static mysql_drv_args_t args;          /* driver args */
 
 static char use_ps; /* whether server-side prepared statemens should be used */
 
-/* Positions in the list of hosts/ports/sockets. Protected by pos_mutex */
-static sb_list_item_t *hosts_pos;
-static sb_list_item_t *ports_pos;
-static sb_list_item_t *sockets_pos;
+/*
+  All host/port pairs in the order of --mysql-host and --mysql-port (ports
+  varying first), or all sockets if --mysql-socket is specified
+*/
+static mysql_endpoint_t *endpoints;
+static unsigned int     nendpoints;
+
+/* Whether per-endpoint statistics are collected */
+static bool ep_stats;
+
+/* Position for round-robin balancing. Protected by balance_mutex */
+static unsigned int    rr_pos;
 
-static pthread_mutex_t pos_mutex;
+static pthread_mutex_t balance_mutex;
+
+static const char *balance_names[] =
+{
+  "round-robin",
+  "random",
+  "least-outstanding",
+  "weighted",
+  "affinity",
+  NULL
+};
 
 #ifdef HAVE_MYSQL_OPT_SSL_MODE
 
@@ -220,10 +375,20 @@ static int mysql_drv_fetch(db_result_t *);
 static int mysql_drv_fetch_row(db_result_t *, db_row_t *);
 static db_error_t mysql_drv_query(db_conn_t *, const char *, size_t,
                            db_result_t *);
+static db_error_t mysql_drv_query_stream(db_conn_t *, const char *, size_t,
+                                  db_result_t *);
 static int mysql_drv_free_results(db_result_t *);
 static int mysql_drv_close(db_stmt_t *);
 static int mysql_drv_thread_done(int);
 static int mysql_drv_done(void);
+static void mysql_drv_report_intermediate(sb_stat_t *);
+static void mysql_drv_report_cumulative(sb_stat_t *);
+#ifdef HAVE_MYSQL_NONBLOCK_API
+static int mysql_drv_send_query(db_conn_t *, const char *, size_t);
+static int mysql_drv_send_execute(db_stmt_t *);
+static int mysql_drv_poll(db_conn_t *, int *, short *);
+static db_error_t mysql_drv_reap(db_conn_t *, db_result_t *);
+#endif
 
 /* MySQL driver definition */
 
@@ -248,6 +413,15 @@ static db_driver_t mysql_driver =
     .free_results = mysql_drv_free_results,
     .close = mysql_drv_close,
     .query = mysql_drv_query,
+    .query_stream = mysql_drv_query_stream,
+#ifdef HAVE_MYSQL_NONBLOCK_API
+    .send_query = mysql_drv_send_query,
+    .send_execute = mysql_drv_send_execute,
+    .poll = mysql_drv_poll,
+    .reap = mysql_drv_reap,
+#endif
+    .report_intermediate = mysql_drv_report_intermediate,
+    .report_cumulative = mysql_drv_report_cumulative,
     .thread_done = mysql_drv_thread_done,
     .done = mysql_drv_done
   }
@@ -257,6 +431,7 @@ static db_driver_t mysql_driver =
 /* Local functions */
 
 static int get_mysql_bind_type(db_bind_type_t);
+static db_error_t process_result(db_conn_t *, MYSQL_RES *, db_result_t *);
 
 /* Register MySQL driver */
 
@@ -272,9 +447,131 @@ int register_driver_mysql(sb_list_t *drivers)
 /* MySQL driver initialization */
 
 
+/* Add an endpoint to the endpoints array */
+
+static int add_endpoint(const char *host, unsigned int port, char *socket)
+{
+  mysql_endpoint_t *ep;
+
+  ep = realloc(endpoints, (nendpoints + 1) * sizeof(mysql_endpoint_t));
+  if (ep == NULL)
+    return 1;
+  endpoints = ep;
+
+  ep = endpoints + nendpoints++;
+  memset(ep, 0, sizeof(*ep));
+
+  ep->host = host;
+  ep->port = port;
+  ep->socket = socket;
+  ep->weight = 1;
+
+  if (socket != NULL)
+    snprintf(ep->name, sizeof(ep->name), "%s", socket);
+  else
+    snprintf(ep->name, sizeof(ep->name), "%s:%u", host, port);
+
+  return 0;
+}
+
+
+/* Build the list of endpoints and parse load balancing options */
+
+static int init_endpoints(void)
+{
+  sb_list_item_t *hpos;
+  sb_list_item_t *ppos;
+  sb_list_t      *weights;
+  const char     *str;
+  unsigned int   i;
+
+  if (!SB_LIST_IS_EMPTY(args.sockets))
+  {
+    SB_LIST_FOR_EACH(ppos, args.sockets)
+    {
+      if (add_endpoint("localhost", 0,
+                       SB_LIST_ENTRY(ppos, value_t, listitem)->data))
+        return 1;
+    }
+  }
+  else
+  {
+    SB_LIST_FOR_EACH(hpos, args.hosts)
+    {
+      SB_LIST_FOR_EACH(ppos, args.ports)
+      {
+        if (add_endpoint(SB_LIST_ENTRY(hpos, value_t, listitem)->data,
+                         atoi(SB_LIST_ENTRY(ppos, value_t, listitem)->data),
+                         NULL))
+          return 1;
+      }
+    }
+  }
+
+  str = sb_get_value_string("mysql-balance");
+  for (i = 0; balance_names[i] != NULL; i++)
+  {
+    if (!strcasecmp(str, balance_names[i]))
+      break;
+  }
+  if (balance_names[i] == NULL)
+  {
+    log_text(LOG_FATAL, "Invalid value for --mysql-balance: '%s'", str);
+    return 1;
+  }
+  args.balance = (balance_t) i;
+
+  str = sb_get_value_string("mysql-balance-scope");
+  if (!strcasecmp(str, "connection"))
+    args.balance_scope = BALANCE_SCOPE_CONNECTION;
+  else if (!strcasecmp(str, "transaction"))
+    args.balance_scope = BALANCE_SCOPE_TRANSACTION;
+  else
+  {
+    log_text(LOG_FATAL, "Invalid value for --mysql-balance-scope: '%s'", str);
+    return 1;
+  }
+
+  weights = sb_get_value_list("mysql-weights");
+  if (!SB_LIST_IS_EMPTY(weights))
+  {
+    i = 0;
+    SB_LIST_FOR_EACH(ppos, weights)
+    {
+      const char *val = SB_LIST_ENTRY(ppos, value_t, listitem)->data;
+
+      if (i == nendpoints || atoi(val) <= 0)
+      {
+        i = 0;
+        break;
+      }
+      endpoints[i++].weight = atoi(val);
+    }
+
+    if (i != nendpoints)
+    {
+      log_text(LOG_FATAL, "--mysql-weights must specify a positive weight "
+               "for each of %u endpoints", nendpoints);
+      return 1;
+    }
+  }
+
+  ep_stats = nendpoints > 1;
+
+  for (i = 0; ep_stats && i < nendpoints; i++)
+  {
+    if (sb_histogram_init(&endpoints[i].histogram,
+                          SB_HISTOGRAM_DEFAULT_SIG_DIGITS, NS2MS(1), 1E5))
+      return 1;
+  }
+
+  return 0;
+}
+
+
 int mysql_drv_init(void)
 {
-  pthread_mutex_init(&pos_mutex, NULL);
+  pthread_mutex_init(&balance_mutex, NULL);
 
   args.hosts = sb_get_value_list("mysql-host");
   if (SB_LIST_IS_EMPTY(args.hosts))
@@ -282,7 +579,6 @@ int mysql_drv_init(void)
     log_text(LOG_FATAL, "No MySQL hosts specified, aborting");
     return 1;
   }
-  hosts_pos = SB_LIST_ITEM_NEXT(args.hosts);
 
   args.ports = sb_get_value_list("mysql-port");
   if (SB_LIST_IS_EMPTY(args.ports))
@@ -290,10 +586,11 @@ int mysql_drv_init(void)
     log_text(LOG_FATAL, "No MySQL ports specified, aborting");
     return 1;
   }
-  ports_pos = SB_LIST_ITEM_NEXT(args.ports);
 
   args.sockets = sb_get_value_list("mysql-socket");
-  sockets_pos = args.sockets;
+
+  if (init_endpoints())
+    return 1;
 
   args.user = sb_get_value_string("mysql-user");
   args.password = sb_get_value_string("mysql-password");
@@ -335,10 +632,16 @@ int mysql_drv_init(void)
   args.ignored_errors = sb_get_value_list("mysql-ignore-errors");
 
   args.dry_run = sb_get_value_flag("mysql-dry-run");
+  args.ps_stream = sb_get_value_flag("mysql-ps-stream");
 
   use_ps = 0;
   mysql_drv_caps.prepared_statements = 1;
-  if (db_globals.ps_mode != DB_PS_MODE_DISABLE)
+  /*
+    Server-side prepared statements are bound to a session, so they cannot be
+    used when connections switch between endpoints
+  */
+  if (db_globals.ps_mode != DB_PS_MODE_DISABLE &&
+      args.balance_scope != BALANCE_SCOPE_TRANSACTION)
     use_ps = 1;
 
   DEBUG("mysql_library_init(%d, %p, %p)", 0, NULL, NULL);
@@ -381,9 +684,119 @@ int mysql_drv_describe(drv_caps_t *caps)
 }
 
 
+#ifdef HAVE_MYSQL_NONBLOCK_API
+
+/*
+  Enable the non-blocking API on a given session handle. This is only done when
+  the non-blocking API is actually used, i.e. for timed connects and
+  asynchronous queries, so the blocking path is not affected otherwise.
+*/
+
+static void set_nonblock(MYSQL *con)
+{
+  mysql_session_t * const session = (mysql_session_t *) con;
+
+  if (session->nonblock)
+    return;
+
+  DEBUG("mysql_options(%p, %s, %s)",con, "MYSQL_OPT_NONBLOCK", "0");
+  mysql_options(con, MYSQL_OPT_NONBLOCK, 0);
+
+  session->nonblock = true;
+}
+
+
+/*
+  Connect with the non-blocking client API and report latencies of individual
+  connection phases to the DB layer (--db-connect-stats). The client library
+  waits for the socket to become writable while the transport connection is
+  being established, so the connect phase ends when it first waits to read the
+  server greeting. The protocol handshake (including TLS negotiation, which is
+  not reported separately) and authentication take the rest.
+*/
+
+static MYSQL *mysql_drv_timed_connect(db_mysql_conn_t *db_mysql_con,
+                                      unsigned long flags)
+{
+  MYSQL                  *con = db_mysql_con->mysql;
+  const mysql_endpoint_t *ep = db_mysql_con->ep;
+  const uint64_t         start = sb_clock_ns();
+  uint64_t               phase_start = 0;
+  MYSQL                  *ret;
+  struct pollfd          pfd;
+  int                    status, ready, rc, timeout;
+
+  set_nonblock(con);
+
+  status = mysql_real_connect_start(&ret, con, ep->host, db_mysql_con->user,
+                                    db_mysql_con->password, db_mysql_con->db,
+                                    ep->port, ep->socket, flags);
+  while (status != 0)
+  {
+    if (phase_start == 0 && (status & MYSQL_WAIT_READ))
+    {
+      phase_start = sb_clock_ns();
+      db_conn_phase_done(DB_CONN_PHASE_CONNECT, phase_start - start);
+    }
+
+    pfd.fd = mysql_get_socket(con);
+    pfd.events = ((status & MYSQL_WAIT_READ) ? POLLIN : 0) |
+      ((status & MYSQL_WAIT_WRITE) ? POLLOUT : 0) |
+      ((status & MYSQL_WAIT_EXCEPT) ? POLLPRI : 0);
+    timeout = (status & MYSQL_WAIT_TIMEOUT) ?
+      (int) mysql_get_timeout_value_ms(con) : -1;
+
+    rc = poll(&pfd, 1, timeout);
+    if (rc < 0 && errno == EINTR)
+      continue;
+
+    if (rc == 0)
+      ready = MYSQL_WAIT_TIMEOUT;
+    else
+    {
+      /* Let the client library detect and report socket errors */
+      ready = (rc < 0 || (pfd.revents & (POLLERR | POLLHUP))) ? status : 0;
+      if (pfd.revents & POLLIN)
+        ready |= MYSQL_WAIT_READ;
+      if (pfd.revents & POLLOUT)
+        ready |= MYSQL_WAIT_WRITE;
+      if (pfd.revents & POLLPRI)
+        ready |= MYSQL_WAIT_EXCEPT;
+    }
+
+    status = mysql_real_connect_cont(&ret, con, ready);
+  }
+
+  if (ret != NULL)
+  {
+    const uint64_t now = sb_clock_ns();
+
+    if (phase_start == 0)
+    {
+      db_conn_phase_done(DB_CONN_PHASE_CONNECT, now - start);
+      phase_start = now;
+    }
+
+    db_conn_phase_done(DB_CONN_PHASE_AUTH, now - phase_start);
+    db_conn_phase_done(DB_CONN_PHASE_TOTAL, now - start);
+  }
+
+  return ret;
+}
+
+#endif /* HAVE_MYSQL_NONBLOCK_API */
+
+
 static int mysql_drv_real_connect(db_mysql_conn_t *db_mysql_con)
 {
   MYSQL          *con = db_mysql_con->mysql;
+  const mysql_endpoint_t *ep = db_mysql_con->ep;
+  MYSQL          *ret;
+#if MYSQL_VERSION_ID >= 50000
+  const unsigned long flags = CLIENT_MULTI_STATEMENTS;
+#else
+  const unsigned long flags = 0;
+#endif
 
 #ifdef HAVE_MYSQL_OPT_SSL_MODE
   DEBUG("mysql_options(%p,%s,%d)", con, "MYSQL_OPT_SSL_MODE", args.ssl_mode);
@@ -406,114 +819,182 @@ static int mysql_drv_real_connect(db_mysql_conn_t *db_mysql_con)
     mysql_options(con, MYSQL_OPT_COMPRESS, NULL);
   }
 
+#ifdef HAVE_MYSQL_NONBLOCK_API
+  /*
+    The handle is either new or has been closed by mysql_drv_reconnect(), so
+    MYSQL_OPT_NONBLOCK is not set in either case
+  */
+  ((mysql_session_t *) con)->nonblock = false;
+#endif
+
   DEBUG("mysql_real_connect(%p, \"%s\", \"%s\", \"%s\", \"%s\", %u, \"%s\", %s)",
         con,
-        SAFESTR(db_mysql_con->host),
+        SAFESTR(ep->host),
         SAFESTR(db_mysql_con->user),
         SAFESTR(db_mysql_con->password),
         SAFESTR(db_mysql_con->db),
-        db_mysql_con->port,
-        SAFESTR(db_mysql_con->socket),
+        ep->port,
+        SAFESTR(ep->socket),
         (MYSQL_VERSION_ID >= 50000) ? "CLIENT_MULTI_STATEMENTS" : "0"
         );
 
-  return mysql_real_connect(con,
-                            db_mysql_con->host,
-                            db_mysql_con->user,
-                            db_mysql_con->password,
-                            db_mysql_con->db,
-                            db_mysql_con->port,
-                            db_mysql_con->socket,
-#if MYSQL_VERSION_ID >= 50000
-                            CLIENT_MULTI_STATEMENTS
-#else
-                            0
+#ifdef HAVE_MYSQL_NONBLOCK_API
+  if (db_globals.connect_stats)
+    ret = mysql_drv_timed_connect(db_mysql_con, flags);
+  else
 #endif
-                            ) == NULL;
-}
+  {
+    /*
+      The blocking call performs transport connect, TLS handshake and
+      authentication at once, so only the total connection time is reported
+      with --db-connect-stats.
+    */
+    const uint64_t start = db_globals.connect_stats ? sb_clock_ns() : 0;
+
+    ret = mysql_real_connect(con,
+                             ep->host,
+                             db_mysql_con->user,
+                             db_mysql_con->password,
+                             db_mysql_con->db,
+                             ep->port,
+                             ep->socket,
+                             flags);
+
+    if (ret != NULL && db_globals.connect_stats)
+      db_conn_phase_done(DB_CONN_PHASE_TOTAL, sb_clock_ns() - start);
+  }
 
+  if (ret == NULL)
+  {
+    db_conn_attempt_failed();
+    return 1;
+  }
 
-/* Connect to MySQL database */
+  return 0;
+}
 
 
-int mysql_drv_connect(db_conn_t *sb_conn)
+/*
+  Pick an endpoint according to --mysql-balance. 'key' is the affinity key, or
+  NULL to map connections to endpoints by thread.
+*/
+
+static unsigned int pick_endpoint(db_conn_t *sb_conn, const char *key,
+                                  size_t keylen)
 {
-  MYSQL           *con;
-  db_mysql_conn_t *db_mysql_con;
+  unsigned int i, best = 0;
+  uint32_t     hash;
+  int          total;
 
-  if (args.dry_run)
+  if (nendpoints == 1)
     return 0;
 
-  db_mysql_con = (db_mysql_conn_t *) calloc(1, sizeof(db_mysql_conn_t));
+  switch (args.balance) {
+  case BALANCE_RANDOM:
+    return sb_rand_uniform(0, nendpoints - 1);
 
-  if (db_mysql_con == NULL)
-    return 1;
+  case BALANCE_AFFINITY:
+    if (key == NULL)
+      return (unsigned int) sb_conn->thread_id % nendpoints;
 
-  con = (MYSQL *) malloc(sizeof(MYSQL));
-  if (con == NULL)
-    return 1;
+    /* FNV-1a */
+    hash = 2166136261U;
+    for (size_t j = 0; j < keylen; j++)
+      hash = (hash ^ (unsigned char) key[j]) * 16777619U;
 
-  db_mysql_con->mysql = con;
+    return hash % nendpoints;
 
-  DEBUG("mysql_init(%p)", con);
-  mysql_init(con);
+  case BALANCE_LEAST_OUTSTANDING:
+    /*
+      Pick the endpoint with the fewest queries in flight, then the fewest
+      open sessions. Start scanning at a rotating position to break ties.
+    */
+    pthread_mutex_lock(&balance_mutex);
+    best = rr_pos;
+    rr_pos = (rr_pos + 1) % nendpoints;
+    pthread_mutex_unlock(&balance_mutex);
 
-  pthread_mutex_lock(&pos_mutex);
+    for (unsigned int k = 1; k < nendpoints; k++)
+    {
+      const mysql_endpoint_t *a = endpoints + (best + k) % nendpoints;
+      const mysql_endpoint_t *b = endpoints + best;
+      const uint64_t a_out = ck_pr_load_64(&a->outstanding);
+      const uint64_t b_out = ck_pr_load_64(&b->outstanding);
+
+      if (a_out < b_out ||
+          (a_out == b_out &&
+           ck_pr_load_64(&a->sessions) < ck_pr_load_64(&b->sessions)))
+        best = (best + k) % nendpoints;
+    }
 
-  if (SB_LIST_IS_EMPTY(args.sockets))
-  {
-    db_mysql_con->socket = NULL;
-    db_mysql_con->host = SB_LIST_ENTRY(hosts_pos, value_t, listitem)->data;
-    db_mysql_con->port =
-      atoi(SB_LIST_ENTRY(ports_pos, value_t, listitem)->data);
+    return best;
 
-    /*
-       Pick the next port in args.ports. If there are no more ports in the list,
-       move to the next available host and get the first port again.
-    */
-    ports_pos = SB_LIST_ITEM_NEXT(ports_pos);
-    if (ports_pos == args.ports) {
-      hosts_pos = SB_LIST_ITEM_NEXT(hosts_pos);
-      if (hosts_pos == args.hosts)
-        hosts_pos = SB_LIST_ITEM_NEXT(hosts_pos);
+  case BALANCE_WEIGHTED:
+    /* Smooth weighted round-robin */
+    pthread_mutex_lock(&balance_mutex);
+    total = 0;
+    for (i = 0; i < nendpoints; i++)
+    {
+      endpoints[i].cur_weight += endpoints[i].weight;
+      total += endpoints[i].weight;
 
-      ports_pos = SB_LIST_ITEM_NEXT(ports_pos);
+      if (endpoints[i].cur_weight > endpoints[best].cur_weight)
+        best = i;
     }
-  }
-  else
-  {
-    db_mysql_con->host = "localhost";
+    endpoints[best].cur_weight -= total;
+    pthread_mutex_unlock(&balance_mutex);
 
-    /*
-       The sockets list may be empty. So unlike hosts/ports the loop invariant
-       here is that sockets_pos points to the previous one and should be
-       advanced before using it, not after.
-     */
-    sockets_pos = SB_LIST_ITEM_NEXT(sockets_pos);
-    if (sockets_pos == args.sockets)
-      sockets_pos = SB_LIST_ITEM_NEXT(sockets_pos);
+    return best;
 
-    db_mysql_con->socket = SB_LIST_ENTRY(sockets_pos, value_t, listitem)->data;
+  case BALANCE_ROUND_ROBIN:
+    break;
   }
-  pthread_mutex_unlock(&pos_mutex);
 
-  db_mysql_con->user = args.user;
-  db_mysql_con->password = args.password;
-  db_mysql_con->db = args.db;
+  pthread_mutex_lock(&balance_mutex);
+  best = rr_pos;
+  rr_pos = (rr_pos + 1) % nendpoints;
+  pthread_mutex_unlock(&balance_mutex);
+
+  return best;
+}
+
+
+/*
+  Open a new session to a given endpoint and make it current. The previous
+  session is left intact.
+*/
+
+static int open_session(db_mysql_conn_t *db_mysql_con, mysql_endpoint_t *ep)
+{
+  MYSQL            * const prev_con = db_mysql_con->mysql;
+  mysql_endpoint_t * const prev_ep = db_mysql_con->ep;
+  MYSQL            *con;
+
+  con = (MYSQL *) malloc(sizeof(mysql_session_t));
+  if (con == NULL)
+    return 1;
+
+  DEBUG("mysql_init(%p)", con);
+  mysql_init(con);
+
+  db_mysql_con->mysql = con;
+  db_mysql_con->ep = ep;
 
   if (mysql_drv_real_connect(db_mysql_con))
   {
-    if (!SB_LIST_IS_EMPTY(args.sockets))
+    if (ep->socket != NULL)
       log_text(LOG_FATAL, "unable to connect to MySQL server on socket '%s', "
-               "aborting...", db_mysql_con->socket);
+               "aborting...", ep->socket);
     else
       log_text(LOG_FATAL, "unable to connect to MySQL server on host '%s', "
-               "port %u, aborting...",
-               db_mysql_con->host, db_mysql_con->port);
+               "port %u, aborting...", ep->host, ep->port);
     log_text(LOG_FATAL, "error %d: %s", mysql_errno(con),
              mysql_error(con));
-    free(db_mysql_con);
     free(con);
+
+    db_mysql_con->mysql = prev_con;
+    db_mysql_con->ep = prev_ep;
+
     return 1;
   }
 
@@ -523,72 +1004,206 @@ int mysql_drv_connect(db_conn_t *sb_conn)
           SAFESTR(mysql_get_ssl_cipher(con)));
   }
 
-  sb_conn->ptr = db_mysql_con;
+  ck_pr_inc_64(&ep->connects);
+  ck_pr_inc_64(&ep->sessions);
 
   return 0;
 }
 
 
-/* Disconnect from MySQL database */
-
+/* Close the current session */
 
-int mysql_drv_disconnect(db_conn_t *sb_conn)
+static void close_session(MYSQL *con, mysql_endpoint_t *ep)
 {
-  db_mysql_conn_t *db_mysql_con = sb_conn->ptr;
-
-  if (args.dry_run)
-    return 0;
-  if (db_mysql_con != NULL && db_mysql_con->mysql != NULL)
-  {
-    DEBUG("mysql_close(%p)", db_mysql_con->mysql);
-    mysql_close(db_mysql_con->mysql);
-    free(db_mysql_con->mysql);
-    free(db_mysql_con);
-  }
+  DEBUG("mysql_close(%p)", con);
+  mysql_close(con);
+  free(con);
 
-  return 0;
+  ck_pr_dec_64(&ep->sessions);
 }
 
 
-/* Prepare statement */
+/* Connect to MySQL database */
 
 
-int mysql_drv_prepare(db_stmt_t *stmt, const char *query, size_t len)
+int mysql_drv_connect(db_conn_t *sb_conn)
 {
-  MYSQL_STMT *mystmt;
-  unsigned int rc;
+  db_mysql_conn_t *db_mysql_con;
+  mysql_endpoint_t *ep;
 
   if (args.dry_run)
     return 0;
 
-  db_mysql_conn_t *db_mysql_con = (db_mysql_conn_t *) stmt->connection->ptr;
-  MYSQL      *con = db_mysql_con->mysql;
+  db_mysql_con = (db_mysql_conn_t *) calloc(1, sizeof(db_mysql_conn_t));
 
-  if (con == NULL)
+  if (db_mysql_con == NULL)
     return 1;
 
-  if (use_ps)
+  db_mysql_con->user = args.user;
+  db_mysql_con->password = args.password;
+  db_mysql_con->db = args.db;
+
+  if (args.balance_scope == BALANCE_SCOPE_TRANSACTION)
   {
-    mystmt = mysql_stmt_init(con);
-    DEBUG("mysql_stmt_init(%p) = %p", con, mystmt);
-    if (mystmt == NULL)
+    db_mysql_con->sessions = calloc(nendpoints, sizeof(MYSQL *));
+    if (db_mysql_con->sessions == NULL)
     {
-      log_text(LOG_FATAL, "mysql_stmt_init() failed");
+      free(db_mysql_con);
       return 1;
     }
-    stmt->ptr = (void *)mystmt;
-    DEBUG("mysql_stmt_prepare(%p, \"%s\", %u) = %p", mystmt, query,
-          (unsigned int) len, stmt->ptr);
-    if (mysql_stmt_prepare(mystmt, query, len))
-    {
-      /* Check if this statement in not supported */
-      rc = mysql_errno(con);
-      DEBUG("mysql_errno(%p) = %u", con, rc);
+  }
+
+  ep = endpoints + pick_endpoint(sb_conn, NULL, 0);
+
+  if (open_session(db_mysql_con, ep))
+  {
+    free(db_mysql_con->sessions);
+    free(db_mysql_con);
+    return 1;
+  }
+
+  if (db_mysql_con->sessions != NULL)
+    db_mysql_con->sessions[ep - endpoints] = db_mysql_con->mysql;
+
+  sb_conn->ptr = db_mysql_con;
+
+  return 0;
+}
+
+
+/* Disconnect from MySQL database */
+
+
+int mysql_drv_disconnect(db_conn_t *sb_conn)
+{
+  db_mysql_conn_t *db_mysql_con = sb_conn->ptr;
+
+  if (args.dry_run)
+    return 0;
+  if (db_mysql_con != NULL && db_mysql_con->mysql != NULL)
+  {
+    if (db_mysql_con->sessions != NULL)
+    {
+      for (unsigned int i = 0; i < nendpoints; i++)
+      {
+        if (db_mysql_con->sessions[i] != NULL)
+          close_session(db_mysql_con->sessions[i], endpoints + i);
+      }
+      free(db_mysql_con->sessions);
+    }
+    else
+      close_session(db_mysql_con->mysql, db_mysql_con->ep);
+#ifdef HAVE_MYSQL_NONBLOCK_API
+    free(db_mysql_con->async_query);
+#endif
+    free(db_mysql_con);
+  }
+
+  return 0;
+}
+
+
+/*
+  Allocate and bind result buffers of a prepared statement. All values are
+  fetched in the text format, like in results of non-prepared queries.
+*/
+
+static int bind_result_buffers(db_mysql_stmt_t *db_mysql_stmt)
+{
+  MYSQL_STMT  * const mystmt = db_mysql_stmt->stmt;
+  MYSQL_RES   *meta;
+  MYSQL_FIELD *fields;
+  unsigned int n;
+  int         rc = 1;
+
+  meta = mysql_stmt_result_metadata(mystmt);
+  DEBUG("mysql_stmt_result_metadata(%p) = %p", mystmt, meta);
+  if (meta == NULL)
+    return 1;
+
+  n = mysql_num_fields(meta);
+  fields = mysql_fetch_fields(meta);
+
+  db_mysql_stmt->nfields = n;
+  db_mysql_stmt->res_bind = calloc(n, sizeof(MYSQL_BIND));
+  db_mysql_stmt->res_buf = calloc(n, sizeof(char *));
+  db_mysql_stmt->res_len = calloc(n, sizeof(unsigned long));
+  db_mysql_stmt->res_null = calloc(n, sizeof(my_bool));
+  db_mysql_stmt->res_error = calloc(n, sizeof(my_bool));
+
+  if (db_mysql_stmt->res_bind == NULL || db_mysql_stmt->res_buf == NULL ||
+      db_mysql_stmt->res_len == NULL || db_mysql_stmt->res_null == NULL ||
+      db_mysql_stmt->res_error == NULL)
+    goto end;
+
+  for (unsigned int i = 0; i < n; i++)
+  {
+    MYSQL_BIND * const bind = db_mysql_stmt->res_bind + i;
+    const unsigned long len =
+      SB_MIN(SB_MAX(fields[i].length, 32UL), (unsigned long) RES_BUF_INIT_MAX);
+
+    if ((db_mysql_stmt->res_buf[i] = malloc(len)) == NULL)
+      goto end;
+
+    bind->buffer_type = MYSQL_TYPE_STRING;
+    bind->buffer = db_mysql_stmt->res_buf[i];
+    bind->buffer_length = len;
+    bind->length = db_mysql_stmt->res_len + i;
+    bind->is_null = db_mysql_stmt->res_null + i;
+    bind->error = db_mysql_stmt->res_error + i;
+  }
+
+  rc = mysql_stmt_bind_result(mystmt, db_mysql_stmt->res_bind);
+  DEBUG("mysql_stmt_bind_result(%p, %p) = %d", mystmt,
+        db_mysql_stmt->res_bind, rc);
+
+ end:
+  mysql_free_result(meta);
+
+  return rc;
+}
+
+
+/* Prepare statement */
+
+
+int mysql_drv_prepare(db_stmt_t *stmt, const char *query, size_t len)
+{
+  MYSQL_STMT *mystmt;
+  unsigned int rc;
+
+  if (args.dry_run)
+    return 0;
+
+  db_mysql_conn_t *db_mysql_con = (db_mysql_conn_t *) stmt->connection->ptr;
+  MYSQL      *con = db_mysql_con->mysql;
+
+  if (con == NULL)
+    return 1;
+
+  if (use_ps)
+  {
+    mystmt = mysql_stmt_init(con);
+    DEBUG("mysql_stmt_init(%p) = %p", con, mystmt);
+    if (mystmt == NULL)
+    {
+      log_text(LOG_FATAL, "mysql_stmt_init() failed");
+      return 1;
+    }
+    DEBUG("mysql_stmt_prepare(%p, \"%s\", %u)", mystmt, query,
+          (unsigned int) len);
+    if (mysql_stmt_prepare(mystmt, query, len))
+    {
+      /* Check if this statement in not supported */
+      rc = mysql_errno(con);
+      DEBUG("mysql_errno(%p) = %u", con, rc);
       if (rc == ER_UNSUPPORTED_PS)
       {
         log_text(LOG_INFO,
                  "Failed to prepare query \"%s\" (%d: %s), using emulation",
                  query, rc, mysql_error(con));
+        DEBUG("mysql_stmt_close(%p)", mystmt);
+        mysql_stmt_close(mystmt);
         goto emulate;
       }
       else
@@ -602,10 +1217,40 @@ int mysql_drv_prepare(db_stmt_t *stmt, const char *query, size_t len)
       }
     }
 
+    db_mysql_stmt_t *db_mysql_stmt = calloc(1, sizeof(db_mysql_stmt_t));
+    if (db_mysql_stmt == NULL)
+    {
+      mysql_stmt_close(mystmt);
+      return 1;
+    }
+
+    db_mysql_stmt->stmt = mystmt;
+    stmt->ptr = db_mysql_stmt;
+
+    db_mysql_stmt->param_count = mysql_stmt_param_count(mystmt);
+    DEBUG("mysql_stmt_param_count(%p) = %lu", mystmt,
+          db_mysql_stmt->param_count);
+    if (db_mysql_stmt->param_count > 0 &&
+        (db_mysql_stmt->param_bind =
+         calloc(db_mysql_stmt->param_count, sizeof(MYSQL_BIND))) == NULL)
+    {
+      /* db_prepare() does not close statements that failed to prepare */
+      mysql_drv_close(stmt);
+      return 1;
+    }
+
     stmt->query = strdup(query);
     stmt->counter = (mysql_stmt_field_count(mystmt) > 0) ?
       SB_CNT_READ : SB_CNT_WRITE;
 
+    if (stmt->counter == SB_CNT_READ && bind_result_buffers(db_mysql_stmt))
+    {
+      log_text(LOG_FATAL, "failed to allocate result buffers for query \"%s\"",
+               query);
+      mysql_drv_close(stmt);
+      return 1;
+    }
+
     return 0;
   }
 
@@ -615,7 +1260,7 @@ int mysql_drv_prepare(db_stmt_t *stmt, const char *query, size_t len)
   stmt->emulated = 1;
   stmt->query = strdup(query);
 
-  return 0;
+  return stmt->query == NULL;
 }
 
 
@@ -648,7 +1293,6 @@ int mysql_drv_bind_param(db_stmt_t *stmt, db_bind_t *params, size_t len)
   MYSQL_BIND   *bind;
   unsigned int i;
   my_bool rc;
-  unsigned long param_count;
 
   if (args.dry_run)
     return 0;
@@ -663,42 +1307,46 @@ int mysql_drv_bind_param(db_stmt_t *stmt, db_bind_t *params, size_t len)
   {
     if (stmt->ptr == NULL)
       return 1;
+
+    db_mysql_stmt_t *db_mysql_stmt = stmt->ptr;
+    MYSQL_STMT      *mystmt = db_mysql_stmt->stmt;
+
     /* Validate parameters count */
-    param_count = mysql_stmt_param_count(stmt->ptr);
-    DEBUG("mysql_stmt_param_count(%p) = %lu", stmt->ptr, param_count);
-    if (param_count != len)
+    if (db_mysql_stmt->param_count != len)
     {
       log_text(LOG_FATAL, "Wrong number of parameters to mysql_stmt_bind_param");
       return 1;
     }
     /* Convert sysbench bind structures to MySQL ones */
-    bind = (MYSQL_BIND *)calloc(len, sizeof(MYSQL_BIND));
-    if (bind == NULL)
-      return 1;
+    bind = db_mysql_stmt->param_bind;
     for (i = 0; i < len; i++)
+    {
+      memset(&bind[i], 0, sizeof(MYSQL_BIND));
       convert_to_mysql_bind(&bind[i], &params[i]);
+    }
 
-    rc = mysql_stmt_bind_param(stmt->ptr, bind);
-    DEBUG("mysql_stmt_bind_param(%p, %p) = %d", stmt->ptr, bind, rc);
+    rc = mysql_stmt_bind_param(mystmt, bind);
+    DEBUG("mysql_stmt_bind_param(%p, %p) = %d", mystmt, bind, rc);
     if (rc)
     {
       log_text(LOG_FATAL, "mysql_stmt_bind_param() failed");
       log_text(LOG_FATAL, "MySQL error: %d \"%s\"", mysql_errno(con),
                  mysql_error(con));
-      free(bind);
       return 1;
     }
-    free(bind);
 
     return 0;
   }
 
   /* Use emulation */
-  if (stmt->bound_param != NULL)
-    free(stmt->bound_param);
-  stmt->bound_param = (db_bind_t *)malloc(len * sizeof(db_bind_t));
-  if (stmt->bound_param == NULL)
-    return 1;
+  if (stmt->bound_param == NULL || stmt->bound_param_len != len)
+  {
+    db_bind_t *bound_param = realloc(stmt->bound_param,
+                                     len * sizeof(db_bind_t));
+    if (bound_param == NULL)
+      return 1;
+    stmt->bound_param = bound_param;
+  }
   memcpy(stmt->bound_param, params, len * sizeof(db_bind_t));
   stmt->bound_param_len = len;
 
@@ -725,21 +1373,37 @@ int mysql_drv_bind_result(db_stmt_t *stmt, db_bind_t *params, size_t len)
   if (con == NULL || stmt->ptr == NULL)
     return 1;
 
-  /* Convert sysbench bind structures to MySQL ones */
-  bind = (MYSQL_BIND *)calloc(len, sizeof(MYSQL_BIND));
-  if (bind == NULL)
+  db_mysql_stmt_t *db_mysql_stmt = stmt->ptr;
+
+  if (len != db_mysql_stmt->nfields)
+  {
+    log_text(LOG_FATAL, "Wrong number of results to mysql_stmt_bind_result");
     return 1;
+  }
+
+  /* The number of results is fixed, so the arrays are allocated only once */
+  if (db_mysql_stmt->user_res_bind == NULL &&
+      (db_mysql_stmt->user_res_bind = malloc(len * sizeof(MYSQL_BIND))) == NULL)
+    return 1;
+
+  /* Convert sysbench bind structures to MySQL ones */
+  bind = db_mysql_stmt->user_res_bind;
   for (i = 0; i < len; i++)
+  {
+    memset(&bind[i], 0, sizeof(MYSQL_BIND));
     convert_to_mysql_bind(&bind[i], &params[i]);
+  }
 
-  rc = mysql_stmt_bind_result(stmt->ptr, bind);
-  DEBUG("mysql_stmt_bind_result(%p, %p) = %d", stmt->ptr, bind, rc);
+  rc = mysql_stmt_bind_result(db_mysql_stmt->stmt, bind);
+  DEBUG("mysql_stmt_bind_result(%p, %p) = %d", db_mysql_stmt->stmt, bind, rc);
   if (rc)
-  {
-    free(bind);
     return 1;
-  }
-  free(bind);
+
+  /* Fetched rows now refer to the caller's buffers */
+  if (db_mysql_stmt->user_bind == NULL &&
+      (db_mysql_stmt->user_bind = malloc(len * sizeof(db_bind_t))) == NULL)
+    return 1;
+  memcpy(db_mysql_stmt->user_bind, params, len * sizeof(db_bind_t));
 
   return 0;
 }
@@ -750,18 +1414,23 @@ static int mysql_drv_reconnect(db_conn_t *sb_con)
 {
   db_mysql_conn_t *db_mysql_con = (db_mysql_conn_t *) sb_con->ptr;
   MYSQL *con = db_mysql_con->mysql;
+  unsigned int attempt = 0;
 
   log_text(LOG_DEBUG, "Reconnecting");
 
   DEBUG("mysql_close(%p)", con);
   mysql_close(con);
 
+#ifdef HAVE_MYSQL_NONBLOCK_API
+  db_mysql_con->async_stage = ASYNC_NONE;
+#endif
+
   while (mysql_drv_real_connect(db_mysql_con))
   {
     if (sb_globals.error)
       return DB_ERROR_FATAL;
 
-    usleep(1000);
+    db_reconnect_backoff(attempt++);
   }
 
   log_text(LOG_DEBUG, "Reconnected");
@@ -844,207 +1513,840 @@ static db_error_t check_error(db_conn_t *sb_con, const char *func,
   return DB_ERROR_FATAL;
 }
 
-/* Execute prepared statement */
-
+/* Start tracking a query on a given endpoint */
 
-db_error_t mysql_drv_execute(db_stmt_t *stmt, db_result_t *rs)
+static inline uint64_t endpoint_query_start(mysql_endpoint_t *ep)
 {
-  db_conn_t       *con = stmt->connection;
-  char            *buf = NULL;
-  unsigned int    buflen = 0;
-  unsigned int    i, j, vcnt;
-  char            need_realloc;
-  int             n;
+  ck_pr_inc_64(&ep->outstanding);
 
-  if (args.dry_run)
-    return DB_ERROR_NONE;
+  return sb_clock_ns();
+}
 
-  con->sql_errno = 0;
-  con->sql_state = NULL;
-  con->sql_errmsg = NULL;
 
-  if (!stmt->emulated)
-  {
-    if (stmt->ptr == NULL)
-    {
-      log_text(LOG_DEBUG,
-               "ERROR: exiting mysql_drv_execute(), uninitialized statement");
-      return DB_ERROR_FATAL;
-    }
+/* Account a finished query in statistics of a given endpoint */
 
-    int err = mysql_stmt_execute(stmt->ptr);
-    DEBUG("mysql_stmt_execute(%p) = %d", stmt->ptr, err);
+static void endpoint_query_done(mysql_endpoint_t *ep, uint64_t start,
+                                db_error_t rc)
+{
+  const uint64_t ns = sb_clock_ns() - start;
+  uint64_t       max;
 
-    if (err)
-      return check_error(con, "mysql_stmt_execute()", stmt->query,
-                         &rs->counter);
+  ck_pr_dec_64(&ep->outstanding);
+  ck_pr_inc_64(&ep->queries);
+  ck_pr_add_64(&ep->sum_ns, ns);
 
-    if (stmt->counter != SB_CNT_READ)
-    {
-      rs->nrows = (uint32_t) mysql_stmt_affected_rows(stmt->ptr);
-      DEBUG("mysql_stmt_affected_rows(%p) = %u", stmt->ptr,
-            (unsigned) rs->nrows);
+  if (rc != DB_ERROR_NONE)
+    ck_pr_inc_64(&ep->errors);
 
-      rs->counter = (rs->nrows > 0) ? SB_CNT_WRITE : SB_CNT_OTHER;
+  max = ck_pr_load_64(&ep->max_ns);
+  while (ns > max && !ck_pr_cas_64_value(&ep->max_ns, max, ns, &max))
+    ;
 
-      return DB_ERROR_NONE;
-    }
+  sb_histogram_update_int(&ep->histogram, ns);
+}
 
-    err = mysql_stmt_store_result(stmt->ptr);
-    DEBUG("mysql_stmt_store_result(%p) = %d", stmt->ptr, err);
-    if (err)
-    {
-      return check_error(con, "mysql_stmt_store_result()", NULL,
-                         &rs->counter);
-    }
 
-    rs->counter = stmt->counter;
-    rs->nrows = (uint32_t) mysql_stmt_num_rows(stmt->ptr);
-    DEBUG("mysql_stmt_num_rows(%p) = %u", rs->statement->ptr,
-          (unsigned) (rs->nrows));
+/* Execute server-side prepared statement */
 
-    return DB_ERROR_NONE;
+static db_error_t execute_ps(db_stmt_t *stmt, db_result_t *rs)
+{
+  db_conn_t       *con = stmt->connection;
+
+  if (stmt->ptr == NULL)
+  {
+    log_text(LOG_DEBUG,
+             "ERROR: exiting mysql_drv_execute(), uninitialized statement");
+    return DB_ERROR_FATAL;
   }
 
-  /* Use emulation */
-  /* Build the actual query string from parameters list */
-  need_realloc = 1;
-  vcnt = 0;
-  for (i = 0, j = 0; stmt->query[i] != '\0'; i++)
+  db_mysql_stmt_t *db_mysql_stmt = stmt->ptr;
+  MYSQL_STMT      *mystmt = db_mysql_stmt->stmt;
+
+  int err = mysql_stmt_execute(mystmt);
+  DEBUG("mysql_stmt_execute(%p) = %d", mystmt, err);
+
+  if (err)
+    return check_error(con, "mysql_stmt_execute()", stmt->query,
+                       &rs->counter);
+
+  if (stmt->counter != SB_CNT_READ)
   {
-  again:
-    if (j+1 >= buflen || need_realloc)
-    {
-      buflen = (buflen > 0) ? buflen * 2 : 256;
-      buf = realloc(buf, buflen);
-      if (buf == NULL)
-      {
-        log_text(LOG_DEBUG, "ERROR: exiting mysql_drv_execute(), memory allocation failure");
-        return DB_ERROR_FATAL;
-      }
-      need_realloc = 0;
-    }
+    rs->nrows = (uint32_t) mysql_stmt_affected_rows(mystmt);
+    DEBUG("mysql_stmt_affected_rows(%p) = %u", mystmt,
+          (unsigned) rs->nrows);
 
-    if (stmt->query[i] != '?')
-    {
-      buf[j++] = stmt->query[i];
-      continue;
-    }
+    rs->counter = (rs->nrows > 0) ? SB_CNT_WRITE : SB_CNT_OTHER;
 
-    n = db_print_value(stmt->bound_param + vcnt, buf + j, (int)(buflen - j));
-    if (n < 0)
-    {
-      need_realloc = 1;
-      goto again;
-    }
-    j += (unsigned int)n;
-    vcnt++;
+    return DB_ERROR_NONE;
+  }
+
+  rs->counter = stmt->counter;
+  rs->nfields = db_mysql_stmt->nfields;
+
+  /* The number of rows is not known until all of them are fetched */
+  if (args.ps_stream)
+  {
+    rs->nrows = 0;
+    return DB_ERROR_NONE;
   }
-  buf[j] = '\0';
 
-  db_error_t rc = mysql_drv_query(con, buf, j, rs);
+  err = mysql_stmt_store_result(mystmt);
+  DEBUG("mysql_stmt_store_result(%p) = %d", mystmt, err);
+  if (err)
+  {
+    return check_error(con, "mysql_stmt_store_result()", NULL,
+                       &rs->counter);
+  }
 
-  free(buf);
+  rs->nrows = (uint32_t) mysql_stmt_num_rows(mystmt);
+  DEBUG("mysql_stmt_num_rows(%p) = %u", mystmt, (unsigned) (rs->nrows));
 
-  return rc;
+  return DB_ERROR_NONE;
 }
 
 
-/* Execute SQL query */
+/* Execute prepared statement */
 
 
-db_error_t mysql_drv_query(db_conn_t *sb_conn, const char *query, size_t len,
-                           db_result_t *rs)
+db_error_t mysql_drv_execute(db_stmt_t *stmt, db_result_t *rs)
 {
-  db_mysql_conn_t *db_mysql_con;
-  MYSQL *con;
+  db_conn_t       *con = stmt->connection;
+  char            *buf;
+  size_t          len;
 
   if (args.dry_run)
     return DB_ERROR_NONE;
 
-  sb_conn->sql_errno = 0;
-  sb_conn->sql_state = NULL;
-  sb_conn->sql_errmsg = NULL;
-
-  db_mysql_con = (db_mysql_conn_t *)sb_conn->ptr;
-  con = db_mysql_con->mysql;
-
-  int err = mysql_real_query(con, query, len);
-  DEBUG("mysql_real_query(%p, \"%s\", %zd) = %d", con, query, len, err);
-
-  if (SB_UNLIKELY(err != 0))
-    return check_error(sb_conn, "mysql_drv_query()", query, &rs->counter);
-
-  /* Store results and get query type */
-  MYSQL_RES *res = mysql_store_result(con);
-  DEBUG("mysql_store_result(%p) = %p", con, res);
+  con->sql_errno = 0;
+  con->sql_state = NULL;
+  con->sql_errmsg = NULL;
 
-  if (res == NULL)
+  if (!stmt->emulated)
   {
-    if (mysql_errno(con) == 0 && mysql_field_count(con) == 0)
-    {
-      /* Not a select. Check if it was a DML */
-      uint32_t nrows = (uint32_t) mysql_affected_rows(con);
-      if (nrows > 0)
-      {
-        rs->counter = SB_CNT_WRITE;
-        rs->nrows = nrows;
-      }
-      else
-        rs->counter = SB_CNT_OTHER;
+    if (!ep_stats)
+      return execute_ps(stmt, rs);
 
-      return DB_ERROR_NONE;
-    }
+    mysql_endpoint_t * const ep = ((db_mysql_conn_t *) con->ptr)->ep;
+    const uint64_t           start = endpoint_query_start(ep);
+    const db_error_t         rc = execute_ps(stmt, rs);
 
-    return check_error(sb_conn, "mysql_store_result()", NULL, &rs->counter);
+    endpoint_query_done(ep, start, rc);
+
+    return rc;
   }
 
-  rs->counter = SB_CNT_READ;
-  rs->ptr = (void *)res;
+  /* Use emulation */
+  if ((buf = db_build_query(stmt, &len)) == NULL)
+    return DB_ERROR_FATAL;
 
-  rs->nrows = mysql_num_rows(res);
-  DEBUG("mysql_num_rows(%p) = %u", res, (unsigned int) rs->nrows);
+  return mysql_drv_query(con, buf, len, rs);
+}
 
-  rs->nfields = mysql_num_fields(res);
-  DEBUG("mysql_num_fields(%p) = %u", res, (unsigned int) rs->nfields);
 
-  return DB_ERROR_NONE;
-}
+/* Check if a query starts a transaction */
 
+static bool is_trx_start(const char *query, size_t len)
+{
+  size_t i = 0;
 
-/* Fetch row from result set of a prepared statement */
+  while (i < len && isspace((unsigned char) query[i]))
+    i++;
 
+  query += i;
+  len -= i;
 
-int mysql_drv_fetch(db_result_t *rs)
-{
-  /* NYI */
-  (void)rs;  /* unused */
+  if (len >= 5 && !strncasecmp(query, "BEGIN", 5))
+    return len == 5 || !isalnum((unsigned char) query[5]);
 
-  if (args.dry_run)
-    return DB_ERROR_NONE;
+  if (len >= 17 && !strncasecmp(query, "START TRANSACTION", 17))
+    return len == 17 || !isalnum((unsigned char) query[17]);
 
-  return 1;
+  return false;
 }
 
-/* Fetch row from result set of a query */
 
-int mysql_drv_fetch_row(db_result_t *rs, db_row_t *row)
+/*
+  Find the affinity key of a query for --mysql-balance=affinity, i.e. the name
+  of the first table following FROM, INTO, UPDATE or JOIN. Return NULL if
+  there is no such name.
+*/
+
+static const char *get_affinity_key(const char *query, size_t len,
+                                    size_t *keylen)
 {
-  MYSQL_ROW my_row;
+  static const char * const keywords[] = { "FROM", "INTO", "UPDATE", "JOIN" };
+  size_t i = 0;
 
-  if (args.dry_run)
-    return DB_ERROR_NONE;
+#define IS_IDENT_CHAR(c) (isalnum((unsigned char) (c)) || (c) == '_' ||  \
+                          (c) == '$' || (c) == '.' || (c) == '`')
 
-  my_row = mysql_fetch_row(rs->ptr);
-  DEBUG("mysql_fetch_row(%p) = %p", rs->ptr, my_row);
+  while (i < len)
+  {
+    size_t start, wlen;
 
-  unsigned long *lengths = mysql_fetch_lengths(rs->ptr);
-  DEBUG("mysql_fetch_lengths(%p) = %p", rs->ptr, lengths);
+    while (i < len && !IS_IDENT_CHAR(query[i]))
+      i++;
+    start = i;
+    while (i < len && IS_IDENT_CHAR(query[i]))
+      i++;
+    wlen = i - start;
 
-  if (lengths == NULL)
-    return DB_ERROR_IGNORABLE;
+    for (size_t k = 0; k < sizeof(keywords) / sizeof(keywords[0]); k++)
+    {
+      if (wlen != strlen(keywords[k]) ||
+          strncasecmp(query + start, keywords[k], wlen))
+        continue;
 
-  for (size_t i = 0; i < rs->nfields; i++)
+      while (i < len && isspace((unsigned char) query[i]))
+        i++;
+      start = i;
+      while (i < len && IS_IDENT_CHAR(query[i]))
+        i++;
+
+      if (i == start)
+        return NULL;
+
+      *keylen = i - start;
+      return query + start;
+    }
+  }
+
+#undef IS_IDENT_CHAR
+
+  return NULL;
+}
+
+
+/*
+  Make the session to a given endpoint current, opening it on the first use.
+  Only used with --mysql-balance-scope=transaction.
+*/
+
+static int switch_endpoint(db_mysql_conn_t *db_mysql_con, unsigned int idx)
+{
+  mysql_endpoint_t * const ep = endpoints + idx;
+
+  if (db_mysql_con->ep == ep)
+    return 0;
+
+  if (db_mysql_con->sessions[idx] == NULL)
+  {
+    if (open_session(db_mysql_con, ep))
+      return 1;
+
+    db_mysql_con->sessions[idx] = db_mysql_con->mysql;
+
+    return 0;
+  }
+
+  db_mysql_con->mysql = db_mysql_con->sessions[idx];
+  db_mysql_con->ep = ep;
+
+  return 0;
+}
+
+
+/*
+  Execute a query. Streamed results are read row by row with mysql_use_result()
+  rather than stored on the client with mysql_store_result().
+*/
+
+static db_error_t real_query(db_conn_t *sb_conn, const char *query,
+                             size_t len, db_result_t *rs, bool stream)
+{
+  db_mysql_conn_t *db_mysql_con = (db_mysql_conn_t *) sb_conn->ptr;
+  MYSQL           *con = db_mysql_con->mysql;
+
+  int err = mysql_real_query(con, query, len);
+  DEBUG("mysql_real_query(%p, \"%s\", %zd) = %d", con, query, len, err);
+
+  if (SB_UNLIKELY(err != 0))
+    return check_error(sb_conn, "mysql_drv_query()", query, &rs->counter);
+
+  /* Store results and get query type */
+  MYSQL_RES *res = stream ? mysql_use_result(con) : mysql_store_result(con);
+  DEBUG("%s(%p) = %p", stream ? "mysql_use_result" : "mysql_store_result",
+        con, res);
+
+  return process_result(sb_conn, res, rs);
+}
+
+
+/* Execute a query on the current endpoint, accounting it in statistics */
+
+static db_error_t endpoint_query(db_conn_t *sb_conn, const char *query,
+                                 size_t len, db_result_t *rs, bool stream)
+{
+  if (!ep_stats)
+    return real_query(sb_conn, query, len, rs, stream);
+
+  mysql_endpoint_t * const ep = ((db_mysql_conn_t *) sb_conn->ptr)->ep;
+  const uint64_t           start = endpoint_query_start(ep);
+  const db_error_t         rc = real_query(sb_conn, query, len, rs, stream);
+
+  endpoint_query_done(ep, start, rc);
+
+  return rc;
+}
+
+
+/*
+  Pick an endpoint for a new transaction with --mysql-balance-scope=transaction.
+  With --mysql-balance=affinity BEGIN is deferred until the first statement of
+  the transaction is known. Returns DB_ERROR_NONE if the query must be executed
+  on the current endpoint, or DB_ERROR_IGNORABLE if the query has been handled.
+*/
+
+static db_error_t balance_transaction(db_conn_t *sb_conn, const char *query,
+                                      size_t len, db_result_t *rs)
+{
+  db_mysql_conn_t * const db_mysql_con = (db_mysql_conn_t *) sb_conn->ptr;
+  const char             *key;
+  size_t                 keylen = 0;
+  db_error_t             rc;
+
+  if (is_trx_start(query, len))
+  {
+    if (args.balance == BALANCE_AFFINITY)
+    {
+      db_mysql_con->pending_begin = true;
+      rs->counter = SB_CNT_OTHER;
+      rs->nrows = 0;
+
+      return DB_ERROR_IGNORABLE;
+    }
+
+    if (switch_endpoint(db_mysql_con, pick_endpoint(sb_conn, NULL, 0)))
+    {
+      rs->counter = SB_CNT_ERROR;
+      return DB_ERROR_FATAL;
+    }
+
+    return DB_ERROR_NONE;
+  }
+
+  if (!db_mysql_con->pending_begin)
+    return DB_ERROR_NONE;
+
+  db_mysql_con->pending_begin = false;
+
+  key = get_affinity_key(query, len, &keylen);
+
+  if (switch_endpoint(db_mysql_con, pick_endpoint(sb_conn, key, keylen)))
+  {
+    rs->counter = SB_CNT_ERROR;
+    return DB_ERROR_FATAL;
+  }
+
+  rc = endpoint_query(sb_conn, "BEGIN", 5, rs, false);
+
+  return rc == DB_ERROR_IGNORABLE ? DB_ERROR_NONE : rc;
+}
+
+
+/* Execute SQL query */
+
+
+static db_error_t run_query(db_conn_t *sb_conn, const char *query, size_t len,
+                            db_result_t *rs, bool stream)
+{
+  if (args.dry_run)
+    return DB_ERROR_NONE;
+
+  sb_conn->sql_errno = 0;
+  sb_conn->sql_state = NULL;
+  sb_conn->sql_errmsg = NULL;
+
+  if (SB_UNLIKELY(args.balance_scope == BALANCE_SCOPE_TRANSACTION))
+  {
+    const db_error_t rc = balance_transaction(sb_conn, query, len, rs);
+
+    if (rc == DB_ERROR_IGNORABLE)
+      return DB_ERROR_NONE;
+    if (rc != DB_ERROR_NONE)
+      return rc;
+  }
+
+  return endpoint_query(sb_conn, query, len, rs, stream);
+}
+
+
+db_error_t mysql_drv_query(db_conn_t *sb_conn, const char *query, size_t len,
+                           db_result_t *rs)
+{
+  return run_query(sb_conn, query, len, rs, false);
+}
+
+
+/* Execute SQL query and stream its result set */
+
+
+db_error_t mysql_drv_query_stream(db_conn_t *sb_conn, const char *query,
+                                  size_t len, db_result_t *rs)
+{
+  return run_query(sb_conn, query, len, rs, true);
+}
+
+
+/* Get query type and result set properties from a stored result */
+
+
+static db_error_t process_result(db_conn_t *sb_conn, MYSQL_RES *res,
+                                 db_result_t *rs)
+{
+  MYSQL *con = ((db_mysql_conn_t *) sb_conn->ptr)->mysql;
+
+  if (res == NULL)
+  {
+    if (mysql_errno(con) == 0 && mysql_field_count(con) == 0)
+    {
+      /* Not a select. Check if it was a DML */
+      uint32_t nrows = (uint32_t) mysql_affected_rows(con);
+      if (nrows > 0)
+      {
+        rs->counter = SB_CNT_WRITE;
+        rs->nrows = nrows;
+      }
+      else
+        rs->counter = SB_CNT_OTHER;
+
+      return DB_ERROR_NONE;
+    }
+
+    return check_error(sb_conn, "mysql_store_result()", NULL, &rs->counter);
+  }
+
+  rs->counter = SB_CNT_READ;
+  rs->ptr = (void *)res;
+
+  rs->nrows = mysql_num_rows(res);
+  DEBUG("mysql_num_rows(%p) = %u", res, (unsigned int) rs->nrows);
+
+  rs->nfields = mysql_num_fields(res);
+  DEBUG("mysql_num_fields(%p) = %u", res, (unsigned int) rs->nfields);
+
+  return DB_ERROR_NONE;
+}
+
+
+#ifdef HAVE_MYSQL_NONBLOCK_API
+
+/*
+  Asynchronous queries use the non-blocking API of the client library, so at
+  most one query per connection can be in flight.
+*/
+
+static int async_start(db_conn_t *sb_conn, const char *query, size_t len)
+{
+  db_mysql_conn_t *db_mysql_con = (db_mysql_conn_t *) sb_conn->ptr;
+  MYSQL           *con;
+
+  if (db_mysql_con->async_stage != ASYNC_NONE)
+  {
+    log_text(LOG_ALERT, "the MySQL driver supports only one asynchronous "
+             "query per connection");
+    return 1;
+  }
+
+  /*
+    Pick an endpoint like synchronous queries do. Nothing is in flight at this
+    point, so the current session can be switched.
+  */
+  if (SB_UNLIKELY(args.balance_scope == BALANCE_SCOPE_TRANSACTION))
+  {
+    db_result_t      rs;
+    const db_error_t rc = balance_transaction(sb_conn, query, len, &rs);
+
+    if (rc == DB_ERROR_IGNORABLE)
+    {
+      db_mysql_con->async_stage = ASYNC_DEFERRED;
+      return 0;
+    }
+    if (rc != DB_ERROR_NONE)
+      return 1;
+  }
+
+  con = db_mysql_con->mysql;
+
+  /* Copy the query to a per-connection buffer which only grows when needed */
+  if (len + 1 > db_mysql_con->async_buflen)
+  {
+    char *buf = realloc(db_mysql_con->async_query, len + 1);
+    if (buf == NULL)
+      return 1;
+    db_mysql_con->async_query = buf;
+    db_mysql_con->async_buflen = len + 1;
+  }
+  memcpy(db_mysql_con->async_query, query, len);
+  db_mysql_con->async_query[len] = '\0';
+
+  db_mysql_con->async_res = NULL;
+  db_mysql_con->async_stage = ASYNC_QUERY;
+
+  if (ep_stats)
+  {
+    db_mysql_con->async_ep = db_mysql_con->ep;
+    db_mysql_con->async_start_ns = endpoint_query_start(db_mysql_con->ep);
+  }
+
+  set_nonblock(con);
+
+  db_mysql_con->async_status =
+    mysql_real_query_start(&db_mysql_con->async_err, con,
+                           db_mysql_con->async_query, len);
+  DEBUG("mysql_real_query_start(%p, \"%s\", %zd) = %d", con,
+        db_mysql_con->async_query, len, db_mysql_con->async_status);
+
+  return 0;
+}
+
+
+/*
+  Move the in-flight query to the next stage once the current non-blocking call
+  has completed
+*/
+
+static void async_next_stage(db_mysql_conn_t *db_mysql_con)
+{
+  MYSQL *con = db_mysql_con->mysql;
+
+  if (db_mysql_con->async_status != 0)
+    return;
+
+  if (db_mysql_con->async_stage == ASYNC_QUERY && !db_mysql_con->async_err)
+  {
+    db_mysql_con->async_stage = ASYNC_STORE;
+    db_mysql_con->async_status =
+      mysql_store_result_start(&db_mysql_con->async_res, con);
+    DEBUG("mysql_store_result_start(%p) = %d", con,
+          db_mysql_con->async_status);
+
+    if (db_mysql_con->async_status != 0)
+      return;
+  }
+
+  db_mysql_con->async_stage = ASYNC_DONE;
+}
+
+
+/*
+  Continue the in-flight query, waiting for socket events up to timeout
+  milliseconds. Returns 1 when results can be reaped, 0 on timeout.
+*/
+
+static int async_wait(db_mysql_conn_t *db_mysql_con, int timeout)
+{
+  MYSQL         *con = db_mysql_con->mysql;
+  struct pollfd pfd;
+  int           rc, ready;
+
+  if (db_mysql_con->async_stage == ASYNC_NONE ||
+      db_mysql_con->async_stage == ASYNC_DEFERRED)
+    return 1;
+
+  for (async_next_stage(db_mysql_con);
+       db_mysql_con->async_stage != ASYNC_DONE;
+       async_next_stage(db_mysql_con))
+  {
+    const int status = db_mysql_con->async_status;
+
+    pfd.fd = mysql_get_socket(con);
+    pfd.events = ((status & MYSQL_WAIT_READ) ? POLLIN : 0) |
+      ((status & MYSQL_WAIT_WRITE) ? POLLOUT : 0) |
+      ((status & MYSQL_WAIT_EXCEPT) ? POLLPRI : 0);
+
+    rc = poll(&pfd, 1, timeout);
+    if (rc < 0 && errno == EINTR)
+      continue;
+    if (rc == 0)
+      return 0;
+
+    /* Let the client library detect and report socket errors */
+    ready = (rc < 0 || (pfd.revents & (POLLERR | POLLHUP))) ? status : 0;
+    if (pfd.revents & POLLIN)
+      ready |= MYSQL_WAIT_READ;
+    if (pfd.revents & POLLOUT)
+      ready |= MYSQL_WAIT_WRITE;
+    if (pfd.revents & POLLPRI)
+      ready |= MYSQL_WAIT_EXCEPT;
+
+    if (db_mysql_con->async_stage == ASYNC_QUERY)
+      db_mysql_con->async_status =
+        mysql_real_query_cont(&db_mysql_con->async_err, con, ready);
+    else
+      db_mysql_con->async_status =
+        mysql_store_result_cont(&db_mysql_con->async_res, con, ready);
+  }
+
+  return 1;
+}
+
+
+/* Send SQL query without waiting for its result */
+
+
+int mysql_drv_send_query(db_conn_t *sb_conn, const char *query, size_t len)
+{
+  if (args.dry_run)
+    return 0;
+
+  return async_start(sb_conn, query, len);
+}
+
+
+/* Send prepared statement without waiting for its result */
+
+
+int mysql_drv_send_execute(db_stmt_t *stmt)
+{
+  char   *buf;
+  size_t len;
+
+  if (args.dry_run)
+    return 0;
+
+  if (!stmt->emulated)
+  {
+    log_text(LOG_ALERT, "the MySQL driver does not support asynchronous "
+             "execution of server-side prepared statements");
+    return 1;
+  }
+
+  if ((buf = db_build_query(stmt, &len)) == NULL)
+    return 1;
+
+  return async_start(stmt->connection, buf, len);
+}
+
+
+/* Check if the in-flight query can be reaped without blocking */
+
+
+int mysql_drv_poll(db_conn_t *sb_conn, int *fd, short *events)
+{
+  db_mysql_conn_t *db_mysql_con = (db_mysql_conn_t *) sb_conn->ptr;
+  int             status;
+
+  if (args.dry_run || async_wait(db_mysql_con, 0))
+    return 1;
+
+  status = db_mysql_con->async_status;
+
+  *fd = mysql_get_socket(db_mysql_con->mysql);
+  *events = ((status & MYSQL_WAIT_READ) ? POLLIN : 0) |
+    ((status & MYSQL_WAIT_WRITE) ? POLLOUT : 0) |
+    ((status & MYSQL_WAIT_EXCEPT) ? POLLPRI : 0);
+
+  return 0;
+}
+
+
+/* Wait for and reap the result of the in-flight query */
+
+
+db_error_t mysql_drv_reap(db_conn_t *sb_conn, db_result_t *rs)
+{
+  db_mysql_conn_t *db_mysql_con;
+  db_error_t      rc;
+
+  if (args.dry_run)
+  {
+    rs->counter = SB_CNT_OTHER;
+    return DB_ERROR_NONE;
+  }
+
+  sb_conn->sql_errno = 0;
+  sb_conn->sql_state = NULL;
+  sb_conn->sql_errmsg = NULL;
+
+  db_mysql_con = (db_mysql_conn_t *) sb_conn->ptr;
+
+  if (db_mysql_con->async_stage == ASYNC_DEFERRED)
+  {
+    db_mysql_con->async_stage = ASYNC_NONE;
+    rs->counter = SB_CNT_OTHER;
+    rs->nrows = 0;
+
+    return DB_ERROR_NONE;
+  }
+
+  async_wait(db_mysql_con, -1);
+  db_mysql_con->async_stage = ASYNC_NONE;
+
+  if (SB_UNLIKELY(db_mysql_con->async_err != 0))
+    rc = check_error(sb_conn, "mysql_real_query_cont()",
+                     db_mysql_con->async_query, &rs->counter);
+  else
+  {
+    DEBUG("mysql_store_result_cont(%p) = %p", db_mysql_con->mysql,
+          db_mysql_con->async_res);
+
+    rc = process_result(sb_conn, db_mysql_con->async_res, rs);
+  }
+
+  if (ep_stats)
+    endpoint_query_done(db_mysql_con->async_ep, db_mysql_con->async_start_ns,
+                        rc);
+
+  return rc;
+}
+
+#endif /* HAVE_MYSQL_NONBLOCK_API */
+
+
+/* Fetch row from result set of a prepared statement */
+
+
+int mysql_drv_fetch(db_result_t *rs)
+{
+  if (args.dry_run)
+    return DB_ERROR_NONE;
+
+  if (rs->statement == NULL || rs->statement->emulated)
+    return 1;
+
+  /* Values are stored in buffers passed to bind_result() */
+  MYSQL_STMT *mystmt = ((db_mysql_stmt_t *) rs->statement->ptr)->stmt;
+  int rc = mysql_stmt_fetch(mystmt);
+  DEBUG("mysql_stmt_fetch(%p) = %d", mystmt, rc);
+
+  return rc != 0 && rc != MYSQL_DATA_TRUNCATED;
+}
+
+/*
+  Fetch a truncated value into a larger buffer. The new buffer is also bound
+  to the statement for subsequent rows.
+*/
+
+static int fetch_truncated_column(db_mysql_stmt_t *db_mysql_stmt,
+                                  unsigned int i)
+{
+  MYSQL_BIND * const bind = db_mysql_stmt->res_bind + i;
+  const unsigned long len = db_mysql_stmt->res_len[i] + 1;
+  char        *buf;
+  int         rc;
+
+  if ((buf = realloc(db_mysql_stmt->res_buf[i], len)) == NULL)
+    return 1;
+
+  db_mysql_stmt->res_buf[i] = buf;
+  bind->buffer = buf;
+  bind->buffer_length = len;
+
+  rc = mysql_stmt_fetch_column(db_mysql_stmt->stmt, bind, i, 0);
+  DEBUG("mysql_stmt_fetch_column(%p, %p, %u, 0) = %d", db_mysql_stmt->stmt,
+        bind, i, rc);
+
+  return rc;
+}
+
+
+/* Fetch row from result set of a prepared statement */
+
+static int stmt_fetch_row(db_result_t *rs, db_row_t *row)
+{
+  db_mysql_stmt_t * const db_mysql_stmt = rs->statement->ptr;
+  MYSQL_STMT      * const mystmt = db_mysql_stmt->stmt;
+  bool            rebind = false;
+  int             rc;
+
+  rc = mysql_stmt_fetch(mystmt);
+  DEBUG("mysql_stmt_fetch(%p) = %d", mystmt, rc);
+
+  if (rc == MYSQL_NO_DATA)
+    return DB_ERROR_IGNORABLE;
+
+  if (rc == MYSQL_DATA_TRUNCATED && db_mysql_stmt->user_bind == NULL)
+  {
+    for (unsigned int i = 0; i < db_mysql_stmt->nfields; i++)
+    {
+      if (!db_mysql_stmt->res_error[i])
+        continue;
+
+      if (fetch_truncated_column(db_mysql_stmt, i))
+      {
+        log_text(LOG_FATAL, "mysql_stmt_fetch_column() failed: %s",
+                 mysql_stmt_error(mystmt));
+        return DB_ERROR_FATAL;
+      }
+      rebind = true;
+    }
+
+    if (rebind && mysql_stmt_bind_result(mystmt, db_mysql_stmt->res_bind))
+    {
+      log_text(LOG_FATAL, "mysql_stmt_bind_result() failed: %s",
+               mysql_stmt_error(mystmt));
+      return DB_ERROR_FATAL;
+    }
+  }
+  else if (rc != 0 && rc != MYSQL_DATA_TRUNCATED)
+  {
+    log_text(LOG_FATAL, "mysql_stmt_fetch() failed: %s",
+             mysql_stmt_error(mystmt));
+    return DB_ERROR_FATAL;
+  }
+
+  for (unsigned int i = 0; i < db_mysql_stmt->nfields; i++)
+  {
+    if (db_mysql_stmt->user_bind != NULL)
+    {
+      db_bind_t * const bind = db_mysql_stmt->user_bind + i;
+
+      row->values[i].ptr = (bind->is_null != NULL && *bind->is_null) ?
+        NULL : bind->buffer;
+      row->values[i].len = *bind->data_len;
+    }
+    else
+    {
+      row->values[i].ptr = db_mysql_stmt->res_null[i] ?
+        NULL : db_mysql_stmt->res_buf[i];
+      row->values[i].len = db_mysql_stmt->res_len[i];
+    }
+  }
+
+  return DB_ERROR_NONE;
+}
+
+/* Fetch row from result set of a query */
+
+int mysql_drv_fetch_row(db_result_t *rs, db_row_t *row)
+{
+  MYSQL_ROW my_row;
+
+  if (args.dry_run)
+    return DB_ERROR_NONE;
+
+  if (rs->statement != NULL && !rs->statement->emulated)
+    return stmt_fetch_row(rs, row);
+
+  my_row = mysql_fetch_row(rs->ptr);
+  DEBUG("mysql_fetch_row(%p) = %p", rs->ptr, my_row);
+
+  if (my_row == NULL)
+  {
+    /* Streamed results can fail while rows are being read */
+    db_conn_t * const sb_conn = SB_CONTAINER_OF(rs, db_conn_t, rs);
+    MYSQL     * const con = ((db_mysql_conn_t *) sb_conn->ptr)->mysql;
+
+    if (mysql_errno(con) == 0)
+      return DB_ERROR_IGNORABLE;
+
+    log_text(LOG_FATAL, "mysql_fetch_row() returned error %u (%s)",
+             mysql_errno(con), mysql_error(con));
+
+    return DB_ERROR_FATAL;
+  }
+
+  unsigned long *lengths = mysql_fetch_lengths(rs->ptr);
+  DEBUG("mysql_fetch_lengths(%p) = %p", rs->ptr, lengths);
+
+  if (lengths == NULL)
+    return DB_ERROR_IGNORABLE;
+
+  /* Streamed results only know the number of rows fetched so far */
+  rs->nrows = mysql_num_rows(rs->ptr);
+
+  for (size_t i = 0; i < rs->nfields; i++)
   {
     row->values[i].len = lengths[i];
     row->values[i].ptr = my_row[i];
@@ -1063,8 +2365,10 @@ int mysql_drv_free_results(db_result_t *rs)
   /* Is this a result set of a prepared statement? */
   if (rs->statement != NULL && rs->statement->emulated == 0)
   {
-    DEBUG("mysql_stmt_free_result(%p)", rs->statement->ptr);
-    mysql_stmt_free_result(rs->statement->ptr);
+    MYSQL_STMT *mystmt = ((db_mysql_stmt_t *) rs->statement->ptr)->stmt;
+
+    DEBUG("mysql_stmt_free_result(%p)", mystmt);
+    mysql_stmt_free_result(mystmt);
     rs->ptr = NULL;
   }
 
@@ -1096,8 +2400,25 @@ int mysql_drv_close(db_stmt_t *stmt)
   if (stmt->ptr == NULL)
     return 1;
 
-  int rc = mysql_stmt_close(stmt->ptr);
-  DEBUG("mysql_stmt_close(%p) = %d", stmt->ptr, rc);
+  db_mysql_stmt_t *db_mysql_stmt = stmt->ptr;
+
+  int rc = mysql_stmt_close(db_mysql_stmt->stmt);
+  DEBUG("mysql_stmt_close(%p) = %d", db_mysql_stmt->stmt, rc);
+
+  if (db_mysql_stmt->res_buf != NULL)
+  {
+    for (unsigned int i = 0; i < db_mysql_stmt->nfields; i++)
+      free(db_mysql_stmt->res_buf[i]);
+  }
+  free(db_mysql_stmt->res_buf);
+  free(db_mysql_stmt->res_bind);
+  free(db_mysql_stmt->res_len);
+  free(db_mysql_stmt->res_null);
+  free(db_mysql_stmt->res_error);
+  free(db_mysql_stmt->user_bind);
+  free(db_mysql_stmt->param_bind);
+  free(db_mysql_stmt->user_res_bind);
+  free(db_mysql_stmt);
 
   stmt->ptr = NULL;
 
@@ -1108,6 +2429,13 @@ int mysql_drv_close(db_stmt_t *stmt)
 /* Uninitialize driver */
 int mysql_drv_done(void)
 {
+  for (unsigned int i = 0; ep_stats && i < nendpoints; i++)
+    sb_histogram_done(&endpoints[i].histogram);
+
+  free(endpoints);
+  endpoints = NULL;
+  nendpoints = 0;
+
   if (args.dry_run)
     return 0;
 
@@ -1116,6 +2444,84 @@ int mysql_drv_done(void)
   return 0;
 }
 
+
+/* Print per-endpoint statistics for the last reporting interval */
+
+static void mysql_drv_report_intermediate(sb_stat_t *stat)
+{
+  const double seconds = stat->time_interval;
+
+  if (!ep_stats)
+    return;
+
+  for (unsigned int i = 0; i < nendpoints; i++)
+  {
+    mysql_endpoint_t * const ep = endpoints + i;
+    const uint64_t           queries = ck_pr_load_64(&ep->queries);
+    const uint64_t           errors = ck_pr_load_64(&ep->errors);
+    const uint64_t           sum_ns = ck_pr_load_64(&ep->sum_ns);
+    const uint64_t           nq = queries - ep->last_queries;
+    char                     pct_buf[64] = "";
+
+    if (sb_globals.percentile > 0)
+      snprintf(pct_buf, sizeof(pct_buf), " lat (ms,%u%%): %4.2f",
+               sb_globals.percentile,
+               sb_histogram_get_pct_intermediate(&ep->histogram,
+                                                 sb_globals.percentile));
+
+    log_timestamp(LOG_NOTICE, stat->time_total,
+                  "endpoint %s qps: %4.2f err/s: %4.2f avg lat (ms): %4.2f%s "
+                  "sessions: %" PRIu64, ep->name, nq / seconds,
+                  (errors - ep->last_errors) / seconds,
+                  nq > 0 ? NS2MS(sum_ns - ep->last_sum_ns) / nq : 0, pct_buf,
+                  ck_pr_load_64(&ep->sessions));
+
+    ep->last_queries = queries;
+    ep->last_errors = errors;
+    ep->last_sum_ns = sum_ns;
+  }
+}
+
+
+/* Print per-endpoint statistics since the start of the benchmark */
+
+static void mysql_drv_report_cumulative(sb_stat_t *stat)
+{
+  const double seconds = stat->time_interval;
+
+  if (!ep_stats)
+    return;
+
+  log_text(LOG_NOTICE, "    per-endpoint statistics (--mysql-balance=%s):",
+           balance_names[args.balance]);
+
+  for (unsigned int i = 0; i < nendpoints; i++)
+  {
+    mysql_endpoint_t * const ep = endpoints + i;
+    const uint64_t           queries = ck_pr_load_64(&ep->queries);
+    const uint64_t           errors = ck_pr_load_64(&ep->errors);
+    char                     pct_buf[64] = "";
+
+    if (sb_globals.percentile > 0)
+      snprintf(pct_buf, sizeof(pct_buf), ", %uth percentile: %.2f",
+               sb_globals.percentile,
+               sb_histogram_get_pct_cumulative(&ep->histogram,
+                                               sb_globals.percentile));
+
+    log_text(LOG_NOTICE, "        %s:", ep->name);
+    log_text(LOG_NOTICE, "            queries:                     %-6" PRIu64
+             " (%.2f per sec.)", queries, queries / seconds);
+    log_text(LOG_NOTICE, "            errors:                      %-6" PRIu64
+             " (%.2f per sec.)", errors, errors / seconds);
+    log_text(LOG_NOTICE, "            connections:                 %" PRIu64,
+             ck_pr_load_64(&ep->connects));
+    log_text(LOG_NOTICE, "            latency (ms):                avg: %.2f, "
+             "max: %.2f%s", queries > 0 ?
+             NS2MS(ck_pr_load_64(&ep->sum_ns)) / queries : 0,
+             NS2MS(ck_pr_load_64(&ep->max_ns)), pct_buf);
+  }
+}
+
 /* Map SQL data type to bind_type value in MYSQL_BIND */
 
 int get_mysql_bind_type(db_bind_type_t type)
@@ -27,6 +27,10 @@
 # include <strings.h>
 #endif
 
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+
 #include <libpq-fe.h>
 
 #include "sb_options.h"
@@ -38,6 +42,10 @@
 /* Maximum length of text representation of bind parameters */
 #define MAX_PARAM_LENGTH 256UL
 
+/* libpq connection handle of a sysbench connection */
+#define PGCONN(sb_conn) ((sb_conn)->ptr != NULL ?                   \
+                         ((pg_conn_t *) (sb_conn)->ptr)->pgcon : NULL)
+
 /* PostgreSQL driver arguments */
 
 static sb_arg_t pgsql_drv_args[] =
@@ -47,6 +55,9 @@ static sb_arg_t pgsql_drv_args[] =
   SB_OPT("pgsql-user", "PostgreSQL user", "sbtest", STRING),
   SB_OPT("pgsql-password", "PostgreSQL password", "", STRING),
   SB_OPT("pgsql-db", "PostgreSQL database name", "sbtest", STRING),
+  SB_OPT("pgsql-pipeline", "Send prepared statements in pipeline mode and "
+         "reap their results at COMMIT or ROLLBACK. Result sets of pipelined "
+         "statements are not available to scripts", "off", BOOL),
 
   SB_OPT_END
 };
@@ -58,6 +69,7 @@ typedef struct
   char               *user;
   char               *password;
   char               *db;
+  bool               pipeline;
 } pgsql_drv_args_t;
 
 /* Structure used for DB-to-PgSQL bind types map */
@@ -96,6 +108,32 @@ static drv_caps_t pgsql_drv_caps =
   0,    /* unsigned int */
 };
 
+/*
+  Maximum number of statements sent in pipeline mode with --pgsql-pipeline
+  before their results are reaped
+*/
+#define PIPELINE_MAX 256
+
+/* Describes the PostgreSQL connection */
+typedef struct
+{
+  PGconn       *pgcon;
+  /*
+    An internal ROLLBACK has been sent in pipeline mode after an ignorable error,
+    and its result must be skipped after 'rollback_after' more results
+  */
+  bool         rollback;
+  unsigned int rollback_after;
+  /* Statements sent with --pgsql-pipeline and not reaped yet */
+  unsigned int deferred;
+  const char   *deferred_queries[PIPELINE_MAX];
+  /*
+    Rows of the current result set are read in the single-row mode. The result
+    set is exhausted once its PGresult is NULL.
+  */
+  bool         streaming;
+} pg_conn_t;
+
 /* Describes the PostgreSQL prepared statement */
 typedef struct pg_stmt
 {
@@ -103,7 +141,10 @@ typedef struct pg_stmt
   int      prepared;
   int      nparams;
   Oid      *ptypes;
-  char     **pvalues;
+  char     **pvalues;      /* Buffers for converted parameter values */
+  const char **pdata;      /* Parameter values passed to libpq */
+  int      *plengths;      /* Lengths of binary parameter values */
+  int      *pformats;      /* Parameter formats, 0 is text, 1 is binary */
 } pg_stmt_t;
 
 static pgsql_drv_args_t args;          /* driver args */
@@ -123,11 +164,21 @@ static int pgsql_drv_bind_result(db_stmt_t *, db_bind_t *, size_t);
 static db_error_t pgsql_drv_execute(db_stmt_t *, db_result_t *);
 static int pgsql_drv_fetch(db_result_t *);
 static int pgsql_drv_fetch_row(db_result_t *, db_row_t *);
+static db_error_t pgsql_drv_query_stream(db_conn_t *, const char *, size_t,
+                                         db_result_t *);
 static db_error_t pgsql_drv_query(db_conn_t *, const char *, size_t,
                                   db_result_t *);
 static int pgsql_drv_free_results(db_result_t *);
 static int pgsql_drv_close(db_stmt_t *);
 static int pgsql_drv_done(void);
+#ifdef LIBPQ_HAS_PIPELINING
+static int pgsql_drv_send_query(db_conn_t *, const char *, size_t);
+static int pgsql_drv_send_execute(db_stmt_t *);
+static int pgsql_drv_poll(db_conn_t *, int *, short *);
+static db_error_t pgsql_drv_reap(db_conn_t *, db_result_t *);
+static db_error_t pgsql_execute_pipelined(db_stmt_t *, db_result_t *);
+static db_error_t pgsql_drain(db_conn_t *, db_result_t *);
+#endif
 
 /* PgSQL driver definition */
 
@@ -152,6 +203,13 @@ static db_driver_t pgsql_driver =
     .free_results = pgsql_drv_free_results,
     .close = pgsql_drv_close,
     .query = pgsql_drv_query,
+    .query_stream = pgsql_drv_query_stream,
+#ifdef LIBPQ_HAS_PIPELINING
+    .send_query = pgsql_drv_send_query,
+    .send_execute = pgsql_drv_send_execute,
+    .poll = pgsql_drv_poll,
+    .reap = pgsql_drv_reap,
+#endif
     .done = pgsql_drv_done
   }
 };
@@ -160,6 +218,7 @@ static db_driver_t pgsql_driver =
 /* Local functions */
 
 static int get_pgsql_bind_type(db_bind_type_t);
+static int get_pgsql_binary_length(db_bind_type_t);
 static int get_unique_stmt_name(char *, int);
 
 /* Register PgSQL driver */
@@ -181,6 +240,15 @@ int pgsql_drv_init(void)
   args.user = sb_get_value_string("pgsql-user");
   args.password = sb_get_value_string("pgsql-password");
   args.db = sb_get_value_string("pgsql-db");
+  args.pipeline = sb_get_value_flag("pgsql-pipeline");
+
+#ifndef LIBPQ_HAS_PIPELINING
+  if (args.pipeline)
+  {
+    log_text(LOG_FATAL, "--pgsql-pipeline requires libpq 14 or later");
+    return 1;
+  }
+#endif
 
   use_ps = 0;
   pgsql_drv_caps.prepared_statements = 1;
@@ -231,30 +299,111 @@ static void empty_notice_processor(void *arg, const char *msg)
   (void) msg; /* unused */
 }
 
+/*
+  Connect with the non-blocking libpq API and report latencies of individual
+  connection phases to the DB layer (--db-connect-stats). The TCP connect
+  phase ends when libpq leaves CONNECTION_STARTED, the TLS handshake ends when
+  it leaves CONNECTION_SSL_STARTUP, authentication and session setup take the
+  rest up to PGRES_POLLING_OK.
+*/
+
+static PGconn *pgsql_drv_timed_connect(void)
+{
+  const char * const keywords[] =
+    { "host", "port", "dbname", "user", "password", NULL };
+  const char * const values[] =
+    { args.host, args.port, args.db, args.user, args.password, NULL };
+  const uint64_t     start = sb_clock_ns();
+  uint64_t           phase_start = start;
+  uint64_t           now = start;
+  ConnStatusType     phase = CONNECTION_STARTED;
+  PostgresPollingStatusType pst = PGRES_POLLING_WRITING;
+  PGconn             *con;
+
+  con = PQconnectStartParams(keywords, values, 0);
+  if (con == NULL || PQstatus(con) == CONNECTION_BAD)
+    return con;
+
+  while (pst != PGRES_POLLING_OK && pst != PGRES_POLLING_FAILED)
+  {
+    struct pollfd pfd;
+
+    pfd.fd = PQsocket(con);
+    pfd.events = pst == PGRES_POLLING_READING ? POLLIN : POLLOUT;
+
+    if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+      return con;
+
+    pst = PQconnectPoll(con);
+    now = sb_clock_ns();
+
+    /* Failed attempts are only counted, not timed */
+    if (PQstatus(con) == CONNECTION_BAD)
+      break;
+
+    if (phase == CONNECTION_STARTED && PQstatus(con) != CONNECTION_STARTED)
+    {
+      db_conn_phase_done(DB_CONN_PHASE_CONNECT, now - phase_start);
+      phase_start = now;
+      phase = PQstatus(con);
+    }
+
+    if (phase == CONNECTION_SSL_STARTUP &&
+        PQstatus(con) != CONNECTION_SSL_STARTUP)
+    {
+      db_conn_phase_done(DB_CONN_PHASE_TLS, now - phase_start);
+      phase_start = now;
+      phase = PQstatus(con);
+    }
+  }
+
+  if (pst == PGRES_POLLING_OK)
+  {
+    db_conn_phase_done(DB_CONN_PHASE_AUTH, now - phase_start);
+    db_conn_phase_done(DB_CONN_PHASE_TOTAL, now - start);
+  }
+
+  return con;
+}
+
 /* Connect to database */
 
 int pgsql_drv_connect(db_conn_t *sb_conn)
 {
-  PGconn *con;
-
-  con = PQsetdbLogin(args.host,
-                     args.port,
-                     NULL,
-                     NULL,
-                     args.db,
-                     args.user,
-                     args.password);
+  PGconn    *con;
+  pg_conn_t *pgconn;
+
+  if (db_globals.connect_stats)
+    con = pgsql_drv_timed_connect();
+  else
+    con = PQsetdbLogin(args.host,
+                       args.port,
+                       NULL,
+                       NULL,
+                       args.db,
+                       args.user,
+                       args.password);
   if (PQstatus(con) != CONNECTION_OK)
   {
     log_text(LOG_FATAL, "Connection to database failed: %s",
              PQerrorMessage(con));
     PQfinish(con);
+    db_conn_attempt_failed();
     return 1;
   }
 
   /* Silence the default notice receiver spitting NOTICE message to stderr */
   PQsetNoticeProcessor(con, empty_notice_processor, NULL);
-  sb_conn->ptr = con;
+
+  pgconn = (pg_conn_t *) calloc(1, sizeof(pg_conn_t));
+  if (pgconn == NULL)
+  {
+    PQfinish(con);
+    return 1;
+  }
+
+  pgconn->pgcon = con;
+  sb_conn->ptr = pgconn;
   
   return 0;
 }
@@ -263,14 +412,23 @@ int pgsql_drv_connect(db_conn_t *sb_conn)
 
 int pgsql_drv_disconnect(db_conn_t *sb_conn)
 {
-  PGconn *con = (PGconn *)sb_conn->ptr;
+  pg_conn_t *pgconn = sb_conn->ptr;
 
   /* These might be allocated in pgsql_check_status() */
   xfree(sb_conn->sql_state);
   xfree(sb_conn->sql_errmsg);
 
-  if (con != NULL)
-    PQfinish(con);
+  if (pgconn != NULL)
+  {
+#ifdef LIBPQ_HAS_PIPELINING
+    /* Account results of pipelined statements */
+    if (pgconn->deferred > 0)
+      pgsql_drain(sb_conn, NULL);
+#endif
+
+    PQfinish(pgconn->pgcon);
+    xfree(sb_conn->ptr);
+  }
 
   return 0;
 }
@@ -279,6 +437,8 @@ int pgsql_drv_disconnect(db_conn_t *sb_conn)
 
 int pgsql_drv_reconnect(db_conn_t *sb_conn)
 {
+  unsigned int attempt = 0;
+
   if (pgsql_drv_disconnect(sb_conn))
     return DB_ERROR_FATAL;
 
@@ -286,6 +446,8 @@ int pgsql_drv_reconnect(db_conn_t *sb_conn)
   {
     if (sb_globals.error)
       return DB_ERROR_FATAL;
+
+    db_reconnect_backoff(attempt++);
   }
 
   return DB_ERROR_IGNORABLE;
@@ -297,7 +459,7 @@ int pgsql_drv_reconnect(db_conn_t *sb_conn)
 
 int pgsql_drv_prepare(db_stmt_t *stmt, const char *query, size_t len)
 {
-  PGconn       *con = (PGconn *)stmt->connection->ptr;
+  PGconn       *con = PGCONN(stmt->connection);
   PGresult     *pgres;
   pg_stmt_t    *pgstmt;
   char         *buf = NULL;
@@ -322,6 +484,13 @@ int pgsql_drv_prepare(db_stmt_t *stmt, const char *query, size_t len)
     return 0;
   }
 
+#ifdef LIBPQ_HAS_PIPELINING
+  /* PQprepare() cannot be used in pipeline mode */
+  if (((pg_conn_t *) stmt->connection->ptr)->deferred > 0 &&
+      pgsql_drain(stmt->connection, NULL) != DB_ERROR_NONE)
+    return 1;
+#endif
+
   /* Convert query to PgSQL-style named placeholders */
   need_realloc = 1;
   vcnt = 1;
@@ -409,7 +578,7 @@ int pgsql_drv_prepare(db_stmt_t *stmt, const char *query, size_t len)
 
 int pgsql_drv_bind_param(db_stmt_t *stmt, db_bind_t *params, size_t len)
 {
-  PGconn       *con = (PGconn *)stmt->connection->ptr;
+  PGconn       *con = PGCONN(stmt->connection);
   PGresult     *pgres;
   pg_stmt_t    *pgstmt;
   unsigned int i;
@@ -431,6 +600,13 @@ int pgsql_drv_bind_param(db_stmt_t *stmt, db_bind_t *params, size_t len)
   pgstmt = stmt->ptr;
   if (pgstmt->prepared)
     return 0;
+
+#ifdef LIBPQ_HAS_PIPELINING
+  /* PQprepare() cannot be used in pipeline mode */
+  if (((pg_conn_t *) stmt->connection->ptr)->deferred > 0 &&
+      pgsql_drain(stmt->connection, NULL) != DB_ERROR_NONE)
+    return 1;
+#endif
   
   /* Prepare statement here, since we need to know types of parameters */
   /* Validate parameters count */
@@ -478,6 +654,25 @@ int pgsql_drv_bind_param(db_stmt_t *stmt, db_bind_t *params, size_t len)
     if (pgstmt->pvalues[i] == NULL)
       return 1;
   }
+
+  pgstmt->pdata = (const char **)calloc(len, sizeof(char *));
+  pgstmt->plengths = (int *)calloc(len, sizeof(int));
+  pgstmt->pformats = (int *)calloc(len, sizeof(int));
+  if (pgstmt->pdata == NULL || pgstmt->plengths == NULL ||
+      pgstmt->pformats == NULL)
+    return 1;
+
+  /*
+    Use the binary format for numeric types and VARCHAR to avoid text
+    conversions on both the client and the server sides
+  */
+  for (i = 0; i < len; i++)
+  {
+    pgstmt->plengths[i] = get_pgsql_binary_length(params[i].type);
+    pgstmt->pformats[i] = pgstmt->plengths[i] != 0 ||
+      params[i].type == DB_TYPE_VARCHAR;
+  }
+
   pgstmt->prepared = 1;
 
   return 0;
@@ -507,7 +702,7 @@ static db_error_t pgsql_check_status(db_conn_t *con, PGresult *pgres,
 {
   ExecStatusType status;
   db_error_t     rc;
-  PGconn * const pgcon = con->ptr;
+  pg_conn_t * const pgconn = con->ptr;
 
   status = PQresultStatus(pgres);
   switch(status) {
@@ -552,9 +747,35 @@ static db_error_t pgsql_check_status(db_conn_t *con, PGresult *pgres,
         !strcmp(con->sql_state, "23505") /* unique violation */ ||
         !strcmp(con->sql_state, "40001"))/* serialization_failure */
     {
-      PGresult *tmp;
-      tmp = PQexec(pgcon, "ROLLBACK");
-      PQclear(tmp);
+#ifdef LIBPQ_HAS_PIPELINING
+      if (PQpipelineStatus(pgconn->pgcon) != PQ_PIPELINE_OFF)
+      {
+        /*
+          PQexec() cannot be used in pipeline mode. Send ROLLBACK after the
+          statements already in the pipeline, which are going to fail with
+          in_failed_sql_transaction until then.
+        */
+        if (!pgconn->rollback &&
+            PQsendQueryParams(pgconn->pgcon, "ROLLBACK", 0, NULL, NULL, NULL,
+                              NULL, 0) &&
+            PQpipelineSync(pgconn->pgcon))
+        {
+          pgconn->rollback = true;
+          pgconn->rollback_after = con->pending + pgconn->deferred;
+        }
+      }
+      else
+#endif
+      {
+        PGresult *tmp;
+        tmp = PQexec(pgconn->pgcon, "ROLLBACK");
+        PQclear(tmp);
+      }
+      rc = DB_ERROR_IGNORABLE;
+    }
+    else if (pgconn->rollback &&
+             !strcmp(con->sql_state, "25P02")) /* in_failed_sql_transaction */
+    {
       rc = DB_ERROR_IGNORABLE;
     }
     else
@@ -582,27 +803,102 @@ static db_error_t pgsql_check_status(db_conn_t *con, PGresult *pgres,
 }
 
 
+/* Store the n least significant bytes of a value in network byte order */
+
+static inline void put_be(char *buf, uint64_t val, unsigned int n)
+{
+  while (n-- > 0)
+  {
+    buf[n] = (char) (val & 0xff);
+    val >>= 8;
+  }
+}
+
+
+/* Convert sysbench bind structures to PgSQL data */
+
+static void pgsql_convert_params(db_stmt_t *stmt, pg_stmt_t *pgstmt)
+{
+  unsigned int  i;
+  unsigned long len;
+  uint32_t      u32;
+  uint64_t      u64;
+
+  for (i = 0; i < (unsigned)pgstmt->nparams; i++)
+  {
+    db_bind_t * const bind = stmt->bound_param + i;
+    char      * const buf = pgstmt->pvalues[i];
+
+    if (bind->is_null && *(bind->is_null))
+    {
+      pgstmt->pdata[i] = NULL;
+      continue;
+    }
+
+    pgstmt->pdata[i] = buf;
+
+    /* Binary values are in network byte order */
+    switch (bind->type) {
+      case DB_TYPE_SMALLINT:
+        put_be(buf, (uint16_t) *(short *) bind->buffer, 2);
+        break;
+      case DB_TYPE_INT:
+        put_be(buf, (uint32_t) *(int *) bind->buffer, 4);
+        break;
+      case DB_TYPE_BIGINT:
+        put_be(buf, (uint64_t) *(long long *) bind->buffer, 8);
+        break;
+      case DB_TYPE_FLOAT:
+        memcpy(&u32, bind->buffer, sizeof(u32));
+        put_be(buf, u32, 4);
+        break;
+      case DB_TYPE_DOUBLE:
+        memcpy(&u64, bind->buffer, sizeof(u64));
+        put_be(buf, u64, 8);
+        break;
+      case DB_TYPE_VARCHAR:
+        /* The binary format of VARCHAR is the string itself */
+        pgstmt->pdata[i] = bind->buffer;
+        pgstmt->plengths[i] = (int) bind->data_len[0];
+        break;
+      case DB_TYPE_CHAR:
+
+        len = SB_MIN(MAX_PARAM_LENGTH - 1, bind->data_len[0]);
+
+        memcpy(buf, bind->buffer, len);
+        /* PostgreSQL requires a zero-terminated string */
+        buf[len] = '\0';
+
+        break;
+      default:
+        db_print_value(bind, buf, MAX_PARAM_LENGTH);
+    }
+  }
+}
+
+
 /* Execute prepared statement */
 
 
 db_error_t pgsql_drv_execute(db_stmt_t *stmt, db_result_t *rs)
 {
   db_conn_t       *con = stmt->connection;
-  PGconn          *pgcon = (PGconn *)con->ptr;
+  PGconn          *pgcon = PGCONN(con);
   PGresult        *pgres;
   pg_stmt_t       *pgstmt;
-  char            *buf = NULL;
-  unsigned int    buflen = 0;
-  unsigned int    i, j, vcnt;
-  char            need_realloc;
-  int             n;
+  char            *buf;
+  size_t          len;
   db_error_t      rc;
-  unsigned long   len;
 
   con->sql_errno = 0;
   xfree(con->sql_state);
   xfree(con->sql_errmsg);
 
+#ifdef LIBPQ_HAS_PIPELINING
+  if (args.pipeline)
+    return pgsql_execute_pipelined(stmt, rs);
+#endif
+
   if (!stmt->emulated)
   {
     pgstmt = stmt->ptr;
@@ -613,32 +909,11 @@ db_error_t pgsql_drv_execute(db_stmt_t *stmt, db_result_t *rs)
       return DB_ERROR_FATAL;
     }
 
-    /* Convert sysbench bind structures to PgSQL data */
-    for (i = 0; i < (unsigned)pgstmt->nparams; i++)
-    {
-      if (stmt->bound_param[i].is_null && *(stmt->bound_param[i].is_null))
-        continue;
-
-      switch (stmt->bound_param[i].type) {
-        case DB_TYPE_CHAR:
-        case DB_TYPE_VARCHAR:
-
-          len = stmt->bound_param[i].data_len[0];
-
-          memcpy(pgstmt->pvalues[i], stmt->bound_param[i].buffer,
-                 SB_MIN(MAX_PARAM_LENGTH, len));
-          /* PostgreSQL requires a zero-terminated string */
-          pgstmt->pvalues[i][len] = '\0';
-
-          break;
-        default:
-          db_print_value(stmt->bound_param + i, pgstmt->pvalues[i],
-                         MAX_PARAM_LENGTH);
-      }
-    }
+    pgsql_convert_params(stmt, pgstmt);
 
     pgres = PQexecPrepared(pgcon, pgstmt->name, pgstmt->nparams,
-                           (const char **)pgstmt->pvalues, NULL, NULL, 1);
+                           pgstmt->pdata, pgstmt->plengths, pgstmt->pformats,
+                           1);
 
     rc = pgsql_check_status(con, pgres, "PQexecPrepared", NULL, rs);
 
@@ -648,53 +923,70 @@ db_error_t pgsql_drv_execute(db_stmt_t *stmt, db_result_t *rs)
   }
 
   /* Use emulation */
-  /* Build the actual query string from parameters list */
-  need_realloc = 1;
-  vcnt = 0;
-  for (i = 0, j = 0; stmt->query[i] != '\0'; i++)
-  {
-  again:
-    if (j+1 >= buflen || need_realloc)
-    {
-      buflen = (buflen > 0) ? buflen * 2 : 256;
-      buf = realloc(buf, buflen);
-      if (buf == NULL)
-        return DB_ERROR_FATAL;
-      need_realloc = 0;
-    }
+  if ((buf = db_build_query(stmt, &len)) == NULL)
+    return DB_ERROR_FATAL;
 
-    if (stmt->query[i] != '?')
-    {
-      buf[j++] = stmt->query[i];
-      continue;
-    }
+  return pgsql_drv_query(con, buf, len, rs);
+}
 
-    n = db_print_value(stmt->bound_param + vcnt, buf + j, buflen - j);
-    if (n < 0)
-    {
-      need_realloc = 1;
-      goto again;
-    }
-    j += n;
-    vcnt++;
+
+/* Execute SQL query */
+
+
+db_error_t pgsql_drv_query(db_conn_t *sb_conn, const char *query, size_t len,
+                           db_result_t *rs)
+{
+  PGconn         *pgcon = PGCONN(sb_conn);
+  PGresult       *pgres;
+  db_error_t     rc;
+
+  (void)len; /* unused */
+
+  sb_conn->sql_errno = 0;
+  xfree(sb_conn->sql_state);
+  xfree(sb_conn->sql_errmsg);
+
+#ifdef LIBPQ_HAS_PIPELINING
+  /* Reap pipelined statements first, do not execute the query on errors */
+  if (((pg_conn_t *) sb_conn->ptr)->deferred > 0 &&
+      (rc = pgsql_drain(sb_conn, NULL)) != DB_ERROR_NONE)
+  {
+    rs->counter = DB_CNT_DEFERRED;
+    return rc;
   }
-  buf[j] = '\0';
+#endif
 
-  rc = pgsql_drv_query(con, buf, j, rs);
+  pgres = PQexec(pgcon, query);
+  rc = pgsql_check_status(sb_conn, pgres, "PQexec", query, rs);
 
-  free(buf);
+  rs->ptr = (rs->counter == SB_CNT_READ) ? (void *) pgres : NULL;
 
   return rc;
 }
 
 
-/* Execute SQL query */
+/* Discard the remaining results of a query sent with PQsendQuery() */
 
 
-db_error_t pgsql_drv_query(db_conn_t *sb_conn, const char *query, size_t len,
-                           db_result_t *rs)
+static void pgsql_stream_end(db_conn_t *sb_conn)
+{
+  PGresult *pgres;
+
+  while ((pgres = PQgetResult(PGCONN(sb_conn))) != NULL)
+    PQclear(pgres);
+}
+
+
+/*
+  Execute SQL query in the single-row mode, so that rows are read from the
+  server one by one by pgsql_drv_fetch_row() instead of being stored in memory
+*/
+
+
+db_error_t pgsql_drv_query_stream(db_conn_t *sb_conn, const char *query,
+                                  size_t len, db_result_t *rs)
 {
-  PGconn         *pgcon = sb_conn->ptr;
+  PGconn         *pgcon = PGCONN(sb_conn);
   PGresult       *pgres;
   db_error_t     rc;
 
@@ -704,15 +996,446 @@ db_error_t pgsql_drv_query(db_conn_t *sb_conn, const char *query, size_t len,
   xfree(sb_conn->sql_state);
   xfree(sb_conn->sql_errmsg);
 
-  pgres = PQexec(pgcon, query);
-  rc = pgsql_check_status(sb_conn, pgres, "PQexec", query, rs);
+#ifdef LIBPQ_HAS_PIPELINING
+  /* Reap pipelined statements first, do not execute the query on errors */
+  if (((pg_conn_t *) sb_conn->ptr)->deferred > 0 &&
+      (rc = pgsql_drain(sb_conn, NULL)) != DB_ERROR_NONE)
+  {
+    rs->counter = DB_CNT_DEFERRED;
+    return rc;
+  }
+#endif
+
+  if (!PQsendQuery(pgcon, query))
+  {
+    log_text(LOG_FATAL, "PQsendQuery() failed: %s", PQerrorMessage(pgcon));
+    rs->counter = SB_CNT_ERROR;
+    return DB_ERROR_FATAL;
+  }
+
+  PQsetSingleRowMode(pgcon);
+
+  pgres = PQgetResult(pgcon);
+  if (pgres == NULL)
+  {
+    log_text(LOG_FATAL, "PQgetResult() failed: %s", PQerrorMessage(pgcon));
+    rs->counter = SB_CNT_ERROR;
+    return DB_ERROR_FATAL;
+  }
+
+  if (PQresultStatus(pgres) == PGRES_SINGLE_TUPLE)
+  {
+    /* The number of rows is only known once all of them are fetched */
+    rs->nrows = 0;
+    rs->nfields = PQnfields(pgres);
+    rs->counter = SB_CNT_READ;
+    rs->ptr = pgres;
+    rs->row.ptr = 0;
+
+    ((pg_conn_t *) sb_conn->ptr)->streaming = true;
+
+    return DB_ERROR_NONE;
+  }
+
+  /* Empty result sets, statements without results and errors */
+  rc = pgsql_check_status(sb_conn, pgres, "PQgetResult", query, rs);
+
+  rs->ptr = (rs->counter == SB_CNT_READ) ? (void *) pgres : NULL;
+
+  pgsql_stream_end(sb_conn);
+
+  return rc;
+}
+
+
+/*
+  Read the next row of a streamed result set. Returns DB_ERROR_IGNORABLE after
+  the last row.
+*/
+
+
+static db_error_t pgsql_stream_next(db_conn_t *sb_conn, db_result_t *rs)
+{
+  PGresult *pgres;
+
+  PQclear(rs->ptr);
+  rs->ptr = NULL;
+
+  pgres = PQgetResult(PGCONN(sb_conn));
+  if (pgres != NULL && PQresultStatus(pgres) == PGRES_SINGLE_TUPLE)
+  {
+    rs->ptr = pgres;
+    return DB_ERROR_NONE;
+  }
+
+  if (pgres != NULL && PQresultStatus(pgres) != PGRES_TUPLES_OK)
+  {
+    log_text(LOG_FATAL, "PQgetResult() failed: %s",
+             PQresultErrorMessage(pgres));
+    PQclear(pgres);
+    pgsql_stream_end(sb_conn);
+
+    return DB_ERROR_FATAL;
+  }
+
+  /* The end of the result set */
+  PQclear(pgres);
+  pgsql_stream_end(sb_conn);
+
+  return DB_ERROR_IGNORABLE;
+}
+
+
+#ifdef LIBPQ_HAS_PIPELINING
+
+/*
+  Asynchronous execution uses the libpq pipeline mode. Each statement is
+  followed by a sync point, so that an error in one statement does not abort
+  the following ones. The connection is switched back to the regular mode once
+  all results are reaped.
+*/
+
+static int pgsql_send(db_conn_t *sb_conn, const char *query, pg_stmt_t *pgstmt)
+{
+  PGconn *pgcon = PGCONN(sb_conn);
+  int    rc;
+
+  if (PQpipelineStatus(pgcon) == PQ_PIPELINE_OFF &&
+      (PQsetnonblocking(pgcon, 1) != 0 || !PQenterPipelineMode(pgcon)))
+  {
+    log_text(LOG_FATAL, "PQenterPipelineMode() failed: %s",
+             PQerrorMessage(pgcon));
+    return 1;
+  }
+
+  if (pgstmt != NULL)
+    rc = PQsendQueryPrepared(pgcon, pgstmt->name, pgstmt->nparams,
+                             pgstmt->pdata, pgstmt->plengths,
+                             pgstmt->pformats, 1);
+  else
+    rc = PQsendQueryParams(pgcon, query, 0, NULL, NULL, NULL, NULL, 0);
+
+  if (!rc || !PQpipelineSync(pgcon) || PQflush(pgcon) < 0)
+  {
+    log_text(LOG_FATAL, "%s() failed: %s", pgstmt != NULL ?
+             "PQsendQueryPrepared" : "PQsendQueryParams",
+             PQerrorMessage(pgcon));
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/* Send SQL query without waiting for its result */
+
+
+int pgsql_drv_send_query(db_conn_t *sb_conn, const char *query, size_t len)
+{
+  (void) len; /* unused */
+
+  if (pgsql_drain(sb_conn, NULL) != DB_ERROR_NONE)
+    return 1;
+
+  return pgsql_send(sb_conn, query, NULL);
+}
+
+
+/* Send prepared statement without waiting for its result */
+
+
+int pgsql_drv_send_execute(db_stmt_t *stmt)
+{
+  pg_stmt_t *pgstmt;
+  char      *buf;
+  size_t    len;
+
+  if (pgsql_drain(stmt->connection, NULL) != DB_ERROR_NONE)
+    return 1;
+
+  if (!stmt->emulated)
+  {
+    pgstmt = stmt->ptr;
+    if (pgstmt == NULL || !pgstmt->prepared)
+    {
+      log_text(LOG_ALERT, "parameters must be bound before sending "
+               "a prepared statement");
+      return 1;
+    }
+
+    pgsql_convert_params(stmt, pgstmt);
+
+    return pgsql_send(stmt->connection, NULL, pgstmt);
+  }
+
+  if ((buf = db_build_query(stmt, &len)) == NULL)
+    return 1;
+
+  return pgsql_send(stmt->connection, buf, NULL);
+}
+
+
+/* Check if the next result can be reaped without blocking */
+
+
+int pgsql_drv_poll(db_conn_t *sb_conn, int *fd, short *events)
+{
+  PGconn *pgcon = PGCONN(sb_conn);
+  int    flush;
+
+  if ((flush = PQflush(pgcon)) < 0 || !PQconsumeInput(pgcon))
+    return -1;
+
+  if (!PQisBusy(pgcon))
+    return 1;
+
+  *fd = PQsocket(pgcon);
+  *events = POLLIN | (flush > 0 ? POLLOUT : 0);
+
+  return 0;
+}
+
+
+/*
+  Wait for the next result in the pipeline and return it. NULL is returned on
+  connection errors, or at the end of results of the current statement.
+*/
+
+static PGresult *pgsql_get_result(db_conn_t *sb_conn)
+{
+  struct pollfd pfd;
+  int           rc;
+
+  while ((rc = pgsql_drv_poll(sb_conn, &pfd.fd, &pfd.events)) == 0)
+  {
+    if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+      return NULL;
+  }
+
+  return rc > 0 ? PQgetResult(PGCONN(sb_conn)) : NULL;
+}
+
+
+/*
+  Skip the remaining results of the current statement, up to and including its
+  sync point
+*/
+
+static void pgsql_skip_results(db_conn_t *sb_conn)
+{
+  PGresult *pgres;
+
+  while ((pgres = pgsql_get_result(sb_conn)) != NULL)
+  {
+    const ExecStatusType status = PQresultStatus(pgres);
+
+    PQclear(pgres);
+
+    if (status == PGRES_PIPELINE_SYNC)
+      break;
+  }
+}
+
+
+/*
+  Read the result of the oldest statement in the pipeline. The pipeline mode is
+  left once there are no more statements to reap.
+*/
+
+static db_error_t pgsql_reap_result(db_conn_t *sb_conn, const char *query,
+                                    db_result_t *rs)
+{
+  pg_conn_t  *pgconn = sb_conn->ptr;
+  PGconn     *pgcon = pgconn->pgcon;
+  PGresult   *pgres;
+  db_error_t rc;
+
+  if (pgconn->rollback)
+  {
+    if (pgconn->rollback_after == 0)
+    {
+      /* The internal ROLLBACK is next in the pipeline */
+      pgsql_skip_results(sb_conn);
+      pgconn->rollback = false;
+    }
+    else
+      pgconn->rollback_after--;
+  }
+
+  pgres = pgsql_get_result(sb_conn);
+  if (pgres == NULL)
+  {
+    log_text(LOG_FATAL, "PQgetResult() failed: %s", PQerrorMessage(pgcon));
+    rs->counter = SB_CNT_ERROR;
+    return DB_ERROR_FATAL;
+  }
+
+  rc = pgsql_check_status(sb_conn, pgres, "PQgetResult", query, rs);
 
   rs->ptr = (rs->counter == SB_CNT_READ) ? (void *) pgres : NULL;
 
+  /* Consume the end of results and the sync point of this statement */
+  pgsql_skip_results(sb_conn);
+
+  if (sb_conn->pending == 0 && pgconn->deferred == 0)
+  {
+    if (pgconn->rollback)
+    {
+      pgsql_skip_results(sb_conn);
+      pgconn->rollback = false;
+    }
+
+    PQexitPipelineMode(pgcon);
+    PQsetnonblocking(pgcon, 0);
+  }
+
+  return rc;
+}
+
+
+/* Reap the result of the oldest asynchronous statement */
+
+
+db_error_t pgsql_drv_reap(db_conn_t *sb_conn, db_result_t *rs)
+{
+  sb_conn->sql_errno = 0;
+  xfree(sb_conn->sql_state);
+  xfree(sb_conn->sql_errmsg);
+
+  return pgsql_reap_result(sb_conn, NULL, rs);
+}
+
+
+/*
+  Reap results of all statements sent with --pgsql-pipeline and update
+  statistic counters for them. If 'last' is not NULL, the result of the last
+  statement is stored there and left to the caller to account. Returns the most
+  severe error of all statements.
+*/
+
+static db_error_t pgsql_drain(db_conn_t *sb_conn, db_result_t *last)
+{
+  pg_conn_t         *pgconn = sb_conn->ptr;
+  const unsigned int n = pgconn->deferred;
+  db_result_t        tmp;
+  db_error_t         rc = DB_ERROR_NONE;
+
+  for (unsigned int i = 0; i < n; i++)
+  {
+    db_result_t * const rs = (i == n - 1 && last != NULL) ? last : &tmp;
+    db_error_t          err;
+
+    pgconn->deferred = n - i - 1;
+    rs->ptr = NULL;
+
+    err = pgsql_reap_result(sb_conn, pgconn->deferred_queries[i], rs);
+
+    if (err > rc)
+      rc = err;
+
+    if (rs != last || rc != DB_ERROR_NONE)
+    {
+      if (rs != last)
+        sb_counter_inc(sb_conn->thread_id, rs->counter);
+
+      if (rs->ptr != NULL)
+      {
+        PQclear(rs->ptr);
+        rs->ptr = NULL;
+      }
+    }
+  }
+
   return rc;
 }
 
 
+/* Check if a query ends a transaction, so the pipeline should be reaped */
+
+static bool is_trx_end(const char *query)
+{
+  static const char * const keywords[] = { "COMMIT", "ROLLBACK", "END",
+                                           "ABORT" };
+
+  query += strspn(query, " \t\r\n");
+
+  for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++)
+  {
+    const size_t len = strlen(keywords[i]);
+
+    if (!strncasecmp(query, keywords[i], len) &&
+        !isalnum((unsigned char) query[len]) && query[len] != '_')
+      return true;
+  }
+
+  return false;
+}
+
+
+/*
+  Execute a prepared statement with --pgsql-pipeline. Statements are only sent
+  to the server, results are reaped when a transaction ends or the pipeline is
+  full.
+*/
+
+static db_error_t pgsql_execute_pipelined(db_stmt_t *stmt, db_result_t *rs)
+{
+  db_conn_t  *con = stmt->connection;
+  pg_conn_t  *pgconn = con->ptr;
+  pg_stmt_t  *pgstmt = stmt->ptr;
+  char       *buf = NULL;
+  size_t     len;
+  db_error_t rc;
+  int        err;
+
+  /* Do not send the statement if the full pipeline has errors */
+  if (pgconn->deferred >= PIPELINE_MAX &&
+      (rc = pgsql_drain(con, NULL)) != DB_ERROR_NONE)
+  {
+    rs->counter = DB_CNT_DEFERRED;
+    return rc;
+  }
+
+  if (!stmt->emulated)
+  {
+    if (pgstmt == NULL)
+    {
+      log_text(LOG_DEBUG,
+               "ERROR: exiting pgsql_execute_pipelined(), uninitialized statement");
+      return DB_ERROR_FATAL;
+    }
+
+    pgsql_convert_params(stmt, pgstmt);
+    err = pgsql_send(con, NULL, pgstmt);
+  }
+  else
+  {
+    if ((buf = db_build_query(stmt, &len)) == NULL)
+      return DB_ERROR_FATAL;
+
+    err = pgsql_send(con, buf, NULL);
+  }
+
+  if (err)
+  {
+    rs->counter = SB_CNT_ERROR;
+    return DB_ERROR_FATAL;
+  }
+
+  pgconn->deferred_queries[pgconn->deferred++] = stmt->query;
+
+  if (is_trx_end(stmt->query))
+    return pgsql_drain(con, rs);
+
+  rs->counter = DB_CNT_DEFERRED;
+  rs->ptr = NULL;
+
+  return DB_ERROR_NONE;
+}
+
+#endif /* LIBPQ_HAS_PIPELINING */
+
+
 /* Fetch row from result set of a prepared statement */
 
 
@@ -738,7 +1461,25 @@ int pgsql_drv_fetch_row(db_result_t *rs, db_row_t *row)
     memory management.
   */
   rownum = (intptr_t) row->ptr;
-  if (rownum >= (int) rs->nrows)
+
+  if (((pg_conn_t *) SB_CONTAINER_OF(rs, db_conn_t, rs)->ptr)->streaming)
+  {
+    if (rs->ptr == NULL)
+      return DB_ERROR_IGNORABLE;
+
+    /* Each result of the single-row mode holds a single row */
+    if (rownum > 0)
+    {
+      const int rc = pgsql_stream_next(SB_CONTAINER_OF(rs, db_conn_t, rs), rs);
+
+      if (rc != DB_ERROR_NONE)
+        return rc;
+    }
+
+    rownum = 0;
+    rs->nrows++;
+  }
+  else if (rownum >= (int) rs->nrows)
     return DB_ERROR_IGNORABLE;
 
   for (i = 0; i < (int) rs->nfields; i++)
@@ -767,6 +1508,20 @@ int pgsql_drv_fetch_row(db_result_t *rs, db_row_t *row)
 
 int pgsql_drv_free_results(db_result_t *rs)
 {
+  db_conn_t * const sb_conn = SB_CONTAINER_OF(rs, db_conn_t, rs);
+
+  /* Discard the rows of a streamed result set that have not been fetched */
+  if (((pg_conn_t *) sb_conn->ptr)->streaming)
+  {
+    PQclear((PGresult *)rs->ptr);
+    rs->ptr = NULL;
+    rs->row.ptr = 0;
+    pgsql_stream_end(sb_conn);
+    ((pg_conn_t *) sb_conn->ptr)->streaming = false;
+
+    return 0;
+  }
+
   if (rs->ptr != NULL)
   {
     PQclear((PGresult *)rs->ptr);
@@ -787,6 +1542,13 @@ int pgsql_drv_close(db_stmt_t *stmt)
 {
   pg_stmt_t *pgstmt = stmt->ptr;
   int       i;
+
+#ifdef LIBPQ_HAS_PIPELINING
+  /* Pipelined statements may refer to the query text */
+  if (stmt->connection->ptr != NULL &&
+      ((pg_conn_t *) stmt->connection->ptr)->deferred > 0)
+    pgsql_drain(stmt->connection, NULL);
+#endif
   
   if (pgstmt == NULL)
     return 1;
@@ -802,6 +1564,9 @@ int pgsql_drv_close(db_stmt_t *stmt)
         free(pgstmt->pvalues[i]);
     free(pgstmt->pvalues);
   }
+  xfree(pgstmt->pdata);
+  xfree(pgstmt->plengths);
+  xfree(pgstmt->pformats);
 
   xfree(stmt->ptr);
 
@@ -831,6 +1596,29 @@ int get_pgsql_bind_type(db_bind_type_t type)
 }
 
 
+/*
+  Return the length of the binary format of a given type, or 0 if the text
+  format is used for it
+*/
+
+
+int get_pgsql_binary_length(db_bind_type_t type)
+{
+  switch (type) {
+  case DB_TYPE_SMALLINT:
+    return 2;
+  case DB_TYPE_INT:
+  case DB_TYPE_FLOAT:
+    return 4;
+  case DB_TYPE_BIGINT:
+  case DB_TYPE_DOUBLE:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+
 int get_unique_stmt_name(char *name, int len)
 {
   return snprintf(name, len, "sbstmt%d%d",
@@ -0,0 +1,40 @@
+#!/usr/bin/env sysbench
+-- -------------------------------------------------------------------------- --
+-- Connection storm benchmark: each event opens a new connection, optionally
+-- executes a query and keeps the connection open for --hold_time milliseconds,
+-- then disconnects. The connection churn rate is controlled with --rate or
+-- --rate-profile, and --db-connect-stats reports latencies of individual
+-- connection phases (TCP connect, TLS handshake, authentication) and of the
+-- first query on each connection. TLS options of the database driver (e.g.
+-- --mysql-ssl) apply to every new connection.
+-- -------------------------------------------------------------------------- --
+
+sysbench.cmdline.options = {
+   query =
+      {"Query to execute on each new connection (empty to skip)", "SELECT 1"},
+   hold_time =
+      {"Time to keep each connection open after the query, ms", 0}
+}
+
+function thread_init()
+   drv = sysbench.sql.driver()
+end
+
+function event()
+   -- Failed connection attempts are counted with --db-connect-stats, keep
+   -- going to measure them instead of aborting the benchmark
+   local success, con = pcall(drv.connect, drv)
+   if not success then
+      return
+   end
+
+   if sysbench.opt.query ~= "" then
+      con:query(sysbench.opt.query)
+   end
+
+   if sysbench.opt.hold_time > 0 then
+      sysbench.sleep(sysbench.opt.hold_time)
+   end
+
+   con:disconnect()
+end
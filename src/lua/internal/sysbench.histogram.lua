@@ -28,7 +28,7 @@ typedef struct histogram sb_histogram_t;
 /*
   Allocate a new histogram and initialize it with sb_histogram_init().
 */
-sb_histogram_t *sb_histogram_new(size_t size, double range_min,
+sb_histogram_t *sb_histogram_new(unsigned int sig_digits, double unit,
                                  double range_max);
 
 /*
@@ -61,8 +61,19 @@ local histogram_mt = {
 }
 ffi.metatype('sb_histogram_t', histogram_mt)
 
-function sysbench.histogram.new(size, range_min, range_max)
-   local h = ffi.C.sb_histogram_new(size, range_min, range_max)
+-- Create a new histogram tracking values up to range_max with sig_digits
+-- significant decimal digits (3 by default). Values below range_min are
+-- tracked, but with lower precision. The 'size' argument is ignored and only
+-- kept for compatibility, since the number of histogram elements is derived
+-- from the range and the precision.
+function sysbench.histogram.new(size, range_min, range_max, sig_digits)
+   sig_digits = sig_digits or 3
+   local unit = range_min / 10 ^ sig_digits
+   local h = ffi.C.sb_histogram_new(sig_digits, unit, range_max)
+
+   if h == nil then
+      error("failed to create a histogram", 2)
+   end
 
    return ffi.gc(h, ffi.C.sb_histogram_delete)
 end
@@ -20,8 +20,14 @@ ffi.cdef[[
 void sb_event_start(int thread_id);
 void sb_event_stop(int thread_id);
 bool sb_more_events(int thread_id);
+void sb_sleep_ns(uint64_t ns);
 ]]
 
+-- Sleep for a given number of milliseconds
+function sysbench.sleep(ms)
+   ffi.C.sb_sleep_ns(ms * 1000000)
+end
+
 -- ----------------------------------------------------------------------
 -- Main event loop. This is a Lua version of sysbench.c:thread_run()
 -- ----------------------------------------------------------------------
@@ -65,15 +71,33 @@ sysbench.hooks = {
    -- report_cumulative = <func>
 }
 
+-- Return formatted values of all latency percentiles in milliseconds, along
+-- with their ranks. With a single percentile, this is the --percentile value
+local function latency_pcts(stat)
+   if #stat.percentiles < 2 then
+      return { tostring(sysbench.opt.percentile) },
+         { string.format("%4.2f", stat.latency_pct * 1000) }
+   end
+
+   local ranks, values = {}, {}
+   for i, rank in ipairs(stat.percentiles) do
+      ranks[i] = string.format("%g", rank)
+      values[i] = string.format("%4.2f", stat.latency_pcts[i] * 1000)
+   end
+   return ranks, values
+end
+
 -- Report statistics in the CSV format. Add the following to your
 -- script to replace the default human-readable reports
 --
 -- sysbench.hooks.report_intermediate = sysbench.report_csv
 function sysbench.report_csv(stat)
    local seconds = stat.time_interval
+   local _, pcts = latency_pcts(stat)
+   -- There is one latency column for each percentile
    print(string.format("%.0f,%u,%4.2f," ..
                           "%4.2f,%4.2f,%4.2f,%4.2f," ..
-                          "%4.2f,%4.2f," ..
+                          "%s,%4.2f," ..
                           "%4.2f",
                        stat.time_total,
                        stat.threads_running,
@@ -82,7 +106,7 @@ function sysbench.report_csv(stat)
                        stat.reads / seconds,
                        stat.writes / seconds,
                        stat.other / seconds,
-                       stat.latency_pct * 1000,
+                       table.concat(pcts, ","),
                        stat.errors / seconds,
                        stat.reconnects / seconds
    ))
@@ -104,6 +128,21 @@ function sysbench.report_json(stat)
    end
 
    local seconds = stat.time_interval
+   local pcts = {}
+   for i, rank in ipairs(stat.percentiles) do
+      pcts[i] = string.format('"%g": %4.2f', rank, stat.latency_pcts[i] * 1000)
+   end
+   -- Only available in intermediate reports in the --rate mode
+   local rate = ""
+   if stat.rate_target then
+      rate = ([[
+
+    "target_rate": %4.2f,
+    "backlog": %4.2f,
+    "service_latency": %4.2f,]]):format(stat.rate_target,
+                                       stat.backlog_time * 1000,
+                                       stat.latency_service_pct * 1000)
+   end
    io.write(([[
   {
     "queries": %u,
@@ -117,6 +156,7 @@ function sysbench.report_json(stat)
       "other": %4.2f
     },
     "latency": %4.2f,
+    "percentiles": {%s},%s
     "errors": %4.2f,
     "reconnects": %4.2f
   }]]):format(
@@ -129,6 +169,8 @@ function sysbench.report_json(stat)
             stat.writes / seconds,
             stat.other / seconds,
             stat.latency_pct * 1000,
+            table.concat(pcts, ", "),
+            rate,
             stat.errors / seconds,
             stat.reconnects / seconds
    ))
@@ -144,8 +186,9 @@ end
 -- end
 function sysbench.report_default(stat)
    local seconds = stat.time_interval
+   local ranks, pcts = latency_pcts(stat)
    print(string.format("[ %.0fs ] thds: %u tps: %4.2f qps: %4.2f " ..
-                          "(r/w/o: %4.2f/%4.2f/%4.2f) lat (ms,%u%%): %4.2f " ..
+                          "(r/w/o: %4.2f/%4.2f/%4.2f) lat (ms,%s%%): %s " ..
                           "err/s %4.2f reconn/s: %4.2f",
                        stat.time_total,
                        stat.threads_running,
@@ -154,9 +197,23 @@ function sysbench.report_default(stat)
                        stat.reads / seconds,
                        stat.writes / seconds,
                        stat.other / seconds,
-                       sysbench.opt.percentile,
-                       stat.latency_pct * 1000,
+                       table.concat(ranks, "%/"),
+                       table.concat(pcts, "/"),
                        stat.errors / seconds,
                        stat.reconnects / seconds
    ))
+   -- Only available in intermediate reports in the --rate mode
+   if stat.rate_target then
+      print(string.format("[ %.0fs ] queue length: %u concurrency: %u",
+                          stat.time_total,
+                          stat.queue_length,
+                          stat.concurrency))
+      print(string.format("[ %.0fs ] target rate: %4.2f backlog (ms): %4.2f " ..
+                             "service lat (ms,%u%%): %4.2f",
+                          stat.time_total,
+                          stat.rate_target,
+                          stat.backlog_time * 1000,
+                          sysbench.opt.percentile,
+                          stat.latency_service_pct * 1000))
+   end
 end
@@ -68,6 +68,9 @@ typedef enum
   SB_CNT_RECONNECT,
   SB_CNT_BYTES_READ,
   SB_CNT_BYTES_WRITTEN,
+  SB_CNT_POOL_CHECKOUT,
+  SB_CNT_POOL_WAIT,
+  SB_CNT_POOL_WAIT_NS,
   SB_CNT_MAX
 } sb_counter_type;
 
@@ -135,6 +138,9 @@ int db_connection_close(sql_connection *con);
 int db_connection_reconnect(sql_connection *con);
 void db_connection_free(sql_connection *con);
 
+sql_connection *db_pool_checkout(sql_driver *drv);
+void db_pool_checkin(sql_connection *con);
+
 int db_bulk_insert_init(sql_connection *, const char *, size_t);
 int db_bulk_insert_next(sql_connection *, const char *, size_t);
 int db_bulk_insert_done(sql_connection *);
@@ -150,6 +156,21 @@ sql_result *db_execute(sql_statement *stmt);
 int db_close(sql_statement *stmt);
 
 int db_free_results(sql_result *);
+
+int db_send_query(sql_connection *con, const char *query, size_t len);
+int db_send_execute(sql_statement *stmt);
+sql_result *db_reap(sql_connection *con);
+unsigned int db_pending(sql_connection *con);
+int db_poll(sql_connection **cons, size_t ncons, int timeout, char *ready);
+
+void db_report_stmt_stats(double time_total, double time_interval,
+                          bool cumulative);
+void db_report_pool_stats(double time_total, double time_interval,
+                          uint64_t checkouts, uint64_t waits,
+                          double wait_time, bool cumulative);
+void db_report_conn_stats(bool cumulative);
+void db_report_driver_stats(double time_total, double time_interval,
+                            bool cumulative);
 ]]
 
 local sql_driver = ffi.typeof('sql_driver *')
@@ -177,6 +198,44 @@ sysbench.sql.type =
       VARCHAR = ffi.C.SQL_TYPE_VARCHAR
    }
 
+-- Print per-statement statistics collected with --db-stmt-stats. Default
+-- reports include them automatically, custom report hooks can call this
+-- function, e.g.:
+--
+-- function sysbench.hooks.report_cumulative(stat)
+--   sysbench.report_default(stat)
+--   sysbench.sql.report_statements(stat, true)
+-- end
+function sysbench.sql.report_statements(stat, cumulative)
+   ffi.C.db_report_stmt_stats(stat.time_total, stat.time_interval,
+                              cumulative == true)
+end
+
+-- Print connection pool statistics collected with --db-pool-size. Default
+-- reports include them automatically, custom report hooks can call this
+-- function like sysbench.sql.report_statements()
+function sysbench.sql.report_pool(stat, cumulative)
+   ffi.C.db_report_pool_stats(stat.time_total, stat.time_interval,
+                              stat.pool_checkouts, stat.pool_waits,
+                              stat.pool_wait_time, cumulative == true)
+end
+
+-- Print driver-specific statistics, e.g. per-endpoint statistics of the MySQL
+-- driver with multiple hosts or sockets. Default reports include them
+-- automatically, custom report hooks can call this function like
+-- sysbench.sql.report_statements()
+function sysbench.sql.report_drivers(stat, cumulative)
+   ffi.C.db_report_driver_stats(stat.time_total, stat.time_interval,
+                                cumulative == true)
+end
+
+-- Print connection statistics collected with --db-connect-stats. Only
+-- cumulative reports include them, custom report hooks can call this function
+-- like sysbench.sql.report_statements()
+function sysbench.sql.report_connections(stat, cumulative)
+   ffi.C.db_report_conn_stats(cumulative == true)
+end
+
 -- Initialize a given SQL driver and return a handle to it to create
 -- connections. A nil driver name (i.e. no function argument) initializes the
 -- default driver, i.e. the one specified with --db-driver on the command line.
@@ -188,6 +247,29 @@ function sysbench.sql.driver(driver_name)
    return ffi.gc(drv, ffi.C.db_destroy)
 end
 
+-- Wait up to timeout milliseconds (or indefinitely, if timeout is nil or
+-- negative) until results of asynchronous statements can be reaped without
+-- blocking on at least one of the specified connections. Returns a table of
+-- such connections, which is empty on timeout.
+function sysbench.sql.poll(connections, timeout)
+   local n = #connections
+   local cons = ffi.new('sql_connection *[?]', n, connections)
+   local ready = ffi.new('char[?]', n)
+
+   if ffi.C.db_poll(cons, n, timeout or -1, ready) < 0 then
+      error("db_poll() failed", 2)
+   end
+
+   local result = {}
+   for i = 0, n - 1 do
+      if ready[i] ~= 0 then
+         result[#result + 1] = connections[i + 1]
+      end
+   end
+
+   return result
+end
+
 -- sql_driver methods
 local driver_methods = {}
 
@@ -199,6 +281,17 @@ function driver_methods.connect(self)
    return ffi.gc(con, ffi.C.db_connection_free)
 end
 
+-- Check out a connection from the pool shared by all threads (see
+-- --db-pool-size), waiting until one is available if necessary. The connection
+-- must be returned to the pool with sql_connection:checkin()
+function driver_methods.checkout(self)
+   local con = ffi.C.db_pool_checkout(self)
+   if con == nil then
+      error("connection pool checkout failed", 2)
+   end
+   return con
+end
+
 function driver_methods.name(self)
    return ffi.string(self.sname)
 end
@@ -222,6 +315,12 @@ function connection_methods.reconnect(self)
    return assert(ffi.C.db_connection_reconnect(self) == 0)
 end
 
+-- Return a connection obtained with sql_driver:checkout() to the pool. The
+-- connection must not be used after that
+function connection_methods.checkin(self)
+   ffi.C.db_pool_checkin(self)
+end
+
 function connection_methods.check_error(self, rs, query)
    if rs ~= nil or self.error == sysbench.sql.error.NONE then
       return rs
@@ -272,6 +371,27 @@ function connection_methods.query(self, query)
    return self:check_error(rs, query)
 end
 
+-- Send a query without waiting for its results, which must then be read with
+-- sql_connection:reap()
+function connection_methods.send_query(self, query)
+   if ffi.C.db_send_query(self, query, #query) ~= 0 then
+      self:check_error(nil, query)
+   end
+end
+
+-- Read results of the oldest query or statement sent with
+-- sql_connection:send_query() or sql_statement:send_execute(), waiting for
+-- them if necessary
+function connection_methods.reap(self)
+   local rs = ffi.C.db_reap(self)
+   return self:check_error(rs, '<asynchronous statement>')
+end
+
+-- Return the number of sent queries and statements with results not reaped yet
+function connection_methods.pending(self)
+   return tonumber(ffi.C.db_pending(self))
+end
+
 function connection_methods.bulk_insert_init(self, query)
    return assert(ffi.C.db_bulk_insert_init(self, query, #query) == 0,
                  "db_bulk_insert_init() failed")
@@ -338,7 +458,7 @@ function sql_param.set(self, value)
    elseif btype == sql_type.FLOAT or
       btype == sql_type.DOUBLE
    then
-      self.buffer[1] = value
+      self.buffer[0] = value
    elseif btype == sql_type.CHAR or
       btype == sql_type.VARCHAR
    then
@@ -433,6 +553,12 @@ function statement_methods.execute(self)
    return self.connection:check_error(rs, '<prepared statement>')
 end
 
+function statement_methods.send_execute(self)
+   if ffi.C.db_send_execute(self) ~= 0 then
+      self.connection:check_error(nil, '<prepared statement>')
+   end
+end
+
 function statement_methods.close(self)
    return ffi.C.db_close(self)
 end
@@ -89,6 +89,9 @@ function sysbench.hooks.report_intermediate(stat)
    	sysbench.report_json(stat)
    else
    	sysbench.report_default(stat)
+   	sysbench.sql.report_pool(stat, false)
+   	sysbench.sql.report_drivers(stat, false)
+   	sysbench.sql.report_statements(stat, false)
    end
 end
 
@@ -98,6 +101,10 @@ function sysbench.hooks.report_cumulative(stat)
    	sysbench.report_json(stat)
    else
    	sysbench.report_default(stat)
+   	sysbench.sql.report_pool(stat, true)
+   	sysbench.sql.report_connections(stat, true)
+   	sysbench.sql.report_drivers(stat, true)
+   	sysbench.sql.report_statements(stat, true)
    end
 end
 
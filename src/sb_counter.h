@@ -41,6 +41,9 @@ typedef enum {
   SB_CNT_RECONNECT,     /* reconnects */
   SB_CNT_BYTES_READ,    /* bytes read */
   SB_CNT_BYTES_WRITTEN, /* bytes written */
+  SB_CNT_POOL_CHECKOUT, /* connection pool checkouts */
+  SB_CNT_POOL_WAIT,     /* checkouts waiting for a pooled connection */
+  SB_CNT_POOL_WAIT_NS,  /* time spent waiting for pooled connections, ns */
   SB_CNT_MAX
 } sb_counter_type_t;
 
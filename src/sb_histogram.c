@@ -33,7 +33,6 @@
 #include "sysbench.h"
 #include "sb_histogram.h"
 #include "sb_logger.h"
-#include "sb_rand.h"
 
 #include "sb_ck_pr.h"
 #include "ck_cc.h"
@@ -41,32 +40,148 @@
 #include "sb_util.h"
 
 
+/* Global latency histogram */
+sb_histogram_t sb_latency_histogram CK_CC_CACHELINE;
+
+/* Global service time histogram, only used in the --rate mode */
+sb_histogram_t sb_service_histogram CK_CC_CACHELINE;
+
+
 /*
-   Number of slots for current histogram array. TODO: replace this constant with
-   some autodetection code based on the number of available cores or some such.
+  Map a value expressed in units to an index in histogram arrays.
 */
-#define SB_HISTOGRAM_NSLOTS 128
+static inline size_t value_to_index(const sb_histogram_t *h, uint64_t value)
+{
+  const unsigned int half_mag = h->sub_bucket_half_count_magnitude;
+  const unsigned int bucket =
+    64 - SB_CLZ64(value | h->sub_bucket_mask) - (half_mag + 1);
+  const uint64_t sub_bucket = value >> bucket;
 
-/* Global latency histogram */
-sb_histogram_t sb_latency_histogram CK_CC_CACHELINE;
+  return ((size_t) (bucket + 1) << half_mag) +
+    (sub_bucket - (h->sub_bucket_count >> 1));
+}
 
 
-int sb_histogram_init(sb_histogram_t *h, size_t size,
-                      double range_min, double range_max)
+/*
+  Map an index in histogram arrays to the highest value (in user units, not
+  integer ones) that is equivalent to all values recorded in that element.
+*/
+static double index_to_value(const sb_histogram_t *h, size_t i)
 {
-  size_t i;
+  const unsigned int half_mag = h->sub_bucket_half_count_magnitude;
+  const uint64_t half_count = h->sub_bucket_count >> 1;
+  int bucket = (int) (i >> half_mag) - 1;
+  uint64_t sub_bucket = (i & (half_count - 1)) + half_count;
+
+  if (bucket < 0)
+  {
+    sub_bucket -= half_count;
+    bucket = 0;
+  }
+
+  return (double) ((sub_bucket << bucket) + (UINT64_C(1) << bucket) - 1) *
+    h->unit;
+}
+
+
+/*
+  Allocate a zeroed shard with a given index and publish it, so concurrent
+  merges either see a NULL pointer or a fully initialized shard. Only the owning
+  thread allocates a worker shard, so no compare-and-swap is required. Returns
+  NULL on allocation failure.
+*/
+static uint64_t *alloc_shard(sb_histogram_t *h, unsigned int s)
+{
+  const size_t size = h->shard_size * sizeof(uint64_t);
+  uint64_t     *shard;
+
+  if ((shard = sb_memalign(size, CK_MD_CACHELINE)) == NULL)
+    return NULL;
+
+  memset(shard, 0, size);
+
+  ck_pr_fence_store();
+  ck_pr_store_ptr(&h->shards[s], shard);
+
+  return shard;
+}
+
+
+int sb_histogram_init(sb_histogram_t *h, unsigned int sig_digits,
+                      double unit, double range_max)
+{
+  size_t   i, size;
   uint64_t *tmp;
+  uint64_t largest, smallest_untrackable;
+  unsigned int nbuckets;
+
+  if (sig_digits < 1 || sig_digits > SB_HISTOGRAM_MAX_SIG_DIGITS)
+  {
+    log_text(LOG_FATAL, "Invalid number of significant digits for a "
+             "histogram: %u (must be between 1 and %d)", sig_digits,
+             SB_HISTOGRAM_MAX_SIG_DIGITS);
+    return 1;
+  }
 
-  /* Allocate memory for cumulative_array + temp_array + all slot arrays */
-  tmp = (uint64_t *) calloc(size * (SB_HISTOGRAM_NSLOTS + 2), sizeof(uint64_t));
-  h->interm_slots = (uint64_t **) malloc(SB_HISTOGRAM_NSLOTS *
-                                         sizeof(uint64_t *));
+  if (!(unit > 0) || !(range_max >= unit) || range_max / unit > 1e18)
+  {
+    log_text(LOG_FATAL, "Invalid histogram range: unit = %g, max = %g",
+             unit, range_max);
+    return 1;
+  }
+
+  /*
+    The number of linear sub-buckets in each bucket must be enough to
+    distinguish 10^sig_digits values in a single decimal order of magnitude.
+  */
+  largest = 2;
+  for (i = 0; i < sig_digits; i++)
+    largest *= 10;
 
-  if (tmp == NULL || h->interm_slots == NULL)
+  h->sub_bucket_count = 2;
+  h->sub_bucket_half_count_magnitude = 0;
+  while (h->sub_bucket_count < largest)
+  {
+    h->sub_bucket_count <<= 1;
+    h->sub_bucket_half_count_magnitude++;
+  }
+  h->sub_bucket_mask = h->sub_bucket_count - 1;
+
+  h->sig_digits = sig_digits;
+  h->unit = unit;
+  h->max_value = (uint64_t) (range_max / unit + 0.5);
+
+  /* Number of power-of-2 buckets required to cover the entire range */
+  smallest_untrackable = h->sub_bucket_count;
+  nbuckets = 1;
+  while (smallest_untrackable <= h->max_value)
+  {
+    smallest_untrackable <<= 1;
+    nbuckets++;
+  }
+
+  size = (size_t) (nbuckets + 1) * (h->sub_bucket_count >> 1);
+
+  /* Allocate memory for cumulative_array + temp_array + snapshot_array */
+  tmp = (uint64_t *) calloc(size * 3, sizeof(uint64_t));
+  /*
+    Shard pointers are allocated for all worker threads + background threads,
+    but only the shared shard is allocated here, see alloc_shard(). Each shard
+    occupies a whole number of cache lines.
+  */
+  SB_COMPILE_TIME_ASSERT(CK_MD_CACHELINE % sizeof(uint64_t) == 0);
+  h->shard_size = SB_ALIGN(size, CK_MD_CACHELINE / sizeof(uint64_t));
+  h->nshards = sb_globals.threads + 1;
+  h->shards = (uint64_t **) calloc(h->nshards, sizeof(uint64_t *));
+
+  if (tmp == NULL || h->shards == NULL ||
+      alloc_shard(h, h->nshards - 1) == NULL)
   {
     log_text(LOG_FATAL,
              "Failed to allocate memory for a histogram object, size = %zd",
              size);
+    free(tmp);
+    free(h->shards);
     return 1;
   }
 
@@ -76,18 +191,9 @@ int sb_histogram_init(sb_histogram_t *h, size_t size,
   h->temp_array = tmp;
   tmp += size;
 
-  for (i = 0; i < SB_HISTOGRAM_NSLOTS; i++)
-  {
-    h->interm_slots[i] = tmp;
-    tmp += size;
-  }
-
-  h->range_deduct = log(range_min);
-  h->range_mult = (size - 1) / (log(range_max) - h->range_deduct);
-
-  h->range_min = range_min;
-  h->range_max = range_max;
+  h->snapshot_array = tmp;
 
+  h->cumulative_nevents = 0;
   h->array_size = size;
 
   pthread_rwlock_init(&h->lock, NULL);
@@ -96,194 +202,242 @@ int sb_histogram_init(sb_histogram_t *h, size_t size,
 }
 
 
-void sb_histogram_update(sb_histogram_t *h, double value)
+void sb_histogram_update_int(sb_histogram_t *h, uint64_t value)
 {
-  size_t      slot;
-  ssize_t     i;
+  const unsigned int tid = (unsigned int) sb_tls_thread_id;
+  uint64_t           *shard, *p;
+
+  if (SB_UNLIKELY(value > h->max_value))
+    value = h->max_value;
+
+  if (SB_LIKELY(sb_tls_worker && tid < h->nshards - 1))
+  {
+    shard = h->shards[tid];
 
-  slot = sb_rand_uniform_uint64() % SB_HISTOGRAM_NSLOTS;
+    if (SB_UNLIKELY(shard == NULL))
+      shard = alloc_shard(h, tid);
 
-  i = floor((log(value) - h->range_deduct) * h->range_mult + 0.5);
-  if (SB_UNLIKELY(i < 0))
-    i = 0;
-  else if (SB_UNLIKELY(i >= (ssize_t) (h->array_size)))
-    i = h->array_size - 1;
+    if (SB_LIKELY(shard != NULL))
+    {
+      /*
+        Worker threads are the only writers to their own shards, so there is
+        no need for atomic read-modify-write operations. The store is still
+        atomic so that concurrent merges never see a torn value.
+      */
+      p = shard + value_to_index(h, value);
+      ck_pr_store_64(p, ck_pr_load_64(p) + 1);
+
+      return;
+    }
 
-  ck_pr_inc_64(&h->interm_slots[slot][i]);
+    /* Failed to allocate a shard, fall back to the shared one */
+  }
+
+  /*
+    The last shard is shared by all other threads, including the main thread
+    which runs Lua init()/done() hooks with sb_tls_thread_id 0
+  */
+  p = h->shards[h->nshards - 1] + value_to_index(h, value);
+  ck_pr_inc_64(p);
 }
 
 
-double sb_histogram_get_pct_intermediate(sb_histogram_t *h,
-                                         double percentile)
+void sb_histogram_update(sb_histogram_t *h, double value)
 {
-  size_t   i, s;
-  uint64_t nevents, ncur, nmax;
-  double   res;
+  const double units = value / h->unit + 0.5;
+  uint64_t     v;
 
-  nevents = 0;
+  if (SB_UNLIKELY(!(units >= 1.0)))
+    v = 0;
+  else if (SB_UNLIKELY(units >= (double) h->max_value))
+    v = h->max_value;
+  else
+    v = (uint64_t) units;
 
-  /*
-    This can be called concurrently with other sb_histogram_get_pct_*()
-    functions, so use the lock to protect shared structures. This will not block
-    sb_histogram_update() calls, but we make sure we don't lose any concurrent
-    increments by atomically fetching each array element and replacing it with
-    0.
-  */
-  pthread_rwlock_wrlock(&h->lock);
+  sb_histogram_update_int(h, v);
+}
 
-  /*
-    Merge intermediate slots into temp_array.
-  */
-  const size_t size = h->array_size;
-  uint64_t * const array = h->temp_array;
 
-  for (i = 0; i < size; i++)
-  {
-    array[i] = ck_pr_fas_64(&h->interm_slots[0][i], 0);
-    nevents += array[i];
-  }
+/*
+  Aggregate all shards into temp_array so that it contains the number of events
+  recorded since the previous merge, and add those values to cumulative_array.
+  Shard values are never reset and only grow, so the difference between the
+  current sum over all shards and the sum seen by the previous merge accounts
+  for every concurrent update exactly once, either in this merge or in the next
+  one. Returns the number of events in temp_array. This should be called with
+  the histogram lock write-locked.
+*/
+static uint64_t merge_shards(sb_histogram_t *h)
+{
+  const size_t   size = h->array_size;
+  uint64_t       * const array = h->temp_array;
+  uint64_t       nevents = 0;
+  size_t         i;
+  unsigned int   s;
 
-  for (s = 1; s < SB_HISTOGRAM_NSLOTS; s++)
+  memset(array, 0, size * sizeof(uint64_t));
+
+  for (s = 0; s < h->nshards; s++)
   {
-    for (i = 0; i < size; i++)
-    {
-      uint64_t t;
+    const uint64_t * const shard = ck_pr_load_ptr(&h->shards[s]);
 
-      t = ck_pr_fas_64(&h->interm_slots[s][i], 0);
+    /* Not updated by the owning thread yet */
+    if (shard == NULL)
+      continue;
 
-      array[i] += t;
-      nevents += t;
-    }
-  }
+    ck_pr_fence_load();
 
-  /*
-    Now that we have an aggregate 'snapshot' of current arrays and the total
-    number of events in it, calculate the current, intermediate percentile value
-    to return.
-  */
-  nmax = floor(nevents * percentile / 100 + 0.5);
+    for (i = 0; i < size; i++)
+      array[i] += ck_pr_load_64(&shard[i]);
+  }
 
-  ncur = 0;
   for (i = 0; i < size; i++)
   {
-    ncur += array[i];
-    if (ncur >= nmax)
-      break;
-  }
+    const uint64_t total = array[i];
 
-  res = exp(i / h->range_mult + h->range_deduct);
+    array[i] = total - h->snapshot_array[i];
+    h->snapshot_array[i] = total;
 
-  /* Finally, add temp_array into accumulated values in cumulative_array. */
-  for (i = 0; i < size; i++)
-  {
     h->cumulative_array[i] += array[i];
+    nevents += array[i];
   }
 
   h->cumulative_nevents += nevents;
 
-  pthread_rwlock_unlock(&h->lock);
-
-  return res;
+  return nevents;
 }
 
 
 /*
-  Aggregate arrays from intermediate slots into cumulative_array. This should be
-  called with the histogram lock write-locked.
+  Calculate values for a given list of percentiles from a given array with a
+  given total number of events in a single pass over the array. This should be
+  called with the histogram lock either read- or write-locked.
 */
-static void merge_intermediate_into_cumulative(sb_histogram_t *h)
+static void get_pcts(sb_histogram_t *h, const uint64_t *array,
+                     uint64_t nevents, const double *pcts, size_t npcts,
+                     double *res)
 {
-  size_t   i, s;
-  uint64_t nevents;
+  const size_t size = h->array_size;
+  size_t       i, j, nleft;
+  uint64_t     ncur;
 
-  nevents = h->cumulative_nevents;
+  for (j = 0; j < npcts; j++)
+    res[j] = -1;
 
-  const size_t size = h->array_size;
-  uint64_t * const array = h->cumulative_array;
+  nleft = npcts;
+  ncur = 0;
 
-  for (s = 0; s < SB_HISTOGRAM_NSLOTS; s++)
+  for (i = 0; i < size && nleft > 0; i++)
   {
-    for (i = 0; i < size; i++)
+    if (array[i] == 0 && i > 0)
+      continue;
+
+    ncur += array[i];
+
+    for (j = 0; j < npcts; j++)
     {
-      uint64_t t = ck_pr_fas_64(&h->interm_slots[s][i], 0);
-      array[i] += t;
-      nevents += t;
+      if (res[j] < 0 && ncur >= floor(nevents * pcts[j] / 100 + 0.5))
+      {
+        res[j] = index_to_value(h, i);
+        nleft--;
+      }
     }
   }
 
-  h->cumulative_nevents = nevents;
-}
-
-
-/*
-  Calculate a given percentile from the cumulative array. This should be called
-  with the histogram lock either read- or write-locked.
-*/
-static double get_pct_cumulative(sb_histogram_t *h, double percentile)
-{
-  size_t   i;
-  uint64_t ncur, nmax;
-
-  nmax = floor(h->cumulative_nevents * percentile / 100 + 0.5);
-
-  ncur = 0;
-  for (i = 0; i < h->array_size; i++)
+  /* Can only happen if the requested rank is above 100 */
+  for (j = 0; j < npcts; j++)
   {
-    ncur += h->cumulative_array[i];
-    if (ncur >= nmax)
-      break;
+    if (res[j] < 0)
+      res[j] = index_to_value(h, size - 1);
   }
-
-  return exp(i / h->range_mult + h->range_deduct);
 }
 
 
-double sb_histogram_get_pct_cumulative(sb_histogram_t *h, double percentile)
+void sb_histogram_get_pcts_intermediate(sb_histogram_t *h, const double *pcts,
+                                        size_t npcts, double *res)
 {
-  double res;
+  uint64_t nevents;
 
   /*
-    This can be called concurrently with other sb_histogram_get_pct_*()
+    This can be called concurrently with other sb_histogram_get_pct*()
     functions, so use the lock to protect shared structures. This will not block
-    sb_histogram_update() calls, but we make sure we don't lose any concurrent
-    increments by atomically fetching each array element and replacing it with
-    0.
+    sb_histogram_update() calls, and no concurrent updates are lost, see
+    merge_shards().
   */
   pthread_rwlock_wrlock(&h->lock);
 
-  merge_intermediate_into_cumulative(h);
+  nevents = merge_shards(h);
 
-  res = get_pct_cumulative(h, percentile);
+  /*
+    Now that we have an aggregate 'snapshot' of current arrays and the total
+    number of events in it, calculate the current, intermediate percentile
+    values to return.
+  */
+  get_pcts(h, h->temp_array, nevents, pcts, npcts, res);
 
   pthread_rwlock_unlock(&h->lock);
-
-  return res;
 }
 
 
-double sb_histogram_get_pct_checkpoint(sb_histogram_t *h,
-                                       double percentile)
+void sb_histogram_get_pcts_cumulative(sb_histogram_t *h, const double *pcts,
+                                      size_t npcts, double *res)
 {
-  double   res;
+  /* See comments in sb_histogram_get_pcts_intermediate() */
+  pthread_rwlock_wrlock(&h->lock);
 
-  /*
-    This can be called concurrently with other sb_histogram_get_pct_*()
-    functions, so use the lock to protect shared structures. This will not block
-    sb_histogram_update() calls, but we make sure we don't lose any concurrent
-    increments by atomically fetching each array element and replacing it with
-    0.
-  */
+  merge_shards(h);
+
+  get_pcts(h, h->cumulative_array, h->cumulative_nevents, pcts, npcts, res);
+
+  pthread_rwlock_unlock(&h->lock);
+}
+
+
+void sb_histogram_get_pcts_checkpoint(sb_histogram_t *h, const double *pcts,
+                                      size_t npcts, double *res)
+{
+  /* See comments in sb_histogram_get_pcts_intermediate() */
   pthread_rwlock_wrlock(&h->lock);
 
-  merge_intermediate_into_cumulative(h);
+  merge_shards(h);
 
-  res = get_pct_cumulative(h, percentile);
+  get_pcts(h, h->cumulative_array, h->cumulative_nevents, pcts, npcts, res);
 
   /* Reset the cumulative array */
   memset(h->cumulative_array, 0, h->array_size * sizeof(uint64_t));
   h->cumulative_nevents = 0;
 
   pthread_rwlock_unlock(&h->lock);
+}
+
+
+double sb_histogram_get_pct_intermediate(sb_histogram_t *h,
+                                         double percentile)
+{
+  double res;
+
+  sb_histogram_get_pcts_intermediate(h, &percentile, 1, &res);
+
+  return res;
+}
+
+
+double sb_histogram_get_pct_cumulative(sb_histogram_t *h, double percentile)
+{
+  double res;
+
+  sb_histogram_get_pcts_cumulative(h, &percentile, 1, &res);
+
+  return res;
+}
+
+
+double sb_histogram_get_pct_checkpoint(sb_histogram_t *h,
+                                       double percentile)
+{
+  double res;
+
+  sb_histogram_get_pcts_checkpoint(h, &percentile, 1, &res);
 
   return res;
 }
@@ -297,7 +451,7 @@ void sb_histogram_print(sb_histogram_t *h)
 
   pthread_rwlock_wrlock(&h->lock);
 
-  merge_intermediate_into_cumulative(h);
+  merge_shards(h);
 
   uint64_t * const array = h->cumulative_array;
 
@@ -309,7 +463,10 @@ void sb_histogram_print(sb_histogram_t *h)
   }
 
   if (maxcnt == 0)
+  {
+    pthread_rwlock_unlock(&h->lock);
     return;
+  }
 
   printf("       value  ------------- distribution ------------- count\n");
 
@@ -321,7 +478,7 @@ void sb_histogram_print(sb_histogram_t *h)
     width = floor(array[i] * (double) 40 / maxcnt + 0.5);
 
     printf("%12.3f |%-40.*s %lu\n",
-           exp(i / h->range_mult + h->range_deduct),          /* value */
+           index_to_value(h, i),                              /* value */
            width, "****************************************", /* distribution */
            (unsigned long) array[i]);                /* count */
   }
@@ -335,14 +492,17 @@ void sb_histogram_done(sb_histogram_t *h)
   pthread_rwlock_destroy(&h->lock);
 
   free(h->cumulative_array);
-  free(h->interm_slots);
+
+  for (unsigned int s = 0; s < h->nshards; s++)
+    free(h->shards[s]);
+  free(h->shards);
 }
 
 /*
   Allocate a new histogram and initialize it with sb_histogram_init().
 */
 
-sb_histogram_t *sb_histogram_new(size_t size, double range_min,
+sb_histogram_t *sb_histogram_new(unsigned int sig_digits, double unit,
                                  double range_max)
 {
   sb_histogram_t *h;
@@ -350,7 +510,7 @@ sb_histogram_t *sb_histogram_new(size_t size, double range_min,
   if ((h = malloc(sizeof(*h))) == NULL)
     return NULL;
 
-  if (sb_histogram_init(h, size, range_min, range_max))
+  if (sb_histogram_init(h, sig_digits, unit, range_max))
   {
     free(h);
     return NULL;
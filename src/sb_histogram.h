@@ -24,6 +24,21 @@
 # include <pthread.h>
 #endif
 
+/*
+  Default and maximum number of significant decimal digits maintained by
+  histograms.
+*/
+#define SB_HISTOGRAM_DEFAULT_SIG_DIGITS 3
+#define SB_HISTOGRAM_MAX_SIG_DIGITS 5
+
+/*
+  HDR-style histogram. Values are stored as integer multiples of a fixed 'unit'
+  in a series of power-of-2 buckets, each one split into a number of linear
+  sub-buckets sufficient to maintain the requested number of significant
+  decimal digits. This provides a fixed relative precision over the entire
+  value range while mapping values to array elements with a bit scan and a
+  couple of shifts, i.e. without any floating point math on the update path.
+*/
 typedef struct {
   /*
      Cumulative histogram array. Updated 'on demand' by
@@ -41,21 +56,38 @@ typedef struct {
   */
   uint64_t              *temp_array;
   /*
-     Intermediate histogram values are split into multiple slots and updated
-     with atomics. Aggregations into cumulative values is performed by
-     sb_histogram_get_pct_intermediate() function.
+    Sum of all shards as of the last merge. Protected by 'lock'.
+  */
+  uint64_t              *snapshot_array;
+  /*
+     Intermediate histogram values are split into per-thread shards, one for
+     each worker thread plus one shared by all background threads. Worker
+     threads update their own shards without atomic read-modify-write
+     operations. Worker shards are allocated on the first update by the owning
+     thread, so histograms that are only updated by a few threads do not pay
+     for all of them. The shared shard is always allocated. Shards are never
+     reset, merging them into cumulative values is performed by
+     sb_histogram_get_pct_*() functions.
   */
-  uint64_t              **interm_slots;
+  uint64_t              **shards;
+  /* Number of shards */
+  unsigned int          nshards;
+  /* Size of each shard, in elements */
+  size_t                shard_size;
   /* Number of elements in each array */
   size_t                array_size;
-  /* Lower bound of values to track */
-  double                range_min;
-  /* Upper bound of values to track */
-  double                range_max;
-  /* Value to deduct to calculate histogram range based on array element */
-  double                range_deduct;
-  /* Value to multiply to calculate histogram range based array element */
-  double                range_mult;
+  /* Number of significant decimal digits to maintain */
+  unsigned int          sig_digits;
+  /* Value corresponding to a single integer unit */
+  double                unit;
+  /* Upper bound of values to track, in units. Larger values are clamped */
+  uint64_t              max_value;
+  /* Number of sub-buckets in each bucket, a power of 2 */
+  uint64_t              sub_bucket_count;
+  /* log2(sub_bucket_count / 2) */
+  unsigned int          sub_bucket_half_count_magnitude;
+  /* Mask of value bits covered by the first bucket */
+  uint64_t              sub_bucket_mask;
   /*
      rwlock to protect cumulative_array and cumulative_nevents from concurrent
      updates.
@@ -66,10 +98,13 @@ typedef struct {
 /* Global latency histogram */
 extern sb_histogram_t sb_latency_histogram;
 
+/* Global service time histogram, only used in the --rate mode */
+extern sb_histogram_t sb_service_histogram;
+
 /*
   Allocate a new histogram and initialize it with sb_histogram_init().
 */
-sb_histogram_t *sb_histogram_new(size_t size, double range_min,
+sb_histogram_t *sb_histogram_new(unsigned int sig_digits, double unit,
                                  double range_max);
 
 /*
@@ -78,14 +113,23 @@ sb_histogram_t *sb_histogram_new(size_t size, double range_min,
 void sb_histogram_delete(sb_histogram_t *h);
 
 /*
-  Initialize a new histogram object with a given array size and value bounds.
+  Initialize a new histogram object tracking values between 0 and range_max with
+  a given number of significant decimal digits. Values are stored as integer
+  multiples of 'unit', which is thus the lowest discernible value.
 */
-int sb_histogram_init(sb_histogram_t *h, size_t size,
-                      double range_min, double range_max);
+int sb_histogram_init(sb_histogram_t *h, unsigned int sig_digits,
+                      double unit, double range_max);
 
 /* Update histogram with a given value. */
 void sb_histogram_update(sb_histogram_t *h, double value);
 
+/*
+  Update histogram with a given value expressed as a number of units. This is
+  the preferred way to update histograms on hot paths, since it does not involve
+  any floating point conversions.
+*/
+void sb_histogram_update_int(sb_histogram_t *h, uint64_t value);
+
 /*
   Calculate a given percentile value from the intermediate histogram values,
   then merge intermediate values into cumulative ones atomically, i.e. in a way
@@ -108,6 +152,18 @@ double sb_histogram_get_pct_cumulative(sb_histogram_t *h, double percentile);
 */
 double sb_histogram_get_pct_checkpoint(sb_histogram_t *h, double percentile);
 
+/*
+  The following are equivalents of the sb_histogram_get_pct_*() functions
+  calculating values for 'npcts' percentiles from the 'pcts' array in a single
+  pass, storing results in the 'res' array.
+*/
+void sb_histogram_get_pcts_intermediate(sb_histogram_t *h, const double *pcts,
+                                        size_t npcts, double *res);
+void sb_histogram_get_pcts_cumulative(sb_histogram_t *h, const double *pcts,
+                                      size_t npcts, double *res);
+void sb_histogram_get_pcts_checkpoint(sb_histogram_t *h, const double *pcts,
+                                      size_t npcts, double *res);
+
 /*
   Print a given histogram to stdout
 */
@@ -22,6 +22,7 @@
 
 #ifdef STDC_HEADERS
 # include <stdio.h>
+# include <stdlib.h>
 # include <stdarg.h>
 # include <string.h>
 #endif
@@ -43,11 +44,10 @@
 #define ERROR_BUFFER_SIZE 256
 
 /*
-   Use 1024-element array for latency histogram tracking values between 0.001
-   milliseconds and 100 seconds.
+   Latency histogram tracks values in nanoseconds up to 100 seconds (values are
+   reported in milliseconds).
 */
-#define OPER_LOG_GRANULARITY 1024
-#define OPER_LOG_MIN_VALUE   1e-3
+#define OPER_LOG_UNIT        NS2MS(1)
 #define OPER_LOG_MAX_VALUE   1E5
 
 /* Array of message handlers (one chain per message type) */
@@ -97,7 +97,11 @@ static sb_arg_t oper_handler_args[] =
   SB_OPT("percentile", "percentile to calculate in latency statistics (1-100). "
          "Use the special value of 0 to disable percentile calculations",
          "95", INT),
+  SB_OPT("percentiles", "comma-separated list of additional percentile ranks "
+         "to calculate in latency statistics, e.g. 50,99,99.9", "", LIST),
   SB_OPT("histogram", "print latency histogram in report", "off", BOOL),
+  SB_OPT("histogram-precision", "number of significant decimal digits to "
+         "maintain in latency statistics (1-5)", "3", INT),
 
   SB_OPT_END
 };
@@ -458,6 +462,65 @@ int text_handler_process(log_msg_t *msg)
 }
 
 
+/*
+  Initialize the list of percentile ranks from --percentile and --percentiles
+*/
+
+static int init_percentiles(void)
+{
+  sb_list_t      *list = sb_get_value_list("percentiles");
+  sb_list_item_t *pos;
+  unsigned int   i;
+
+  sb_globals.n_percentiles = 0;
+
+  if (sb_globals.percentile == 0)
+  {
+    if (!SB_LIST_IS_EMPTY(list))
+    {
+      log_text(LOG_FATAL, "--percentiles cannot be used with --percentile=0");
+      return 1;
+    }
+
+    return 0;
+  }
+
+  sb_globals.percentiles[sb_globals.n_percentiles++] = sb_globals.percentile;
+
+  SB_LIST_FOR_EACH(pos, list)
+  {
+    const char *val = SB_LIST_ENTRY(pos, value_t, listitem)->data;
+    char       *endptr;
+    double     pct;
+
+    pct = strtod(val, &endptr);
+    if (*val == '\0' || *endptr != '\0' || !(pct > 0 && pct <= 100))
+    {
+      log_text(LOG_FATAL, "Invalid value for --percentiles: '%s'", val);
+      return 1;
+    }
+
+    /* Skip duplicates */
+    for (i = 0; i < sb_globals.n_percentiles; i++)
+      if (sb_globals.percentiles[i] == pct)
+        break;
+    if (i < sb_globals.n_percentiles)
+      continue;
+
+    if (sb_globals.n_percentiles >= MAX_PERCENTILES)
+    {
+      log_text(LOG_FATAL, "Too many percentiles specified, the maximum is %d",
+               MAX_PERCENTILES);
+      return 1;
+    }
+
+    sb_globals.percentiles[sb_globals.n_percentiles++] = pct;
+  }
+
+  return 0;
+}
+
+
 /* Initialize operation messages handler */
 
 
@@ -474,6 +537,9 @@ int oper_handler_init(void)
   }
   sb_globals.percentile = tmp;
 
+  if (init_percentiles())
+    return 1;
+
   sb_globals.histogram = sb_get_value_flag("histogram");
   if (sb_globals.percentile == 0 && sb_globals.histogram != 0)
   {
@@ -481,8 +547,21 @@ int oper_handler_init(void)
     return 1;
   }
 
-  if (sb_histogram_init(&sb_latency_histogram, OPER_LOG_GRANULARITY,
-                        OPER_LOG_MIN_VALUE, OPER_LOG_MAX_VALUE))
+  tmp = sb_get_value_int("histogram-precision");
+  if (tmp < 1 || tmp > SB_HISTOGRAM_MAX_SIG_DIGITS)
+  {
+    log_text(LOG_FATAL, "Invalid value for --histogram-precision: %d",
+             tmp);
+    return 1;
+  }
+
+  if (sb_histogram_init(&sb_latency_histogram, tmp, OPER_LOG_UNIT,
+                        OPER_LOG_MAX_VALUE))
+    return 1;
+
+  if (sb_globals.tx_rate > 0 &&
+      sb_histogram_init(&sb_service_histogram, tmp, OPER_LOG_UNIT,
+                        OPER_LOG_MAX_VALUE))
     return 1;
 
   return 0;
@@ -495,5 +574,8 @@ int oper_handler_done(void)
 {
   sb_histogram_done(&sb_latency_histogram);
 
+  if (sb_globals.tx_rate > 0)
+    sb_histogram_done(&sb_service_histogram);
+
   return 0;
 }
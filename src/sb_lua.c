@@ -514,6 +514,19 @@ static void sb_lua_var_string(lua_State *L, const char *name, const char *s)
     lua_settable(L, -3);
 }
 
+static void sb_lua_var_numbers(lua_State *L, const char *name,
+                               const double *vals, unsigned int n)
+{
+    lua_pushstring(L, name);
+    lua_newtable(L);
+    for (unsigned int i = 0; i < n; i++)
+    {
+      lua_pushnumber(L, vals[i]);
+      lua_rawseti(L, -2, i + 1);
+    }
+    lua_settable(L, -3);
+}
+
 /*
   Set package.path and package.cpath in a given environment. Also honor
   LUA_PATH/LUA_CPATH to mimic the default Lua behavior.
@@ -963,6 +976,7 @@ static void *cmd_worker_thread(void *arg)
   sb_thread_ctxt_t   *ctxt= (sb_thread_ctxt_t *)arg;
 
   sb_tls_thread_id = ctxt->id;
+  sb_tls_worker = true;
 
   /* Initialize thread-local RNG state */
   sb_rand_thread_init();
@@ -1010,12 +1024,24 @@ static void stat_to_lua_table(lua_State *L, sb_stat_t *stat)
   stat_to_number(time_interval);
   stat_to_number(time_total);
   stat_to_number(latency_pct);
+  /* Percentile ranks and latency values for each of them */
+  sb_lua_var_numbers(L, "percentiles", sb_globals.percentiles,
+                     sb_globals.n_percentiles);
+  sb_lua_var_numbers(L, "latency_pcts", stat->latency_pcts,
+                     sb_globals.n_percentiles);
+  /* Service time percentiles are only available with tx_rate > 0 */
+  stat_to_number(latency_service_pct);
+  sb_lua_var_numbers(L, "latency_service_pcts", stat->latency_service_pcts,
+                     sb_globals.tx_rate > 0 ? sb_globals.n_percentiles : 0);
   stat_to_number(events);
   stat_to_number(reads);
   stat_to_number(writes);
   stat_to_number(other);
   stat_to_number(errors);
   stat_to_number(reconnects);
+  stat_to_number(pool_checkouts);
+  stat_to_number(pool_waits);
+  stat_to_number(pool_wait_time);
 }
 
 /* Call sysbench.hooks.report_intermediate */
@@ -1034,6 +1060,12 @@ static void sb_lua_report_intermediate(sb_stat_t *stat)
   */
   stat_to_number(queue_length);
   stat_to_number(concurrency);
+  /* Only set with tx_rate > 0, so hooks can check for it */
+  if (sb_globals.tx_rate > 0)
+  {
+    stat_to_number(backlog_time);
+    stat_to_number(rate_target);
+  }
 
   if (lua_pcall(L, 1, 0, 0))
   {
@@ -0,0 +1,354 @@
+/* Copyright (C) 2026 sysbench contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+/*
+  Time-varying target rates for the --rate mode. The following profiles are
+  supported by --rate-profile:
+
+  ramp:FROM:TO:SECONDS    linear ramp from FROM to TO events/s in SECONDS,
+                          then stay at TO
+  step:RATE:SECONDS,...   a table of steps, each one RATE events/s for SECONDS
+                          seconds. The last rate is used after the last step
+  sine:MEAN:AMP:PERIOD    MEAN + AMP * sin(2 * pi * t / PERIOD) events/s
+  csv:FILE                per-second target rates read from FILE, one per line.
+                          If a line has multiple comma-separated columns, the
+                          last one is used. Empty lines and lines starting with
+                          '#' are ignored. The last rate is used after the end
+                          of the file
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef STDC_HEADERS
+# include <stdio.h>
+# include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif
+#ifdef HAVE_MATH_H
+# include <math.h>
+#endif
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif
+
+#include "sysbench.h"
+#include "sb_rate.h"
+#include "sb_logger.h"
+#include "sb_util.h"
+
+#ifndef M_PI
+# define M_PI 3.14159265358979323846
+#endif
+
+typedef enum {
+  RATE_PROFILE_NONE,
+  RATE_PROFILE_RAMP,
+  RATE_PROFILE_STEP,
+  RATE_PROFILE_SINE,
+  RATE_PROFILE_CSV
+} rate_profile_type_t;
+
+static struct {
+  rate_profile_type_t type;
+
+  /* ramp: from, to, duration. sine: mean, amplitude, period */
+  double              args[3];
+
+  /*
+    step and csv: rates and cumulative end times (in seconds) of each element
+  */
+  double              *rates;
+  double              *ends;
+  size_t              n;
+
+  double              max;  /* Maximum rate, computed once by sb_rate_init() */
+} profile;
+
+
+/* Append an element to step or csv profiles */
+
+static int profile_add(double rate, double duration)
+{
+  double *rates, *ends;
+
+  if (!(rate >= 0) || !(duration > 0))
+    return 1;
+
+  rates = realloc(profile.rates, (profile.n + 1) * sizeof(double));
+  if (rates == NULL)
+    return 1;
+  profile.rates = rates;
+
+  ends = realloc(profile.ends, (profile.n + 1) * sizeof(double));
+  if (ends == NULL)
+    return 1;
+  profile.ends = ends;
+
+  profile.rates[profile.n] = rate;
+  profile.ends[profile.n] = duration +
+    (profile.n > 0 ? profile.ends[profile.n - 1] : 0);
+  profile.n++;
+
+  return 0;
+}
+
+
+/* Parse exactly n colon-separated numbers */
+
+static int parse_args(const char *str, unsigned int n)
+{
+  const char *p = str;
+  char       *endptr;
+
+  for (unsigned int i = 0; i < n; i++)
+  {
+    profile.args[i] = strtod(p, &endptr);
+    if (endptr == p || *endptr != (i < n - 1 ? ':' : '\0'))
+      return 1;
+    p = endptr + 1;
+  }
+
+  return 0;
+}
+
+
+static int parse_step(const char *str)
+{
+  const char *p = str;
+  char       *endptr;
+  double     rate, duration;
+
+  while (*p != '\0')
+  {
+    rate = strtod(p, &endptr);
+    if (endptr == p || *endptr != ':')
+      return 1;
+
+    p = endptr + 1;
+    duration = strtod(p, &endptr);
+    if (endptr == p || (*endptr != ',' && *endptr != '\0'))
+      return 1;
+
+    if (profile_add(rate, duration))
+      return 1;
+
+    p = *endptr == ',' ? endptr + 1 : endptr;
+  }
+
+  return profile.n == 0;
+}
+
+
+static int parse_csv(const char *path)
+{
+  FILE   *fp;
+  char   buf[1024];
+  int    rc = 0;
+
+  if ((fp = fopen(path, "r")) == NULL)
+  {
+    log_errno(LOG_FATAL, "Cannot open rate profile file '%s'", path);
+    return 1;
+  }
+
+  while (fgets(buf, sizeof(buf), fp) != NULL)
+  {
+    char   *p = buf + strspn(buf, " \t");
+    char   *col, *endptr;
+    double rate;
+
+    if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0')
+      continue;
+
+    col = strrchr(p, ',');
+    col = col != NULL ? col + 1 : p;
+
+    rate = strtod(col, &endptr);
+    if (endptr == col || *(endptr + strspn(endptr, " \t\r\n")) != '\0' ||
+        profile_add(rate, 1))
+    {
+      log_text(LOG_FATAL, "Invalid line in rate profile file '%s': %s", path,
+               buf);
+      rc = 1;
+      break;
+    }
+  }
+
+  fclose(fp);
+
+  if (rc == 0 && profile.n == 0)
+  {
+    log_text(LOG_FATAL, "No rates found in rate profile file '%s'", path);
+    rc = 1;
+  }
+
+  return rc;
+}
+
+
+/* Return the maximum target rate of the profile */
+
+static double profile_max(void)
+{
+  double max = 0;
+
+  switch (profile.type) {
+  case RATE_PROFILE_NONE:
+    return sb_globals.tx_rate;
+  case RATE_PROFILE_RAMP:
+    return SB_MAX(profile.args[0], profile.args[1]);
+  case RATE_PROFILE_SINE:
+    return profile.args[0] + profile.args[1];
+  case RATE_PROFILE_STEP:
+  case RATE_PROFILE_CSV:
+    for (size_t i = 0; i < profile.n; i++)
+      max = SB_MAX(max, profile.rates[i]);
+    return max;
+  }
+
+  return max;
+}
+
+
+int sb_rate_init(void)
+{
+  const char *str = sb_get_value_string("rate-profile");
+  int        rc;
+
+  profile.type = RATE_PROFILE_NONE;
+
+  if (str == NULL || *str == '\0')
+    return 0;
+
+  if (!strncasecmp(str, "ramp:", 5))
+  {
+    profile.type = RATE_PROFILE_RAMP;
+    rc = parse_args(str + 5, 3) || profile.args[0] < 0 ||
+      profile.args[1] < 0 || profile.args[2] <= 0;
+  }
+  else if (!strncasecmp(str, "step:", 5))
+  {
+    profile.type = RATE_PROFILE_STEP;
+    rc = parse_step(str + 5);
+  }
+  else if (!strncasecmp(str, "sine:", 5))
+  {
+    profile.type = RATE_PROFILE_SINE;
+    rc = parse_args(str + 5, 3) || profile.args[0] <= 0 ||
+      profile.args[1] < 0 || profile.args[2] <= 0;
+  }
+  else if (!strncasecmp(str, "csv:", 4))
+  {
+    profile.type = RATE_PROFILE_CSV;
+    if (parse_csv(str + 4))
+    {
+      sb_rate_done();
+      return 1;
+    }
+    rc = 0;
+  }
+  else
+    rc = 1;
+
+  if (rc == 0 && (profile.max = profile_max()) <= 0)
+    rc = 1;
+
+  if (rc)
+  {
+    log_text(LOG_FATAL, "Invalid value for --rate-profile: '%s'", str);
+    sb_rate_done();
+    return 1;
+  }
+
+  return 0;
+}
+
+
+void sb_rate_done(void)
+{
+  free(profile.rates);
+  free(profile.ends);
+
+  profile.rates = NULL;
+  profile.ends = NULL;
+  profile.n = 0;
+  profile.type = RATE_PROFILE_NONE;
+}
+
+
+bool sb_rate_profile_enabled(void)
+{
+  return profile.type != RATE_PROFILE_NONE;
+}
+
+
+/* Called for every generated event, so the maximum rate is cached */
+
+double sb_rate_max(void)
+{
+  if (profile.type == RATE_PROFILE_NONE)
+    return sb_globals.tx_rate;
+
+  return profile.max;
+}
+
+
+double sb_rate_get(uint64_t ns)
+{
+  const double t = NS2SEC(ns);
+  size_t       lo, hi;
+
+  switch (profile.type) {
+  case RATE_PROFILE_NONE:
+    return sb_globals.tx_rate;
+
+  case RATE_PROFILE_RAMP:
+    if (t >= profile.args[2])
+      return profile.args[1];
+    return profile.args[0] +
+      (profile.args[1] - profile.args[0]) * t / profile.args[2];
+
+  case RATE_PROFILE_SINE:
+    return SB_MAX(0.0, profile.args[0] +
+                  profile.args[1] * sin(2 * M_PI * t / profile.args[2]));
+
+  case RATE_PROFILE_STEP:
+  case RATE_PROFILE_CSV:
+    if (t >= profile.ends[profile.n - 1])
+      return profile.rates[profile.n - 1];
+
+    /* Find the first element ending after t */
+    lo = 0;
+    hi = profile.n - 1;
+    while (lo < hi)
+    {
+      const size_t mid = (lo + hi) / 2;
+
+      if (profile.ends[mid] > t)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+    return profile.rates[lo];
+  }
+
+  return sb_globals.tx_rate;
+}
@@ -0,0 +1,48 @@
+/* Copyright (C) 2026 sysbench contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+/*
+  Target event rate for the --rate mode, either constant or following a
+  time-varying profile specified with --rate-profile.
+*/
+
+#ifndef SB_RATE_H
+#define SB_RATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Parse --rate-profile, if specified. Returns 0 on success, 1 on errors. */
+int sb_rate_init(void);
+
+/* Return true if a rate profile was specified with --rate-profile */
+bool sb_rate_profile_enabled(void);
+
+/* Return the maximum target rate of the profile */
+double sb_rate_max(void);
+
+/* Release resources allocated by sb_rate_init() */
+void sb_rate_done(void);
+
+/*
+  Return the target rate in events per second at a given time in nanoseconds
+  since the benchmark start. Returns sb_globals.tx_rate when no profile is
+  specified.
+*/
+double sb_rate_get(uint64_t ns);
+
+#endif /* SB_RATE_H */
@@ -28,10 +28,96 @@
 # include <string.h>
 #endif
 
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+# include <cpuid.h>
+#endif
+
 #include "sb_logger.h"
 #include "sb_timer.h"
 #include "sb_util.h"
 
+/* Time to measure the TSC frequency against CLOCK_MONOTONIC */
+#define TSC_CALIBRATION_NS 50000000
+
+sb_clock_t sb_clock;
+
+#ifdef SB_HAVE_TSC
+
+/* Check if the CPU reports an invariant TSC */
+
+static bool tsc_invariant(void)
+{
+  unsigned int eax, ebx, ecx, edx;
+
+  if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+    return false;
+
+  __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+
+  return (edx & (1U << 8)) != 0;
+}
+
+/* Measure the TSC frequency against CLOCK_MONOTONIC */
+
+static void tsc_calibrate(void)
+{
+  uint64_t ns_start, ns_end, tsc_start, tsc_end;
+
+  sb_clock.tsc = false;
+
+  ns_start = sb_clock_ns();
+  tsc_start = __rdtsc();
+
+  sb_nanosleep(TSC_CALIBRATION_NS);
+
+  ns_end = sb_clock_ns();
+  tsc_end = __rdtsc();
+
+  sb_clock.tsc_base = tsc_end;
+  sb_clock.ns_base = ns_end;
+  sb_clock.tsc_mult = (uint64_t)
+    ((((unsigned __int128) (ns_end - ns_start)) << 32) / (tsc_end - tsc_start));
+
+  sb_clock.tsc = true;
+}
+
+#endif /* SB_HAVE_TSC */
+
+/* Select clock source by name */
+
+int sb_clock_init(const char *name)
+{
+  sb_clock.tsc = false;
+
+  if (!strcasecmp(name, "monotonic"))
+    return 0;
+
+  if (strcasecmp(name, "tsc"))
+  {
+    log_text(LOG_FATAL, "Invalid value for --clock: '%s'", name);
+    return 1;
+  }
+
+#ifdef SB_HAVE_TSC
+  if (tsc_invariant())
+  {
+    tsc_calibrate();
+    log_text(LOG_DEBUG, "TSC frequency: %.3f MHz",
+             (double) (UINT64_C(1) << 32) * 1000 / sb_clock.tsc_mult);
+    return 0;
+  }
+#endif
+
+  log_text(LOG_WARNING, "Invariant TSC is not available on this platform, "
+           "using the monotonic clock instead");
+
+  return 0;
+}
+
 /* Some functions for simple time operations */
 
 /* initialize timer */
@@ -40,10 +126,16 @@ void sb_timer_init(sb_timer_t *t)
 {
   SB_COMPILE_TIME_ASSERT(sizeof(sb_timer_t) % CK_MD_CACHELINE == 0);
 
-  memset(&t->time_start, 0, sizeof(struct timespec));
-  memset(&t->time_end, 0, sizeof(struct timespec));
+  t->time_start = 0;
+  t->time_end = 0;
+
+  ck_sequence_init(&t->seq);
+  t->epoch = t->prev_epoch = t->req_epoch = 0;
 
-  ck_spinlock_init(&t->lock);
+  t->prev_events = 0;
+  t->prev_min_time = UINT64_MAX;
+  t->prev_max_time = 0;
+  t->prev_sum_time = 0;
 
   sb_timer_reset(t);
 }
@@ -65,14 +157,14 @@ void sb_timer_copy(sb_timer_t *to, sb_timer_t *from)
 {
   memcpy(to, from, sizeof(sb_timer_t));
 
-  ck_spinlock_init(&to->lock);
+  ck_sequence_init(&to->seq);
 }
 
 /* check whether the timer is running */
 
 bool sb_timer_running(sb_timer_t *t)
 {
-  return TIMESPEC_DIFF(t->time_start, t->time_end) > 0;
+  return t->time_start > t->time_end;
 }
 
 /*
@@ -83,12 +175,10 @@ bool sb_timer_running(sb_timer_t *t)
 
 uint64_t sb_timer_current(sb_timer_t *t)
 {
-  struct timespec tmp;
-  uint64_t        res;
+  const uint64_t ns = sb_clock_ns();
+  const uint64_t res = ns - t->time_start;
 
-  SB_GETTIME(&tmp);
-  res = TIMESPEC_DIFF(tmp, t->time_start);
-  t->time_start = tmp;
+  t->time_start = ns;
 
   return res;
 }
@@ -100,14 +190,57 @@ uint64_t sb_timer_current(sb_timer_t *t)
 
 void sb_timer_checkpoint(sb_timer_t *t, sb_timer_t *old)
 {
-  ck_spinlock_lock(&t->lock);
+  /* req_epoch is only modified here, so no atomic load is required */
+  const unsigned int epoch = t->req_epoch;
+  unsigned int       version;
+
+  /* Close the current epoch. Pairs with the fence in sb_timer_stop() */
+  ck_pr_store_uint(&t->req_epoch, epoch + 1);
+  ck_pr_fence_store_load();
+
+  do
+  {
+    version = ck_sequence_read_begin(&t->seq);
+    memcpy(old, t, sizeof(*old));
+  } while (ck_sequence_read_retry(&t->seq, version));
+
+  if (old->epoch != epoch)
+  {
+    if (old->epoch == epoch + 1 && old->prev_epoch == epoch)
+    {
+      /* The writer has already started a new epoch */
+      old->events = old->prev_events;
+      old->min_time = old->prev_min_time;
+      old->max_time = old->prev_max_time;
+      old->sum_time = old->prev_sum_time;
+    }
+    else
+    {
+      /* No events have been stopped in the closed epoch */
+      sb_timer_reset(old);
+    }
+  }
+
+  ck_sequence_init(&old->seq);
+  old->epoch = old->req_epoch = epoch;
+}
 
-  memcpy(old, t, sizeof(*old));
-  ck_spinlock_init(&old->lock);
+/* Start a new epoch requested by sb_timer_checkpoint() */
 
-  sb_timer_reset(t);
+void sb_timer_new_epoch(sb_timer_t *t, unsigned int epoch)
+{
+  t->prev_epoch = t->epoch;
+  t->prev_events = t->events;
+  t->prev_min_time = t->min_time;
+  t->prev_max_time = t->max_time;
+  t->prev_sum_time = t->sum_time;
 
-  ck_spinlock_unlock(&t->lock);
+  t->epoch = epoch;
+
+  t->min_time = UINT64_MAX;
+  t->max_time = 0;
+  t->sum_time = 0;
+  t->events = 0;
 }
 
 /* get average time per event */
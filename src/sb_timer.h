@@ -37,8 +37,14 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#if defined(__x86_64__) && defined(__GNUC__)
+# define SB_HAVE_TSC 1
+# include <x86intrin.h>
+#endif
+
 #include "sb_util.h"
-#include "ck_spinlock.h"
+#include "ck_pr.h"
+#include "ck_sequence.h"
 
 #define NS_PER_SEC 1000000000
 #define US_PER_SEC 1000000
@@ -74,25 +80,85 @@
   } while (0)
 #endif
 
+/*
+  Clock source used for event timing, see --clock. Only modified by
+  sb_clock_init(), i.e. before any timers are started.
+*/
+
+typedef struct
+{
+  bool     tsc;       /* Use the time stamp counter rather than clock_gettime() */
+  uint64_t tsc_base;  /* TSC value at calibration time */
+  uint64_t ns_base;   /* CLOCK_MONOTONIC value at calibration time */
+  uint64_t tsc_mult;  /* Nanoseconds per TSC tick as a 32.32 fixed point value */
+} sb_clock_t;
+
+extern sb_clock_t sb_clock;
+
+/*
+  Select clock source by name: "monotonic" or "tsc". The latter falls back to
+  "monotonic" with a warning if the CPU does not provide an invariant TSC.
+  Returns 0 on success, 1 on errors.
+*/
+int sb_clock_init(const char *name);
+
+/* Get the current time in nanoseconds from the selected clock source */
+static inline uint64_t sb_clock_ns(void)
+{
+  struct timespec ts;
+
+#ifdef SB_HAVE_TSC
+  if (SB_LIKELY(sb_clock.tsc))
+    return sb_clock.ns_base + (uint64_t)
+      (((unsigned __int128) (__rdtsc() - sb_clock.tsc_base) *
+        sb_clock.tsc_mult) >> 32);
+#endif
+
+  SB_GETTIME(&ts);
+
+  return SEC2NS(ts.tv_sec) + ts.tv_nsec;
+}
+
 typedef enum {TIMER_UNINITIALIZED, TIMER_INITIALIZED, TIMER_STOPPED, \
               TIMER_RUNNING} timer_state_t;
 
-/* Timer structure definition */
+/*
+  Timer structure definition.
+
+  A timer is only modified by a single thread, which is the one calling
+  sb_timer_start() and sb_timer_stop(). Those functions update the timer in a
+  seqlock write section, so other threads can take consistent copies with
+  sb_timer_checkpoint() without any locking on the writer side.
+
+  Since a reader cannot reset the timer itself, sb_timer_checkpoint() instead
+  requests a new "epoch" by incrementing 'req_epoch'. The writer notices that on
+  the next sb_timer_stop() call, saves the statistics of the closed epoch into
+  the prev_* fields and starts a new epoch with empty statistics.
+*/
 
 typedef struct
 {
-  struct timespec time_start;
-  struct timespec time_end;
+  uint64_t        time_start;
+  uint64_t        time_end;
   uint64_t        events;
   uint64_t        queue_time;
   uint64_t        min_time;
   uint64_t        max_time;
   uint64_t        sum_time;
 
-  ck_spinlock_t   lock;
+  /* Statistics of the previous epoch */
+  uint64_t        prev_events;
+  uint64_t        prev_min_time;
+  uint64_t        prev_max_time;
+  uint64_t        prev_sum_time;
+
+  ck_sequence_t   seq;
+  unsigned int    epoch;
+  unsigned int    prev_epoch;
+  unsigned int    req_epoch;
 
-  char pad[SB_CACHELINE_PAD(sizeof(struct timespec)*2 + sizeof(uint64_t)*5 +
-                            sizeof(ck_spinlock_t))];
+  char pad[SB_CACHELINE_PAD(sizeof(uint64_t)*11 +
+                            sizeof(ck_sequence_t) + sizeof(unsigned int)*3)];
 } sb_timer_t;
 
 
@@ -113,24 +179,40 @@ void sb_timer_reset(sb_timer_t *t);
 /* check whether the timer is running */
 bool sb_timer_running(sb_timer_t *t);
 
+/* Start a new epoch requested by sb_timer_checkpoint() */
+void sb_timer_new_epoch(sb_timer_t *t, unsigned int epoch);
+
 /* start timer */
 static inline void sb_timer_start(sb_timer_t *t)
 {
-  ck_spinlock_lock(&t->lock);
-
-  SB_GETTIME(&t->time_start);
+  const uint64_t ns = sb_clock_ns();
 
-  ck_spinlock_unlock(&t->lock);
+  ck_sequence_write_begin(&t->seq);
+  t->time_start = ns;
+  ck_sequence_write_end(&t->seq);
 }
 
 /* stop timer */
 static inline uint64_t sb_timer_stop(sb_timer_t *t)
 {
-  ck_spinlock_lock(&t->lock);
+  const uint64_t ns = sb_clock_ns();
+  unsigned int   epoch;
+
+  ck_sequence_write_begin(&t->seq);
+
+  /*
+    Pairs with the fence in sb_timer_checkpoint(): either we see the new epoch
+    requested by the reader, or the reader sees this write section and retries
+  */
+  ck_pr_fence_store_load();
 
-  SB_GETTIME(&t->time_end);
+  epoch = ck_pr_load_uint(&t->req_epoch);
+  if (SB_UNLIKELY(epoch != t->epoch))
+    sb_timer_new_epoch(t, epoch);
 
-  uint64_t elapsed = TIMESPEC_DIFF(t->time_end, t->time_start) + t->queue_time;
+  t->time_end = ns;
+
+  uint64_t elapsed = t->time_end - t->time_start + t->queue_time;
 
   t->events++;
   t->sum_time += elapsed;
@@ -140,7 +222,7 @@ static inline uint64_t sb_timer_stop(sb_timer_t *t)
   if (SB_UNLIKELY(elapsed > t->max_time))
     t->max_time = elapsed;
 
-  ck_spinlock_unlock(&t->lock);
+  ck_sequence_write_end(&t->seq);
 
   return elapsed;
 }
@@ -151,10 +233,7 @@ static inline uint64_t sb_timer_stop(sb_timer_t *t)
 */
 static inline uint64_t sb_timer_value(sb_timer_t *t)
 {
-  struct timespec ts;
-
-  SB_GETTIME(&ts);
-  return TIMESPEC_DIFF(ts, t->time_start) + t->queue_time;
+  return sb_clock_ns() - t->time_start + t->queue_time;
 }
 
 /* Clone a timer */
@@ -169,7 +248,9 @@ uint64_t sb_timer_current(sb_timer_t *t);
 
 /*
   Atomically reset a given timer after copying its state into the timer pointed
-  to by 'old'.
+  to by 'old'. Can be called concurrently with sb_timer_start()/sb_timer_stop()
+  from the thread owning the timer, but not with other sb_timer_checkpoint()
+  calls for the same timer.
 */
 void sb_timer_checkpoint(sb_timer_t *t, sb_timer_t *old);
 
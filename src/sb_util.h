@@ -31,6 +31,8 @@
 # include <unistd.h>
 #endif
 
+#include <stdint.h>
+
 #include "ck_md.h"
 #include "ck_cc.h"
 
@@ -85,6 +87,28 @@
 #define SB_LIKELY(x) CK_CC_LIKELY(x)
 #define SB_UNLIKELY(x) CK_CC_UNLIKELY(x)
 
+/*
+  Count leading zero bits in a 64-bit value. The result is undefined for 0, so
+  callers must make sure at least one bit is set.
+*/
+#ifdef __GNUC__
+#  define SB_CLZ64(x) __builtin_clzll((unsigned long long) (x))
+#else
+static inline int sb_clz64(uint64_t x)
+{
+  int n = 0;
+
+  while (!(x & (UINT64_C(1) << 63)))
+  {
+    x <<= 1;
+    n++;
+  }
+
+  return n;
+}
+#  define SB_CLZ64(x) sb_clz64(x)
+#endif /* __GNUC__ */
+
 /* SB_CONTAINER_OF */
 #ifdef __GNUC__
 #  define SB_MEMBER_TYPE(type, member) __typeof__ (((type *)0)->member)
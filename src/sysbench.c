@@ -73,6 +73,7 @@
 #include "sb_rand.h"
 #include "sb_thread.h"
 #include "sb_barrier.h"
+#include "sb_rate.h"
 
 #include "ck_cc.h"
 #include "ck_ring.h"
@@ -82,6 +83,33 @@
 /* Maximum queue length for the tx-rate mode. Must be a power of 2 */
 #define MAX_QUEUE_LEN 131072
 
+/*
+  Time to wait before retrying to enqueue an event when the queue is full and
+  --rate-overload=wait
+*/
+#define EVENTGEN_RETRY_NS 10000
+
+/*
+  With --rate-scheduler=thread, worker threads busy-wait for the intended event
+  start time if it is closer than this, and sleep otherwise
+*/
+#define RATE_SPIN_NS 50000
+
+/* Maximum time to sleep before re-checking for errors and time limits */
+#define RATE_MAX_SLEEP_NS 100000000
+
+/* Time step to re-check the target rate when it is zero */
+#define RATE_IDLE_NS 1000000
+
+/*
+  The deadline thread busy-waits for the --time limit if it is closer than this,
+  so that the time limit flag is set with no wakeup latency
+*/
+#define DEADLINE_SPIN_NS 1000000
+
+/* Maximum number of events claimed by a worker thread at once for --events */
+#define EVENT_BATCH_MAX 1024
+
 /*
   Extra thread ID assigned to background threads. This may be used as an index
   into per-thread arrays (see comment in sb_alloc_per_thread_array().
@@ -103,6 +131,35 @@ sb_arg_t general_args[] =
   SB_OPT("thread-stack-size", "size of stack per thread", "64K", SIZE),
   SB_OPT("thread-init-timeout", "wait time in seconds for worker threads to initialize", "30", INT),
   SB_OPT("rate", "average transactions rate. 0 for unlimited rate", "0", INT),
+  SB_OPT("rate-profile", "time-varying target rate to use instead of a "
+         "constant --rate: 'ramp:FROM:TO:SECONDS' for a linear ramp, "
+         "'step:RATE:SECONDS[,RATE:SECONDS...]' for a table of steps, "
+         "'sine:MEAN:AMPLITUDE:PERIOD' for a sinusoid, or 'csv:FILE' for "
+         "per-second target rates read from a file", NULL, STRING),
+  SB_OPT("rate-overload", "action to take when worker threads are unable to "
+         "keep up with the --rate event generation rate: 'abort' the run, or "
+         "'wait' for free space in the event queue. In the latter case "
+         "events keep their intended start times, so any delays are "
+         "accounted in latency statistics", "abort", STRING),
+  SB_OPT("rate-scheduler", "event scheduling method for the --rate mode: "
+         "'queue' uses a single event generation thread and a shared event "
+         "queue, 'thread' makes each worker thread follow its own arrival "
+         "schedule with the average rate of --rate/--threads, which scales to "
+         "much higher rates. Events are never queued with 'thread', so worker "
+         "threads that cannot keep up fall behind their schedules and delays "
+         "are accounted in latency statistics", "queue", STRING),
+  SB_OPT("thread-rate", "per-thread event rate for closed-loop pacing: each "
+         "worker thread waits as necessary to start events at this average "
+         "rate. 0 disables per-thread pacing", "0", DOUBLE),
+  SB_OPT("think-time", "time in milliseconds each worker thread waits after "
+         "an event is completed before starting the next one", "0", DOUBLE),
+  SB_OPT("pacing-distribution", "distribution of intervals for --thread-rate "
+         "and --think-time: fixed, exponential or uniform", "fixed", STRING),
+  SB_OPT("clock", "clock source for event timing: 'monotonic' uses "
+         "clock_gettime(CLOCK_MONOTONIC), 'tsc' uses the CPU time stamp "
+         "counter calibrated at startup, which is cheaper to read. 'tsc' falls "
+         "back to 'monotonic' if the CPU does not provide an invariant TSC",
+         "monotonic", STRING),
   SB_OPT("report-interval", "periodically report intermediate statistics with "
          "a specified interval in seconds. 0 disables intermediate reports",
          "0", INT),
@@ -136,6 +193,18 @@ static sb_barrier_t worker_barrier;
 /* Wait at most this number of seconds for worker threads to initialize */
 static int thread_init_timeout;
 
+/* Per-thread pacing, see --thread-rate and --think-time */
+typedef enum {
+  PACING_DIST_FIXED,
+  PACING_DIST_EXPONENTIAL,
+  PACING_DIST_UNIFORM
+} pacing_dist_t;
+
+static bool          pacing_enabled;
+static double        thread_rate;
+static double        think_time_ns;
+static pacing_dist_t pacing_dist;
+
 /* Barrier to signal reporting threads */
 static sb_barrier_t report_barrier;
 
@@ -149,6 +218,36 @@ static ck_ring_t          queue_ring CK_CC_CACHELINE;
 static int report_thread_created CK_CC_CACHELINE;
 static int checkpoints_thread_created;
 static int eventgen_thread_created;
+static int deadline_thread_created;
+
+/*
+  Maximum time in nanoseconds by which event generation was behind schedule
+  since the last intermediate report
+*/
+static uint64_t eventgen_backlog_ns CK_CC_CACHELINE;
+
+/*
+  Per-thread event schedules for --rate-scheduler=thread or per-thread pacing
+*/
+typedef struct {
+  uint64_t next_ns;     /* intended start time of the next event */
+  uint64_t backlog_ns;  /* max lag behind schedule since the last report */
+  char     pad[SB_CACHELINE_PAD(sizeof(uint64_t) * 2)];
+} rate_sched_t;
+
+static rate_sched_t *rate_scheds;
+
+/*
+  Per-thread event budgets for --events. Worker threads claim batches of events
+  from sb_globals.nevents rather than incrementing it for every event, see
+  claim_events().
+*/
+typedef struct {
+  uint64_t left;        /* events left in the currently claimed batch */
+  char     pad[SB_CACHELINE_PAD(sizeof(uint64_t))];
+} event_budget_t;
+
+static event_budget_t *event_budgets;
 
 /* per-thread timers for response time stats */
 static sb_timer_t *timers;
@@ -164,6 +263,14 @@ sb_timer_t sb_intermediate_timer CK_CC_CACHELINE;
 sb_timer_t sb_checkpoint_timer   CK_CC_CACHELINE;
 
 TLS int sb_tls_thread_id;
+TLS bool sb_tls_worker;
+
+/* Generate exponentially distributed number with a given Lambda */
+
+static inline double sb_rand_exp(double lambda)
+{
+  return -lambda * log(1 - sb_rand_uniform_double());
+}
 
 static void print_header(void);
 static void print_help(void);
@@ -182,20 +289,113 @@ static void sigalrm_thread_init_timeout_handler(int sig)
   exit(2);
 }
 
+/*
+  Format latency percentiles for intermediate reports, e.g.
+  "lat (ms,95%): 1.23" or "lat (ms,95%/99%/99.9%): 1.23/4.56/7.89" when
+  additional percentiles are requested with --percentiles.
+*/
+
+char *sb_report_format_latency(sb_stat_t *stat, char *buf, size_t size)
+{
+  unsigned int i;
+  int          n;
+  size_t       len;
+
+  if (sb_globals.n_percentiles < 2)
+  {
+    snprintf(buf, size, "lat (ms,%u%%): %4.2f", sb_globals.percentile,
+             SEC2MS(stat->latency_pct));
+    return buf;
+  }
+
+  len = 0;
+  n = snprintf(buf, size, "lat (ms,");
+  for (i = 0; i < sb_globals.n_percentiles && n >= 0; i++)
+  {
+    len += n;
+    if (len >= size)
+      return buf;
+    n = snprintf(buf + len, size - len, "%s%g%%", i > 0 ? "/" : "",
+                 sb_globals.percentiles[i]);
+  }
+  for (i = 0; i < sb_globals.n_percentiles && n >= 0; i++)
+  {
+    len += n;
+    if (len >= size)
+      return buf;
+    n = snprintf(buf + len, size - len, "%s%4.2f", i > 0 ? "/" : "): ",
+                 SEC2MS(stat->latency_pcts[i]));
+  }
+
+  return buf;
+}
+
+/*
+  Format values of all latency percentiles in sb_globals.percentiles[] from a
+  given array as ", <rank>th percentile: <value>" items into a given buffer.
+  Returns the buffer.
+*/
+
+char *sb_report_format_pcts(const double *pcts, char *buf, size_t size)
+{
+  size_t len = 0;
+
+  buf[0] = '\0';
+
+  for (unsigned int i = 0; i < sb_globals.n_percentiles && len < size; i++)
+  {
+    const int n = snprintf(buf + len, size - len, ", %gth percentile: %.2f",
+                           sb_globals.percentiles[i], SEC2MS(pcts[i]));
+    if (n < 0)
+      break;
+    len += n;
+  }
+
+  return buf;
+}
+
+/*
+  Print a cumulative report line for each latency percentile in
+  sb_globals.percentiles[] with values from a given array. Values are
+  right-aligned so that lines are 'width' characters long after the indentation
+  and the label.
+*/
+
+void sb_report_percentiles(const double *pcts, int width)
+{
+  for (unsigned int i = 0; i < sb_globals.n_percentiles; i++)
+  {
+    char label[32];
+
+    snprintf(label, sizeof(label), "%3gth percentile:",
+             sb_globals.percentiles[i]);
+    log_text(LOG_NOTICE, "        %s %*.2f", label,
+             (int) (width - strlen(label)), SEC2MS(pcts[i]));
+  }
+}
+
 /* Default intermediate reports handler */
 
 void sb_report_intermediate(sb_stat_t *stat)
 {
+  char lat_buf[SB_REPORT_LATENCY_BUF_SIZE];
+
   log_timestamp(LOG_NOTICE, stat->time_total,
-                "thds: %" PRIu32 " eps: %4.2f lat (ms,%u%%): %4.2f",
+                "thds: %" PRIu32 " eps: %4.2f %s",
                 stat->threads_running,
                 stat->events / stat->time_interval,
-                sb_globals.percentile,
-                SEC2MS(stat->latency_pct));
+                sb_report_format_latency(stat, lat_buf, sizeof(lat_buf)));
   if (sb_globals.tx_rate > 0)
+  {
     log_timestamp(LOG_NOTICE, stat->time_total,
                   "queue length: %" PRIu64 " concurrency: %" PRIu64,
                   stat->queue_length, stat->concurrency);
+    log_timestamp(LOG_NOTICE, stat->time_total,
+                  "target rate: %4.2f backlog (ms): %4.2f "
+                  "service lat (ms,%u%%): %4.2f",
+                  stat->rate_target, SEC2MS(stat->backlog_time),
+                  sb_globals.percentile, SEC2MS(stat->latency_service_pct));
+  }
 }
 
 
@@ -214,6 +414,10 @@ static void report_get_common_stat(sb_stat_t *stat, sb_counters_t cnt)
   stat->bytes_read =    cnt[SB_CNT_BYTES_READ];
   stat->bytes_written = cnt[SB_CNT_BYTES_WRITTEN];
 
+  stat->pool_checkouts = cnt[SB_CNT_POOL_CHECKOUT];
+  stat->pool_waits =     cnt[SB_CNT_POOL_WAIT];
+  stat->pool_wait_time = NS2SEC(cnt[SB_CNT_POOL_WAIT_NS]);
+
   stat->time_total = NS2SEC(sb_timer_value(&sb_exec_timer)) -
     sb_globals.warmup_time;
 }
@@ -234,16 +438,54 @@ static void report_intermediate(void)
   sb_counters_agg_intermediate(cnt);
   report_get_common_stat(&stat, cnt);
 
-  stat.latency_pct =
-    MS2SEC(sb_histogram_get_pct_intermediate(&sb_latency_histogram,
-                                             sb_globals.percentile));
+  if (sb_globals.n_percentiles > 0)
+  {
+    sb_histogram_get_pcts_intermediate(&sb_latency_histogram,
+                                       sb_globals.percentiles,
+                                       sb_globals.n_percentiles,
+                                       stat.latency_pcts);
+    for (unsigned i = 0; i < sb_globals.n_percentiles; i++)
+      stat.latency_pcts[i] = MS2SEC(stat.latency_pcts[i]);
+    stat.latency_pct = stat.latency_pcts[0];
+  }
 
-  stat.time_interval = NS2SEC(sb_timer_current(&sb_intermediate_timer));
+  const uint64_t interval_ns = sb_timer_current(&sb_intermediate_timer);
+
+  stat.time_interval = NS2SEC(interval_ns);
 
   if (sb_globals.tx_rate > 0)
   {
-    stat.queue_length = ck_ring_size(&queue_ring);
     stat.concurrency = ck_pr_load_int(&sb_globals.concurrency);
+    /* Use the target rate in the middle of the reported interval */
+    stat.rate_target = sb_rate_get(sb_timer_value(&sb_exec_timer) -
+                                   interval_ns / 2);
+
+    if (sb_globals.tx_rate_per_thread)
+    {
+      uint64_t backlog_ns = 0;
+
+      for (unsigned i = 0; i < sb_globals.threads; i++)
+        backlog_ns = SB_MAX(backlog_ns,
+                            ck_pr_fas_64(&rate_scheds[i].backlog_ns, 0));
+
+      stat.backlog_time = NS2SEC(backlog_ns);
+    }
+    else
+    {
+      stat.queue_length = ck_ring_size(&queue_ring);
+      stat.backlog_time = NS2SEC(ck_pr_fas_64(&eventgen_backlog_ns, 0));
+    }
+
+    if (sb_globals.n_percentiles > 0)
+    {
+      sb_histogram_get_pcts_intermediate(&sb_service_histogram,
+                                         sb_globals.percentiles,
+                                         sb_globals.n_percentiles,
+                                         stat.latency_service_pcts);
+      for (unsigned i = 0; i < sb_globals.n_percentiles; i++)
+        stat.latency_service_pcts[i] = MS2SEC(stat.latency_service_pcts[i]);
+      stat.latency_service_pct = stat.latency_service_pcts[0];
+    }
   }
 
   if (current_test && current_test->ops.report_intermediate)
@@ -307,8 +549,7 @@ void sb_report_cumulative(sb_stat_t *stat)
            SEC2MS(stat->latency_max));
 
   if (sb_globals.percentile > 0)
-    log_text(LOG_NOTICE, "        %3dth percentile: %27.2f",
-             sb_globals.percentile, SEC2MS(stat->latency_pct));
+    sb_report_percentiles(stat->latency_pcts, 44);
   else
     log_text(LOG_NOTICE, "         percentile stats:               disabled");
 
@@ -316,6 +557,17 @@ void sb_report_cumulative(sb_stat_t *stat)
            SEC2MS(stat->latency_sum));
   log_text(LOG_NOTICE, "");
 
+  if (sb_globals.tx_rate > 0 && sb_globals.percentile > 0)
+  {
+    /*
+      Latency above is measured from intended event start times, print service
+      times measured from actual start times as well
+    */
+    log_text(LOG_NOTICE, "Service time (ms):");
+    sb_report_percentiles(stat->latency_service_pcts, 44);
+    log_text(LOG_NOTICE, "");
+  }
+
   /* Aggregate temporary timers copy */
   sb_timer_t t;
   sb_timer_init(&t);
@@ -378,9 +630,28 @@ static void checkpoint(sb_stat_t *stat)
 
   stat->time_interval = NS2SEC(sb_timer_current(&sb_checkpoint_timer));
 
-  stat->latency_pct =
-    MS2SEC(sb_histogram_get_pct_checkpoint(&sb_latency_histogram,
-                                           sb_globals.percentile));
+  if (sb_globals.n_percentiles > 0)
+  {
+    sb_histogram_get_pcts_checkpoint(&sb_latency_histogram,
+                                     sb_globals.percentiles,
+                                     sb_globals.n_percentiles,
+                                     stat->latency_pcts);
+    for (unsigned i = 0; i < sb_globals.n_percentiles; i++)
+      stat->latency_pcts[i] = MS2SEC(stat->latency_pcts[i]);
+    stat->latency_pct = stat->latency_pcts[0];
+
+    if (sb_globals.tx_rate > 0)
+    {
+      sb_histogram_get_pcts_checkpoint(&sb_service_histogram,
+                                       sb_globals.percentiles,
+                                       sb_globals.n_percentiles,
+                                       stat->latency_service_pcts);
+      for (unsigned i = 0; i < sb_globals.n_percentiles; i++)
+        stat->latency_service_pcts[i] =
+          MS2SEC(stat->latency_service_pcts[i]);
+      stat->latency_service_pct = stat->latency_service_pcts[0];
+    }
+  }
 
   /* Atomically reset each timer after copying it into its timers_copy slot */
   for (size_t i = 0; i < sb_globals.threads; i++)
@@ -623,12 +894,24 @@ void print_run_mode(sb_test_t *test)
   if (sb_globals.warmup_time > 0)
     log_text(LOG_NOTICE, "Warmup time: %ds", sb_globals.warmup_time);
 
-  if (sb_globals.tx_rate > 0)
+  if (sb_rate_profile_enabled())
+  {
+    log_text(LOG_NOTICE, "Target transaction rate profile: %s",
+             sb_get_value_string("rate-profile"));
+  }
+  else if (sb_globals.tx_rate > 0)
   {
     log_text(LOG_NOTICE,
             "Target transaction rate: %d/sec", sb_globals.tx_rate);
   }
 
+  if (pacing_enabled)
+  {
+    log_text(LOG_NOTICE, "Per-thread pacing: rate: %g/sec, think time: %gms, "
+             "distribution: %s", thread_rate, NS2MS(think_time_ns),
+             sb_get_value_string("pacing-distribution"));
+  }
+
   if (sb_globals.report_interval)
   {
     log_text(LOG_NOTICE, "Report intermediate results every %d second(s)",
@@ -686,16 +969,220 @@ void print_run_mode(sb_test_t *test)
     test->ops.print_mode();
 }
 
-bool sb_more_events(int thread_id)
+/*
+  Advance a given intended event start time to the next arrival of a Poisson
+  process following the target rate divided by 'nsched', i.e. the number of
+  independent schedules. Arrivals are generated by thinning: candidates are
+  drawn at the maximum rate of the profile, and each one is accepted with the
+  probability of the target rate at its time divided by the maximum rate. Unlike
+  intervals drawn at the rate of the previous arrival, this follows steps and
+  ramps out of low rates immediately. Periods with zero target rate are skipped.
+  Returns false if the time limit is reached or an error occurs while waiting
+  for a non-zero target rate.
+*/
+
+static bool rate_next_event(uint64_t *next_ns, unsigned int nsched)
+{
+  const double max_rate = sb_rate_max();
+  double       rate;
+
+  for (;;)
+  {
+    *next_ns += sb_rand_exp(1e9 * nsched / max_rate);
+
+    while ((rate = sb_rate_get(*next_ns)) <= 0)
+    {
+      const uint64_t curr_ns = sb_timer_value(&sb_exec_timer);
+
+      if (sb_globals.error ||
+          (sb_globals.max_time_ns > 0 && curr_ns >= sb_globals.max_time_ns))
+        return false;
+
+      *next_ns += RATE_IDLE_NS;
+      if (*next_ns > curr_ns)
+        sb_nanosleep(*next_ns - curr_ns);
+    }
+
+    if (rate >= max_rate || sb_rand_uniform_double() * max_rate < rate)
+      return true;
+  }
+}
+
+/*
+  Wait until a given absolute time in nanoseconds since the benchmark start by
+  sleeping until close enough to it, and then spinning. 'curr_ns' must be set to
+  the current time by the caller, and is updated on return. Returns false if an
+  error occurs or the time limit is reached while waiting.
+*/
+
+static bool wait_until(uint64_t due_ns, uint64_t *curr_ns)
 {
-  (void) thread_id; /* unused */
+  while (*curr_ns < due_ns)
+  {
+    if (sb_globals.error)
+      return false;
+
+    if (sb_globals.max_time_ns > 0 &&
+        SB_UNLIKELY(*curr_ns >= sb_globals.max_time_ns))
+    {
+      log_text(LOG_INFO, "Time limit exceeded, exiting...");
+      return false;
+    }
+
+    if (due_ns - *curr_ns > RATE_SPIN_NS)
+      sb_nanosleep(SB_MIN(due_ns - *curr_ns - RATE_SPIN_NS,
+                          (uint64_t) RATE_MAX_SLEEP_NS));
+    else
+      ck_pr_stall();
+
+    *curr_ns = sb_timer_value(&sb_exec_timer);
+  }
+
+  return true;
+}
+
+/*
+  Generate a random pacing interval with a given mean according to
+  --pacing-distribution
+*/
+
+static uint64_t pacing_interval(double mean_ns)
+{
+  switch (pacing_dist) {
+  case PACING_DIST_EXPONENTIAL:
+    return sb_rand_exp(mean_ns);
+  case PACING_DIST_UNIFORM:
+    return 2 * mean_ns * sb_rand_uniform_double();
+  case PACING_DIST_FIXED:
+  default:
+    return mean_ns;
+  }
+}
+
+/*
+  Wait for the next event start time according to --thread-rate and
+  --think-time for a given thread. Event start times are absolute deadlines
+  spaced by --thread-rate intervals, so event execution times do not affect the
+  per-thread rate, unless a thread falls behind its schedule by more than one
+  interval, in which case the schedule is restarted from the current time
+  rather than trying to catch up with a burst of events.
+*/
+
+static bool wait_paced_event(int thread_id)
+{
+  rate_sched_t * const sched = &rate_scheds[thread_id];
+  uint64_t     curr_ns = sb_timer_value(&sb_exec_timer);
+  uint64_t     due_ns = curr_ns;
+
+  if (SB_UNLIKELY(sched->next_ns == 0))
+  {
+    /* First event, start immediately */
+    sched->next_ns = curr_ns;
+    return true;
+  }
+
+  if (thread_rate > 0)
+  {
+    const uint64_t interval_ns = pacing_interval(1e9 / thread_rate);
+
+    if (curr_ns > sched->next_ns + interval_ns)
+      sched->next_ns = curr_ns;
+    else
+      sched->next_ns += interval_ns;
+
+    due_ns = sched->next_ns;
+  }
 
+  if (think_time_ns > 0)
+    due_ns = SB_MAX(due_ns, curr_ns + pacing_interval(think_time_ns));
+
+  return wait_until(due_ns, &curr_ns);
+}
+
+/*
+  Wait for the intended start time of the next event in the arrival schedule of
+  a given thread. Used with --rate-scheduler=thread.
+*/
+
+static bool wait_scheduled_event(int thread_id)
+{
+  rate_sched_t * const sched = &rate_scheds[thread_id];
+  uint64_t     curr_ns = sb_timer_value(&sb_exec_timer);
+
+  if (SB_UNLIKELY(sched->next_ns == 0))
+    sched->next_ns = curr_ns;
+
+  /*
+    Superposition of independent Poisson processes with rates of
+    tx_rate/threads is a Poisson process with the rate of tx_rate
+  */
+  if (!rate_next_event(&sched->next_ns, sb_globals.threads))
+    return false;
+
+  const uint64_t due_ns = sched->next_ns;
+
+  if (!wait_until(due_ns, &curr_ns))
+    return false;
+
+  /* Track how far behind schedule we are */
+  const uint64_t lag_ns = curr_ns - due_ns;
+
+  if (lag_ns > ck_pr_load_64(&sched->backlog_ns))
+    ck_pr_store_64(&sched->backlog_ns, lag_ns);
+
+  ck_pr_inc_int(&sb_globals.concurrency);
+
+  timers[thread_id].queue_time = lag_ns;
+
+  return true;
+}
+
+
+/*
+  Take one event from the --events budget of a given thread, claiming a new
+  batch from the global counter when the budget is exhausted. Batches get
+  smaller as the limit approaches, so that the remaining events are shared
+  among all threads rather than being held by a few of them. Returns false
+  when the event limit is reached.
+*/
+
+static bool claim_events(int thread_id, uint64_t max_events)
+{
+  event_budget_t * const budget = &event_budgets[thread_id];
+
+  if (SB_LIKELY(budget->left > 0))
+  {
+    budget->left--;
+    return true;
+  }
+
+  const uint64_t claimed = ck_pr_load_64(&sb_globals.nevents);
+
+  if (claimed >= max_events)
+    return false;
+
+  const uint64_t batch = SB_MIN(SB_MAX((max_events - claimed) /
+                                       (2 * sb_globals.threads),
+                                       (uint64_t) 1),
+                                (uint64_t) EVENT_BATCH_MAX);
+  const uint64_t start = ck_pr_faa_64(&sb_globals.nevents, batch);
+
+  if (start >= max_events)
+    return false;
+
+  budget->left = SB_MIN(batch, max_events - start) - 1;
+
+  return true;
+}
+
+
+bool sb_more_events(int thread_id)
+{
   if (sb_globals.error)
     return false;
 
-  /* Check if we have a time limit */
-  if (sb_globals.max_time_ns > 0 &&
-      SB_UNLIKELY(sb_timer_value(&sb_exec_timer) >= sb_globals.max_time_ns))
+  /* Check if the time limit has been reached, see deadline_thread_proc() */
+  if (SB_UNLIKELY(ck_pr_load_int(&sb_globals.time_limit_reached)))
   {
     log_text(LOG_INFO, "Time limit exceeded, exiting...");
     return false;
@@ -703,13 +1190,18 @@ bool sb_more_events(int thread_id)
 
   /* Check if we have a limit on the number of events */
   const uint64_t max_events = ck_pr_load_64(&sb_globals.max_events);
-  if (max_events > 0 &&
-      SB_UNLIKELY(ck_pr_faa_64(&sb_globals.nevents, 1) >= max_events))
+  if (max_events > 0 && SB_UNLIKELY(!claim_events(thread_id, max_events)))
   {
     log_text(LOG_INFO, "Event limit exceeded, exiting...");
     return false;
   }
 
+  if (sb_globals.tx_rate > 0 && sb_globals.tx_rate_per_thread)
+    return wait_scheduled_event(thread_id);
+
+  if (pacing_enabled)
+    return wait_paced_event(thread_id);
+
   /* If we are in tx_rate mode, we take events from queue */
   if (sb_globals.tx_rate > 0)
   {
@@ -737,8 +1229,15 @@ bool sb_more_events(int thread_id)
 
     ck_pr_inc_int(&sb_globals.concurrency);
 
-    timers[thread_id].queue_time = sb_timer_value(&sb_exec_timer) -
-      ((uint64_t *) ptr)[0];
+    /*
+      Account for the time since the intended event start time, so that latency
+      statistics are not affected by coordinated omission
+    */
+    const uint64_t intended_ns = ((uint64_t *) ptr)[0];
+    const uint64_t curr_ns = sb_timer_value(&sb_exec_timer);
+
+    timers[thread_id].queue_time =
+      curr_ns > intended_ns ? curr_ns - intended_ns : 0;
   }
 
   return true;
@@ -759,17 +1258,27 @@ void sb_event_stop(int thread_id)
   value = sb_timer_stop(timer);
 
   if (sb_globals.percentile > 0)
-    sb_histogram_update(&sb_latency_histogram, NS2MS(value));
+    sb_histogram_update_int(&sb_latency_histogram, value);
 
   sb_counter_inc(thread_id, SB_CNT_EVENT);
 
   if (sb_globals.tx_rate > 0)
   {
+    if (sb_globals.percentile > 0)
+      sb_histogram_update_int(&sb_service_histogram,
+                              value - timer->queue_time);
+
     ck_pr_dec_int(&sb_globals.concurrency);
   }
 }
 
 
+void sb_sleep_ns(uint64_t ns)
+{
+  sb_nanosleep(ns);
+}
+
+
 /* Main event loop -- the default thread_run implementation */
 
 
@@ -808,6 +1317,7 @@ static void *worker_thread(void *arg)
   sb_test_t * const test = current_test;
 
   sb_tls_thread_id = thread_id = ctxt->id;
+  sb_tls_worker = true;
 
   /* Initialize thread-local RNG state */
   sb_rand_thread_init();
@@ -848,13 +1358,6 @@ static void *worker_thread(void *arg)
   return NULL;
 }
 
-/* Generate exponentially distributed number with a given Lambda */
-
-static inline double sb_rand_exp(double lambda)
-{
-  return -lambda * log(1 - sb_rand_uniform_double());
-}
-
 static void *eventgen_thread_proc(void *arg)
 {
   (void)arg; /* unused */
@@ -881,24 +1384,21 @@ static void *eventgen_thread_proc(void *arg)
 
   eventgen_thread_created = 1;
 
-  /*
-    Get exponentially distributed time intervals in nanoseconds with Lambda =
-    tx_rate. Alternatively, we can use Lambda = tx_rate / 1e9
-  */
-  const double lambda = 1e9 / sb_globals.tx_rate;
-
-  uint64_t curr_ns = sb_timer_value(&sb_exec_timer);
-  uint64_t intr_ns = sb_rand_exp(lambda);
-  uint64_t next_ns = curr_ns + intr_ns;
+  uint64_t curr_ns;
+  uint64_t next_ns = sb_timer_value(&sb_exec_timer);
 
   for (int i = 0; ; i = (i+1) % MAX_QUEUE_LEN)
   {
+    /*
+      Get exponentially distributed time intervals in nanoseconds with Lambda
+      equal to the current target rate
+    */
+    const bool more = rate_next_event(&next_ns, 1);
+
     curr_ns = sb_timer_value(&sb_exec_timer);
-    intr_ns = sb_rand_exp(lambda);
-    next_ns += intr_ns;
 
-    if (sb_globals.max_time_ns > 0 &&
-        SB_UNLIKELY(curr_ns >= sb_globals.max_time_ns))
+    if (!more || (sb_globals.max_time_ns > 0 &&
+                  SB_UNLIKELY(curr_ns >= sb_globals.max_time_ns)))
     {
       /* Wake all waiting threads */
       pthread_cond_broadcast(&queue_cond);
@@ -908,19 +1408,44 @@ static void *eventgen_thread_proc(void *arg)
     if (next_ns > curr_ns)
       sb_nanosleep(next_ns - curr_ns);
 
-    /* Enqueue a new event */
-    queue_array[i] = sb_timer_value(&sb_exec_timer);
-    if (ck_ring_enqueue_spmc(&queue_ring, queue_ring_buffer,
-                             &queue_array[i]) == false)
+    /*
+      Enqueue a new event with its intended start time, which may be in the
+      past if we are behind schedule
+    */
+    queue_array[i] = next_ns;
+    while (ck_ring_enqueue_spmc(&queue_ring, queue_ring_buffer,
+                                &queue_array[i]) == false)
     {
-      sb_globals.error = 1;
-      log_text(LOG_FATAL,
-               "The event queue is full. This means the worker threads are "
-               "unable to keep up with the specified event generation rate");
+      if (!sb_globals.tx_rate_wait)
+      {
+        sb_globals.error = 1;
+        log_text(LOG_FATAL,
+                 "The event queue is full. This means the worker threads are "
+                 "unable to keep up with the specified event generation rate");
+        pthread_cond_broadcast(&queue_cond);
+        return NULL;
+      }
+
+      /* Wake up all waiting threads and retry once some of them dequeue */
       pthread_cond_broadcast(&queue_cond);
-      return NULL;
+      sb_nanosleep(EVENTGEN_RETRY_NS);
+
+      curr_ns = sb_timer_value(&sb_exec_timer);
+
+      if (sb_globals.error || (sb_globals.max_time_ns > 0 &&
+                               curr_ns >= sb_globals.max_time_ns))
+      {
+        pthread_cond_broadcast(&queue_cond);
+        return NULL;
+      }
     }
 
+    /* Track how far behind schedule we are */
+    curr_ns = sb_timer_value(&sb_exec_timer);
+    if (curr_ns > next_ns &&
+        curr_ns - next_ns > ck_pr_load_64(&eventgen_backlog_ns))
+      ck_pr_store_64(&eventgen_backlog_ns, curr_ns - next_ns);
+
     /* Wake up one waiting thread, if there are any */
     pthread_cond_signal(&queue_cond);
   }
@@ -1029,6 +1554,36 @@ static void *checkpoints_thread_proc(void *arg)
   return NULL;
 }
 
+/*
+  Thread enforcing the --time limit. Worker threads only check the flag set by
+  this thread, so they don't have to read the clock for every event.
+*/
+
+static void *deadline_thread_proc(void *arg)
+{
+  uint64_t curr_ns;
+
+  (void) arg; /* unused */
+
+  sb_tls_thread_id = SB_BACKGROUND_THREAD_ID;
+
+  log_text(LOG_DEBUG, "Deadline thread started");
+
+  deadline_thread_created = 1;
+
+  while ((curr_ns = sb_timer_value(&sb_exec_timer)) < sb_globals.max_time_ns)
+  {
+    if (sb_globals.max_time_ns - curr_ns > DEADLINE_SPIN_NS)
+      sb_nanosleep(sb_globals.max_time_ns - curr_ns - DEADLINE_SPIN_NS);
+    else
+      ck_pr_stall();
+  }
+
+  ck_pr_store_int(&sb_globals.time_limit_reached, 1);
+
+  return NULL;
+}
+
 /* Callback to start timers when all threads are ready */
 
 static int threads_started_callback(void *arg)
@@ -1061,6 +1616,7 @@ static int run_test(sb_test_t *test)
   pthread_t    report_thread;
   pthread_t    checkpoints_thread;
   pthread_t    eventgen_thread;
+  pthread_t    deadline_thread;
   unsigned int barrier_threads;
   uint64_t     old_max_events = 0;
 
@@ -1086,7 +1642,8 @@ static int run_test(sb_test_t *test)
 
   /* Calculate the required number of threads for the worker start barrier */
   barrier_threads = 1 /* main thread */ + sb_globals.threads +
-    (sb_globals.tx_rate > 0) /* event generation thread */;
+    (sb_globals.tx_rate > 0 && !sb_globals.tx_rate_per_thread)
+    /* event generation thread */;
 
   if (sb_barrier_init(&worker_barrier, barrier_threads,
                       threads_started_callback, NULL))
@@ -1119,7 +1676,7 @@ static int run_test(sb_test_t *test)
     }
   }
 
-  if (sb_globals.tx_rate > 0)
+  if (sb_globals.tx_rate > 0 && !sb_globals.tx_rate_per_thread)
   {
     if ((err = sb_thread_create(&eventgen_thread, &sb_thread_attr,
                                 &eventgen_thread_proc, NULL)) != 0)
@@ -1165,6 +1722,18 @@ static int run_test(sb_test_t *test)
     return 1;
   }
 
+  if (sb_globals.max_time_ns > 0)
+  {
+    /* Create a thread to enforce the time limit */
+    if ((err = sb_thread_create(&deadline_thread, &sb_thread_attr,
+                                &deadline_thread_proc, NULL)) != 0)
+    {
+      log_errno(LOG_FATAL,
+                "sb_thread_create() for the deadline thread failed.");
+      return 1;
+    }
+  }
+
 #ifdef HAVE_ALARM
   alarm(0);
 
@@ -1236,6 +1805,14 @@ static int run_test(sb_test_t *test)
       log_text(LOG_FATAL, "Terminating the event generator thread failed.");
   }
 
+  if (deadline_thread_created)
+  {
+    /* The deadline thread terminates itself when the time limit is reached */
+    sb_thread_cancel(deadline_thread);
+    if (sb_thread_join(deadline_thread, NULL))
+      log_errno(LOG_FATAL, "Terminating the deadline thread failed.");
+  }
+
   if (checkpoints_thread_created)
   {
     if (sb_thread_cancel(checkpoints_thread) ||
@@ -1310,6 +1887,9 @@ static int init(void)
     return 1;
   }
 
+  if (sb_clock_init(sb_get_value_string("clock")))
+    return 1;
+
   sb_globals.max_events = sb_get_value_int("events");
 
   sb_globals.warmup_time = sb_get_value_int("warmup-time");
@@ -1384,6 +1964,74 @@ static int init(void)
 
   sb_globals.tx_rate = sb_get_value_int("rate");
 
+  if (sb_rate_init())
+    return 1;
+
+  if (sb_rate_profile_enabled())
+  {
+    if (sb_globals.tx_rate > 0)
+    {
+      log_text(LOG_FATAL, "--rate and --rate-profile cannot be used together");
+      return 1;
+    }
+
+    /* Any non-zero value enables the rate mode */
+    const double max_rate = ceil(sb_rate_max());
+
+    sb_globals.tx_rate = max_rate < 1 ? 1 : (unsigned int) max_rate;
+  }
+
+  tmp = sb_get_value_string("rate-overload");
+  if (!strcasecmp(tmp, "abort"))
+    sb_globals.tx_rate_wait = 0;
+  else if (!strcasecmp(tmp, "wait"))
+    sb_globals.tx_rate_wait = 1;
+  else
+  {
+    log_text(LOG_FATAL, "Invalid value for --rate-overload: '%s'", tmp);
+    return 1;
+  }
+
+  thread_rate = sb_get_value_double("thread-rate");
+  think_time_ns = MS2NS(sb_get_value_double("think-time"));
+  if (thread_rate < 0 || think_time_ns < 0)
+  {
+    log_text(LOG_FATAL, "--thread-rate and --think-time cannot be negative");
+    return 1;
+  }
+
+  pacing_enabled = thread_rate > 0 || think_time_ns > 0;
+  if (pacing_enabled && sb_globals.tx_rate > 0)
+  {
+    log_text(LOG_FATAL, "--thread-rate and --think-time cannot be used "
+             "together with --rate or --rate-profile");
+    return 1;
+  }
+
+  tmp = sb_get_value_string("pacing-distribution");
+  if (!strcasecmp(tmp, "fixed"))
+    pacing_dist = PACING_DIST_FIXED;
+  else if (!strcasecmp(tmp, "exponential"))
+    pacing_dist = PACING_DIST_EXPONENTIAL;
+  else if (!strcasecmp(tmp, "uniform"))
+    pacing_dist = PACING_DIST_UNIFORM;
+  else
+  {
+    log_text(LOG_FATAL, "Invalid value for --pacing-distribution: '%s'", tmp);
+    return 1;
+  }
+
+  tmp = sb_get_value_string("rate-scheduler");
+  if (!strcasecmp(tmp, "queue"))
+    sb_globals.tx_rate_per_thread = 0;
+  else if (!strcasecmp(tmp, "thread"))
+    sb_globals.tx_rate_per_thread = 1;
+  else
+  {
+    log_text(LOG_FATAL, "Invalid value for --rate-scheduler: '%s'", tmp);
+    return 1;
+  }
+
   sb_globals.report_interval = sb_get_value_int("report-interval");
 
   sb_globals.n_checkpoints = 0;
@@ -1420,12 +2068,28 @@ static int init(void)
   timers = sb_alloc_per_thread_array(sizeof(sb_timer_t));
   timers_copy = sb_alloc_per_thread_array(sizeof(sb_timer_t));
 
-  if (timers == NULL || timers_copy == NULL)
+  SB_COMPILE_TIME_ASSERT(sizeof(event_budget_t) % CK_MD_CACHELINE == 0);
+  event_budgets = sb_alloc_per_thread_array(sizeof(event_budget_t));
+
+  if (timers == NULL || timers_copy == NULL || event_budgets == NULL)
   {
     log_text(LOG_FATAL, "Memory allocation failure");
     return 1;
   }
 
+  if ((sb_globals.tx_rate > 0 && sb_globals.tx_rate_per_thread) ||
+      pacing_enabled)
+  {
+    SB_COMPILE_TIME_ASSERT(sizeof(rate_sched_t) % CK_MD_CACHELINE == 0);
+
+    rate_scheds = sb_alloc_per_thread_array(sizeof(rate_sched_t));
+    if (rate_scheds == NULL)
+    {
+      log_text(LOG_FATAL, "Memory allocation failure");
+      return 1;
+    }
+  }
+
   for (unsigned i = 0; i < sb_globals.threads; i++)
     sb_timer_init(&timers[i]);
 
@@ -1611,6 +2275,10 @@ end:
 
   free(timers);
   free(timers_copy);
+  free(event_budgets);
+  free(rate_scheds);
+
+  sb_rate_done();
 
   free(sb_globals.argv);
 
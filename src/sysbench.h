@@ -52,6 +52,12 @@
 /* Maximum number of elements in --report-checkpoints list */
 #define MAX_CHECKPOINTS 256
 
+/*
+  Maximum number of percentile ranks in latency stats, i.e. --percentile plus
+  elements of the --percentiles list
+*/
+#define MAX_PERCENTILES 16
+
 /* Request types definition */
 
 typedef enum
@@ -93,6 +99,8 @@ typedef struct {
   double   time_total;          /* Time elapsed since the benchmark start */
 
   double   latency_pct;         /* Latency percentile */
+  /* Latency values for all percentiles in sb_globals.percentiles */
+  double   latency_pcts[MAX_PERCENTILES];
 
   double   latency_min;         /* Minimum latency (cumulative reports only) */
   double   latency_max;         /* Maximum latency (cumulative reports only) */
@@ -109,8 +117,25 @@ typedef struct {
   uint64_t bytes_read;          /* Bytes read */
   uint64_t bytes_written;       /* Bytes written */
 
+  uint64_t pool_checkouts;      /* Connection pool checkouts */
+  uint64_t pool_waits;          /* Checkouts waiting for a connection */
+  double   pool_wait_time;      /* Total time spent waiting for connections */
+
   uint64_t queue_length;        /* Event queue length (tx_rate-only) */
   uint64_t concurrency;         /* Number of in-flight events (tx_rate-only) */
+  double   rate_target;         /* Target event rate (tx_rate-only) */
+
+  /*
+    Service time percentiles, i.e. latency from the actual event start rather
+    than from its intended start time (tx_rate-only)
+  */
+  double   latency_service_pct;
+  double   latency_service_pcts[MAX_PERCENTILES];
+  /*
+    Maximum time by which event generation was behind schedule since the last
+    report because the event queue was full (tx_rate-only)
+  */
+  double   backlog_time;
 } sb_stat_t;
 
 /* Commands */
@@ -185,6 +210,16 @@ typedef struct
   char            **argv;      /* command line arguments */
   char            **env;      /* environment */
   unsigned int    tx_rate;      /* target transaction rate */
+  /*
+    wait for free space in the event queue rather than abort when workers can't
+    keep up with tx_rate
+  */
+  unsigned char   tx_rate_wait;
+  /*
+    each worker thread follows its own arrival schedule in the tx_rate mode,
+    rather than taking events from a shared queue
+  */
+  unsigned char   tx_rate_per_thread;
   uint64_t        max_events;   /* maximum number of events to execute */
   uint64_t        max_time_ns;  /* total execution time limit */
   pthread_mutex_t exec_mutex CK_CC_CACHELINE;   /* execution mutex */
@@ -194,6 +229,12 @@ typedef struct
   unsigned int    threads_running;  /* number of threads currently active */
   unsigned int    report_interval;  /* intermediate reports interval */
   unsigned int    percentile;   /* percentile rank for latency stats */
+  /*
+    all percentile ranks to calculate in latency stats, starting with
+    'percentile'
+  */
+  double          percentiles[MAX_PERCENTILES];
+  unsigned int    n_percentiles; /* number of percentile ranks */
   unsigned int    histogram;    /* show histogram in latency stats */
   /* array of report checkpoints */
   unsigned int    checkpoints[MAX_CHECKPOINTS];
@@ -208,6 +249,8 @@ typedef struct
                                                   shutdown */
   int             forced_shutdown_in_progress;
   int             warmup_time;  /* warmup time */
+  int             time_limit_reached CK_CC_CACHELINE; /* set when the --time
+                                                     limit is reached */
   uint64_t        nevents CK_CC_CACHELINE; /* event counter */
   const char      *luajit_cmd; /* LuaJIT command */
 } sb_globals_t;
@@ -223,15 +266,42 @@ extern sb_timer_t      sb_intermediate_timer;
 extern sb_timer_t      sb_checkpoint_timer;
 
 extern TLS int sb_tls_thread_id;
+/* Set in worker threads, false in the main thread and background threads */
+extern TLS bool sb_tls_worker;
 
 bool sb_more_events(int thread_id);
 sb_event_t sb_next_event(sb_test_t *test, int thread_id);
 void sb_event_start(int thread_id);
 void sb_event_stop(int thread_id);
 
+/* Sleep for a given number of nanoseconds. Exported for Lua scripts */
+void sb_sleep_ns(uint64_t ns);
+
 /* Print a description of available command line options for the current test */
 void sb_print_test_options(void);
 
+/* Buffer size for sb_report_format_latency() */
+#define SB_REPORT_LATENCY_BUF_SIZE 512
+
+/*
+  Format latency percentiles from a given stat object for intermediate reports
+  into a given buffer. Returns the buffer.
+*/
+char *sb_report_format_latency(sb_stat_t *stat, char *buf, size_t size);
+
+/*
+  Format latency percentiles from a given array for cumulative reports as a
+  list of items, each preceded by ", ", into a given buffer. Returns the
+  buffer.
+*/
+char *sb_report_format_pcts(const double *pcts, char *buf, size_t size);
+
+/*
+  Print a cumulative report line for each latency percentile with values from
+  a given array, aligned to a given width
+*/
+void sb_report_percentiles(const double *pcts, int width);
+
 /* Default intermediate reports handler */
 void sb_report_intermediate(sb_stat_t *stat);
 
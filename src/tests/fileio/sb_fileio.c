@@ -775,8 +775,7 @@ void file_report_cumulative(sb_stat_t *stat)
            SEC2MS(stat->latency_max));
 
   if (sb_globals.percentile > 0)
-    log_text(LOG_NOTICE, "        %3dth percentile:                %10.2f",
-             sb_globals.percentile, SEC2MS(stat->latency_pct));
+    sb_report_percentiles(stat->latency_pcts, 42);
   else
     log_text(LOG_NOTICE, "         percentile stats:               disabled");
 
@@ -23,52 +23,233 @@
 #ifdef HAVE_MATH_H
 # include <math.h>
 #endif
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif
 
 #include <inttypes.h>
-#include <sys/wait.h>
-#include <sys/types.h>
-#include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <errno.h>
 #include "db_driver.h"
 
 #include "sysbench.h"
+#include "sb_barrier.h"
+#include "sb_histogram.h"
+#include "sb_rand.h"
+#include "sb_thread.h"
+#include "tpch_answers.h"
+#include "tpch_dbgen.h"
+#include "tpch_qgen.h"
 
-#define TPCH_QUERIES 22
-#define TPCH_QUERY_OFFSET(iteration) (iteration % TPCH_QUERIES == 0 ? TPCH_QUERIES : iteration % TPCH_QUERIES)
+#include "ck_pr.h"
 
 /* TPC-H test arguments */
 static sb_arg_t tpch_args[] =
 {
-  SB_OPT("data-size", "Size of the data to generate in GB", "", INT),
+  SB_OPT("data-size", "Size of the data to generate in GB, i.e. the TPC-H "
+         "scale factor", "1", DOUBLE),
   SB_OPT("root-path", "Absolute path to sysbench's root", "", STRING),
   SB_OPT("report-json", "Print the results in JSON format", "off", BOOL),
+  SB_OPT("power-test", "Run the power test (a single query stream) before "
+         "the throughput test with one query stream per thread", "on", BOOL),
+  SB_OPT("refresh", "Run the refresh functions (RF1 and RF2) in the power "
+         "test and in a refresh stream concurrent with the query streams of "
+         "the throughput test. The refresh stream uses the last thread",
+         "off", BOOL),
+  SB_OPT("answers", "File with answers to compare query results with when "
+         "--validate is on. Without it, results are compared with the first "
+         "stream that has executed each query", "", STRING),
+  SB_OPT("save-answers", "Save query answers to a file when --validate is on",
+         "", STRING),
   SB_OPT_END
 };
 
 /* TPC-H test operations */
 static int tpch_prepare(void);
 static int tpch_init(void);
+static int tpch_thread_init(int thread_id);
 static void tpch_print_mode(void);
 static sb_event_t tpch_next_event(int thread_id);
 static int tpch_execute_event(sb_event_t *, int);
+static int tpch_thread_run(int thread_id);
+static int tpch_thread_done(int thread_id);
 static void tpch_report_intermediate(sb_stat_t *);
 static void tpch_report_cumulative(sb_stat_t *);
 static int tpch_done(void);
 
+/* Query stream, stream 0 is the power test */
+typedef struct {
+    unsigned int order[TPCH_QUERIES]; /* Query numbers in execution order */
+    unsigned int pos;                 /* Position of the next query */
+    bool failed;                      /* Some queries have failed */
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint64_t query_ns[TPCH_QUERIES];  /* Execution times by query number */
+    tpch_answer_t answers[TPCH_QUERIES]; /* Answers with --validate */
+} tpch_stream_t;
+
+/* Refresh functions */
+typedef enum {
+    TPCH_RF1,                         /* Insert new orders */
+    TPCH_RF2,                         /* Delete orders inserted by RF1 */
+    TPCH_RF_MAX
+} tpch_rf_t;
+
+/* Refresh stream, stream 0 is the power test */
+typedef struct {
+    unsigned int pairs;               /* Executed RF1/RF2 pairs */
+    bool failed;                      /* Some refresh functions have failed */
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint64_t rf_ns[TPCH_RF_MAX];      /* Execution times of the last pair */
+} tpch_refresh_stream_t;
+
+/* Refresh function statistics across all refresh streams */
+typedef struct {
+    unsigned int count;
+    unsigned int errors;
+    uint64_t orders;                  /* Inserted or deleted orders */
+    uint64_t sum_ns;
+    uint64_t max_ns;
+} tpch_rf_stats_t;
+
 /* TPC-H test struct */
 typedef struct tpch_s {
-    unsigned int size;
+    double size;
     char *root_path;
     char *query_path;
     db_driver_t *db_driver;
     char **sql_queries;
+    bool power_test;
+    bool refresh;
+    unsigned int query_streams;  /* Number of throughput test query streams */
+    uint64_t seed;               /* Substitution parameters seed */
+    tpch_stream_t *streams;      /* Power test and throughput test streams */
+    tpch_stream_t **current;     /* Stream being executed by each thread */
+    sb_barrier_t power_barrier;  /* Throughput test start */
+    db_conn_t **conns;           /* Connection of each thread */
+    sb_histogram_t *histograms[TPCH_QUERIES]; /* Latencies by query number */
+    tpch_refresh_stream_t refresh_streams[2]; /* Power and throughput tests */
+    tpch_rf_stats_t rf_stats[TPCH_RF_MAX];
+    char *answers_path;          /* Answers to compare with, or NULL */
+    char *save_answers_path;     /* File to save answers to, or NULL */
+    tpch_answer_t answers[TPCH_QUERIES]; /* Loaded from answers_path */
 } tpch_t;
 
 static tpch_t tpch = {};
 
+/* Query latency histograms track values up to 1 hour, in milliseconds */
+#define TPCH_HISTOGRAM_SIG_DIGITS 2
+#define TPCH_HISTOGRAM_MAX_VALUE 36E5
+
+/* TPC-H metrics, 0 if not available */
+typedef struct {
+    double power_time;      /* Power test time, seconds */
+    double throughput_time; /* Throughput test time, seconds */
+    double power;           /* Power@Size */
+    double throughput;      /* Throughput@Size */
+    double qphh;            /* QphH@Size */
+} tpch_metrics_t;
+
+/* Latency statistics of a query across all streams, in milliseconds */
+typedef struct {
+    unsigned int count;
+    double avg;
+    double max;
+    double pcts[MAX_PERCENTILES]; /* for ranks in sb_globals.percentiles */
+} tpch_query_stats_t;
+
+/* Query answers validation results */
+typedef struct {
+    unsigned int checked;   /* Answers compared with the expected ones */
+    unsigned int mismatches;
+} tpch_validation_t;
+
+/* Set by prepare threads on errors */
+static int tpch_prepare_failed;
+
+static const char *tpch_schema[] = {
+    "DROP TABLE IF EXISTS lineitem",
+    "DROP TABLE IF EXISTS orders",
+    "DROP TABLE IF EXISTS customer",
+    "DROP TABLE IF EXISTS partsupp",
+    "DROP TABLE IF EXISTS supplier",
+    "DROP TABLE IF EXISTS part",
+    "DROP TABLE IF EXISTS nation",
+    "DROP TABLE IF EXISTS region",
+    "CREATE TABLE region (r_regionkey integer not null, "
+    "r_name char(25) not null, r_comment varchar(152))",
+    "CREATE TABLE nation (n_nationkey integer not null, "
+    "n_name char(25) not null, n_regionkey integer not null, "
+    "n_comment varchar(152))",
+    "CREATE TABLE part (p_partkey integer not null, "
+    "p_name varchar(55) not null, p_mfgr char(25) not null, "
+    "p_brand char(10) not null, p_type varchar(25) not null, "
+    "p_size integer not null, p_container char(10) not null, "
+    "p_retailprice decimal(15,2) not null, p_comment varchar(23) not null)",
+    "CREATE TABLE partsupp (ps_partkey integer not null, "
+    "ps_suppkey integer not null, ps_availqty integer not null, "
+    "ps_supplycost decimal(15,2) not null, "
+    "ps_comment varchar(199) not null)",
+    "CREATE TABLE supplier (s_suppkey integer not null, "
+    "s_name char(25) not null, s_address varchar(40) not null, "
+    "s_nationkey integer not null, s_phone char(15) not null, "
+    "s_acctbal decimal(15,2) not null, s_comment varchar(101) not null)",
+    "CREATE TABLE customer (c_custkey integer not null, "
+    "c_name varchar(25) not null, c_address varchar(40) not null, "
+    "c_nationkey integer not null, c_phone char(15) not null, "
+    "c_acctbal decimal(15,2) not null, c_mktsegment char(10) not null, "
+    "c_comment varchar(117) not null)",
+    "CREATE TABLE orders (o_orderkey bigint not null, "
+    "o_custkey integer not null, o_orderstatus char(1) not null, "
+    "o_totalprice decimal(15,2) not null, o_orderdate date not null, "
+    "o_orderpriority char(15) not null, o_clerk char(15) not null, "
+    "o_shippriority integer not null, o_comment varchar(79) not null)",
+    "CREATE TABLE lineitem (l_orderkey bigint not null, "
+    "l_partkey integer not null, l_suppkey integer not null, "
+    "l_linenumber integer not null, l_quantity decimal(15,2) not null, "
+    "l_extendedprice decimal(15,2) not null, "
+    "l_discount decimal(15,2) not null, l_tax decimal(15,2) not null, "
+    "l_returnflag char(1) not null, l_linestatus char(1) not null, "
+    "l_shipdate date not null, l_commitdate date not null, "
+    "l_receiptdate date not null, l_shipinstruct char(25) not null, "
+    "l_shipmode char(10) not null, l_comment varchar(44) not null)",
+    NULL
+};
+
+/* Keys are created after loading data */
+static const char *tpch_constraints[] = {
+    "ALTER TABLE region ADD CONSTRAINT region_pk PRIMARY KEY (r_regionkey)",
+    "ALTER TABLE nation ADD CONSTRAINT nation_pk PRIMARY KEY (n_nationkey)",
+    "ALTER TABLE nation ADD CONSTRAINT nation_fk1 FOREIGN KEY (n_regionkey) "
+    "REFERENCES region (r_regionkey)",
+    "ALTER TABLE part ADD CONSTRAINT part_pk PRIMARY KEY (p_partkey)",
+    "ALTER TABLE supplier ADD CONSTRAINT supplier_pk PRIMARY KEY (s_suppkey)",
+    "ALTER TABLE supplier ADD CONSTRAINT supplier_fk1 "
+    "FOREIGN KEY (s_nationkey) REFERENCES nation (n_nationkey)",
+    "ALTER TABLE partsupp ADD CONSTRAINT partsupp_pk "
+    "PRIMARY KEY (ps_partkey, ps_suppkey)",
+    "ALTER TABLE customer ADD CONSTRAINT customer_pk PRIMARY KEY (c_custkey)",
+    "ALTER TABLE customer ADD CONSTRAINT customer_fk1 "
+    "FOREIGN KEY (c_nationkey) REFERENCES nation (n_nationkey)",
+    "ALTER TABLE lineitem ADD CONSTRAINT lineitem_pk "
+    "PRIMARY KEY (l_orderkey, l_linenumber)",
+    "ALTER TABLE orders ADD CONSTRAINT orders_pk PRIMARY KEY (o_orderkey)",
+    "ALTER TABLE partsupp ADD CONSTRAINT partsupp_fk1 "
+    "FOREIGN KEY (ps_suppkey) REFERENCES supplier (s_suppkey)",
+    "ALTER TABLE partsupp ADD CONSTRAINT partsupp_fk2 "
+    "FOREIGN KEY (ps_partkey) REFERENCES part (p_partkey)",
+    "ALTER TABLE orders ADD CONSTRAINT orders_fk1 "
+    "FOREIGN KEY (o_custkey) REFERENCES customer (c_custkey)",
+    "ALTER TABLE lineitem ADD CONSTRAINT lineitem_fk1 "
+    "FOREIGN KEY (l_orderkey) REFERENCES orders (o_orderkey)",
+    "ALTER TABLE lineitem ADD CONSTRAINT lineitem_fk2 "
+    "FOREIGN KEY (l_partkey, l_suppkey) "
+    "REFERENCES partsupp (ps_partkey, ps_suppkey)",
+    NULL
+};
+
 static sb_test_t tpch_test =
 {
   .sname = "tpch",
@@ -78,6 +259,9 @@ static sb_test_t tpch_test =
     .print_mode = tpch_print_mode,
     .next_event = tpch_next_event,
     .execute_event = tpch_execute_event,
+    .thread_init = tpch_thread_init,
+    .thread_run = tpch_thread_run,
+    .thread_done = tpch_thread_done,
     .report_intermediate = tpch_report_intermediate,
     .report_cumulative = tpch_report_cumulative,
     .done = tpch_done
@@ -88,8 +272,144 @@ static sb_test_t tpch_test =
   .args = tpch_args
 };
 
-static void tpch_report_json(const double seconds, sb_stat_t *stat)
+/* Check if a stream has executed a query */
+
+static bool query_done(const tpch_stream_t *stream, unsigned int query)
+{
+    for (unsigned int i = 0; i < stream->pos; i++) {
+        if (stream->order[i] == query)
+            return true;
+    }
+    return false;
+}
+
+static void get_query_stats(unsigned int query, tpch_query_stats_t *qs)
 {
+    uint64_t sum_ns = 0;
+    uint64_t max_ns = 0;
+
+    memset(qs, 0, sizeof(*qs));
+
+    for (unsigned int s = 0; s <= tpch.query_streams; s++) {
+        const tpch_stream_t *stream = &tpch.streams[s];
+
+        if (!query_done(stream, query))
+            continue;
+        qs->count++;
+        sum_ns += stream->query_ns[query-1];
+        max_ns = SB_MAX(max_ns, stream->query_ns[query-1]);
+    }
+
+    if (qs->count == 0)
+        return;
+
+    qs->avg = NS2MS(sum_ns) / qs->count;
+    qs->max = NS2MS(max_ns);
+    sb_histogram_get_pcts_cumulative(tpch.histograms[query-1],
+                                     sb_globals.percentiles,
+                                     sb_globals.n_percentiles, qs->pcts);
+}
+
+/*
+  Get the answer of the first stream that has executed a query without errors,
+  or NULL if there is none
+*/
+
+static const tpch_answer_t *first_answer(unsigned int query)
+{
+    for (unsigned int s = 0; s <= tpch.query_streams; s++) {
+        const tpch_answer_t *a = &tpch.streams[s].answers[query-1];
+
+        if (query_done(&tpch.streams[s], query) && a->valid)
+            return a;
+    }
+    return NULL;
+}
+
+/* Answers are compared with the loaded ones, or with the first answer */
+
+static const tpch_answer_t *expected_answer(unsigned int query)
+{
+    if (tpch.answers_path != NULL)
+        return &tpch.answers[query-1];
+
+    return first_answer(query);
+}
+
+/* Compare answers of all streams with expected ones, logging mismatches */
+
+static void validate_answers(tpch_validation_t *v, bool verbose)
+{
+    memset(v, 0, sizeof(*v));
+
+    for (unsigned int q = 1; q <= TPCH_QUERIES; q++) {
+        const tpch_answer_t *expected = expected_answer(q);
+
+        if (expected == NULL)
+            continue;
+
+        for (unsigned int s = 0; s <= tpch.query_streams; s++) {
+            const tpch_answer_t *a = &tpch.streams[s].answers[q-1];
+
+            if (!query_done(&tpch.streams[s], q) || !a->valid)
+                continue;
+
+            v->checked++;
+            if (tpch_answer_equal(a, expected))
+                continue;
+
+            v->mismatches++;
+            if (verbose)
+                log_text(LOG_ALERT, "Q%u of stream %u returned %" PRIu64
+                         " rows with checksum %016" PRIx64 ", expected %"
+                         PRIu64 " rows with checksum %016" PRIx64, q, s,
+                         a->rows, a->checksum, expected->rows,
+                         expected->checksum);
+        }
+    }
+}
+
+static void print_json_metric(const char *name, double value, bool last)
+{
+    if (value > 0)
+        printf("\t\t\"%s\": %4.2f%s\n", name, value, last ? "" : ",");
+    else
+        printf("\t\t\"%s\": null%s\n", name, last ? "" : ",");
+}
+
+/*
+  Format latency percentiles in milliseconds as members of a JSON object keyed
+  by percentile ranks
+*/
+
+static char *format_json_pcts(const double *pcts, char *buf, size_t size)
+{
+    size_t len = 0;
+
+    buf[0] = '\0';
+    for (unsigned int i = 0; i < sb_globals.n_percentiles && len < size; i++) {
+        const int n = snprintf(buf + len, size - len, "%s\"%g\": %4.2f",
+                               i > 0 ? ", " : "", sb_globals.percentiles[i],
+                               pcts[i]);
+        if (n < 0)
+            break;
+        len += n;
+    }
+
+    return buf;
+}
+
+/* Metrics are only printed in the cumulative report, i.e. when m != NULL */
+
+static void tpch_report_json(const double seconds, sb_stat_t *stat,
+                             const tpch_metrics_t *m)
+{
+    double pcts[MAX_PERCENTILES];
+    char pct_buf[SB_REPORT_LATENCY_BUF_SIZE];
+
+    for (unsigned int i = 0; i < sb_globals.n_percentiles; i++)
+        pcts[i] = SEC2MS(stat->latency_pcts[i]);
+
     printf("[\n"
            "\t{\n"
            "\t\t\"time\": %d,\n"
@@ -99,40 +419,100 @@ static void tpch_report_json(const double seconds, sb_stat_t *stat)
            "\t\t\t\"total\": %4.2f,\n"
            "\t\t\t\"reads\": %4.2f,\n"
            "\t\t\t\"writes\": %4.2f,\n"
-           "\t\t\t\"other\": %4.2f,\n"
+           "\t\t\t\"other\": %4.2f\n"
+           "\t\t},\n"
            "\t\t\"latency\": %4.2f,\n"
+           "\t\t\"percentiles\": {%s},\n"
            "\t\t\"errors\": %4.2f,\n"
-           "\t\t\"reconnects\": %4.2f\n"
-           "\t}\n"
-           "]\n",
+           "\t\t\"reconnects\": %4.2f%s\n",
            (int)seconds,
-           0,
+           stat->threads_running,
            stat->events / seconds,
            (stat->reads + stat->writes + stat->other) / seconds,
            stat->reads / seconds,
            stat->writes / seconds,
            stat->other / seconds,
            SEC2MS(stat->latency_pct),
+           format_json_pcts(pcts, pct_buf, sizeof(pct_buf)),
            stat->errors / seconds,
-           stat->reconnects / seconds);
+           stat->reconnects / seconds,
+           m != NULL ? "," : "");
+
+    if (m != NULL) {
+        print_json_metric("power", m->power, false);
+        print_json_metric("throughput", m->throughput, false);
+        print_json_metric("qphh", m->qphh, false);
+
+        printf("\t\t\"queries\": [\n");
+        for (unsigned int q = 1; q <= TPCH_QUERIES; q++) {
+            tpch_query_stats_t qs;
+
+            get_query_stats(q, &qs);
+            printf("\t\t\t{ \"query\": %u, \"count\": %u, \"avg\": %4.2f, "
+                   "\"max\": %4.2f, \"percentiles\": {%s} }%s\n",
+                   q, qs.count, qs.avg, qs.max,
+                   format_json_pcts(qs.pcts, pct_buf, sizeof(pct_buf)),
+                   q < TPCH_QUERIES ? "," : "");
+        }
+        printf("\t\t]%s\n", tpch.refresh || sb_globals.validate ? "," : "");
+    }
+
+    if (m != NULL && tpch.refresh) {
+        printf("\t\t\"refresh\": [\n");
+        for (int rf = 0; rf < TPCH_RF_MAX; rf++) {
+            const tpch_rf_stats_t *stats = &tpch.rf_stats[rf];
+
+            printf("\t\t\t{ \"function\": \"RF%d\", \"count\": %u, "
+                   "\"errors\": %u, \"orders\": %" PRIu64 ", "
+                   "\"avg\": %4.2f, \"max\": %4.2f }%s\n",
+                   rf + 1, stats->count, stats->errors, stats->orders,
+                   stats->count > 0 ? NS2MS(stats->sum_ns) / stats->count : 0,
+                   NS2MS(stats->max_ns), rf + 1 < TPCH_RF_MAX ? "," : "");
+        }
+        printf("\t\t]%s\n", sb_globals.validate ? "," : "");
+    }
+
+    if (m != NULL && sb_globals.validate) {
+        tpch_validation_t v;
+
+        validate_answers(&v, false);
+        printf("\t\t\"validation\": { \"checked\": %u, "
+               "\"mismatches\": %u }\n", v.checked, v.mismatches);
+    }
+
+    printf("\t}\n"
+           "]\n");
+}
+
+/* Return the value of a file name option, or NULL if it is empty */
+
+static char *get_path_arg(const char *name)
+{
+    char *path = sb_get_value_string(name);
+
+    return path != NULL && path[0] != '\0' ? path : NULL;
 }
 
 static int get_tpch_args(void)
 {
-    int size = sb_get_value_int("data-size");
-    char *root_path = sb_get_value_string("root-path");
+    double size = sb_get_value_double("data-size");
 
-    if (size <= 0) {
-        log_text(LOG_FATAL, "Invalid value of data-size: %d.", size);
+    if (size < TPCH_MIN_SCALE) {
+        log_text(LOG_FATAL, "Invalid value of data-size: %g, must be at least %g.",
+                 size, TPCH_MIN_SCALE);
         return 1;
     }
-    if (root_path == NULL) {
-        log_text(LOG_FATAL, "Invalid value of root-path, got NULL.");
+
+    tpch.size = size;
+    tpch.root_path = sb_get_value_string("root-path");
+
+    tpch.answers_path = get_path_arg("answers");
+    tpch.save_answers_path = get_path_arg("save-answers");
+    if ((tpch.answers_path != NULL || tpch.save_answers_path != NULL) &&
+        !sb_globals.validate) {
+        log_text(LOG_FATAL, "--answers and --save-answers require --validate");
         return 1;
     }
-
-    tpch.size = (unsigned int)size;
-    tpch.root_path = root_path;
     return 0;
 }
 
@@ -143,7 +523,7 @@ static char *add_path_to_root(char *add)
     if (path == NULL) {
         return NULL;
     }
-    strcat(path, tpch.root_path);
+    strcpy(path, tpch.root_path);
     if (strlen(tpch.root_path) > 0 && tpch.root_path[strlen(tpch.root_path) - 1] != '/') {
         strcat(path, "/");
     }
@@ -151,82 +531,65 @@ static char *add_path_to_root(char *add)
     return path;
 }
 
-static char** get_script_arguments(const char *path)
+static int execute_queries(db_conn_t *conn, const char **queries)
 {
-    const int nb_args = 4;
-    char args_str[4][32] = {
-            "--size",
-            "",
-            "--mysql-params",
-            "tpch"
-    };
-    char **args = malloc(sizeof(char *) * (nb_args + 2));
-    if (args == NULL)
-        return NULL;
-
-    sprintf(args_str[1], "%d", tpch.size);
-
-    args[0] = strdup(path);
-    if (args[0] == NULL) {
-        free(args);
-        return NULL;
-    }
-
-    for (int i = 0; i < nb_args; i++) {
-        args[i+1] = strdup(args_str[i]);
-        if (args[i+1] == NULL) {
-            for (int j = i; j >= 0; j--)
-                free(args[j]);
-            free(args);
-            return NULL;
+    for (int i = 0; queries[i] != NULL; i++) {
+        if (db_query(conn, queries[i], strlen(queries[i])) == NULL &&
+            conn->error != DB_ERROR_NONE) {
+            log_text(LOG_FATAL, "Failed to execute: %s", queries[i]);
+            return 1;
         }
     }
-    args[nb_args+1] = NULL;
-    return args;
+    return 0;
 }
 
-static int execute_init_script(void)
+/*
+  Each prepare thread loads its own chunk of the keys of every table. The
+  generated data does not depend on the number of threads.
+*/
+
+static void *prepare_thread(void *arg)
 {
-    char *path = NULL;
-    char *exec_path = NULL;
-    char **args = NULL;
-    int status = 0;
-    pid_t pid = fork();
+    sb_thread_ctxt_t *ctxt = (sb_thread_ctxt_t *)arg;
+    const uint64_t threads = sb_globals.threads;
+    const uint64_t id = ctxt->id;
+    db_driver_t *driver;
+    db_conn_t *conn;
 
-    if (pid == -1) {
-        return 1;
+    sb_tls_thread_id = ctxt->id;
+
+    driver = db_create(NULL);
+    if (driver == NULL) {
+        ck_pr_store_int(&tpch_prepare_failed, 1);
+        return NULL;
     }
-    if (pid == 0) {
-        path = add_path_to_root("src/tests/tpch/scripts");
-        if (path == NULL)
-            return 1;
-        chdir(path);
 
-        exec_path = malloc(strlen(path) + strlen("/tpch_init.sh"));
-        if (exec_path == NULL)
-            return 1;
-        strcat(exec_path, path);
-        strcat(exec_path, "/tpch_init.sh");
+    conn = db_connection_create(driver);
+    if (conn == NULL) {
+        ck_pr_store_int(&tpch_prepare_failed, 1);
+        db_destroy(driver);
+        return NULL;
+    }
 
-        args = get_script_arguments(exec_path);
-        if (args == NULL)
-            return 1;
-        int exit_code = execve(exec_path, args, sb_globals.env);
-        for (int i = 0; args[i] != NULL; i++)
-            free(args[i]);
-        free(args);
-        if (exit_code == -1)
-            printf("Something went wrong: %s\n", strerror(errno));
-        exit(exit_code);
+    for (int table = 0; table < TPCH_TABLE_MAX; table++) {
+        const uint64_t keys = tpch_dbgen_keys(table);
+
+        if (ck_pr_load_int(&tpch_prepare_failed))
+            break;
+
+        if (tpch_dbgen_load(conn, table, keys * id / threads,
+                            keys * (id + 1) / threads)) {
+            log_text(LOG_FATAL, "Thread %d failed to load table '%s'",
+                     ctxt->id, tpch_dbgen_table_name(table));
+            ck_pr_store_int(&tpch_prepare_failed, 1);
+        }
     }
-    waitpid(pid, &status, 0);
 
-    free(path);
-    free(exec_path);
+    db_connection_close(conn);
+    db_connection_free(conn);
+    db_destroy(driver);
 
-    if (WIFEXITED(status))
-        return WEXITSTATUS(status);
-    return 0;
+    return NULL;
 }
 
 static char *get_sql_file_content(unsigned int id)
@@ -234,7 +597,7 @@ static char *get_sql_file_content(unsigned int id)
     FILE *f = NULL;
     long file_size = 0;
     char *content = NULL;
-    char *file_path = malloc((strlen(tpch.query_path) + strlen("/00.sql")));
+    char *file_path = malloc(strlen(tpch.query_path) + strlen("/00.sql") + 1);
 
     if (file_path == NULL)
         return NULL;
@@ -250,13 +613,18 @@ static char *get_sql_file_content(unsigned int id)
     file_size = ftell(f);
     rewind(f);
 
-    content = malloc(file_size);
+    content = malloc(file_size + 1);
     if (content == NULL) {
         fclose(f);
         return NULL;
     }
 
-    fread(content, file_size, 1, f);
+    if (fread(content, file_size, 1, f) != 1 && file_size > 0) {
+        free(content);
+        fclose(f);
+        return NULL;
+    }
+    content[file_size] = '\0';
     fclose(f);
     f = NULL;
 
@@ -291,18 +659,59 @@ int register_test_tpch(sb_list_t * tests)
 
 int tpch_prepare(void)
 {
+    db_driver_t *driver;
+    db_conn_t *conn;
+    int rc = 1;
+
     if (get_tpch_args() > 0) {
         return 1;
     }
-    execute_init_script();
 
-    return 0;
+    driver = db_create(NULL);
+    if (driver == NULL)
+        return 1;
+    conn = db_connection_create(driver);
+    if (conn == NULL) {
+        db_destroy(driver);
+        return 1;
+    }
+
+    if (tpch_dbgen_init(tpch.size))
+        goto end;
+
+    log_text(LOG_NOTICE, "Creating TPC-H tables...");
+    if (execute_queries(conn, tpch_schema))
+        goto end;
+
+    log_text(LOG_NOTICE, "Loading TPC-H data for scale factor %g using %u "
+             "threads...", tpch.size, sb_globals.threads);
+    if (sb_thread_create_workers(prepare_thread) ||
+        sb_thread_join_workers() || tpch_prepare_failed)
+        goto end;
+
+    log_text(LOG_NOTICE, "Creating primary and foreign keys...");
+    if (execute_queries(conn, tpch_constraints))
+        goto end;
+
+    rc = 0;
+
+end:
+    tpch_dbgen_done();
+    db_connection_close(conn);
+    db_connection_free(conn);
+    db_destroy(driver);
+
+    return rc;
 }
 
 int tpch_init(void)
 {
     if (get_tpch_args() > 0)
         return 1;
+    if (tpch.root_path == NULL) {
+        log_text(LOG_FATAL, "Invalid value of root-path, got NULL.");
+        return 1;
+    }
 
     tpch.db_driver = db_create(NULL);
     if (tpch.db_driver == NULL)
@@ -315,15 +724,84 @@ int tpch_init(void)
     tpch.sql_queries = load_all_queries();
     if (tpch.sql_queries == NULL)
         return 1;
+
+    tpch.power_test = sb_get_value_flag("power-test");
+    tpch.refresh = sb_get_value_flag("refresh");
+    if (tpch.refresh && sb_globals.threads < 2) {
+        log_text(LOG_FATAL, "--refresh requires at least 2 threads");
+        return 1;
+    }
+    tpch.query_streams = sb_globals.threads - tpch.refresh;
+
+    if (tpch.refresh && tpch_dbgen_init(tpch.size))
+        return 1;
+
+    /*
+      The random number generator is only seeded after the test is initialized,
+      so use --rand-seed directly to make the substitution parameters
+      reproducible
+    */
+    tpch.seed = sb_rand_seed != 0 ? (uint64_t) sb_rand_seed : sb_clock_ns();
+    tpch_qgen_init(tpch.size, tpch.seed, sb_globals.validate);
+
+    if (tpch.answers_path != NULL &&
+        tpch_answers_load(tpch.answers_path, tpch.size, tpch.answers))
+        return 1;
+    if (sb_globals.validate && tpch.refresh)
+        log_text(LOG_WARNING, "Query answers may differ between streams "
+                 "executed concurrently with refresh functions");
+
+    tpch.streams = calloc(sb_globals.threads + 1, sizeof(tpch_stream_t));
+    tpch.current = calloc(sb_globals.threads, sizeof(tpch_stream_t *));
+    tpch.conns = calloc(sb_globals.threads, sizeof(db_conn_t *));
+    if (tpch.streams == NULL || tpch.current == NULL || tpch.conns == NULL)
+        return 1;
+
+    for (int i = 0; i < TPCH_QUERIES; i++) {
+        tpch.histograms[i] = sb_histogram_new(TPCH_HISTOGRAM_SIG_DIGITS,
+                                              NS2MS(1),
+                                              TPCH_HISTOGRAM_MAX_VALUE);
+        if (tpch.histograms[i] == NULL)
+            return 1;
+    }
+
+    if (sb_barrier_init(&tpch.power_barrier, sb_globals.threads, NULL, NULL)) {
+        free(tpch.streams);
+        tpch.streams = NULL;
+        return 1;
+    }
     return 0;
 }
 
+/* Each thread keeps its own connection for the whole run */
+
+int tpch_thread_init(int thread_id)
+{
+    tpch.conns[thread_id] = db_connection_create(tpch.db_driver);
+
+    return tpch.conns[thread_id] == NULL;
+}
+
+int tpch_thread_done(int thread_id)
+{
+    db_conn_t *conn = tpch.conns[thread_id];
+
+    tpch.conns[thread_id] = NULL;
+    db_connection_close(conn);
+    db_connection_free(conn);
+
+    return 0;
+}
 
 sb_event_t tpch_next_event(int thread_id)
 {
     sb_event_t req;
 
-    req.type = SB_REQ_TYPE_SQL;
+    /* A stream ends after executing each query once */
+    if (tpch.current[thread_id]->pos < TPCH_QUERIES)
+        req.type = SB_REQ_TYPE_SQL;
+    else
+        req.type = SB_REQ_TYPE_NULL;
 
     return req;
 }
@@ -332,51 +810,448 @@ int tpch_execute_event(sb_event_t *r, int thread_id)
 {
     /* unused */
     (void)r;
-    (void)thread_id;
 
-    static unsigned int event_count = 1;
-    db_conn_t *conn = NULL;
+    tpch_stream_t *stream = tpch.current[thread_id];
+    const unsigned int stream_id = stream - tpch.streams;
+    const unsigned int query_id = stream->order[stream->pos];
+    db_conn_t *conn = tpch.conns[thread_id];
+    tpch_answer_t *answer = &stream->answers[query_id-1];
     char *query = NULL;
-    unsigned int script_id = TPCH_QUERY_OFFSET(event_count);
-
-    event_count++;
+    uint64_t start_ns;
+    db_row_t *row;
 
-    conn = db_connection_create(tpch.db_driver);
-    if (conn == NULL)
+    query = tpch_qgen_query(tpch.sql_queries[query_id-1], query_id, stream_id);
+    if (query == NULL)
         return 1;
 
-    query = tpch.sql_queries[script_id-1];
+    /*
+      Rows are streamed rather than buffered on the client, so large result
+      sets do not inflate the client memory usage and query times
+    */
+    tpch_answer_init(answer);
+    start_ns = sb_clock_ns();
+    db_result_t *res = db_query_stream(conn, query, strlen(query));
+    if (res != NULL) {
+        while ((row = db_fetch_row(res)) != NULL) {
+            if (sb_globals.validate)
+                tpch_answer_row(answer, row, res->nfields);
+        }
+        db_free_results(res);
+    }
+    if (conn->error != DB_ERROR_NONE) {
+        log_text(LOG_ALERT, "Query %u of stream %u failed", query_id,
+                 stream_id);
+        stream->failed = true;
+    } else {
+        answer->valid = sb_globals.validate;
+    }
+    stream->end_ns = sb_clock_ns();
+    stream->query_ns[query_id-1] = stream->end_ns - start_ns;
+    stream->pos++;
+    sb_histogram_update_int(tpch.histograms[query_id-1],
+                            stream->query_ns[query_id-1]);
+
+    free(query);
+
+    return 0;
+}
+
+static int run_stream(int thread_id, unsigned int stream_id)
+{
+    tpch_stream_t *stream = &tpch.streams[stream_id];
+    sb_event_t event;
+    int rc = 0;
 
-    db_result_t *res = db_query(conn, query, strlen(query));
-    if (res == NULL) {
-        printf("Error, got NULL result with query id %d\n", script_id);
-        return 0;
+    tpch_qgen_order(stream_id, stream->order);
+    stream->start_ns = sb_clock_ns();
+    tpch.current[thread_id] = stream;
+
+    while (sb_more_events(thread_id) && rc == 0) {
+        event = tpch_next_event(thread_id);
+        if (event.type == SB_REQ_TYPE_NULL)
+            break;
+
+        sb_event_start(thread_id);
+
+        rc = tpch_execute_event(&event, thread_id);
+
+        sb_event_stop(thread_id);
+    }
+
+    return rc;
+}
+
+/*
+  Execute a refresh function of a refresh set. Failures are recorded in the
+  refresh stream rather than aborting the test, like failed queries.
+*/
+
+static void run_refresh(int thread_id, tpch_refresh_stream_t *rs, tpch_rf_t rf,
+                        unsigned int set)
+{
+    db_conn_t *conn = tpch.conns[thread_id];
+    tpch_rf_stats_t *stats = &tpch.rf_stats[rf];
+    uint64_t start_ns;
+    int rc;
+
+    sb_event_start(thread_id);
+
+    start_ns = sb_clock_ns();
+    if (rf == TPCH_RF1)
+        rc = tpch_dbgen_refresh_insert(conn, set);
+    else
+        rc = tpch_dbgen_refresh_delete(conn, set);
+    rs->end_ns = sb_clock_ns();
+    rs->rf_ns[rf] = rs->end_ns - start_ns;
+
+    sb_event_stop(thread_id);
+
+    if (rc != 0) {
+        log_text(LOG_ALERT, "RF%d of refresh set %u failed", rf + 1, set);
+        rs->failed = true;
+        stats->errors++;
+        return;
+    }
+
+    stats->count++;
+    stats->orders += tpch_dbgen_refresh_orders();
+    stats->sum_ns += rs->rf_ns[rf];
+    stats->max_ns = SB_MAX(stats->max_ns, rs->rf_ns[rf]);
+}
+
+/*
+  RF2 always follows RF1, even when the test is over, so that refresh sets do
+  not leave new orders in the database.
+*/
+
+static bool run_refresh_pair(int thread_id, tpch_refresh_stream_t *rs,
+                             unsigned int set)
+{
+    if (!sb_more_events(thread_id))
+        return false;
+
+    run_refresh(thread_id, rs, TPCH_RF1, set);
+    run_refresh(thread_id, rs, TPCH_RF2, set);
+    rs->pairs++;
+
+    return true;
+}
+
+/*
+  The power test executes RF1, stream 0 and RF2 in thread 0 while other
+  threads wait for it to finish. Then thread N executes stream N + 1 of the
+  throughput test, and with --refresh the last thread executes one pair of
+  refresh functions for each query stream.
+*/
+
+int tpch_thread_run(int thread_id)
+{
+    tpch_refresh_stream_t *rs;
+    int rc = 0;
+
+    if (tpch.power_test) {
+        if (thread_id == 0) {
+            rs = &tpch.refresh_streams[0];
+            rs->start_ns = sb_clock_ns();
+
+            if (tpch.refresh && sb_more_events(thread_id))
+                run_refresh(thread_id, rs, TPCH_RF1, 0);
+
+            rc = run_stream(thread_id, 0);
+
+            if (tpch.refresh && rs->end_ns > 0) {
+                run_refresh(thread_id, rs, TPCH_RF2, 0);
+                rs->pairs++;
+            }
+        }
+
+        if (sb_barrier_wait(&tpch.power_barrier) < 0)
+            return 1;
+        if (rc != 0)
+            return rc;
+    }
+
+    if ((unsigned int) thread_id < tpch.query_streams)
+        return run_stream(thread_id, thread_id + 1);
+
+    rs = &tpch.refresh_streams[1];
+    rs->start_ns = sb_clock_ns();
+
+    for (unsigned int set = 1; set <= tpch.query_streams; set++) {
+        if (!run_refresh_pair(thread_id, rs, set))
+            break;
     }
-    db_free_results(res);
-    db_connection_free(conn);
 
     return 0;
 }
 
 void tpch_print_mode(void)
 {
+    if (tpch.power_test)
+        log_text(LOG_NOTICE, "Power test followed by throughput test with "
+                 "%u query streams%s", tpch.query_streams,
+                 tpch.refresh ? " and a refresh stream" : "");
+    else
+        log_text(LOG_NOTICE, "Throughput test with %u query streams%s",
+                 tpch.query_streams,
+                 tpch.refresh ? " and a refresh stream" : "");
+    if (sb_globals.validate)
+        log_text(LOG_NOTICE, "Query validation parameters, answers compared "
+                 "with %s\n", tpch.answers_path != NULL ? tpch.answers_path :
+                 "the first stream executing each query");
+    else
+        log_text(LOG_NOTICE, "Substitution parameters seed: %" PRIu64 "\n",
+                 tpch.seed);
+}
+
+static bool stream_complete(const tpch_stream_t *stream)
+{
+    return stream->pos == TPCH_QUERIES && !stream->failed;
+}
+
+static bool refresh_complete(const tpch_refresh_stream_t *rs,
+                             unsigned int pairs)
+{
+    return !tpch.refresh || (rs->pairs == pairs && !rs->failed);
+}
+
+/*
+  Calculate TPC-H metrics (clause 5.4). Metrics that cannot be calculated
+  because of incomplete or failed streams are set to 0.
+*/
+
+static void get_metrics(tpch_metrics_t *m)
+{
+    const unsigned int nstreams = tpch.query_streams;
+    const tpch_stream_t *stream = &tpch.streams[0];
+    const tpch_refresh_stream_t *rs = &tpch.refresh_streams[0];
+    uint64_t start_ns = UINT64_MAX;
+    uint64_t end_ns = 0;
+    bool complete = true;
+
+    memset(m, 0, sizeof(*m));
+
+    if (tpch.power_test && stream_complete(stream) && refresh_complete(rs, 1)) {
+        uint64_t timings[TPCH_QUERIES + TPCH_RF_MAX];
+        const unsigned int n = TPCH_QUERIES + (tpch.refresh ? TPCH_RF_MAX : 0);
+        uint64_t max_ns = 1;
+        double log_sum = 0;
+
+        memcpy(timings, stream->query_ns, sizeof(stream->query_ns));
+        memcpy(timings + TPCH_QUERIES, rs->rf_ns, sizeof(rs->rf_ns));
+
+        for (unsigned int i = 0; i < n; i++)
+            max_ns = SB_MAX(max_ns, timings[i]);
+
+        /* Timings are at least 1/1000 of the longest one, see clause 5.4.1.4 */
+        for (unsigned int i = 0; i < n; i++)
+            log_sum += log(NS2SEC(SB_MAX(timings[i],
+                                         SB_MAX(max_ns / 1000, UINT64_C(1)))));
+
+        if (tpch.refresh)
+            m->power_time = NS2SEC(rs->end_ns - rs->start_ns);
+        else
+            m->power_time = NS2SEC(stream->end_ns - stream->start_ns);
+        m->power = 3600 * tpch.size / exp(log_sum / n);
+    }
+
+    for (unsigned int i = 1; i <= nstreams; i++) {
+        stream = &tpch.streams[i];
+        complete = complete && stream_complete(stream);
+        start_ns = SB_MIN(start_ns, stream->start_ns);
+        end_ns = SB_MAX(end_ns, stream->end_ns);
+    }
+
+    /* The refresh stream is part of the throughput test, see clause 5.3.4 */
+    if (tpch.refresh) {
+        rs = &tpch.refresh_streams[1];
+        complete = complete && refresh_complete(rs, nstreams);
+        start_ns = SB_MIN(start_ns, rs->start_ns);
+        end_ns = SB_MAX(end_ns, rs->end_ns);
+    }
+
+    if (complete && end_ns > start_ns) {
+        m->throughput_time = NS2SEC(end_ns - start_ns);
+        m->throughput = nstreams * TPCH_QUERIES * 3600.0 /
+            m->throughput_time * tpch.size;
+    }
+
+    if (m->power > 0 && m->throughput > 0)
+        m->qphh = sqrt(m->power * m->throughput);
+}
+
+static void report_metric(const char *name, double value)
+{
+    if (value > 0)
+        log_text(LOG_NOTICE, "    %-37s%.2f", name, value);
+    else
+        log_text(LOG_NOTICE, "    %-37sn/a", name);
+}
+
+static void report_query_times(void)
+{
+    const unsigned int first = tpch.power_test ? 0 : 1;
+    const unsigned int last = tpch.query_streams;
+    const size_t len = 16 + 12 * (last + 1);
+    char *line = malloc(len);
+    size_t pos;
+
+    if (line == NULL)
+        return;
+
+    log_text(LOG_NOTICE, "\nTPC-H query times (s):");
+
+    pos = snprintf(line, len, "    %-5s", "query");
+    for (unsigned int s = first; s <= last; s++) {
+        char name[24];
+
+        if (s == 0)
+            strcpy(name, "power");
+        else
+            snprintf(name, sizeof(name), "stream %u", s);
+        pos += snprintf(line + pos, len - pos, "%12s", name);
+    }
+    log_text(LOG_NOTICE, "%s", line);
 
+    for (unsigned int q = 1; q <= TPCH_QUERIES; q++) {
+        char name[16];
+
+        snprintf(name, sizeof(name), "Q%u", q);
+        pos = snprintf(line, len, "    %-5s", name);
+
+        for (unsigned int s = first; s <= last; s++) {
+            const tpch_stream_t *stream = &tpch.streams[s];
+
+            if (query_done(stream, q))
+                pos += snprintf(line + pos, len - pos, "%12.3f",
+                                NS2SEC(stream->query_ns[q-1]));
+            else
+                pos += snprintf(line + pos, len - pos, "%12s", "-");
+        }
+        log_text(LOG_NOTICE, "%s", line);
+    }
+
+    free(line);
+}
+
+static void report_query_latency(void)
+{
+    char line[64 + 12 * MAX_PERCENTILES];
+    int pos;
+
+    log_text(LOG_NOTICE, "\nTPC-H query latency (ms):");
+
+    pos = snprintf(line, sizeof(line), "    %-5s%8s%12s%12s", "query", "count",
+                   "avg", "max");
+    for (unsigned int i = 0; i < sb_globals.n_percentiles; i++) {
+        char pct_name[32];
+
+        snprintf(pct_name, sizeof(pct_name), "%gth pct",
+                 sb_globals.percentiles[i]);
+        pos += snprintf(line + pos, sizeof(line) - pos, "%12s", pct_name);
+    }
+    log_text(LOG_NOTICE, "%s", line);
+
+    for (unsigned int q = 1; q <= TPCH_QUERIES; q++) {
+        tpch_query_stats_t qs;
+        char name[16];
+
+        get_query_stats(q, &qs);
+        snprintf(name, sizeof(name), "Q%u", q);
+
+        if (qs.count == 0)
+            pos = snprintf(line, sizeof(line), "    %-5s%8u%12s%12s", name, 0,
+                           "-", "-");
+        else
+            pos = snprintf(line, sizeof(line), "    %-5s%8u%12.2f%12.2f", name,
+                           qs.count, qs.avg, qs.max);
+
+        for (unsigned int i = 0; i < sb_globals.n_percentiles; i++) {
+            if (qs.count == 0)
+                pos += snprintf(line + pos, sizeof(line) - pos, "%12s", "-");
+            else
+                pos += snprintf(line + pos, sizeof(line) - pos, "%12.2f",
+                                qs.pcts[i]);
+        }
+        log_text(LOG_NOTICE, "%s", line);
+    }
+
+    if (!sb_globals.histogram)
+        return;
+
+    for (unsigned int q = 1; q <= TPCH_QUERIES; q++) {
+        log_text(LOG_NOTICE, "\nQ%u latency histogram (values are in "
+                 "milliseconds)", q);
+        sb_histogram_print(tpch.histograms[q-1]);
+    }
+}
+
+static void report_refresh(void)
+{
+    log_text(LOG_NOTICE, "\nTPC-H refresh functions:");
+    log_text(LOG_NOTICE, "    %-8s%8s%8s%12s%12s%12s", "function", "count",
+             "errors", "orders/s", "avg (ms)", "max (ms)");
+
+    for (int rf = 0; rf < TPCH_RF_MAX; rf++) {
+        const tpch_rf_stats_t *stats = &tpch.rf_stats[rf];
+        char name[8];
+
+        snprintf(name, sizeof(name), "RF%d", rf + 1);
+
+        if (stats->count == 0)
+            log_text(LOG_NOTICE, "    %-8s%8u%8u%12s%12s%12s", name, 0,
+                     stats->errors, "-", "-", "-");
+        else
+            log_text(LOG_NOTICE, "    %-8s%8u%8u%12.2f%12.2f%12.2f", name,
+                     stats->count, stats->errors,
+                     stats->orders / NS2SEC(stats->sum_ns),
+                     NS2MS(stats->sum_ns) / stats->count,
+                     NS2MS(stats->max_ns));
+    }
+}
+
+static void report_validation(void)
+{
+    tpch_validation_t v;
+
+    validate_answers(&v, true);
+
+    log_text(LOG_NOTICE, "\nTPC-H validation:");
+    log_text(LOG_NOTICE, "    answers checked:                     %u",
+             v.checked);
+    log_text(LOG_NOTICE, "    mismatches:                          %u",
+             v.mismatches);
+}
+
+static void report_metrics(const tpch_metrics_t *m)
+{
+    log_text(LOG_NOTICE, "\nTPC-H metrics:");
+    log_text(LOG_NOTICE, "    scale factor:                        %g",
+             tpch.size);
+    log_text(LOG_NOTICE, "    query streams:                       %u",
+             tpch.query_streams);
+    report_metric("power test time (s):", m->power_time);
+    report_metric("throughput test time (s):", m->throughput_time);
+    report_metric("Power@Size:", m->power);
+    report_metric("Throughput@Size:", m->throughput);
+    report_metric("QphH@Size:", m->qphh);
 }
 
 void tpch_report_intermediate(sb_stat_t *stat)
 {
     int json_format = sb_get_value_flag("report-json");
     const double seconds = stat->time_total;
+    char lat_buf[SB_REPORT_LATENCY_BUF_SIZE];
 
     if (json_format) {
-        tpch_report_json(seconds, stat);
+        tpch_report_json(seconds, stat, NULL);
         return;
     }
 
     log_timestamp(LOG_NOTICE, stat->time_total,
                   "thds: %u tps: %4.2f "
                   "qps: %4.2f (r/w/o: %4.2f/%4.2f/%4.2f) "
-                  "lat (ms,%u%%): %4.2f err/s: %4.2f "
+                  "%s err/s: %4.2f "
                   "reconn/s: %4.2f",
                   stat->threads_running,
                   stat->events / seconds,
@@ -384,8 +1259,7 @@ void tpch_report_intermediate(sb_stat_t *stat)
                   stat->reads / seconds,
                   stat->writes / seconds,
                   stat->other / seconds,
-                  sb_globals.percentile,
-                  SEC2MS(stat->latency_pct),
+                  sb_report_format_latency(stat, lat_buf, sizeof(lat_buf)),
                   stat->errors / seconds,
                   stat->reconnects / seconds);
 }
@@ -396,15 +1270,19 @@ void tpch_report_cumulative(sb_stat_t *stat)
 {
     int json_format = sb_get_value_flag("report-json");
     const double seconds = stat->time_total;
+    tpch_metrics_t metrics;
+    char lat_buf[SB_REPORT_LATENCY_BUF_SIZE];
+
+    get_metrics(&metrics);
 
     if (json_format) {
-        tpch_report_json(seconds, stat);
+        tpch_report_json(seconds, stat, &metrics);
         return;
     }
     log_timestamp(LOG_NOTICE, stat->time_total,
                   "thds: %u tps: %4.2f "
                   "qps: %4.2f (r/w/o: %4.2f/%4.2f/%4.2f) "
-                  "lat (ms,%u%%): %4.2f err/s: %4.2f "
+                  "%s err/s: %4.2f "
                   "reconn/s: %4.2f",
                   stat->threads_running,
                   stat->events / seconds,
@@ -412,23 +1290,73 @@ void tpch_report_cumulative(sb_stat_t *stat)
                   stat->reads / seconds,
                   stat->writes / seconds,
                   stat->other / seconds,
-                  sb_globals.percentile,
-                  SEC2MS(stat->latency_pct),
+                  sb_report_format_latency(stat, lat_buf, sizeof(lat_buf)),
                   stat->errors / seconds,
                   stat->reconnects / seconds);
 
     sb_report_cumulative(stat);
+
+    report_query_times();
+    report_query_latency();
+    if (tpch.refresh)
+        report_refresh();
+    if (sb_globals.validate)
+        report_validation();
+    report_metrics(&metrics);
+}
+
+/* Save the first answer to each query, if any */
+
+static int save_answers(void)
+{
+    tpch_answer_t answers[TPCH_QUERIES];
+
+    for (unsigned int q = 1; q <= TPCH_QUERIES; q++) {
+        const tpch_answer_t *a = first_answer(q);
+
+        if (a != NULL)
+            answers[q-1] = *a;
+        else
+            tpch_answer_init(&answers[q-1]);
+    }
+
+    return tpch_answers_save(tpch.save_answers_path, tpch.size, answers);
 }
 
 int tpch_done(void)
 {
+    int rc = 0;
+
+    if (tpch.save_answers_path != NULL && tpch.streams != NULL)
+        rc = save_answers();
+
     for (int i = 0; tpch.sql_queries != NULL && tpch.sql_queries[i] != NULL; i++)
         free(tpch.sql_queries[i]);
     if (tpch.sql_queries != NULL)
         free(tpch.sql_queries);
     free(tpch.query_path);
 
+    if (tpch.streams != NULL)
+        sb_barrier_destroy(&tpch.power_barrier);
+    free(tpch.streams);
+    free(tpch.current);
+
+    /* Threads that have failed do not call thread_done */
+    for (unsigned int i = 0; tpch.conns != NULL && i < sb_globals.threads; i++) {
+        if (tpch.conns[i] != NULL)
+            tpch_thread_done(i);
+    }
+    free(tpch.conns);
+
+    for (int i = 0; i < TPCH_QUERIES; i++) {
+        if (tpch.histograms[i] != NULL)
+            sb_histogram_delete(tpch.histograms[i]);
+    }
+
+    if (tpch.refresh)
+        tpch_dbgen_done();
+
     if (tpch.db_driver != NULL)
         db_destroy(tpch.db_driver);
-    return 0;
+    return rc;
 }
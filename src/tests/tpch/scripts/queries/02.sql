@@ -8,11 +8,11 @@ from part,
 	region
 where p_partkey = ps_partkey
 	and s_suppkey = ps_suppkey
-	and p_size = 15
-	and p_type like '%BRASS'
+	and p_size = :1
+	and p_type like '%:2'
 	and s_nationkey = n_nationkey
 	and n_regionkey = r_regionkey
-	and r_name = 'EUROPE'
+	and r_name = ':3'
 	and ps_supplycost = (
 		select
 			min(ps_supplycost)
@@ -24,7 +24,7 @@ where p_partkey = ps_partkey
 			and s_suppkey = ps_suppkey
 			and s_nationkey = n_nationkey
 			and n_regionkey = r_regionkey
-			and r_name = 'EUROPE'
+			and r_name = ':3'
 	)
 order by s_acctbal desc,
 	n_name,
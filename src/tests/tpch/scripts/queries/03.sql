@@ -6,11 +6,11 @@ select
 from customer,
 	orders,
 	lineitem
-where c_mktsegment = 'BUILDING'
+where c_mktsegment = ':1'
 	and c_custkey = o_custkey
 	and l_orderkey = o_orderkey
-	and o_orderdate < date '1995-03-15'
-	and l_shipdate > date '1995-03-15'
+	and o_orderdate < date ':2'
+	and l_shipdate > date ':2'
 group by
 	l_orderkey,
 	o_orderdate,
@@ -17,7 +17,7 @@ from ( select n_name as nation,
 			and p_partkey = l_partkey
 			and o_orderkey = l_orderkey
 			and s_nationkey = n_nationkey
-			and p_name like '%green%'
+			and p_name like '%:1%'
 	) as profit
 group by nation, o_year
 order by nation, o_year desc;
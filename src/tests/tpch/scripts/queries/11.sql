@@ -6,17 +6,15 @@ from partsupp,
 	nation
 where ps_suppkey = s_suppkey
 	and s_nationkey = n_nationkey
-	and n_name = 'GERMANY'
+	and n_name = ':1'
 group by ps_partkey 
 having sum(ps_supplycost * ps_availqty) >
-	( select sum(ps_supplycost * ps_availqty) * 0.00001000000
-			-- The above constant needs to be adjusted according
-			-- to the scale factor (SF): constant = 0.0001 / SF.
+	( select sum(ps_supplycost * ps_availqty) * :2
 		from partsupp,
 			supplier,
 			nation
 		where ps_suppkey = s_suppkey
 			and s_nationkey = n_nationkey
-			and n_name = 'GERMANY'
+			and n_name = ':1'
 	)
 order by value desc;
@@ -13,10 +13,10 @@ select l_shipmode,
 	end) as low_line_count
 from orders, lineitem
 where o_orderkey = l_orderkey
-	and l_shipmode in ('MAIL', 'SHIP')
+	and l_shipmode in (':1', ':2')
 	and l_commitdate < l_receiptdate
 	and l_shipdate < l_commitdate
-	and l_receiptdate >= date '1994-01-01'
-	and l_receiptdate < date '1994-01-01' + interval '1' year
+	and l_receiptdate >= date ':3'
+	and l_receiptdate < date ':3' + interval '1' year
 group by l_shipmode
 order by l_shipmode;
@@ -4,9 +4,9 @@ select p_brand,
 	count(distinct ps_suppkey) as supplier_cnt
 from partsupp, part
 where p_partkey = ps_partkey
-	and p_brand <> 'Brand#45'
-	and p_type not like 'MEDIUM POLISHED%'
-	and p_size in (49, 14, 23, 45, 19, 3, 36, 9)
+	and p_brand <> ':1'
+	and p_type not like ':2%'
+	and p_size in (:3, :4, :5, :6, :7, :8, :9, :10)
 	and ps_suppkey not in (
 		select s_suppkey
 		from supplier
@@ -5,7 +5,7 @@ where o_orderkey in (
 		select l_orderkey
 		from lineitem
 		group by l_orderkey having
-				sum(l_quantity) > 300
+				sum(l_quantity) > :1
 	)
 	and c_custkey = o_custkey
 	and o_orderkey = l_orderkey
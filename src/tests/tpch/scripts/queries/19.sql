@@ -1,23 +1,23 @@
 select sum(l_extendedprice* (1 - l_discount)) as revenue
 from lineitem, part
 where ( p_partkey = l_partkey
-		and p_brand = 'Brand#12'
+		and p_brand = ':4'
 		and p_container in ('SM CASE', 'SM BOX', 'SM PACK', 'SM PKG')
-		and l_quantity >= 1 and l_quantity <= 1 + 10
+		and l_quantity >= :1 and l_quantity <= :1 + 10
 		and p_size between 1 and 5
 		and l_shipmode in ('AIR', 'AIR REG')
 		and l_shipinstruct = 'DELIVER IN PERSON'
 	) or ( p_partkey = l_partkey
-		and p_brand = 'Brand#23'
+		and p_brand = ':5'
 		and p_container in ('MED BAG', 'MED BOX', 'MED PKG', 'MED PACK')
-		and l_quantity >= 10 and l_quantity <= 10 + 10
+		and l_quantity >= :2 and l_quantity <= :2 + 10
 		and p_size between 1 and 10
 		and l_shipmode in ('AIR', 'AIR REG')
 		and l_shipinstruct = 'DELIVER IN PERSON'
 	) or ( p_partkey = l_partkey
-		and p_brand = 'Brand#34'
+		and p_brand = ':6'
 		and p_container in ('LG CASE', 'LG BOX', 'LG PACK', 'LG PKG')
-		and l_quantity >= 20 and l_quantity <= 20 + 10
+		and l_quantity >= :3 and l_quantity <= :3 + 10
 		and p_size between 1 and 15
 		and l_shipmode in ('AIR', 'AIR REG')
 		and l_shipinstruct = 'DELIVER IN PERSON'
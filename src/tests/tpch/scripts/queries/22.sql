@@ -6,13 +6,13 @@ from ( select
 			c_acctbal
 		from customer
 		where substring(c_phone from 1 for 2) in
-				('13', '31', '23', '29', '30', '18', '17')
+				(':1', ':2', ':3', ':4', ':5', ':6', ':7')
 			and c_acctbal > (
 				select avg(c_acctbal)
 				from customer
 				where c_acctbal > 0.00
 					and substring(c_phone from 1 for 2) in
-						('13', '31', '23', '29', '30', '18', '17')
+						(':1', ':2', ':3', ':4', ':5', ':6', ':7')
 			)
 			and not exists (
 				select *
@@ -0,0 +1,226 @@
+/* Copyright (C) 2026 sysbench contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+/*
+  The checksum of a result set is the sum of mixed FNV-1a hashes of its rows.
+  Answers files have a scale factor line followed by a line per query:
+
+    scale 1
+    Q1 4 2f1d0c5e8a9b3c47
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "sb_logger.h"
+#include "tpch_dbgen.h"
+#include "tpch_answers.h"
+
+#define FNV_OFFSET UINT64_C(0xCBF29CE484222325)
+#define FNV_PRIME UINT64_C(0x100000001B3)
+
+/* Separators hashed after each value, NULL values only hash the separator */
+#define VALUE_SEP 0x1F
+#define NULL_SEP 0x1E
+
+static uint64_t fnv_hash(uint64_t h, const char *s, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char) s[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+static uint64_t fnv_byte(uint64_t h, unsigned char c)
+{
+    return (h ^ c) * FNV_PRIME;
+}
+
+/*
+  Format a numeric value with 2 decimal places into buf. Returns the length, or
+  0 if the value is not a number.
+*/
+
+static size_t format_number(const char *s, size_t len, char *buf, size_t size)
+{
+    double value;
+    char *end;
+    int n;
+
+    if (len == 0 || len >= size ||
+        !(isdigit((unsigned char) s[0]) || s[0] == '-' || s[0] == '+' ||
+          s[0] == '.'))
+        return 0;
+
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+
+    value = strtod(buf, &end);
+    if (end != buf + len || !isfinite(value))
+        return 0;
+
+    /* Avoid "-0.00" for small negative values */
+    if (fabs(value) < 0.005)
+        value = 0;
+
+    n = snprintf(buf, size, "%.2f", value);
+
+    return n > 0 && (size_t) n < size ? (size_t) n : 0;
+}
+
+void tpch_answer_init(tpch_answer_t *a)
+{
+    a->valid = false;
+    a->rows = 0;
+    a->checksum = 0;
+}
+
+void tpch_answer_row(tpch_answer_t *a, const db_row_t *row,
+                     unsigned int nfields)
+{
+    uint64_t h = FNV_OFFSET;
+    char buf[64];
+
+    for (unsigned int i = 0; i < nfields; i++) {
+        const db_value_t *v = &row->values[i];
+        size_t len = v->len;
+        size_t n;
+
+        if (v->ptr == NULL) {
+            h = fnv_byte(h, NULL_SEP);
+            continue;
+        }
+
+        /* CHAR columns may be padded with spaces */
+        while (len > 0 && v->ptr[len-1] == ' ')
+            len--;
+
+        if ((n = format_number(v->ptr, len, buf, sizeof(buf))) > 0)
+            h = fnv_hash(h, buf, n);
+        else
+            h = fnv_hash(h, v->ptr, len);
+        h = fnv_byte(h, VALUE_SEP);
+    }
+
+    a->rows++;
+    a->checksum += tpch_rng_mix(h);
+}
+
+bool tpch_answer_equal(const tpch_answer_t *a, const tpch_answer_t *b)
+{
+    return a->rows == b->rows && a->checksum == b->checksum;
+}
+
+int tpch_answers_load(const char *path, double scale,
+                      tpch_answer_t answers[TPCH_QUERIES])
+{
+    FILE *f = fopen(path, "r");
+    char line[256];
+    double file_scale = 0;
+    unsigned int lineno = 0;
+    int rc = 0;
+
+    if (f == NULL) {
+        log_errno(LOG_FATAL, "Cannot open answers file '%s'", path);
+        return 1;
+    }
+
+    for (int i = 0; i < TPCH_QUERIES; i++)
+        tpch_answer_init(&answers[i]);
+
+    while (rc == 0 && fgets(line, sizeof(line), f) != NULL) {
+        unsigned int query;
+        uint64_t rows;
+        uint64_t checksum;
+
+        lineno++;
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+
+        if (sscanf(line, "scale %lf", &file_scale) == 1)
+            continue;
+
+        if (sscanf(line, "Q%u %" SCNu64 " %" SCNx64, &query, &rows,
+                   &checksum) != 3 || query < 1 || query > TPCH_QUERIES) {
+            log_text(LOG_FATAL, "Invalid line %u in answers file '%s'",
+                     lineno, path);
+            rc = 1;
+            break;
+        }
+
+        answers[query-1].valid = true;
+        answers[query-1].rows = rows;
+        answers[query-1].checksum = checksum;
+    }
+
+    fclose(f);
+
+    if (rc != 0)
+        return rc;
+
+    if (fabs(file_scale - scale) > 1e-9) {
+        log_text(LOG_FATAL, "Answers file '%s' is for scale factor %g, "
+                 "expected %g", path, file_scale, scale);
+        return 1;
+    }
+
+    for (int i = 0; i < TPCH_QUERIES; i++) {
+        if (!answers[i].valid) {
+            log_text(LOG_FATAL, "No answer to Q%d in answers file '%s'",
+                     i + 1, path);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int tpch_answers_save(const char *path, double scale,
+                      const tpch_answer_t answers[TPCH_QUERIES])
+{
+    FILE *f = fopen(path, "w");
+
+    if (f == NULL) {
+        log_errno(LOG_FATAL, "Cannot create answers file '%s'", path);
+        return 1;
+    }
+
+    fprintf(f, "# TPC-H query answers: query, rows, checksum\n");
+    fprintf(f, "scale %.10g\n", scale);
+
+    for (int i = 0; i < TPCH_QUERIES; i++) {
+        if (answers[i].valid)
+            fprintf(f, "Q%d %" PRIu64 " %016" PRIx64 "\n", i + 1,
+                    answers[i].rows, answers[i].checksum);
+    }
+
+    if (fclose(f) != 0) {
+        log_errno(LOG_FATAL, "Cannot write answers file '%s'", path);
+        return 1;
+    }
+
+    return 0;
+}
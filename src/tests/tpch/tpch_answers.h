@@ -0,0 +1,66 @@
+/* Copyright (C) 2026 sysbench contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+/*
+  TPC-H query answers. Result sets are reduced to a row count and a checksum
+  that does not depend on the order of rows, so answers can be compared
+  without buffering result sets on the client.
+*/
+
+#ifndef TPCH_ANSWERS_H
+#define TPCH_ANSWERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "db_driver.h"
+#include "tpch_qgen.h"
+
+typedef struct {
+    bool valid;             /* The query has completed without errors */
+    uint64_t rows;
+    uint64_t checksum;
+} tpch_answer_t;
+
+/* Reset an answer before fetching the rows of a query */
+void tpch_answer_init(tpch_answer_t *a);
+
+/*
+  Add a row to an answer. Numeric values are rounded to 2 decimal places and
+  trailing spaces are ignored, so answers do not depend on column types.
+*/
+void tpch_answer_row(tpch_answer_t *a, const db_row_t *row,
+                     unsigned int nfields);
+
+/* Check if two valid answers are the same */
+bool tpch_answer_equal(const tpch_answer_t *a, const tpch_answer_t *b);
+
+/*
+  Load answers to all queries for a given scale factor from a file. Returns 0
+  on success, 1 on errors.
+*/
+int tpch_answers_load(const char *path, double scale,
+                      tpch_answer_t answers[TPCH_QUERIES]);
+
+/*
+  Save valid answers for a given scale factor to a file. Returns 0 on success,
+  1 on errors.
+*/
+int tpch_answers_save(const char *path, double scale,
+                      const tpch_answer_t answers[TPCH_QUERIES]);
+
+#endif /* TPCH_ANSWERS_H */
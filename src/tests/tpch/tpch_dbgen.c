@@ -0,0 +1,937 @@
+/* Copyright (C) 2026 sysbench contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+/*
+  TPC-H data generator following the value domains and distributions of the
+  TPC-H specification (clause 4.2.3). Comments are random substrings of a text
+  pool generated with the grammar and word lists of the reference dbgen, as
+  dbgen itself does, though the pool is smaller. The random number streams are
+  different from dbgen, so the generated data is not byte-for-byte identical
+  to dbgen output.
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sysbench.h"
+#include "tpch_dbgen.h"
+
+/* Size of the text pool comments are taken from */
+#define TPCH_TEXT_POOL_SIZE (8 * 1024 * 1024)
+
+/* Maximum length of a single row in the VALUES list */
+#define TPCH_ROW_MAX 1024
+
+/* Number of days between STARTDATE (1992-01-01) and ENDDATE (1998-12-31) */
+#define TPCH_TOTAL_DAYS 2557
+
+/* Maximum number of lines per order */
+#define TPCH_MAX_LINES 7
+
+/* Arbitrary seed of the text pool stream */
+#define TPCH_TEXT_SEED 19920101
+
+/* Number of keys in each block of 32 ORDERS keys used by the initial data */
+#define TPCH_ORDER_SLOTS 8
+
+/* Number of orders deleted by a single statement of RF2 */
+#define TPCH_DELETE_BATCH 1000
+
+typedef struct {
+    const char *word;
+    unsigned int weight;
+} tpch_word_t;
+
+#define WORDS(list) list, sizeof(list) / sizeof(list[0])
+
+typedef struct {
+    uint64_t partkey;
+    uint64_t suppkey;
+    int quantity;
+    int64_t extendedprice;
+    int discount;
+    int tax;
+    char returnflag;
+    char linestatus;
+    int shipdate;
+    int commitdate;
+    int receiptdate;
+    const char *shipinstruct;
+    const char *shipmode;
+    const char *comment;
+    int comment_len;
+} tpch_line_t;
+
+typedef struct {
+    uint64_t orderkey;
+    uint64_t custkey;
+    char orderstatus;
+    int64_t totalprice;
+    int orderdate;
+    const char *orderpriority;
+    uint64_t clerk;
+    const char *comment;
+    int comment_len;
+    int nlines;
+    tpch_line_t lines[TPCH_MAX_LINES];
+} tpch_order_t;
+
+static struct {
+    double scale;
+    uint64_t keys[TPCH_TABLE_MAX];
+    uint64_t clerks;
+    uint64_t refresh_orders;
+    char *text;
+    char dates[TPCH_TOTAL_DAYS][11];
+    int current_date;
+} dbgen;
+
+static const char *table_names[TPCH_TABLE_MAX] = {
+    "region", "nation", "part", "partsupp", "supplier", "customer", "orders",
+    "lineitem"
+};
+
+static const char *regions[] = {
+    "AFRICA", "AMERICA", "ASIA", "EUROPE", "MIDDLE EAST"
+};
+
+static const struct {
+    const char *name;
+    unsigned int regionkey;
+} nations[TPCH_NATIONS] = {
+    {"ALGERIA", 0}, {"ARGENTINA", 1}, {"BRAZIL", 1}, {"CANADA", 1},
+    {"EGYPT", 4}, {"ETHIOPIA", 0}, {"FRANCE", 3}, {"GERMANY", 3},
+    {"INDIA", 2}, {"INDONESIA", 2}, {"IRAN", 4}, {"IRAQ", 4}, {"JAPAN", 2},
+    {"JORDAN", 4}, {"KENYA", 0}, {"MOROCCO", 0}, {"MOZAMBIQUE", 0},
+    {"PERU", 1}, {"CHINA", 2}, {"ROMANIA", 3}, {"SAUDI ARABIA", 4},
+    {"VIETNAM", 2}, {"RUSSIA", 3}, {"UNITED KINGDOM", 3},
+    {"UNITED STATES", 1}
+};
+
+static const char *colors[] = {
+    "almond", "antique", "aquamarine", "azure", "beige", "bisque", "black",
+    "blanched", "blue", "blush", "brown", "burlywood", "burnished",
+    "chartreuse", "chiffon", "chocolate", "coral", "cornflower", "cornsilk",
+    "cream", "cyan", "dark", "deep", "dim", "dodger", "drab", "firebrick",
+    "floral", "forest", "frosted", "gainsboro", "ghost", "goldenrod", "green",
+    "grey", "honeydew", "hot", "indian", "ivory", "khaki", "lace", "lavender",
+    "lawn", "lemon", "light", "lime", "linen", "magenta", "maroon", "medium",
+    "metallic", "midnight", "mint", "misty", "moccasin", "navajo", "navy",
+    "olive", "orange", "orchid", "pale", "papaya", "peach", "peru", "pink",
+    "plum", "powder", "puff", "purple", "red", "rose", "rosy", "royal",
+    "saddle", "salmon", "sandy", "seashell", "sienna", "sky", "slate", "smoke",
+    "snow", "spring", "steel", "tan", "thistle", "tomato", "turquoise",
+    "violet", "wheat", "white", "yellow"
+};
+
+static const char *type_s1[] = {
+    "STANDARD", "SMALL", "MEDIUM", "LARGE", "ECONOMY", "PROMO"
+};
+static const char *type_s2[] = {
+    "ANODIZED", "BURNISHED", "PLATED", "POLISHED", "BRUSHED"
+};
+static const char *type_s3[] = {
+    "TIN", "NICKEL", "BRASS", "STEEL", "COPPER"
+};
+static const char *container_s1[] = {
+    "SM", "LG", "MED", "JUMBO", "WRAP"
+};
+static const char *container_s2[] = {
+    "CASE", "BOX", "BAG", "JAR", "PKG", "PACK", "CAN", "DRUM"
+};
+static const char *segments[] = {
+    "AUTOMOBILE", "BUILDING", "FURNITURE", "MACHINERY", "HOUSEHOLD"
+};
+static const char *priorities[] = {
+    "1-URGENT", "2-HIGH", "3-MEDIUM", "4-NOT SPECIFIED", "5-LOW"
+};
+static const char *instructions[] = {
+    "DELIVER IN PERSON", "COLLECT COD", "NONE", "TAKE BACK RETURN"
+};
+static const char *modes[] = {
+    "REG AIR", "AIR", "RAIL", "SHIP", "TRUCK", "MAIL", "FOB"
+};
+
+#define PICK(rng, list) \
+    (list[tpch_rng_uniform((rng), 0, sizeof(list) / sizeof(list[0]) - 1)])
+
+#define LIST(list) { list, sizeof(list) / sizeof(list[0]) }
+
+const tpch_list_t tpch_regions = LIST(regions);
+const tpch_list_t tpch_colors = LIST(colors);
+const tpch_list_t tpch_types[3] = {
+    LIST(type_s1), LIST(type_s2), LIST(type_s3)
+};
+const tpch_list_t tpch_containers[2] = {
+    LIST(container_s1), LIST(container_s2)
+};
+const tpch_list_t tpch_segments = LIST(segments);
+const tpch_list_t tpch_modes = LIST(modes);
+
+/* Text grammar and word lists of the reference dbgen (dists.dss) */
+
+static const tpch_word_t grammar[] = {
+    {"NVT", 3}, {"NVPT", 3}, {"NVNT", 3}, {"NPVNT", 1}, {"NPVPT", 1}
+};
+static const tpch_word_t np_grammar[] = {
+    {"N", 10}, {"JN", 20}, {"J,JN", 10}, {"DJN", 50}
+};
+static const tpch_word_t vp_grammar[] = {
+    {"V", 30}, {"XV", 1}, {"VD", 40}, {"XVD", 1}
+};
+static const tpch_word_t nouns[] = {
+    {"packages", 40}, {"requests", 40}, {"accounts", 40}, {"deposits", 40},
+    {"foxes", 20}, {"ideas", 20}, {"theodolites", 20}, {"pinto beans", 20},
+    {"instructions", 20}, {"dependencies", 10}, {"excuses", 10},
+    {"platelets", 10}, {"asymptotes", 10}, {"courts", 5}, {"dolphins", 5},
+    {"multipliers", 1}, {"sauternes", 1}, {"warthogs", 1}, {"frets", 1},
+    {"dinos", 1}, {"attainments", 1}, {"somas", 1}, {"Tiresias", 1},
+    {"patterns", 1}, {"forges", 1}, {"braids", 1}, {"hockey players", 1},
+    {"frays", 1}, {"warhorses", 1}, {"dugouts", 1}, {"notornis", 1},
+    {"epitaphs", 1}, {"pearls", 1}, {"tithes", 1}, {"waters", 1},
+    {"orbits", 1}, {"gifts", 1}, {"sheaves", 1}, {"depths", 1},
+    {"sentiments", 1}, {"decoys", 1}, {"realms", 1}, {"pains", 1},
+    {"grouches", 1}, {"escapades", 1}
+};
+static const tpch_word_t verbs[] = {
+    {"sleep", 20}, {"wake", 20}, {"are", 20}, {"cajole", 20}, {"haggle", 20},
+    {"nag", 10}, {"use", 10}, {"boost", 10}, {"affix", 5}, {"detect", 5},
+    {"integrate", 5}, {"maintain", 1}, {"nod", 1}, {"was", 1}, {"lose", 1},
+    {"sublate", 1}, {"solve", 1}, {"thrash", 1}, {"promise", 1},
+    {"engage", 1}, {"hinder", 1}, {"print", 1}, {"x-ray", 1}, {"breach", 1},
+    {"eat", 1}, {"grow", 1}, {"impress", 1}, {"mold", 1}, {"poach", 1},
+    {"serve", 1}, {"run", 1}, {"dazzle", 1}, {"snooze", 1}, {"doze", 1},
+    {"unwind", 1}, {"kindle", 1}, {"play", 1}, {"hang", 1}, {"believe", 1},
+    {"doubt", 1}
+};
+static const tpch_word_t adjectives[] = {
+    {"special", 20}, {"pending", 20}, {"unusual", 20}, {"express", 20},
+    {"furious", 1}, {"sly", 1}, {"careful", 1}, {"blithe", 1}, {"quick", 1},
+    {"fluffy", 1}, {"slow", 1}, {"quiet", 1}, {"ruthless", 1}, {"thin", 1},
+    {"close", 1}, {"dogged", 1}, {"daring", 1}, {"brave", 1}, {"stealthy", 1},
+    {"permanent", 1}, {"enticing", 1}, {"idle", 1}, {"busy", 1},
+    {"regular", 50}, {"final", 40}, {"ironic", 40}, {"even", 30}, {"bold", 20},
+    {"silent", 10}
+};
+static const tpch_word_t adverbs[] = {
+    {"sometimes", 1}, {"always", 1}, {"never", 1}, {"furiously", 50},
+    {"slyly", 50}, {"carefully", 50}, {"blithely", 40}, {"quickly", 30},
+    {"fluffily", 20}, {"slowly", 1}, {"quietly", 1}, {"ruthlessly", 1},
+    {"thinly", 1}, {"closely", 1}, {"doggedly", 1}, {"daringly", 1},
+    {"bravely", 1}, {"stealthily", 1}, {"permanently", 1}, {"enticingly", 1},
+    {"idly", 1}, {"busily", 1}, {"regularly", 1}, {"finally", 1},
+    {"ironically", 1}, {"evenly", 1}, {"boldly", 1}, {"silently", 1}
+};
+static const tpch_word_t prepositions[] = {
+    {"about", 50}, {"above", 50}, {"according to", 50}, {"across", 50},
+    {"after", 50}, {"against", 40}, {"along", 40}, {"alongside of", 30},
+    {"among", 30}, {"around", 20}, {"at", 10}, {"atop", 1}, {"before", 1},
+    {"behind", 1}, {"beneath", 1}, {"beside", 1}, {"besides", 1},
+    {"between", 1}, {"beyond", 1}, {"by", 1}, {"despite", 1}, {"during", 1},
+    {"except", 1}, {"for", 1}, {"from", 1}, {"in place of", 1}, {"inside", 1},
+    {"instead of", 1}, {"into", 1}, {"near", 1}, {"of", 1}, {"on", 1},
+    {"outside", 1}, {"over", 1}, {"past", 1}, {"since", 1}, {"through", 1},
+    {"throughout", 1}, {"to", 1}, {"toward", 1}, {"under", 1}, {"until", 1},
+    {"up", 1}, {"upon", 1}, {"without", 1}, {"with", 1}, {"within", 1}
+};
+static const tpch_word_t auxiliaries[] = {
+    {"do", 1}, {"may", 1}, {"might", 1}, {"shall", 1}, {"will", 1},
+    {"would", 1}, {"can", 1}, {"could", 1}, {"should", 1}, {"ought to", 1},
+    {"must", 1}, {"will have to", 1}, {"shall have to", 1},
+    {"could have to", 1}, {"should have to", 1}, {"must have to", 1},
+    {"need to", 1}, {"try to", 1}
+};
+static const tpch_word_t terminators[] = {
+    {".", 50}, {";", 1}, {":", 1}, {"?", 1}, {"!", 1}, {"--", 1}
+};
+
+/* Alphabet of random variable-length strings, e.g. addresses */
+static const char vstr_chars[] =
+    "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ,.";
+
+static const char *rng_word(tpch_rng_t *rng, const tpch_word_t *words,
+                            size_t n)
+{
+    unsigned int total = 0;
+    unsigned int w;
+
+    for (size_t i = 0; i < n; i++)
+        total += words[i].weight;
+
+    w = (unsigned int) tpch_rng_uniform(rng, 0, total - 1);
+    for (size_t i = 0; i < n; i++) {
+        if (w < words[i].weight)
+            return words[i].word;
+        w -= words[i].weight;
+    }
+
+    return words[n - 1].word;
+}
+
+/* Random substring of the text pool of length in the [min, max] range */
+
+static void rng_text(tpch_rng_t *rng, int min, int max, const char **text,
+                     int *len)
+{
+    *len = (int) tpch_rng_uniform(rng, min, max);
+    *text = dbgen.text + tpch_rng_uniform(rng, 0, TPCH_TEXT_POOL_SIZE - *len);
+}
+
+/* Random string of characters from vstr_chars of length in [min, max] */
+
+static int rng_vstr(tpch_rng_t *rng, int min, int max, char *buf)
+{
+    int len = (int) tpch_rng_uniform(rng, min, max);
+
+    for (int i = 0; i < len; i++)
+        buf[i] = vstr_chars[tpch_rng_uniform(rng, 0, sizeof(vstr_chars) - 2)];
+    buf[len] = '\0';
+
+    return len;
+}
+
+static void rng_phone(tpch_rng_t *rng, int nationkey, char *buf)
+{
+    const int local1 = (int) tpch_rng_uniform(rng, 100, 999);
+    const int local2 = (int) tpch_rng_uniform(rng, 100, 999);
+    const int local3 = (int) tpch_rng_uniform(rng, 1000, 9999);
+
+    sprintf(buf, "%02d-%03d-%03d-%04d", nationkey + 10, local1, local2,
+            local3);
+}
+
+/* Append a string to the text pool, returns 1 when the pool is full */
+
+static int text_append(size_t *pos, const char *str)
+{
+    size_t len = strlen(str);
+
+    if (*pos + len >= TPCH_TEXT_POOL_SIZE) {
+        memset(dbgen.text + *pos, ' ', TPCH_TEXT_POOL_SIZE - *pos);
+        *pos = TPCH_TEXT_POOL_SIZE;
+        return 1;
+    }
+    memcpy(dbgen.text + *pos, str, len);
+    *pos += len;
+
+    return 0;
+}
+
+static int text_phrase(tpch_rng_t *rng, size_t *pos, const char *syntax)
+{
+    for (const char *p = syntax; *p != '\0'; p++) {
+        const char *word;
+
+        switch (*p) {
+        case 'N':
+            word = rng_word(rng, WORDS(nouns));
+            break;
+        case 'V':
+            word = rng_word(rng, WORDS(verbs));
+            break;
+        case 'J':
+            word = rng_word(rng, WORDS(adjectives));
+            break;
+        case 'D':
+            word = rng_word(rng, WORDS(adverbs));
+            break;
+        case 'X':
+            word = rng_word(rng, WORDS(auxiliaries));
+            break;
+        case ',':
+            if (text_append(pos, ","))
+                return 1;
+            continue;
+        default:
+            continue;
+        }
+        if (text_append(pos, " ") || text_append(pos, word))
+            return 1;
+    }
+
+    return 0;
+}
+
+static void text_pool_init(void)
+{
+    tpch_rng_t rng;
+    size_t pos = 0;
+    int full = 0;
+
+    tpch_rng_seed(&rng, TPCH_TABLE_MAX, TPCH_TEXT_SEED);
+
+    while (!full) {
+        const char *sentence = rng_word(&rng, WORDS(grammar));
+
+        for (const char *p = sentence; *p != '\0' && !full; p++) {
+            switch (*p) {
+            case 'N':
+                full = text_phrase(&rng, &pos,
+                                   rng_word(&rng, WORDS(np_grammar)));
+                break;
+            case 'V':
+                full = text_phrase(&rng, &pos,
+                                   rng_word(&rng, WORDS(vp_grammar)));
+                break;
+            case 'P':
+                full = text_append(&pos, " ") ||
+                    text_append(&pos, rng_word(&rng, WORDS(prepositions))) ||
+                    text_append(&pos, " the") ||
+                    text_phrase(&rng, &pos, "N");
+                break;
+            case 'T':
+                full = text_append(&pos,
+                                   rng_word(&rng, WORDS(terminators)));
+                break;
+            }
+        }
+    }
+
+    /* Drop the leading space */
+    memmove(dbgen.text, dbgen.text + 1, TPCH_TEXT_POOL_SIZE - 1);
+    dbgen.text[TPCH_TEXT_POOL_SIZE - 1] = ' ';
+}
+
+static void dates_init(void)
+{
+    static const int mdays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    int y = 1992;
+    int m = 1;
+    int d = 1;
+
+    for (int i = 0; i < TPCH_TOTAL_DAYS; i++) {
+        int leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+
+        sprintf(dbgen.dates[i], "%04d-%02d-%02d", y, m, d);
+        if (y == 1995 && m == 6 && d == 17)
+            dbgen.current_date = i;
+
+        if (++d > mdays[m - 1] + (m == 2 && leap)) {
+            d = 1;
+            if (++m > 12) {
+                m = 1;
+                y++;
+            }
+        }
+    }
+}
+
+static uint64_t scaled(double base)
+{
+    uint64_t n = (uint64_t) (base * dbgen.scale);
+
+    return n > 0 ? n : 1;
+}
+
+int tpch_dbgen_init(double scale)
+{
+    dbgen.scale = scale;
+
+    dbgen.keys[TPCH_REGION] = sizeof(regions) / sizeof(regions[0]);
+    dbgen.keys[TPCH_NATION] = TPCH_NATIONS;
+    dbgen.keys[TPCH_PART] = scaled(200000);
+    dbgen.keys[TPCH_PARTSUPP] = dbgen.keys[TPCH_PART];
+    dbgen.keys[TPCH_SUPPLIER] = scaled(10000);
+    dbgen.keys[TPCH_CUSTOMER] = scaled(150000);
+    dbgen.keys[TPCH_ORDERS] = scaled(1500000);
+    dbgen.keys[TPCH_LINEITEM] = dbgen.keys[TPCH_ORDERS];
+    dbgen.clerks = scaled(1000);
+    dbgen.refresh_orders = scaled(1500);
+
+    dbgen.text = malloc(TPCH_TEXT_POOL_SIZE);
+    if (dbgen.text == NULL) {
+        log_text(LOG_FATAL, "Failed to allocate the TPC-H text pool");
+        return 1;
+    }
+
+    text_pool_init();
+    dates_init();
+
+    return 0;
+}
+
+void tpch_dbgen_done(void)
+{
+    free(dbgen.text);
+    dbgen.text = NULL;
+}
+
+const char *tpch_nation_name(unsigned int nationkey)
+{
+    return nations[nationkey].name;
+}
+
+unsigned int tpch_nation_region(unsigned int nationkey)
+{
+    return nations[nationkey].regionkey;
+}
+
+const char *tpch_dbgen_table_name(tpch_table_t table)
+{
+    return table_names[table];
+}
+
+uint64_t tpch_dbgen_keys(tpch_table_t table)
+{
+    return dbgen.keys[table];
+}
+
+/* Money amounts are kept in cents */
+
+#define MONEY_FMT "%s%" PRId64 ".%02d"
+#define MONEY_ARGS(c) ((c) < 0 ? "-" : ""),                             \
+        (int64_t) ((c) < 0 ? -(c) : (c)) / 100,                         \
+        (int) (((c) < 0 ? -(c) : (c)) % 100)
+
+static int64_t retail_price(uint64_t partkey)
+{
+    return 90000 + (int64_t) ((partkey / 10) % 20001) +
+        100 * (int64_t) (partkey % 1000);
+}
+
+/* Supplier of the i-th (0-3) PARTSUPP row of a part */
+
+static uint64_t partsupp_suppkey(uint64_t partkey, uint64_t i)
+{
+    const uint64_t s = dbgen.keys[TPCH_SUPPLIER];
+
+    return (partkey + i * (s / 4 + (partkey - 1) / s)) % s + 1;
+}
+
+/* Orders use only 8 out of each 32 keys to leave room for refresh functions */
+
+static uint64_t order_key(uint64_t i)
+{
+    return (i >> 3 << 5) + (i & 7) + 1;
+}
+
+/*
+  Refresh orders of a set are spread over all blocks of 32 keys, and use one
+  of the 24 unused keys of each block. Sets that share a key are never loaded
+  at the same time, as RF2 deletes the orders inserted by RF1.
+*/
+
+static uint64_t refresh_key(unsigned int set, uint64_t i)
+{
+    const uint64_t blocks = (dbgen.keys[TPCH_ORDERS] + TPCH_ORDER_SLOTS - 1) /
+        TPCH_ORDER_SLOTS;
+    const uint64_t block = i * blocks / dbgen.refresh_orders;
+
+    return (block << 5) + TPCH_ORDER_SLOTS + set % (32 - TPCH_ORDER_SLOTS) + 1;
+}
+
+static void gen_order(uint64_t orderkey, tpch_order_t *o)
+{
+    tpch_rng_t rng;
+    int nfinal = 0;
+
+    o->orderkey = orderkey;
+    tpch_rng_seed(&rng, TPCH_ORDERS, o->orderkey);
+
+    /* Every third customer does not place orders */
+    do {
+        o->custkey = (uint64_t) tpch_rng_uniform(&rng, 1,
+                                            dbgen.keys[TPCH_CUSTOMER]);
+    } while (o->custkey % 3 == 0);
+
+    o->orderdate = (int) tpch_rng_uniform(&rng, 0, TPCH_TOTAL_DAYS - 151 - 1);
+    o->orderpriority = PICK(&rng, priorities);
+    o->clerk = (uint64_t) tpch_rng_uniform(&rng, 1, dbgen.clerks);
+    rng_text(&rng, 19, 78, &o->comment, &o->comment_len);
+    o->nlines = (int) tpch_rng_uniform(&rng, 1, TPCH_MAX_LINES);
+    o->totalprice = 0;
+
+    for (int n = 0; n < o->nlines; n++) {
+        tpch_line_t *l = &o->lines[n];
+
+        l->partkey = (uint64_t) tpch_rng_uniform(&rng, 1, dbgen.keys[TPCH_PART]);
+        l->suppkey = partsupp_suppkey(l->partkey,
+                                      (uint64_t) tpch_rng_uniform(&rng, 0, 3));
+        l->quantity = (int) tpch_rng_uniform(&rng, 1, 50);
+        l->extendedprice = l->quantity * retail_price(l->partkey);
+        l->discount = (int) tpch_rng_uniform(&rng, 0, 10);
+        l->tax = (int) tpch_rng_uniform(&rng, 0, 8);
+        l->shipdate = o->orderdate + (int) tpch_rng_uniform(&rng, 1, 121);
+        l->commitdate = o->orderdate + (int) tpch_rng_uniform(&rng, 30, 90);
+        l->receiptdate = l->shipdate + (int) tpch_rng_uniform(&rng, 1, 30);
+        l->returnflag = l->receiptdate <= dbgen.current_date ?
+            (tpch_rng_uniform(&rng, 0, 1) ? 'R' : 'A') : 'N';
+        l->linestatus = l->shipdate > dbgen.current_date ? 'O' : 'F';
+        l->shipinstruct = PICK(&rng, instructions);
+        l->shipmode = PICK(&rng, modes);
+        rng_text(&rng, 10, 43, &l->comment, &l->comment_len);
+
+        o->totalprice += l->extendedprice * (100 + l->tax) *
+            (100 - l->discount) / 10000;
+        nfinal += l->linestatus == 'F';
+    }
+
+    o->orderstatus = nfinal == o->nlines ? 'F' : (nfinal == 0 ? 'O' : 'P');
+}
+
+static int emit_row(db_conn_t *con, const char *row, int len)
+{
+    if (len < 0 || len >= TPCH_ROW_MAX) {
+        log_text(LOG_FATAL, "TPC-H row is too long: %d", len);
+        return 1;
+    }
+
+    return db_bulk_insert_next(con, row, (size_t) len);
+}
+
+static int gen_region(db_conn_t *con, uint64_t i, char *row)
+{
+    tpch_rng_t rng;
+    const char *comment;
+    int comment_len;
+
+    tpch_rng_seed(&rng, TPCH_REGION, i);
+    rng_text(&rng, 31, 115, &comment, &comment_len);
+
+    return emit_row(con, row,
+                    snprintf(row, TPCH_ROW_MAX, "(%" PRIu64 ",'%s','%.*s')",
+                             i, regions[i], comment_len, comment));
+}
+
+static int gen_nation(db_conn_t *con, uint64_t i, char *row)
+{
+    tpch_rng_t rng;
+    const char *comment;
+    int comment_len;
+
+    tpch_rng_seed(&rng, TPCH_NATION, i);
+    rng_text(&rng, 31, 114, &comment, &comment_len);
+
+    return emit_row(con, row,
+                    snprintf(row, TPCH_ROW_MAX,
+                             "(%" PRIu64 ",'%s',%u,'%.*s')",
+                             i, nations[i].name, nations[i].regionkey,
+                             comment_len, comment));
+}
+
+static int gen_part(db_conn_t *con, uint64_t i, char *row)
+{
+    const uint64_t partkey = i + 1;
+    const int64_t price = retail_price(partkey);
+    tpch_rng_t rng;
+    const char *name[5];
+    const char *type[3];
+    const char *container[2];
+    const char *comment;
+    int comment_len;
+    int mfgr, brand, size;
+
+    tpch_rng_seed(&rng, TPCH_PART, partkey);
+
+    /* 5 distinct colors */
+    for (int n = 0; n < 5; n++) {
+        int dup;
+
+        do {
+            name[n] = PICK(&rng, colors);
+            dup = 0;
+            for (int k = 0; k < n; k++)
+                dup |= name[k] == name[n];
+        } while (dup);
+    }
+
+    mfgr = (int) tpch_rng_uniform(&rng, 1, 5);
+    brand = (int) tpch_rng_uniform(&rng, 1, 5);
+    type[0] = PICK(&rng, type_s1);
+    type[1] = PICK(&rng, type_s2);
+    type[2] = PICK(&rng, type_s3);
+    size = (int) tpch_rng_uniform(&rng, 1, 50);
+    container[0] = PICK(&rng, container_s1);
+    container[1] = PICK(&rng, container_s2);
+    rng_text(&rng, 5, 22, &comment, &comment_len);
+
+    return emit_row(con, row,
+                    snprintf(row, TPCH_ROW_MAX,
+                             "(%" PRIu64 ",'%s %s %s %s %s','Manufacturer#%d',"
+                             "'Brand#%d%d','%s %s %s',%d,'%s %s',"
+                             MONEY_FMT ",'%.*s')",
+                             partkey, name[0], name[1], name[2], name[3],
+                             name[4], mfgr, mfgr, brand, type[0], type[1],
+                             type[2], size, container[0], container[1],
+                             MONEY_ARGS(price), comment_len, comment));
+}
+
+static int gen_partsupp(db_conn_t *con, uint64_t i, char *row)
+{
+    const uint64_t partkey = i + 1;
+    tpch_rng_t rng;
+
+    tpch_rng_seed(&rng, TPCH_PARTSUPP, partkey);
+
+    for (uint64_t n = 0; n < 4; n++) {
+        const int64_t cost = tpch_rng_uniform(&rng, 100, 100000);
+        const char *comment;
+        int comment_len;
+        int availqty = (int) tpch_rng_uniform(&rng, 1, 9999);
+
+        rng_text(&rng, 49, 198, &comment, &comment_len);
+
+        if (emit_row(con, row,
+                     snprintf(row, TPCH_ROW_MAX,
+                              "(%" PRIu64 ",%" PRIu64 ",%d," MONEY_FMT
+                              ",'%.*s')",
+                              partkey, partsupp_suppkey(partkey, n), availqty,
+                              MONEY_ARGS(cost), comment_len, comment)))
+            return 1;
+    }
+
+    return 0;
+}
+
+static int gen_supplier(db_conn_t *con, uint64_t i, char *row)
+{
+    const uint64_t suppkey = i + 1;
+    tpch_rng_t rng;
+    char address[41];
+    char phone[16];
+    char comment[101];
+    const char *text;
+    int comment_len;
+    int nationkey;
+    int64_t acctbal;
+
+    tpch_rng_seed(&rng, TPCH_SUPPLIER, suppkey);
+
+    rng_vstr(&rng, 10, 40, address);
+    nationkey = (int) tpch_rng_uniform(&rng, 0, TPCH_NATIONS - 1);
+    rng_phone(&rng, nationkey, phone);
+    acctbal = tpch_rng_uniform(&rng, -99999, 999999);
+    rng_text(&rng, 25, 100, &text, &comment_len);
+    memcpy(comment, text, comment_len);
+
+    /*
+      5 suppliers per 10000 have customer complaints and another 5 per 10000
+      have recommendations in comments
+    */
+    if (tpch_rng_uniform(&rng, 0, 9999) < 10) {
+        const char *noun = tpch_rng_uniform(&rng, 0, 1) ? "Complaints" : "Recommends";
+        const int start = (int) tpch_rng_uniform(&rng, 0, comment_len - 19);
+        const int gap = (int) tpch_rng_uniform(&rng, 0, comment_len - 19 - start);
+
+        memcpy(comment + start, "Customer ", 9);
+        memcpy(comment + start + 9 + gap, noun, 10);
+    }
+
+    return emit_row(con, row,
+                    snprintf(row, TPCH_ROW_MAX,
+                             "(%" PRIu64 ",'Supplier#%09" PRIu64 "','%s',%d,"
+                             "'%s'," MONEY_FMT ",'%.*s')",
+                             suppkey, suppkey, address, nationkey, phone,
+                             MONEY_ARGS(acctbal), comment_len, comment));
+}
+
+static int gen_customer(db_conn_t *con, uint64_t i, char *row)
+{
+    const uint64_t custkey = i + 1;
+    tpch_rng_t rng;
+    char address[41];
+    char phone[16];
+    const char *segment;
+    const char *comment;
+    int comment_len;
+    int nationkey;
+    int64_t acctbal;
+
+    tpch_rng_seed(&rng, TPCH_CUSTOMER, custkey);
+
+    rng_vstr(&rng, 10, 40, address);
+    nationkey = (int) tpch_rng_uniform(&rng, 0, TPCH_NATIONS - 1);
+    rng_phone(&rng, nationkey, phone);
+    acctbal = tpch_rng_uniform(&rng, -99999, 999999);
+    segment = PICK(&rng, segments);
+    rng_text(&rng, 29, 116, &comment, &comment_len);
+
+    return emit_row(con, row,
+                    snprintf(row, TPCH_ROW_MAX,
+                             "(%" PRIu64 ",'Customer#%09" PRIu64 "','%s',%d,"
+                             "'%s'," MONEY_FMT ",'%s','%.*s')",
+                             custkey, custkey, address, nationkey, phone,
+                             MONEY_ARGS(acctbal), segment,
+                             comment_len, comment));
+}
+
+static int emit_order(db_conn_t *con, uint64_t orderkey, char *row)
+{
+    tpch_order_t o;
+
+    gen_order(orderkey, &o);
+
+    return emit_row(con, row,
+                    snprintf(row, TPCH_ROW_MAX,
+                             "(%" PRIu64 ",%" PRIu64 ",'%c'," MONEY_FMT
+                             ",'%s','%s','Clerk#%09" PRIu64 "',0,'%.*s')",
+                             o.orderkey, o.custkey, o.orderstatus,
+                             MONEY_ARGS(o.totalprice),
+                             dbgen.dates[o.orderdate], o.orderpriority,
+                             o.clerk, o.comment_len, o.comment));
+}
+
+static int emit_lines(db_conn_t *con, uint64_t orderkey, char *row)
+{
+    tpch_order_t o;
+
+    gen_order(orderkey, &o);
+
+    for (int n = 0; n < o.nlines; n++) {
+        const tpch_line_t *l = &o.lines[n];
+
+        if (emit_row(con, row,
+                     snprintf(row, TPCH_ROW_MAX,
+                              "(%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%d,%d,"
+                              MONEY_FMT ",0.%02d,0.%02d,'%c','%c','%s','%s',"
+                              "'%s','%s','%s','%.*s')",
+                              o.orderkey, l->partkey, l->suppkey, n + 1,
+                              l->quantity, MONEY_ARGS(l->extendedprice),
+                              l->discount, l->tax, l->returnflag,
+                              l->linestatus, dbgen.dates[l->shipdate],
+                              dbgen.dates[l->commitdate],
+                              dbgen.dates[l->receiptdate], l->shipinstruct,
+                              l->shipmode, l->comment_len, l->comment)))
+            return 1;
+    }
+
+    return 0;
+}
+
+static int gen_orders(db_conn_t *con, uint64_t i, char *row)
+{
+    return emit_order(con, order_key(i), row);
+}
+
+static int gen_lineitem(db_conn_t *con, uint64_t i, char *row)
+{
+    return emit_lines(con, order_key(i), row);
+}
+
+static int bulk_insert_init(db_conn_t *con, tpch_table_t table)
+{
+    char query[64];
+
+    snprintf(query, sizeof(query), "INSERT INTO %s VALUES",
+             table_names[table]);
+
+    return db_bulk_insert_init(con, query, strlen(query));
+}
+
+int tpch_dbgen_load(db_conn_t *con, tpch_table_t table, uint64_t first,
+                    uint64_t last)
+{
+    static int (*const gen[TPCH_TABLE_MAX])(db_conn_t *, uint64_t, char *) = {
+        gen_region, gen_nation, gen_part, gen_partsupp, gen_supplier,
+        gen_customer, gen_orders, gen_lineitem
+    };
+    char row[TPCH_ROW_MAX];
+
+    if (first >= last)
+        return 0;
+
+    if (bulk_insert_init(con, table))
+        return 1;
+
+    for (uint64_t i = first; i < last; i++) {
+        if (gen[table](con, i, row)) {
+            db_bulk_insert_done(con);
+            return 1;
+        }
+    }
+
+    return db_bulk_insert_done(con);
+}
+
+uint64_t tpch_dbgen_refresh_orders(void)
+{
+    return dbgen.refresh_orders;
+}
+
+int tpch_dbgen_refresh_insert(db_conn_t *con, unsigned int set)
+{
+    char row[TPCH_ROW_MAX];
+
+    /* ORDERS rows go first, as LINEITEM rows reference them */
+    for (int table = TPCH_ORDERS; table <= TPCH_LINEITEM; table++) {
+        if (bulk_insert_init(con, table))
+            return 1;
+
+        for (uint64_t i = 0; i < dbgen.refresh_orders; i++) {
+            const uint64_t key = refresh_key(set, i);
+
+            if (table == TPCH_ORDERS ? emit_order(con, key, row) :
+                emit_lines(con, key, row)) {
+                db_bulk_insert_done(con);
+                return 1;
+            }
+        }
+
+        if (db_bulk_insert_done(con))
+            return 1;
+    }
+
+    return 0;
+}
+
+int tpch_dbgen_refresh_delete(db_conn_t *con, unsigned int set)
+{
+    static const char *const deletes[2] = {
+        "DELETE FROM lineitem WHERE l_orderkey IN (",
+        "DELETE FROM orders WHERE o_orderkey IN ("
+    };
+    const size_t size = 64 + TPCH_DELETE_BATCH * 21;
+    char *query = malloc(size);
+    int rc = 0;
+
+    if (query == NULL)
+        return 1;
+
+    for (uint64_t first = 0; first < dbgen.refresh_orders && rc == 0;
+         first += TPCH_DELETE_BATCH) {
+        const uint64_t last = first + TPCH_DELETE_BATCH < dbgen.refresh_orders ?
+            first + TPCH_DELETE_BATCH : dbgen.refresh_orders;
+
+        /* LINEITEM rows go first, as they reference ORDERS rows */
+        for (int i = 0; i < 2 && rc == 0; i++) {
+            size_t len = (size_t) snprintf(query, size, "%s", deletes[i]);
+            db_result_t *rs;
+
+            for (uint64_t j = first; j < last; j++)
+                len += (size_t) snprintf(query + len, size - len,
+                                         "%s%" PRIu64, j > first ? "," : "",
+                                         refresh_key(set, j));
+            len += (size_t) snprintf(query + len, size - len, ")");
+
+            rs = db_query(con, query, len);
+            if (rs != NULL)
+                db_free_results(rs);
+            else if (con->error != DB_ERROR_NONE)
+                rc = 1;
+        }
+    }
+
+    free(query);
+
+    return rc;
+}
@@ -0,0 +1,149 @@
+/* Copyright (C) 2026 sysbench contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+/*
+  In-process TPC-H data generator. Every row is generated from a random number
+  stream seeded by its table and key, so any range of keys can be generated
+  independently of the others, and the data does not depend on how the key
+  space is split between threads.
+*/
+
+#ifndef TPCH_DBGEN_H
+#define TPCH_DBGEN_H
+
+#include <stdint.h>
+
+#include "db_driver.h"
+
+/* TPC-H tables in the order they are loaded */
+typedef enum {
+    TPCH_REGION,
+    TPCH_NATION,
+    TPCH_PART,
+    TPCH_PARTSUPP,
+    TPCH_SUPPLIER,
+    TPCH_CUSTOMER,
+    TPCH_ORDERS,
+    TPCH_LINEITEM,
+    TPCH_TABLE_MAX
+} tpch_table_t;
+
+/* Minimum supported scale factor */
+#define TPCH_MIN_SCALE 0.01
+
+#define TPCH_NATIONS 25
+
+/* Random number stream (SplitMix64) */
+typedef struct {
+    uint64_t state;
+} tpch_rng_t;
+
+/* List of values shared by the data and query generators */
+typedef struct {
+    const char * const *values;
+    unsigned int count;
+} tpch_list_t;
+
+extern const tpch_list_t tpch_regions;
+extern const tpch_list_t tpch_colors;
+extern const tpch_list_t tpch_types[3];
+extern const tpch_list_t tpch_containers[2];
+extern const tpch_list_t tpch_segments;
+extern const tpch_list_t tpch_modes;
+
+static inline uint64_t tpch_rng_mix(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t tpch_rng_next(tpch_rng_t *rng)
+{
+    return tpch_rng_mix(rng->state += UINT64_C(0x9E3779B97F4A7C15));
+}
+
+/*
+  Seed a stream with a hash of a stream id (e.g. the table) and a key, so
+  streams do not overlap
+*/
+
+static inline void tpch_rng_seed(tpch_rng_t *rng, unsigned int id,
+                                 uint64_t key)
+{
+    rng->state = tpch_rng_mix(((uint64_t) id << 56) ^ tpch_rng_mix(key));
+}
+
+/* Uniformly distributed integer in the [lo, hi] range */
+
+static inline int64_t tpch_rng_uniform(tpch_rng_t *rng, int64_t lo,
+                                       int64_t hi)
+{
+    return lo + (int64_t) (tpch_rng_next(rng) % (uint64_t) (hi - lo + 1));
+}
+
+static inline const char *tpch_rng_pick(tpch_rng_t *rng,
+                                        const tpch_list_t *list)
+{
+    return list->values[tpch_rng_uniform(rng, 0, list->count - 1)];
+}
+
+/*
+  Initialize the generator for a given scale factor. Returns 0 on success, 1 on
+  errors.
+*/
+int tpch_dbgen_init(double scale);
+
+/* Release resources allocated by tpch_dbgen_init() */
+void tpch_dbgen_done(void);
+
+/* Return the name and region key of a nation */
+const char *tpch_nation_name(unsigned int nationkey);
+unsigned int tpch_nation_region(unsigned int nationkey);
+
+/* Return the table name */
+const char *tpch_dbgen_table_name(tpch_table_t table);
+
+/*
+  Return the number of keys to generate for a table. For PARTSUPP and LINEITEM
+  those are keys of the parent PART and ORDERS rows, respectively.
+*/
+uint64_t tpch_dbgen_keys(tpch_table_t table);
+
+/*
+  Generate rows for keys in the [first, last) range (0-based) and insert them
+  into a table with multi-row inserts. Returns 0 on success, 1 on errors.
+*/
+int tpch_dbgen_load(db_conn_t *con, tpch_table_t table, uint64_t first,
+                    uint64_t last);
+
+/* Return the number of orders inserted by RF1 and deleted by RF2 */
+uint64_t tpch_dbgen_refresh_orders(void);
+
+/*
+  RF1: insert new ORDERS and LINEITEM rows of a refresh set. Returns 0 on
+  success, 1 on errors.
+*/
+int tpch_dbgen_refresh_insert(db_conn_t *con, unsigned int set);
+
+/*
+  RF2: delete the ORDERS and LINEITEM rows of a refresh set in batches. Returns
+  0 on success, 1 on errors.
+*/
+int tpch_dbgen_refresh_delete(db_conn_t *con, unsigned int set);
+
+#endif /* TPCH_DBGEN_H */
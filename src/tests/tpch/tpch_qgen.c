@@ -0,0 +1,449 @@
+/* Copyright (C) 2026 sysbench contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+/*
+  Substitution parameters are generated as defined for each query in the TPC-H
+  specification (clauses 2.4.1.3 - 2.4.22.3), or set to the query validation
+  values of the specification (clauses 2.4.1.4 - 2.4.22.4) to make results
+  comparable between runs. Queries of each stream run in the order defined by
+  Appendix A of the specification, with stream 0 being the power test. Streams
+  beyond the 40 listed there reuse the orders from the beginning of the table.
+*/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "tpch_dbgen.h"
+#include "tpch_qgen.h"
+
+/* Maximum number of substitution parameters of a query */
+#define TPCH_MAX_PARAMS 10
+
+/* Random stream id, distinct from table ids used by the data generator */
+#define TPCH_QGEN_PARAMS (TPCH_TABLE_MAX + 1)
+
+typedef char tpch_param_t[32];
+
+static struct {
+    double scale;
+    uint64_t seed;
+    bool validate;
+} qgen;
+
+/*
+  Query order of each stream from Appendix A of the specification. Stream 0 is
+  the power test, streams 1-40 are throughput test streams.
+*/
+#define TPCH_STREAMS 41
+
+static const unsigned char stream_order[TPCH_STREAMS][TPCH_QUERIES] = {
+    { 14,  2,  9, 20,  6, 17, 18,  8, 21, 13,  3,
+      22, 16,  4, 11, 15,  1, 10, 19,  5,  7, 12 },
+    { 21,  3, 18,  5, 11,  7,  6, 20, 17, 12, 16,
+      15, 13, 10,  2,  8, 14, 19,  9, 22,  1,  4 },
+    {  6, 17, 14, 16, 19, 10,  9,  2, 15,  8,  5,
+      22, 12,  7, 13, 18,  1,  4, 20,  3, 11, 21 },
+    {  8,  5,  4,  6, 17,  7,  1, 18, 22, 14,  9,
+      10, 15, 11, 20,  2, 21, 19, 13, 16, 12,  3 },
+    {  5, 21, 14, 19, 15, 17, 12,  6,  4,  9,  8,
+      16, 11,  2, 10, 18,  1, 13,  7, 22,  3, 20 },
+    { 21, 15,  4,  6,  7, 16, 19, 18, 14, 22, 11,
+      13,  3,  1,  2,  5,  8, 20, 12, 17, 10,  9 },
+    { 10,  3, 15, 13,  6,  8,  9,  7,  4, 11, 22,
+      18, 12,  1,  5, 16,  2, 14, 19, 20, 17, 21 },
+    { 18,  8, 20, 21,  2,  4, 22, 17,  1, 11,  9,
+      19,  3, 13,  5,  7, 10, 16,  6, 14, 15, 12 },
+    { 19,  1, 15, 17,  5,  8,  9, 12, 14,  7,  4,
+       3, 20, 16,  6, 22, 10, 13,  2, 21, 18, 11 },
+    {  8, 13,  2, 20, 17,  3,  6, 21, 18, 11, 19,
+      10, 15,  4, 22,  1,  7, 12,  9, 14,  5, 16 },
+    {  6, 15, 18, 17, 12,  1,  7,  2, 22, 13, 21,
+      10, 14,  9,  3, 16, 20, 19, 11,  4,  8,  5 },
+    { 15, 14, 18, 17, 10, 20, 16, 11,  1,  8,  4,
+      22,  5, 12,  3,  9, 21,  2, 13,  6, 19,  7 },
+    {  1,  7, 16, 17, 18, 22, 12,  6,  8,  9, 11,
+       4,  2,  5, 20, 21, 13, 10, 19,  3, 14, 15 },
+    { 21, 17,  7,  3,  1, 10, 12, 22,  9, 16,  6,
+      11,  2,  4,  5, 14,  8, 20, 13, 18, 15, 19 },
+    {  2,  9,  5,  4, 18,  1, 20, 15, 16, 17,  7,
+      21, 13, 14, 19,  8, 22, 11, 10,  3, 12,  6 },
+    { 16,  9, 17,  8, 14, 11, 10, 12,  6, 21,  7,
+       3, 15,  5, 22, 20,  1, 13, 19,  2,  4, 18 },
+    {  1,  3,  6,  5,  2, 16, 14, 22, 17, 20,  4,
+       9, 10, 11, 15,  8, 12, 19, 18, 13,  7, 21 },
+    {  3, 16,  5, 11, 21,  9,  2, 15, 10, 18, 17,
+       7,  8, 19, 14, 13,  1,  4, 22, 20,  6, 12 },
+    { 14,  4, 13,  5, 21, 11,  8,  6,  3, 17,  2,
+      20,  1, 19, 10,  9, 12, 18, 15,  7, 22, 16 },
+    {  4, 12, 22, 14,  5, 15, 16,  2,  8, 10, 17,
+       9, 21,  7,  3,  6, 13, 18, 11, 20, 19,  1 },
+    { 16, 15, 14, 13,  4, 22, 18, 19,  7,  1, 12,
+      17,  5, 10, 20,  3,  9, 21, 11,  2,  6,  8 },
+    { 20, 14, 21, 12, 15, 17,  4, 19, 13, 10, 11,
+       1, 16,  5, 18,  7,  8, 22,  9,  6,  3,  2 },
+    { 16, 14, 13,  2, 21, 10, 11,  4,  1, 22, 18,
+      12, 19,  5,  7,  8,  6,  3, 15, 20,  9, 17 },
+    { 18, 15,  9, 14, 12,  2,  8, 11, 22, 21, 16,
+       1,  6, 17,  5, 10, 19,  4, 20, 13,  3,  7 },
+    {  7,  3, 10, 14, 13, 21, 18,  6, 20,  4,  9,
+       8, 22, 15,  2,  1,  5, 12, 19, 17, 11, 16 },
+    { 18,  1, 13,  7, 16, 10, 14,  2, 19,  5, 21,
+      11, 22, 15,  8, 17, 20,  3,  4, 12,  6,  9 },
+    { 13,  2, 22,  5, 11, 21, 20, 14,  7, 10,  4,
+       9, 19, 18,  6,  3,  1,  8, 15, 12, 17, 16 },
+    { 14, 17, 21,  8,  2,  9,  6,  4,  5, 13, 22,
+       7, 15,  3,  1, 18, 16, 11, 10, 12, 20, 19 },
+    { 10, 22,  1, 12, 13, 18, 21, 20,  2, 14, 16,
+       7, 15,  3,  4, 17,  5, 19,  6,  8,  9, 11 },
+    { 10,  8,  9, 18, 12,  6,  1,  5, 20, 11, 17,
+      22, 16,  3, 13,  2, 15, 21, 14, 19,  7,  4 },
+    {  7, 17, 22,  5,  3, 10, 13, 18,  9,  1, 14,
+      15, 21, 19, 16, 12,  8,  6, 11, 20,  4,  2 },
+    {  2,  9, 21,  3,  4,  7,  1, 11, 16,  5, 20,
+      19, 18,  8, 17, 13, 10, 12, 15,  6, 14, 22 },
+    { 15, 12,  8,  4, 22, 13, 16, 17, 18,  3,  7,
+       5,  6,  1,  9, 11, 21, 10, 14, 20, 19,  2 },
+    { 15, 16,  2, 11, 17,  7,  5, 14, 20,  4, 21,
+       3, 10,  9, 12,  8, 13,  6, 18, 19, 22,  1 },
+    {  1, 13, 11,  3,  4, 21,  6, 14, 15, 22, 18,
+       9,  7,  5, 10, 20, 12, 16, 17,  8, 19,  2 },
+    { 14, 17, 22, 20,  8, 16,  5, 10,  1, 13,  2,
+      21, 12,  9,  4, 18,  3,  7,  6, 19, 15, 11 },
+    {  9, 17,  7,  4,  5, 13, 21, 18, 11,  3, 22,
+       1,  6, 16, 20, 14, 15, 10,  8,  2, 12, 19 },
+    { 13, 14,  5, 22, 19, 11,  9,  6, 18, 15,  8,
+      10,  7,  4, 17, 16,  3,  1, 12,  2, 21, 20 },
+    { 20,  5,  4, 14, 11,  1,  6, 16,  8, 22,  7,
+       3,  2, 12, 21, 19, 17, 13, 10, 15, 18,  9 },
+    {  3,  7, 14, 15,  6,  5, 21, 20, 18, 10,  4,
+      16, 19,  1, 13,  9,  8, 17, 11, 12, 22,  2 },
+    { 13, 15, 17,  1, 22, 11,  3,  4,  7, 20, 14,
+      21,  9,  8,  2, 18, 16,  6, 10, 12,  5, 19 }
+};
+
+static const char *q13_words1[] = {
+    "special", "pending", "unusual", "express"
+};
+static const char *q13_words2[] = {
+    "packages", "requests", "accounts", "deposits"
+};
+
+static const tpch_list_t q13_lists[2] = {
+    { q13_words1, sizeof(q13_words1) / sizeof(q13_words1[0]) },
+    { q13_words2, sizeof(q13_words2) / sizeof(q13_words2[0]) }
+};
+
+/* Query validation parameters, the Q11 fraction depends on the scale factor */
+static const char *validation_params[TPCH_QUERIES][TPCH_MAX_PARAMS] = {
+    { "90" },
+    { "15", "BRASS", "EUROPE" },
+    { "BUILDING", "1995-03-15" },
+    { "1993-07-01" },
+    { "ASIA", "1994-01-01" },
+    { "1994-01-01", "0.06", "24" },
+    { "FRANCE", "GERMANY" },
+    { "BRAZIL", "AMERICA", "ECONOMY ANODIZED STEEL" },
+    { "green" },
+    { "1993-10-01" },
+    { "GERMANY", "" },
+    { "MAIL", "SHIP", "1994-01-01" },
+    { "special", "requests" },
+    { "1995-09-01" },
+    { "1996-01-01" },
+    { "Brand#45", "MEDIUM POLISHED", "49", "14", "23", "45", "19", "3", "36",
+      "9" },
+    { "Brand#23", "MED BOX" },
+    { "300" },
+    { "1", "10", "20", "Brand#12", "Brand#23", "Brand#34" },
+    { "forest", "1994-01-01", "CANADA" },
+    { "SAUDI ARABIA" },
+    { "13", "31", "23", "29", "30", "18", "17" }
+};
+
+void tpch_qgen_init(double scale, uint64_t seed, bool validate)
+{
+    qgen.scale = scale;
+    qgen.seed = seed;
+    qgen.validate = validate;
+}
+
+void tpch_qgen_order(unsigned int stream, unsigned int order[TPCH_QUERIES])
+{
+    const unsigned char *row = stream_order[stream % TPCH_STREAMS];
+
+    for (unsigned int i = 0; i < TPCH_QUERIES; i++)
+        order[i] = row[i];
+}
+
+/*
+  First day of a random month in the [first, last] range, counting months from
+  January 1993
+*/
+
+static void param_month(tpch_rng_t *rng, unsigned int first, unsigned int last,
+                        tpch_param_t p)
+{
+    const unsigned int m = (unsigned int) tpch_rng_uniform(rng, first, last);
+
+    sprintf(p, "%u-%02u-01", 1993 + m / 12, m % 12 + 1);
+}
+
+/* January 1st of a random year in [1993, 1997] */
+
+static void param_year(tpch_rng_t *rng, tpch_param_t p)
+{
+    sprintf(p, "%u-01-01", (unsigned int) tpch_rng_uniform(rng, 1993, 1997));
+}
+
+static void param_brand(tpch_rng_t *rng, tpch_param_t p)
+{
+    const unsigned int m = (unsigned int) tpch_rng_uniform(rng, 1, 5);
+    const unsigned int n = (unsigned int) tpch_rng_uniform(rng, 1, 5);
+
+    sprintf(p, "Brand#%u%u", m, n);
+}
+
+/* FRACTION of Q11 */
+
+static void param_fraction(tpch_param_t p)
+{
+    sprintf(p, "%.10f", 0.0001 / qgen.scale);
+}
+
+static void param_nation(tpch_rng_t *rng, tpch_param_t p)
+{
+    strcpy(p, tpch_nation_name(tpch_rng_uniform(rng, 0, TPCH_NATIONS - 1)));
+}
+
+static void param_string(tpch_rng_t *rng, const tpch_list_t *list,
+                         tpch_param_t p)
+{
+    strcpy(p, tpch_rng_pick(rng, list));
+}
+
+/* Words picked from each of n lists, separated by spaces */
+
+static void param_words(tpch_rng_t *rng, const tpch_list_t *lists,
+                        unsigned int n, tpch_param_t p)
+{
+    p[0] = '\0';
+    for (unsigned int i = 0; i < n; i++) {
+        if (i > 0)
+            strcat(p, " ");
+        strcat(p, tpch_rng_pick(rng, &lists[i]));
+    }
+}
+
+/* n distinct integers in the [lo, hi] range */
+
+static void param_distinct(tpch_rng_t *rng, int lo, int hi, unsigned int n,
+                           tpch_param_t *p)
+{
+    int values[TPCH_MAX_PARAMS];
+
+    for (unsigned int i = 0; i < n; i++) {
+        int dup;
+
+        do {
+            values[i] = (int) tpch_rng_uniform(rng, lo, hi);
+            dup = 0;
+            for (unsigned int j = 0; j < i; j++)
+                dup |= values[j] == values[i];
+        } while (dup);
+
+        sprintf(p[i], "%d", values[i]);
+    }
+}
+
+static unsigned int gen_params(tpch_rng_t *rng, unsigned int query,
+                               tpch_param_t *p)
+{
+    unsigned int nationkey;
+
+    switch (query) {
+    case 1:
+        sprintf(p[0], "%d", (int) tpch_rng_uniform(rng, 60, 120));
+        return 1;
+    case 2:
+        sprintf(p[0], "%d", (int) tpch_rng_uniform(rng, 1, 50));
+        param_string(rng, &tpch_types[2], p[1]);
+        param_string(rng, &tpch_regions, p[2]);
+        return 3;
+    case 3:
+        param_string(rng, &tpch_segments, p[0]);
+        sprintf(p[1], "1995-03-%02d", (int) tpch_rng_uniform(rng, 1, 31));
+        return 2;
+    case 4:
+        param_month(rng, 0, 57, p[0]);
+        return 1;
+    case 5:
+        param_string(rng, &tpch_regions, p[0]);
+        param_year(rng, p[1]);
+        return 2;
+    case 6:
+        param_year(rng, p[0]);
+        sprintf(p[1], "0.0%d", (int) tpch_rng_uniform(rng, 2, 9));
+        sprintf(p[2], "%d", (int) tpch_rng_uniform(rng, 24, 25));
+        return 3;
+    case 7:
+        param_nation(rng, p[0]);
+        do {
+            param_nation(rng, p[1]);
+        } while (!strcmp(p[0], p[1]));
+        return 2;
+    case 8:
+        nationkey = (unsigned int) tpch_rng_uniform(rng, 0, TPCH_NATIONS - 1);
+        strcpy(p[0], tpch_nation_name(nationkey));
+        strcpy(p[1], tpch_regions.values[tpch_nation_region(nationkey)]);
+        param_words(rng, tpch_types, 3, p[2]);
+        return 3;
+    case 9:
+        param_string(rng, &tpch_colors, p[0]);
+        return 1;
+    case 10:
+        param_month(rng, 1, 24, p[0]);
+        return 1;
+    case 11:
+        param_nation(rng, p[0]);
+        param_fraction(p[1]);
+        return 2;
+    case 12:
+        param_string(rng, &tpch_modes, p[0]);
+        do {
+            param_string(rng, &tpch_modes, p[1]);
+        } while (!strcmp(p[0], p[1]));
+        param_year(rng, p[2]);
+        return 3;
+    case 13:
+        param_string(rng, &q13_lists[0], p[0]);
+        param_string(rng, &q13_lists[1], p[1]);
+        return 2;
+    case 14:
+        param_month(rng, 0, 59, p[0]);
+        return 1;
+    case 15:
+        param_month(rng, 0, 57, p[0]);
+        return 1;
+    case 16:
+        param_brand(rng, p[0]);
+        param_words(rng, tpch_types, 2, p[1]);
+        param_distinct(rng, 1, 50, 8, p + 2);
+        return 10;
+    case 17:
+        param_brand(rng, p[0]);
+        param_words(rng, tpch_containers, 2, p[1]);
+        return 2;
+    case 18:
+        sprintf(p[0], "%d", (int) tpch_rng_uniform(rng, 312, 315));
+        return 1;
+    case 19:
+        sprintf(p[0], "%d", (int) tpch_rng_uniform(rng, 1, 10));
+        sprintf(p[1], "%d", (int) tpch_rng_uniform(rng, 10, 20));
+        sprintf(p[2], "%d", (int) tpch_rng_uniform(rng, 20, 30));
+        param_brand(rng, p[3]);
+        param_brand(rng, p[4]);
+        param_brand(rng, p[5]);
+        return 6;
+    case 20:
+        param_string(rng, &tpch_colors, p[0]);
+        param_year(rng, p[1]);
+        param_nation(rng, p[2]);
+        return 3;
+    case 21:
+        param_nation(rng, p[0]);
+        return 1;
+    case 22:
+        /* Country codes are nation keys + 10 */
+        param_distinct(rng, 10, 10 + TPCH_NATIONS - 1, 7, p);
+        return 7;
+    }
+
+    return 0;
+}
+
+static unsigned int get_validation_params(unsigned int query, tpch_param_t *p)
+{
+    const char * const *values = validation_params[query - 1];
+    unsigned int n = 0;
+
+    while (n < TPCH_MAX_PARAMS && values[n] != NULL) {
+        strcpy(p[n], values[n]);
+        n++;
+    }
+
+    if (query == 11)
+        param_fraction(p[1]);
+
+    return n;
+}
+
+char *tpch_qgen_query(const char *tmpl, unsigned int query,
+                      unsigned int stream)
+{
+    tpch_param_t params[TPCH_MAX_PARAMS];
+    tpch_rng_t rng;
+    unsigned int nparams;
+    size_t len = 0;
+    char *buf;
+    char *out;
+
+    if (qgen.validate) {
+        nparams = get_validation_params(query, params);
+    } else {
+        tpch_rng_seed(&rng, TPCH_QGEN_PARAMS,
+                      qgen.seed ^ ((uint64_t) stream << 8 | query));
+        nparams = gen_params(&rng, query, params);
+    }
+
+    /* Two passes: calculate the length first, then substitute */
+    for (int pass = 0; pass < 2; pass++) {
+        out = buf = pass ? malloc(len + 1) : NULL;
+        if (pass && buf == NULL)
+            return NULL;
+
+        len = 0;
+        for (const char *p = tmpl; *p != '\0'; p++) {
+            char *end;
+            unsigned long n;
+
+            if (*p == ':' && isdigit((unsigned char) p[1]) &&
+                (n = strtoul(p + 1, &end, 10)) >= 1 && n <= nparams) {
+                const size_t plen = strlen(params[n - 1]);
+
+                if (pass)
+                    memcpy(out + len, params[n - 1], plen);
+                len += plen;
+                p = end - 1;
+                continue;
+            }
+
+            if (pass)
+                out[len] = *p;
+            len++;
+        }
+    }
+
+    buf[len] = '\0';
+
+    return buf;
+}
@@ -0,0 +1,51 @@
+/* Copyright (C) 2026 sysbench contributors
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+/*
+  TPC-H query generator. Query templates use ':N' placeholders for the N-th
+  substitution parameter of a query, like the templates of the reference qgen.
+*/
+
+#ifndef TPCH_QGEN_H
+#define TPCH_QGEN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TPCH_QUERIES 22
+
+/*
+  Initialize the generator for a given scale factor. Substitution parameters
+  and query orders of all streams are derived from the seed. With 'validate',
+  all streams use the query validation parameters instead.
+*/
+void tpch_qgen_init(double scale, uint64_t seed, bool validate);
+
+/*
+  Get query numbers (1-based) in the execution order of a stream. Stream 0 is
+  the power test.
+*/
+void tpch_qgen_order(unsigned int stream, unsigned int order[TPCH_QUERIES]);
+
+/*
+  Substitute parameters of a query for a stream into a template. Returns a
+  malloc'ed query text, or NULL on errors.
+*/
+char *tpch_qgen_query(const char *tmpl, unsigned int query,
+                      unsigned int stream);
+
+#endif /* TPCH_QGEN_H */
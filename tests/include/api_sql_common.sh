@@ -261,3 +261,43 @@ end
 EOF
 
 sysbench $SB_ARGS
+
+cat <<EOF
+########################################################################
+# Connection pool
+########################################################################
+EOF
+cat >$CRAMTMP/api_sql.lua <<EOF
+drv = sysbench.sql.driver()
+c1 = drv:checkout()
+c2 = drv:checkout()
+print(c1 == c2)
+c1:checkin()
+c3 = drv:checkout()
+print(c3 == c1)
+print(c3:query_row("SELECT 1"))
+c2:checkin()
+c3:checkin()
+EOF
+
+sysbench $SB_ARGS --db-pool-size=2
+
+# Pool statistics can be printed by custom report hooks
+cat >$CRAMTMP/api_sql.lua <<EOF
+function thread_init()
+  drv = sysbench.sql.driver()
+end
+
+function event()
+  local c = drv:checkout()
+  c:query("SELECT 1")
+  c:checkin()
+end
+
+function sysbench.hooks.report_cumulative(stat)
+  sysbench.sql.report_pool(stat, true)
+end
+EOF
+
+sysbench $SB_ARGS --verbosity=3 --events=10 --db-pool-size=2 run |
+  grep -A2 "connection pool:"
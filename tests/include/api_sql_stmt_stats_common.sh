@@ -0,0 +1,83 @@
+########################################################################
+# Common code for per-statement statistics tests (--db-stmt-stats)
+#
+# Expects the following variables and callback functions to be defined by the
+# caller:
+#
+#   DB_DRIVER_ARGS -- extra driver-specific arguments to pass to sysbench
+#
+########################################################################
+
+set -eu
+
+SB_ARGS="--verbosity=3 --events=2 --threads=1 $DB_DRIVER_ARGS $CRAMTMP/api_sql_stmt_stats.lua"
+
+cat >$CRAMTMP/api_sql_stmt_stats.lua <<EOF
+function cmd_prepare()
+  local c = sysbench.sql.driver():connect()
+  for i = 1, 3 do
+    c:query("CREATE TABLE t" .. i .. "(a INT)")
+  end
+end
+
+function cmd_cleanup()
+  local c = sysbench.sql.driver():connect()
+  for i = 1, 3 do
+    c:query("DROP TABLE t" .. i)
+  end
+end
+
+sysbench.cmdline.commands = {
+  prepare = {cmd_prepare},
+  cleanup = {cmd_cleanup}
+}
+
+-- Statements executed by the main thread are accounted too
+function init()
+  local c = sysbench.sql.driver():connect()
+  c:query("SELECT a FROM t1 WHERE a = 0")
+  c:disconnect()
+end
+
+function thread_init()
+  c = sysbench.sql.driver():connect()
+  stmt = c:prepare("SELECT COUNT(*) FROM t1 WHERE a = ?")
+  p = stmt:bind_create(sysbench.sql.type.INT)
+  stmt:bind_param(p)
+end
+
+function event()
+  for i = 1, 3 do
+    p:set(i)
+    stmt:execute()
+    c:query("SELECT a FROM t" .. i .. " WHERE a = " .. i)
+  end
+  pcall(c.query, c, "SELECT a FROM nonexisting WHERE a = 'x'")
+end
+EOF
+
+# Print fingerprints with their counts and errors from the cumulative report
+# in a stable order
+stmt_stats() {
+  sysbench $SB_ARGS "$@" run | awk '
+    /per-statement statistics/ { s = 1; next }
+    s && /^$/ { exit }
+    s && /count:/ {
+      sub(/^ *count/, "count"); sub(/ \(.*, errors/, ", errors");
+      sub(/, avg.*/, ""); print fp ": " $0; next
+    }
+    s { sub(/^ */, ""); fp = $0 }' | LC_ALL=C sort
+}
+
+sysbench $SB_ARGS --verbosity=1 prepare
+
+echo "# --db-stmt-stats=prepared"
+stmt_stats --db-stmt-stats=prepared
+
+echo "# --db-stmt-stats=all"
+stmt_stats --db-stmt-stats=all
+
+echo "# --db-stmt-stats=all --db-ps-mode=disable"
+stmt_stats --db-stmt-stats=all --db-ps-mode=disable
+
+sysbench $SB_ARGS --verbosity=1 cleanup
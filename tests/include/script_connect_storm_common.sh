@@ -0,0 +1,25 @@
+#!/usr/bin/env bash
+#
+################################################################################
+# Common code for connect_storm* tests
+#
+# Expects the following variables and callback functions to be defined by the
+# caller:
+#
+#   DB_DRIVER_ARGS -- extra driver-specific arguments to pass to sysbench
+################################################################################
+
+set -eu
+
+ARGS="${SBTEST_SCRIPTDIR}/connect_storm.lua $DB_DRIVER_ARGS --threads=2 --verbosity=3"
+
+# Print the number of samples for each connection phase, followed by failed
+# connection attempts and reconnects. Callers disable TLS, so no TLS handshake
+# phase is expected.
+sysbench $ARGS --events=10 --db-connect-stats run |
+  sed -n '/connection latency (ms):/,/^$/p' |
+  sed -n -e 's/^ *\(.*[^ ]\) *count: \([0-9]*\),.*/\1: \2/p' \
+    -e 's/^ *\(failed attempts\|reconnects\): *\([0-9]*\)$/\1: \2/p'
+
+sysbench $ARGS --events=10 --query= --hold_time=10 --db-connect-stats run |
+  sed -n 's/^ *\(first query\) *count: \([0-9]*\),.*/\1: \2/p'
@@ -0,0 +1,42 @@
+########################################################################
+# Common code for TPC-H tests
+#
+# Expects the following variables and callback functions to be defined by the
+# caller:
+#
+#   DB_DRIVER_ARGS -- extra driver-specific arguments to pass to sysbench
+#
+########################################################################
+
+set -eu
+
+ARGS="tpch $DB_DRIVER_ARGS --data-size=0.01 --root-path=$SBTEST_ROOTDIR/.."
+
+# Print validation results of a run, saving answers to a given file
+run_validate() {
+  sysbench $ARGS --threads=2 --time=0 --validate --save-answers="$1" run |
+    sed -n '/TPC-H validation:/,/^$/p'
+}
+
+# Data generated with a different number of prepare threads must be the same,
+# and so must be query answers
+sysbench $ARGS --threads=1 --verbosity=1 prepare
+run_validate $CRAMTMP/answers1
+
+sysbench $ARGS --threads=4 --verbosity=1 prepare
+run_validate $CRAMTMP/answers2
+
+head -2 $CRAMTMP/answers1
+grep -c '^Q' $CRAMTMP/answers1
+cmp $CRAMTMP/answers1 $CRAMTMP/answers2 && echo "answers match"
+
+cat >$CRAMTMP/tpch_cleanup.lua <<EOF
+function cleanup()
+  local c = sysbench.sql.driver():connect()
+  for _, t in ipairs({"lineitem", "orders", "customer", "partsupp",
+                      "supplier", "part", "nation", "region"}) do
+    c:query("DROP TABLE " .. t)
+  end
+end
+EOF
+sysbench $DB_DRIVER_ARGS --verbosity=1 $CRAMTMP/tpch_cleanup.lua cleanup
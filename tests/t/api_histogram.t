@@ -15,7 +15,8 @@ Tests for histogram API
   sysbench * (glob)
   
          value  ------------- distribution ------------- count
-         1.000 |**************************************** 2
-         2.001 |********************                     1
-         4.997 |********************                     1
-        10.000 |**************************************** 2
+         0.000 |********************                     1
+         1.000 |********************                     1
+         2.000 |********************                     1
+         5.003 |********************                     1
+        10.007 |**************************************** 2
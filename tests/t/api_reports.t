@@ -63,6 +63,7 @@ Tests for custom report hooks
   $ sysbench $SB_ARGS run
   [
     {
+      "queries": 0,
       "time":    2,
       "threads": 1,
       "tps": *.*, (glob)
@@ -73,10 +74,12 @@ Tests for custom report hooks
         "other": 0.00
       },
       "latency": [1-9][0-9]*\.[0-9]*, (re)
+      "percentiles": {"95": [1-9][0-9]*\.[0-9]*}, (re)
       "errors": 0.00,
       "reconnects": 0.00
     },
     {
+      "queries": 0,
       "time":    4,
       "threads": 1,
       "tps": *.*, (glob)
@@ -87,12 +90,14 @@ Tests for custom report hooks
         "other": 0.00
       },
       "latency": [1-9][0-9]*\.[0-9]*, (re)
+      "percentiles": {"95": [1-9][0-9]*\.[0-9]*}, (re)
       "errors": 0.00,
       "reconnects": 0.00
     }
   ]
   [
     {
+      "queries": 0,
       "time":    5,
       "threads": 0,
       "tps": *.*, (glob)
@@ -103,7 +108,58 @@ Tests for custom report hooks
         "other": 0.00
       },
       "latency": [1-9][0-9]*\.[0-9]*, (re)
+      "percentiles": {"95": [1-9][0-9]*\.[0-9]*}, (re)
       "errors": 0.00,
       "reconnects": 0.00
     }
   ]
+
+########################################################################
+# Multiple percentiles via custom hooks
+########################################################################
+
+  $ cat >api_reports.lua <<EOF
+  > ffi.cdef[[int usleep(unsigned int);]]
+  > 
+  > function event()
+  >   ffi.C.usleep(1000)
+  > end
+  > 
+  > function sysbench.hooks.report_intermediate(stat)
+  >   sysbench.report_default(stat)
+  >   sysbench.report_csv(stat)
+  > end
+  > EOF
+
+  $ sysbench $SB_ARGS --time=3 --percentiles=10,99 run
+  \[ 2s \] thds: 1 tps: [0-9]*\.[0-9]* qps: 0\.00 \(r\/w\/o: 0\.00\/0\.00\/0\.00\) lat \(ms,95%\/10%\/99%\): [1-9][0-9]*\.[0-9]*\/[1-9][0-9]*\.[0-9]*\/[1-9][0-9]*\.[0-9]* err\/s 0\.00 reconn\/s: 0\.00 (re)
+  2,1,[0-9]*\.[0-9]*,0\.00,0\.00,0\.00,0\.00,[1-9][0-9]*\.[0-9]*,[1-9][0-9]*\.[0-9]*,[1-9][0-9]*\.[0-9]*,0\.00,0\.00 (re)
+
+########################################################################
+# Rate mode statistics via custom hooks
+########################################################################
+
+  $ cat >api_reports.lua <<EOF
+  > function event()
+  > end
+  > 
+  > sysbench.hooks.report_intermediate = sysbench.report_default
+  > EOF
+
+  $ sysbench $SB_ARGS --time=3 --rate=100 run
+  \[ 2s \] thds: 1 tps: [0-9]*\.[0-9]* qps: 0\.00 \(r\/w\/o: 0\.00\/0\.00\/0\.00\) lat \(ms,95%\): [0-9]*\.[0-9]* err\/s 0\.00 reconn\/s: 0\.00 (re)
+  \[ 2s \] queue length: [0-9]* concurrency: [0-9]* (re)
+  \[ 2s \] target rate: 100\.00 backlog \(ms\): [0-9]*\.[0-9]* service lat \(ms,95%\): [0-9]*\.[0-9]* (re)
+
+  $ cat >api_reports.lua <<EOF
+  > function event()
+  > end
+  > 
+  > sysbench.hooks.report_intermediate = sysbench.report_json
+  > EOF
+
+  $ sysbench $SB_ARGS --time=3 --rate=100 run | grep -A3 percentiles
+      "percentiles": {"95": [0-9]*\.[0-9]*}, (re)
+      "target_rate": 100.00,
+      "backlog": [0-9]*\.[0-9]*, (re)
+      "service_latency": [0-9]*\.[0-9]*, (re)
@@ -129,3 +129,176 @@ SQL Lua API + MySQL tests
   ########################################################################
   1
   2
+  ########################################################################
+  # Connection pool
+  ########################################################################
+  false
+  true
+  1
+      connection pool:
+          checkouts:                       10     (*.* per sec.) (glob)
+          waits:                           0      (*.* per sec.) (glob)
+
+########################################################################
+# Result sets of server-side prepared statements
+########################################################################
+
+  $ cat >$CRAMTMP/api_sql.lua <<EOF
+  > c = sysbench.sql.driver():connect()
+  > c:query("CREATE TABLE t(a INT, b VARCHAR(2000))")
+  > c:query("INSERT INTO t VALUES (1, 'foo'), (2, NULL), (3, REPEAT('x', 1500))")
+  > stmt = c:prepare("SELECT a, b FROM t WHERE a >= ? ORDER BY a")
+  > p = stmt:bind_create(sysbench.sql.type.INT)
+  > stmt:bind_param(p)
+  > for _, v in ipairs({1, 2}) do
+  >   p:set(v)
+  >   rs = stmt:execute()
+  >   row = rs:fetch_row()
+  >   while row do
+  >     print(string.format("%s %s", row[1], tostring(row[2] and #row[2])))
+  >     row = rs:fetch_row()
+  >   end
+  > end
+  > c:query("DROP TABLE t")
+  > EOF
+
+  $ sysbench $SB_ARGS
+  1 3
+  2 nil
+  3 1500
+  2 nil
+  3 1500
+
+  $ sysbench $SB_ARGS --mysql-ps-stream
+  1 3
+  2 nil
+  3 1500
+  2 nil
+  3 1500
+
+########################################################################
+# Load balancing among endpoints with --mysql-balance-scope=transaction
+########################################################################
+
+The same server is listed twice to get two endpoints. An endpoint is picked
+when the connection is created, then each BEGIN picks an endpoint for the
+whole transaction.
+
+  $ SOCKET=$(echo "$SBTEST_MYSQL_ARGS" | sed -n 's/.*--mysql-socket=\([^ ]*\).*/\1/p')
+  $ HOST=$(echo "$SBTEST_MYSQL_ARGS" | sed -n 's/.*--mysql-host=\([^ ]*\).*/\1/p')
+  $ if [ -n "$SOCKET" ]; then
+  >   EP_ARGS="--mysql-socket=$SOCKET,$SOCKET"
+  > else
+  >   EP_ARGS="--mysql-host=${HOST:-localhost},${HOST:-localhost}"
+  > fi
+
+  $ cat >$CRAMTMP/api_sql.lua <<EOF
+  > -- information_schema.engines and information_schema.schemata map to
+  > -- different endpoints with --mysql-balance=affinity
+  > local tables = { "engines", "engines", "engines", "schemata" }
+  > local n = 0
+  > function thread_init()
+  >   c = sysbench.sql.driver():connect()
+  > end
+  > function event()
+  >   n = n + 1
+  >   c:query("BEGIN")
+  >   c:query("SELECT COUNT(*) FROM information_schema." .. tables[n])
+  >   c:query("COMMIT")
+  > end
+  > EOF
+
+  $ balance() {
+  >   sysbench --verbosity=3 --events=4 $DB_DRIVER_ARGS $EP_ARGS \
+  >     --mysql-balance-scope=transaction "$@" $CRAMTMP/api_sql.lua run |
+  >     sed -n '/per-endpoint statistics/,$p' |
+  >     sed -n 's/^ *\(queries:\|errors:\) *\([0-9]*\).*/\1 \2/p'
+  > }
+
+  $ balance --mysql-balance=round-robin
+  queries: 6
+  errors: 0
+  queries: 6
+  errors: 0
+
+Smooth weighted round-robin with weights 3,1 repeats the endpoint sequence
+1, 1, 2, 1. The first pick goes to the connection, the next four to
+transactions.
+
+  $ balance --mysql-balance=weighted --mysql-weights=3,1
+  queries: 9
+  errors: 0
+  queries: 3
+  errors: 0
+
+  $ balance --mysql-balance=affinity
+  queries: 9
+  errors: 0
+  queries: 3
+  errors: 0
+
+Asynchronous queries pick endpoints the same way. They are only supported with
+client libraries providing the non-blocking API, so fall back to synchronous
+queries otherwise. Per-endpoint statistics are printed by a custom report hook.
+
+  $ cat >$CRAMTMP/api_sql_async.lua <<EOF
+  > local c = sysbench.sql.driver():connect()
+  > if pcall(c.send_query, c, "SELECT 1") then
+  >   c:reap()
+  >   print("yes")
+  > end
+  > EOF
+  $ export SB_ASYNC=$(sysbench --verbosity=0 $DB_DRIVER_ARGS $CRAMTMP/api_sql_async.lua)
+
+  $ cat >$CRAMTMP/api_sql.lua <<EOF
+  > local tables = { "engines", "engines", "engines", "schemata" }
+  > local n = 0
+  > local async = os.getenv("SB_ASYNC") == "yes"
+  > function thread_init()
+  >   c = sysbench.sql.driver():connect()
+  > end
+  > function event()
+  >   n = n + 1
+  >   for _, q in ipairs({ "START TRANSACTION",
+  >                        "SELECT COUNT(*) FROM information_schema." .. tables[n],
+  >                        "COMMIT" }) do
+  >     if async then
+  >       c:send_query(q)
+  >       c:reap()
+  >     else
+  >       c:query(q)
+  >     end
+  >   end
+  > end
+  > function sysbench.hooks.report_cumulative(stat)
+  >   sysbench.sql.report_drivers(stat, true)
+  > end
+  > EOF
+
+  $ balance --mysql-balance=round-robin
+  queries: 6
+  errors: 0
+  queries: 6
+  errors: 0
+
+  $ balance --mysql-balance=affinity
+  queries: 9
+  errors: 0
+  queries: 3
+  errors: 0
+
+########################################################################
+# Per-statement statistics
+########################################################################
+
+  $ . ${SBTEST_INCDIR}/api_sql_stmt_stats_common.sh
+  # --db-stmt-stats=prepared
+  SELECT COUNT(*) FROM t? WHERE a = ?: count: 6, errors: 0
+  # --db-stmt-stats=all
+  SELECT COUNT(*) FROM t? WHERE a = ?: count: 6, errors: 0
+  SELECT a FROM nonexisting WHERE a = ?: count: 2, errors: 2
+  SELECT a FROM t? WHERE a = ?: count: 7, errors: 0
+  # --db-stmt-stats=all --db-ps-mode=disable
+  SELECT COUNT(*) FROM t? WHERE a = ?: count: 6, errors: 0
+  SELECT a FROM nonexisting WHERE a = ?: count: 2, errors: 2
+  SELECT a FROM t? WHERE a = ?: count: 7, errors: 0
@@ -134,3 +134,149 @@ SQL Lua API + PostgreSQL tests
   ########################################################################
   1
   2
+  ########################################################################
+  # Connection pool
+  ########################################################################
+  false
+  true
+  1
+      connection pool:
+          checkouts:                       10     (*.* per sec.) (glob)
+          waits:                           0      (*.* per sec.) (glob)
+
+########################################################################
+# Asynchronous statements
+########################################################################
+
+  $ cat >$CRAMTMP/api_sql.lua <<EOF
+  > drv = sysbench.sql.driver()
+  > c1 = drv:connect()
+  > c2 = drv:connect()
+  > c1:query("CREATE TABLE t(a INT)")
+  > c1:send_query("INSERT INTO t VALUES (1)")
+  > c1:send_query("SELECT count(*) FROM t")
+  > print(c1:pending())
+  > print(c1:reap())
+  > print(c1:reap():fetch_row()[1])
+  > print(c1:pending())
+  > c2:send_query("SELECT pg_sleep(1)")
+  > c1:send_query("SELECT 1")
+  > ready = sysbench.sql.poll({c1, c2})
+  > print(#ready .. " " .. tostring(ready[1] == c1))
+  > print(#sysbench.sql.poll({c2}, 0))
+  > c1:reap()
+  > c2:reap()
+  > c1:send_query("SELECT 1")
+  > print((pcall(c1.query, c1, "SELECT 2")))
+  > c1:reap()
+  > print((pcall(c1.reap, c1)))
+  > stmt = c1:prepare("INSERT INTO t VALUES (?)")
+  > param = stmt:bind_create(sysbench.sql.type.INT)
+  > stmt:bind_param(param)
+  > param:set(2)
+  > stmt:send_execute()
+  > param:set(3)
+  > stmt:send_execute()
+  > c1:reap()
+  > c1:reap()
+  > print(c1:query_row("SELECT sum(a) FROM t"))
+  > c1:query("DROP TABLE t")
+  > EOF
+
+  $ sysbench $SB_ARGS
+  2
+  nil
+  1
+  0
+  1 true
+  0
+  ALERT: attempt to execute a statement on a connection with pending asynchronous results
+  false
+  ALERT: attempt to reap results with no pending asynchronous statements
+  false
+  6
+
+########################################################################
+# --pgsql-pipeline
+########################################################################
+
+  $ cat >$CRAMTMP/api_sql.lua <<EOF
+  > c = sysbench.sql.driver():connect()
+  > c:query("CREATE TABLE t(a INT PRIMARY KEY)")
+  > b = c:prepare("BEGIN")
+  > i = c:prepare("INSERT INTO t VALUES (?)")
+  > cm = c:prepare("COMMIT")
+  > p = i:bind_create(sysbench.sql.type.INT)
+  > i:bind_param(p)
+  > b:execute()
+  > for v = 1, 3 do p:set(v); print(i:execute()) end
+  > print(cm:execute())
+  > print(c:query_row("SELECT count(*) FROM t"))
+  > b:execute()
+  > p:set(1)
+  > i:execute()
+  > p:set(4)
+  > i:execute()
+  > ok, e = pcall(cm.execute, cm)
+  > print(ok, e.sql_state)
+  > print(c:query_row("SELECT count(*) FROM t"))
+  > c:query("DROP TABLE t")
+  > EOF
+
+  $ sysbench $SB_ARGS --pgsql-pipeline
+  nil
+  nil
+  nil
+  nil
+  3
+  false\t23505 (esc)
+  3
+
+########################################################################
+# Binary parameters
+########################################################################
+
+  $ cat >$CRAMTMP/api_sql.lua <<EOF
+  > c = sysbench.sql.driver():connect()
+  > c:query("CREATE TABLE t(a SMALLINT, b INT, c BIGINT, d REAL, e DOUBLE PRECISION, f VARCHAR(10))")
+  > stmt = c:prepare("INSERT INTO t VALUES (?, ?, ?, ?, ?, ?)")
+  > t = sysbench.sql.type
+  > p = { stmt:bind_create(t.SMALLINT), stmt:bind_create(t.INT),
+  >       stmt:bind_create(t.BIGINT), stmt:bind_create(t.FLOAT),
+  >       stmt:bind_create(t.DOUBLE), stmt:bind_create(t.VARCHAR, 10) }
+  > stmt:bind_param(unpack(p))
+  > p[1]:set(-2)
+  > p[2]:set(-70000)
+  > p[3]:set(-5000000000)
+  > p[4]:set(0.5)
+  > p[5]:set(-1.25)
+  > p[6]:set("foo")
+  > stmt:execute()
+  > p[2]:set(nil)
+  > p[6]:set("bar")
+  > stmt:execute()
+  > rs = c:query("SELECT * FROM t WHERE b IS NOT NULL")
+  > print(table.concat(rs:fetch_row(), " ", 1, 6))
+  > print(c:query_row("SELECT f FROM t WHERE b IS NULL"))
+  > c:query("DROP TABLE t")
+  > EOF
+
+  $ sysbench $SB_ARGS
+  -2 -70000 -5000000000 0.5 -1.25 foo
+  bar
+
+########################################################################
+# Per-statement statistics
+########################################################################
+
+  $ . ${SBTEST_INCDIR}/api_sql_stmt_stats_common.sh
+  # --db-stmt-stats=prepared
+  SELECT COUNT(*) FROM t? WHERE a = ?: count: 6, errors: 0
+  # --db-stmt-stats=all
+  SELECT COUNT(*) FROM t? WHERE a = ?: count: 6, errors: 0
+  SELECT a FROM nonexisting WHERE a = ?: count: 2, errors: 2
+  SELECT a FROM t? WHERE a = ?: count: 7, errors: 0
+  # --db-stmt-stats=all --db-ps-mode=disable
+  SELECT COUNT(*) FROM t? WHERE a = ?: count: 6, errors: 0
+  SELECT a FROM nonexisting WHERE a = ?: count: 2, errors: 2
+  SELECT a FROM t? WHERE a = ?: count: 7, errors: 0
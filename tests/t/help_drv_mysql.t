@@ -13,6 +13,9 @@ Skip test if the MySQL driver is not available.
     --mysql-host=[LIST,...]          MySQL server host [localhost]
     --mysql-port=[LIST,...]          MySQL server port [3306]
     --mysql-socket=[LIST,...]        MySQL socket
+    --mysql-balance=STRING           strategy to distribute load among multiple endpoints specified with --mysql-host/--mysql-port or --mysql-socket: round-robin, random, least-outstanding (fewest queries in flight), weighted (see --mysql-weights) or affinity (by the table name of the first statement in a transaction, or by thread with --mysql-balance-scope=connection) [round-robin]
+    --mysql-balance-scope=STRING     pick an endpoint for each 'connection', or for each 'transaction' started with BEGIN or START TRANSACTION. In the latter case each connection keeps a session to every endpoint it uses, and server-side prepared statements are not used [connection]
+    --mysql-weights=[LIST,...]       list of endpoint weights for --mysql-balance=weighted, in the order endpoints are listed with --mysql-host/--mysql-port or --mysql-socket
     --mysql-user=STRING              MySQL user [sbtest]
     --mysql-password=STRING          MySQL password []
     --mysql-db=STRING                MySQL database name [sbtest]
@@ -25,4 +28,5 @@ Skip test if the MySQL driver is not available.
     --mysql-debug[=on|off]           trace all client library calls [off]
     --mysql-ignore-errors=[LIST,...] list of errors to ignore, or "all" [1213,1020,1205]
     --mysql-dry-run[=on|off]         Dry run, pretend that all MySQL client API calls are successful without executing them [off]
+    --mysql-ps-stream[=on|off]       Fetch rows of prepared statement results from the server one by one rather than buffering entire result sets on the client [off]
   
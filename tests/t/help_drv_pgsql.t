@@ -7,9 +7,10 @@ Skip test if the PostgreSQL driver is not available.
 
   $ sysbench --help | sed -n '/pgsql options:/,/^$/p'
   pgsql options:
-    --pgsql-host=STRING     PostgreSQL server host [localhost]
-    --pgsql-port=N          PostgreSQL server port [5432]
-    --pgsql-user=STRING     PostgreSQL user [sbtest]
-    --pgsql-password=STRING PostgreSQL password []
-    --pgsql-db=STRING       PostgreSQL database name [sbtest]
+    --pgsql-host=STRING       PostgreSQL server host [localhost]
+    --pgsql-port=N            PostgreSQL server port [5432]
+    --pgsql-user=STRING       PostgreSQL user [sbtest]
+    --pgsql-password=STRING   PostgreSQL password []
+    --pgsql-db=STRING         PostgreSQL database name [sbtest]
+    --pgsql-pipeline[=on|off] Send prepared statements in pipeline mode and reap their results at COMMIT or ROLLBACK. Result sets of pipelined statements are not available to scripts [off]
   
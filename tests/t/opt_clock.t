@@ -0,0 +1,12 @@
+########################################################################
+Tests for the --clock option
+########################################################################
+
+  $ sysbench --clock=foo cpu run --verbosity=1
+  FATAL: Invalid value for --clock: 'foo'
+  [1]
+
+# The TSC clock (or the monotonic clock as a fallback) must produce sane
+# timings
+  $ sysbench --clock=tsc --time=1 cpu run | grep -E '^    time elapsed:'
+      time elapsed:                        1.0*s (glob)
@@ -20,6 +20,13 @@ separately.
     --thread-stack-size=SIZE        size of stack per thread [64K]
     --thread-init-timeout=N         wait time in seconds for worker threads to initialize [30]
     --rate=N                        average transactions rate. 0 for unlimited rate [0]
+    --rate-profile=STRING           time-varying target rate to use instead of a constant --rate: 'ramp:FROM:TO:SECONDS' for a linear ramp, 'step:RATE:SECONDS[,RATE:SECONDS...]' for a table of steps, 'sine:MEAN:AMPLITUDE:PERIOD' for a sinusoid, or 'csv:FILE' for per-second target rates read from a file
+    --rate-overload=STRING          action to take when worker threads are unable to keep up with the --rate event generation rate: 'abort' the run, or 'wait' for free space in the event queue. In the latter case events keep their intended start times, so any delays are accounted in latency statistics [abort]
+    --rate-scheduler=STRING         event scheduling method for the --rate mode: 'queue' uses a single event generation thread and a shared event queue, 'thread' makes each worker thread follow its own arrival schedule with the average rate of --rate/--threads, which scales to much higher rates. Events are never queued with 'thread', so worker threads that cannot keep up fall behind their schedules and delays are accounted in latency statistics [queue]
+    --thread-rate=N                 per-thread event rate for closed-loop pacing: each worker thread waits as necessary to start events at this average rate. 0 disables per-thread pacing [0]
+    --think-time=N                  time in milliseconds each worker thread waits after an event is completed before starting the next one [0]
+    --pacing-distribution=STRING    distribution of intervals for --thread-rate and --think-time: fixed, exponential or uniform [fixed]
+    --clock=STRING                  clock source for event timing: 'monotonic' uses clock_gettime(CLOCK_MONOTONIC), 'tsc' uses the CPU time stamp counter calibrated at startup, which is cheaper to read. 'tsc' falls back to 'monotonic' if the CPU does not provide an invariant TSC [monotonic]
     --report-interval=N             periodically report intermediate statistics with a specified interval in seconds. 0 disables intermediate reports [0]
     --report-checkpoints=[LIST,...] dump full statistics and reset all counters at specified points in time. The argument is a list of comma-separated values representing the amount of time in seconds elapsed from start of test when report checkpoint(s) must be performed. Report checkpoints are off by default. []
     --debug[=on|off]                print more debugging info [off]
@@ -41,14 +48,20 @@ separately.
   Log options:
     --verbosity=N verbosity level {5 - debug, 0 - only critical messages} [3]
   
-    --percentile=N       percentile to calculate in latency statistics (1-100). Use the special value of 0 to disable percentile calculations [95]
-    --histogram[=on|off] print latency histogram in report [off]
+    --percentile=N           percentile to calculate in latency statistics (1-100). Use the special value of 0 to disable percentile calculations [95]
+    --percentiles=[LIST,...] comma-separated list of additional percentile ranks to calculate in latency statistics, e.g. 50,99,99.9 []
+    --histogram[=on|off]     print latency histogram in report [off]
+    --histogram-precision=N  number of significant decimal digits to maintain in latency statistics (1-5) [3]
   
   General database options:
   
-    --db-driver=STRING  specifies database driver to use \('help' to get list of available drivers\)( \[mysql\])? (re)
-    --db-ps-mode=STRING prepared statements usage mode {auto, disable} [auto]
-    --db-debug[=on|off] print database-specific debug information [off]
+    --db-driver=STRING          specifies database driver to use \('help' to get list of available drivers\)( \[mysql\])? (re)
+    --db-ps-mode=STRING         prepared statements usage mode {auto, disable} [auto]
+    --db-debug[=on|off]         print database-specific debug information [off]
+    --db-pool-size=N            number of connections in the pool shared by all threads. 0 disables pooling, i.e. each checkout creates a new connection [0]
+    --db-pool-check-idle=N      check pooled connections idle for at least this many milliseconds with a trivial query before checkout (0 to disable) [0]
+    --db-connect-stats[=on|off] report latencies of connection phases and first queries on new connections [off]
+    --db-stmt-stats=STRING      collect per-statement latency statistics {off, prepared, all}. 'prepared' tracks prepared statements, 'all' also tracks non-prepared queries by their fingerprints, i.e. with literals replaced by '?' [off]
   
   
     fileio - File I/O test
@@ -0,0 +1,23 @@
+########################################################################
+--percentiles tests
+########################################################################
+
+  $ sysbench --percentiles=0 cpu run
+  FATAL: Invalid value for --percentiles: '0'
+  [1]
+  $ sysbench --percentiles=50,foo cpu run
+  FATAL: Invalid value for --percentiles: 'foo'
+  [1]
+  $ sysbench --percentiles=50 --percentile=0 cpu run
+  FATAL: --percentiles cannot be used with --percentile=0
+  [1]
+
+  $ sysbench --percentiles=50,95,99.9 --events=10 --time=0 cpu run |
+  >   grep -E 'percentile'
+           95th percentile: *.* (glob)
+           50th percentile: *.* (glob)
+          99.9th percentile: *.* (glob)
+
+  $ sysbench --percentiles=50,99 --events=0 --time=2 --report-interval=1 \
+  >   cpu run | grep '^\[ 1s \]'
+  [ 1s ] thds: 1 eps: *.* lat (ms,95%/50%/99%): *.*/*.*/*.* (glob)
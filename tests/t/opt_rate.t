@@ -6,3 +6,69 @@ Tests for the --rate option (aka the limited rate mode)
   $ sysbench --rate=2000000000 cpu run --verbosity=1
   FATAL: The event queue is full. This means the worker threads are unable to keep up with the specified event generation rate
   [1]
+
+  $ sysbench --rate=100 --rate-overload=foo cpu run --verbosity=1
+  FATAL: Invalid value for --rate-overload: 'foo'
+  [1]
+
+# With --rate-overload=wait the run must continue and report both latency from
+# intended start times and service time
+  $ sysbench --rate=2000000000 --rate-overload=wait --time=1 cpu run |
+  >   grep -A1 -E '^(Latency|Service time)'
+  Latency (ms):
+           min: *.* (glob)
+  --
+  Service time (ms):
+           95th percentile: *.* (glob)
+
+  $ sysbench --rate=100 --rate-scheduler=foo cpu run --verbosity=1
+  FATAL: Invalid value for --rate-scheduler: 'foo'
+  [1]
+
+# Per-thread arrival schedules
+  $ sysbench --rate=100 --rate-scheduler=thread --threads=2 --time=1 cpu run |
+  >   grep -E '^(Target|Service time)'
+  Target transaction rate: 100/sec
+  Service time (ms):
+
+########################################################################
+# --rate-profile
+########################################################################
+
+  $ sysbench --rate-profile=foo cpu run --verbosity=1
+  FATAL: Invalid value for --rate-profile: 'foo'
+  [1]
+  $ sysbench --rate-profile=ramp:1:2 cpu run --verbosity=1
+  FATAL: Invalid value for --rate-profile: 'ramp:1:2'
+  [1]
+  $ sysbench --rate-profile=step:100:1,200 cpu run --verbosity=1
+  FATAL: Invalid value for --rate-profile: 'step:100:1,200'
+  [1]
+  $ sysbench --rate=10 --rate-profile=sine:100:50:10 cpu run --verbosity=1
+  FATAL: --rate and --rate-profile cannot be used together
+  [1]
+
+  $ sysbench --rate-profile=step:1000:1,200:1 --time=2 --report-interval=1 \
+  >   cpu run | grep -E '^(\[ 1s \]|Target)'
+  Target transaction rate profile: step:1000:1,200:1
+  [ 1s ] thds: 1 eps: *.* lat (ms,95%): *.* (glob)
+  [ 1s ] queue length: * concurrency: * (glob)
+  [ 1s ] target rate: 1000.00 backlog (ms): *.* service lat (ms,95%): *.* (glob)
+
+# Arrivals follow a step out of a low rate right away, even when the low rate
+# is split between many per-thread schedules
+  $ sysbench --rate-profile=step:10:1,2000:1 --rate-scheduler=thread \
+  >   --threads=16 --time=2 --report-interval=1 cpu --cpu-max-prime=100 run |
+  >   awk '/^\[ 2s \] target rate/ { print "target rate:", $6 }
+  >        /^\[ 2s \] thds/ { print "achieved rate:", ($7 >= 1600 ? "ok" : $7) }'
+  achieved rate: ok
+  target rate: 2000.00
+
+  $ cat > $CRAMTMP/rates.csv <<EOF
+  > # time,rate
+  > 0,500
+  > 1,100
+  > EOF
+  $ sysbench --rate-profile=csv:$CRAMTMP/rates.csv --time=2 \
+  >   --report-interval=1 --rate-scheduler=thread cpu run | grep '^\[ 1s \] target rate'
+  [ 1s ] target rate: 500.00 backlog (ms): *.* service lat (ms,95%): *.* (glob)
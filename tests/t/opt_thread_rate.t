@@ -0,0 +1,30 @@
+########################################################################
+Tests for per-thread pacing (--thread-rate and --think-time)
+########################################################################
+
+  $ sysbench --thread-rate=10 --rate=10 cpu run --verbosity=1
+  FATAL: --thread-rate and --think-time cannot be used together with --rate or --rate-profile
+  [1]
+
+  $ sysbench --think-time=-1 cpu run --verbosity=1
+  FATAL: --thread-rate and --think-time cannot be negative
+  [1]
+
+  $ sysbench --thread-rate=10 --pacing-distribution=foo cpu run --verbosity=1
+  FATAL: Invalid value for --pacing-distribution: 'foo'
+  [1]
+
+# Each thread must start events at the requested rate
+  $ sysbench --thread-rate=20 --threads=2 --time=1 cpu run |
+  >   grep -E '^(Per-thread|    total number of events)'
+  Per-thread pacing: rate: 20/sec, think time: 0ms, distribution: fixed
+      total number of events:              4[0-2] (re)
+
+# Think time is added after each event
+  $ sysbench --think-time=100 --pacing-distribution=uniform --time=1 cpu run |
+  >   grep -E '^Per-thread'
+  Per-thread pacing: rate: 0/sec, think time: 100ms, distribution: uniform
+
+  $ sysbench --thread-rate=50 --think-time=10 --pacing-distribution=exponential \
+  >   --events=10 --time=0 cpu run | grep -E '^    total number of events'
+      total number of events:              10
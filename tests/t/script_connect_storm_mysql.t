@@ -0,0 +1,21 @@
+########################################################################
+connect_storm.lua + MySQL tests
+########################################################################
+
+  $ . $SBTEST_INCDIR/mysql_common.sh
+
+Connect and authentication phases are only reported by client libraries with
+the non-blocking API
+
+  $ . $SBTEST_INCDIR/script_connect_storm_common.sh |
+  >   grep -v '^\(connect\|authentication\): 10$'
+  total: 10
+  first query: 10
+  failed attempts: 0
+  reconnects: 0
+
+Failed connection attempts are counted without aborting the benchmark
+
+  $ sysbench $ARGS --events=10 --mysql-db=sbtest_nonexisting --db-connect-stats \
+  >   run 2>&1 | sed -n 's/^ *\(failed attempts\): *\([0-9]*\)$/\1: \2/p'
+  failed attempts: 10
@@ -0,0 +1,19 @@
+########################################################################
+connect_storm.lua + PostgreSQL tests
+########################################################################
+
+  $ . $SBTEST_INCDIR/pgsql_common.sh
+  $ export PGSSLMODE=disable
+  $ . $SBTEST_INCDIR/script_connect_storm_common.sh
+  connect: 10
+  authentication: 10
+  total: 10
+  first query: 10
+  failed attempts: 0
+  reconnects: 0
+
+Failed connection attempts are counted without aborting the benchmark
+
+  $ sysbench $ARGS --events=10 --pgsql-db=sbtest_nonexisting --db-connect-stats \
+  >   run 2>&1 | sed -n 's/^ *\(failed attempts\): *\([0-9]*\)$/\1: \2/p'
+  failed attempts: 10
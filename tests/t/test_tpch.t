@@ -0,0 +1,24 @@
+########################################################################
+tpch benchmark tests
+########################################################################
+
+Database-specific tests are in test_tpch_mysql.t and test_tpch_pgsql.t
+
+  $ sysbench tpch help
+  sysbench *.* * (glob)
+  
+  tpch options:
+    --data-size=N          Size of the data to generate in GB, i.e. the TPC-H scale factor [1]
+    --root-path=STRING     Absolute path to sysbench's root []
+    --report-json[=on|off] Print the results in JSON format [off]
+    --power-test[=on|off]  Run the power test (a single query stream) before the throughput test with one query stream per thread [on]
+    --refresh[=on|off]     Run the refresh functions (RF1 and RF2) in the power test and in a refresh stream concurrent with the query streams of the throughput test. The refresh stream uses the last thread [off]
+    --answers=STRING       File with answers to compare query results with when --validate is on. Without it, results are compared with the first stream that has executed each query []
+    --save-answers=STRING  Save query answers to a file when --validate is on []
+  
+
+  $ sysbench tpch --save-answers=$CRAMTMP/answers run
+  sysbench *.* * (glob)
+  
+  FATAL: --answers and --save-answers require --validate
+  [1]
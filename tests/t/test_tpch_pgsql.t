@@ -0,0 +1,18 @@
+########################################################################
+tpch + PostgreSQL tests
+########################################################################
+
+  $ . $SBTEST_INCDIR/pgsql_common.sh
+  $ . $SBTEST_INCDIR/test_tpch_common.sh
+  TPC-H validation:
+      answers checked:                     66
+      mismatches:                          0
+  
+  TPC-H validation:
+      answers checked:                     66
+      mismatches:                          0
+  
+  # TPC-H query answers: query, rows, checksum
+  scale 0.01
+  22
+  answers match